@@ -22,12 +22,17 @@
     SOFTWARE.
  */
 
+#include "hdf5configuration.h"
 #include "reader.h"
 #include "writer.h"
 #include "inclination.h"
+#include "parametercache.h"
+#include "prefetcher.h"
+#include "outputoptions.h"
 #include "CLI/CLI.hpp"
 #include <opencv2/core.hpp>
 
+#include <map>
 #include <vector>
 #include <string>
 #include <iostream>
@@ -48,6 +53,9 @@ int main(int argc, char** argv) {
     std::string dataset;
     float im, ic, rmaxWhite, rmaxGray;
     bool detailed = false;
+    bool noParameterCache = false;
+    unsigned prefetchDepth;
+    unsigned long long prefetchMemory;
 
     auto required = app.add_option_group("Required parameters");
     required->add_option("--itra", transmittance_files, "Input transmittance files")
@@ -71,11 +79,40 @@ int main(int argc, char** argv) {
     optional->add_option("--ic, --tc", ic)->default_val(-1);
     optional->add_option("--rmaxWhite, --rrefhm", rmaxWhite)->default_val(-1);
     optional->add_option("--rmaxGray, --rreflm", rmaxGray)->default_val(-1);
-
+    optional->add_flag("--no-parameter-cache", noParameterCache, "Compute all parameters again instead of loading them from the _Parameters.h5 sidecar of a previous run");
+    optional->add_option("--prefetch", prefetchDepth, "Number of sections read in advance")
+            ->default_val(1);
+    optional->add_option("--prefetch-memory", prefetchMemory, "Memory limit for sections read in advance in MiB. 0 uses half of the available memory")
+            ->default_val(0);
+
+    OutputOptions output;
+    addOutputOptions(app, output, optional);
     CLI11_PARSE(app, argc, argv);
+    try {
+        output.validate();
+    } catch(const std::invalid_argument& e) {
+        std::cerr << e.what() << std::endl << "Run with --help for more information." << std::endl;
+        return EXIT_FAILURE;
+    }
+    PLImg::HDF5Configuration::setGlobal(output.hdf5Configuration);
+
+    // Read the following sections while the current one is processed
+    std::vector<std::vector<PLImg::PrefetchInput>> sections;
+    for(unsigned i = 0; i < transmittance_files.size(); ++i) {
+        sections.push_back({{transmittance_files.at(i), dataset},
+                            {retardation_files.at(i), dataset},
+                            {mask_files.at(i), dataset},
+                            {mask_files.at(i), "/Probability"}});
+    }
+    PLImg::Prefetcher prefetcher(sections, prefetchDepth, prefetchMemory * 1024 * 1024);
 
     PLImg::HDF5Writer writer;
+    writer.set_compression(output.compression);
+    writer.set_durable(output.durable);
+    writer.set_pyramid(output.pyramidTileSize);
+    writer.set_asynchronous(output.writeQueue);
     PLImg::Inclination inclination;
+    inclination.set_format(output.inclinationFormat);
     std::string transmittance_basename, inclination_basename;
     std::string transmittance_path, retardation_path, mask_path;
 
@@ -97,7 +134,7 @@ int main(int argc, char** argv) {
         } else {
             transmittance_basename = transmittance_path;
         }
-        for(std::string extension : std::array<std::string, 5> {".h5", ".tiff", ".tif", ".nii.gz", ".nii"}) {
+        for(std::string extension : std::array<std::string, 6> {".h5", ".zarr", ".tiff", ".tif", ".nii.gz", ".nii"}) {
             endPosition = transmittance_basename.rfind(extension);
             if(endPosition != std::string::npos) {
                 transmittance_basename = transmittance_basename.substr(0, endPosition);
@@ -122,10 +159,11 @@ int main(int argc, char** argv) {
         }
 
         // Read all files.
-        std::shared_ptr<cv::Mat> transmittance = std::make_shared<cv::Mat>(PLImg::Reader::imread(transmittance_path, dataset));
-        std::shared_ptr<cv::Mat> retardation = std::make_shared<cv::Mat>(PLImg::Reader::imread(retardation_path, dataset));
-        std::shared_ptr<cv::Mat> mask = std::make_shared<cv::Mat>(PLImg::Reader::imread(mask_path, dataset));
-        std::shared_ptr<cv::Mat> blurredMask = std::make_shared<cv::Mat>(PLImg::Reader::imread(mask_path, "/Probability"));
+        PLImg::PrefetchedSection section = prefetcher.next();
+        std::shared_ptr<cv::Mat> transmittance = std::move(section.images.at(0));
+        std::shared_ptr<cv::Mat> retardation = std::move(section.images.at(1));
+        std::shared_ptr<cv::Mat> mask = std::move(section.images.at(2));
+        std::shared_ptr<cv::Mat> blurredMask = std::move(section.images.at(3));
         std::cout << "Files read" << std::endl;
 
         std::shared_ptr<cv::Mat> medTransmittance;
@@ -141,41 +179,50 @@ int main(int argc, char** argv) {
 
         // Set our read parameters
         inclination.setModalities(medTransmittance, retardation, blurredMask, mask);
-        // If manual parameters were given, apply them here
-        if(im >= 0) {
-            inclination.set_TM(im);
-        }
-        if(ic >= 0) {
-            inclination.set_Tc(ic);
-        }
-        if(rmaxWhite >= 0) {
-            inclination.set_RrefHM(rmaxWhite);
-        }
-        if(rmaxGray >= 0) {
-            inclination.set_RrefLM(rmaxGray);
+        // Parameters of a previous run with the same input files are loaded from the sidecar.
+        // The inclination parameters are independent of each other. Overriding one of them keeps the others cached.
+        std::string parameters_basename(inclination_basename);
+        if (parameters_basename.find("Inclination") != std::string::npos) {
+            parameters_basename = parameters_basename.replace(parameters_basename.find("Inclination"), 11, "Parameters");
+        } else {
+            parameters_basename += "_Parameters";
         }
+        PLImg::ParameterCache cache(output_folder + "/" + parameters_basename + ".h5");
+        std::string inclinationKey = PLImg::ParameterCache::key(PLImg::HDF5Writer::inputIdentity({transmittance_path, retardation_path, mask_path}));
+        // If manual parameters were given, apply them here
+        std::map<std::string, float> manualInclinationParameters = {{"im", im}, {"ic", ic}, {"rmax_white", rmaxWhite}, {"rmax_gray", rmaxGray}};
+        std::map<std::string, float> cachedInclinationParameters = cache.loadInclination(inclinationKey, inclination,
+                                                                                        manualInclinationParameters, !noParameterCache);
         // Create file and dataset. Write the inclination afterwards.
-        writer.set_path(output_folder+ "/" + inclination_basename + ".h5");
-        writer.write_dataset("/Image", *inclination.inclination(), true);
+        writer.set_path(output_folder+ "/" + inclination_basename + output.extension());
+        writer.write_dataset("/Image", inclination.inclination(), true);
         writer.write_attribute("/Image", "im", inclination.T_c());
         writer.write_attribute("/Image", "ic", inclination.T_M());
         writer.write_attribute("/Image", "rmax_white", inclination.R_refHM());
         writer.write_attribute("/Image", "rmax_gray", inclination.R_refLM());
+        if(inclination.format() == PLImg::InclinationFormat::UInt16) {
+            // Degrees are scale_factor * value + add_offset. Pixels without an inclination are _FillValue.
+            writer.write_attribute("/Image", "scale_factor", inclination.scaleFactor());
+            writer.write_attribute("/Image", "add_offset", 0.0f);
+            writer.write_attribute("/Image", "_FillValue", INCLINATION_UINT16_FILL_VALUE);
+        }
         // writer.write_attribute("/Image", "version", PLImg::Version::versionHash() + ", " + PLImg::Version::timeStamp());
 
         writer.writePLIMAttributes({transmittance_path, retardation_path, mask_path}, "/Image", "/Image", "Inclination", argc, argv);
         std::cout << "Inclination generated and written" << std::endl;
         writer.close();
 
+        cache.storeInclination(inclinationKey, inclination, manualInclinationParameters, cachedInclinationParameters);
+
         if(detailed) {
             auto saturation_basename = std::string(inclination_basename);
             if (inclination_basename.find("Inclination") != std::string::npos) {
                 saturation_basename = saturation_basename.replace(saturation_basename.find("Inclination"), 11, "Saturation");
             }
             // Create file and dataset. Write the inclination afterwards.
-            writer.set_path(output_folder+ "/" + saturation_basename + ".h5");
+            writer.set_path(output_folder+ "/" + saturation_basename + output.extension());
 
-            writer.write_dataset("/Image", *inclination.saturation(), true);
+            writer.write_dataset("/Image", inclination.saturation(), true);
             writer.write_attribute("/Image", "im", inclination.T_c());
             writer.write_attribute("/Image", "ic", inclination.T_M());
             writer.write_attribute("/Image", "rmax_white", inclination.R_refHM());
@@ -187,6 +234,8 @@ int main(int argc, char** argv) {
             writer.close();
         }
 
+        // Report errors of the background writer for each section
+        writer.wait();
         std::cout << std::endl;
     }
 
@@ -22,9 +22,12 @@
     SOFTWARE.
  */
 
+#include "hdf5configuration.h"
 #include "reader.h"
 #include "writer.h"
 #include "maskgeneration.h"
+#include "prefetcher.h"
+#include "outputoptions.h"
 #include "CLI/CLI.hpp"
 #include "version.h"
 
@@ -55,6 +58,9 @@ int main(int argc, char** argv) {
     std::string dataset;
     bool detailed = false;
     bool blurred = false;
+    unsigned prefetchDepth;
+    unsigned long long prefetchMemory;
+    unsigned subsample;
 
     float tmin, tmax, tret, ttra;
 
@@ -74,6 +80,13 @@ int main(int argc, char** argv) {
                     ->default_val("/Image");
     optional->add_flag("--detailed", detailed);
     optional->add_flag("--probability", blurred);
+    optional->add_option("--prefetch", prefetchDepth, "Number of sections read in advance")
+                    ->default_val(1);
+    optional->add_option("--prefetch-memory", prefetchMemory, "Memory limit for sections read in advance in MiB. 0 uses half of the available memory")
+                    ->default_val(0);
+    optional->add_option("--subsample", subsample, "Estimate the parameters on every n-th row and column")
+                    ->default_val(1)
+                    ->check(CLI::PositiveNumber);
     auto parameters = optional->add_option_group("Parameters", "Control the generated masks by setting parameters manually");
     parameters->add_option("--ilower, --tthres", ttra, "Average transmittance value of brightest retardation values")
               ->default_val(-1);
@@ -83,9 +96,30 @@ int main(int argc, char** argv) {
               ->default_val(-1);
     parameters->add_option("--iupper, --tback", tmax, "Separator of gray matter and background")
               ->default_val(-1);
+    OutputOptions output;
+    addOutputOptions(app, output);
     CLI11_PARSE(app, argc, argv);
+    try {
+        output.validate();
+    } catch(const std::invalid_argument& e) {
+        std::cerr << e.what() << std::endl << "Run with --help for more information." << std::endl;
+        return EXIT_FAILURE;
+    }
+    PLImg::HDF5Configuration::setGlobal(output.hdf5Configuration);
+
+    // Read the following sections while the current one is processed
+    std::vector<std::vector<PLImg::PrefetchInput>> sections;
+    for(unsigned i = 0; i < transmittance_files.size(); ++i) {
+        sections.push_back({{transmittance_files.at(i), dataset, true},
+                            {retardation_files.at(i), dataset, true}});
+    }
+    PLImg::Prefetcher prefetcher(sections, prefetchDepth, prefetchMemory * 1024 * 1024);
 
     PLImg::HDF5Writer writer;
+    writer.set_compression(output.compression);
+    writer.set_durable(output.durable);
+    writer.set_pyramid(output.pyramidTileSize);
+    writer.set_asynchronous(output.writeQueue);
     PLImg::MaskGeneration generation;
 
     std::string transmittance_basename, mask_basename;
@@ -109,7 +143,7 @@ int main(int argc, char** argv) {
         } else {
             transmittance_basename = transmittance_path;
         }
-        for(std::string& extension : std::array<std::string, 5> {".h5", ".tiff", ".tif", ".nii.gz", ".nii"}) {
+        for(std::string& extension : std::array<std::string, 6> {".h5", ".zarr", ".tiff", ".tif", ".nii.gz", ".nii"}) {
             endPosition = transmittance_basename.rfind(extension);
             if(endPosition != std::string::npos) {
                 transmittance_basename = transmittance_basename.substr(0, endPosition);
@@ -133,24 +167,27 @@ int main(int argc, char** argv) {
             mask_basename = mask_basename.replace(mask_basename.find("Transmittance"), 13, "Mask");
         }
 
-        std::shared_ptr<cv::Mat> transmittance = std::make_shared<cv::Mat>(
-                PLImg::Reader::imread(transmittance_path, dataset));
-        std::shared_ptr<cv::Mat> retardation = std::make_shared<cv::Mat>(
-                PLImg::Reader::imread(retardation_path, dataset));
+        PLImg::PrefetchedSection section = prefetcher.next();
+        std::shared_ptr<cv::Mat> transmittance = std::move(section.images.at(0));
+        std::shared_ptr<cv::Mat> retardation = std::move(section.images.at(1));
+        PLImg::ImageStatistics& transmittanceStatistics = section.statistics.at(0);
+        PLImg::ImageStatistics& retardationStatistics = section.statistics.at(1);
         std::cout << "Files read" << std::endl;
 
         std::shared_ptr<cv::Mat> medTransmittance;
         if (transmittance_path.find("median") == std::string::npos) {
             // Generate median transmittance
             medTransmittance = PLImg::cuda::filters::medianFilter(transmittance);
+            *medTransmittance = PLImg::Reader::convert(*medTransmittance, transmittanceStatistics);
             // Set output file name
             std::string medianName = "median"+std::to_string(MEDIAN_KERNEL_SIZE)+"NTransmittance";
             std::string median_transmittance_basename(mask_basename);
             median_transmittance_basename.replace(mask_basename.find("Mask"), 4, medianName);
-            median_transmittance_path = output_folder + "/" + median_transmittance_basename + ".h5";
+            median_transmittance_path = output_folder + "/" + median_transmittance_basename + output.extension();
             // Set and write file
             writer.set_path(median_transmittance_path);
-            writer.write_dataset("/Image", *medTransmittance, true);
+            // removeBackground() modifies the median transmittance while it may still wait to be written
+            writer.write_dataset("/Image", output.writeQueue > 0 ? std::make_shared<cv::Mat>(medTransmittance->clone()) : medTransmittance, true);
             writer.write_attribute("/Image", "median_kernel_size", int(MEDIAN_KERNEL_SIZE));
             writer.writePLIMAttributes({transmittance_path}, "/Image", "/Image", "NTransmittance", argc, argv);
             writer.close();
@@ -160,7 +197,7 @@ int main(int argc, char** argv) {
         }
         transmittance = nullptr;
 
-        generation.setModalities(retardation, medTransmittance);
+        generation.setModalities(retardation, medTransmittance, retardationStatistics, transmittanceStatistics);
         if(ttra >= 0) {
             generation.set_tthres(ttra);
         }
@@ -173,10 +210,15 @@ int main(int argc, char** argv) {
         if(tmax >= 0) {
             generation.set_tback(tmax);
         }
+        if(subsample > 1) {
+            // Estimate the parameters on a strided subsample. Only the masks will use the full resolution.
+            generation.estimateParameters(std::make_shared<cv::Mat>(PLImg::Reader::subsample(*retardation, subsample)),
+                                          std::make_shared<cv::Mat>(PLImg::Reader::subsample(*medTransmittance, subsample)));
+        }
         generation.removeBackground();
 
-        writer.set_path(output_folder + "/" + mask_basename + ".h5");
-        writer.write_dataset("/Image", *generation.fullMask(), true);
+        writer.set_path(output_folder + "/" + mask_basename + output.extension());
+        writer.write_dataset("/Image", generation.fullMask(), true);
         writer.writePLIMAttributes({median_transmittance_path, retardation_path}, "/Image", "/Image", "Mask", argc, argv);
         writer.write_attribute("/Image", "i_lower", generation.T_thres());
         writer.write_attribute("/Image", "r_thres", generation.R_thres());
@@ -186,14 +228,16 @@ int main(int argc, char** argv) {
         std::cout << "Full mask generated and written" << std::endl;
 
         if (blurred) {
-            writer.write_dataset("/Probability", *generation.probabilityMask());
+            writer.write_dataset("/Probability", generation.probabilityMask());
             std::cout << "Probability mask generated and written" << std::endl;
         }
         if (detailed) {
-            writer.write_dataset("/NoNerveFibers", *generation.noNerveFiberMask());
+            writer.write_dataset("/NoNerveFibers", generation.noNerveFiberMask());
             std::cout << "Detailed masks generated and written" << std::endl;
         }
         writer.close();
+        // Report errors of the background writer for each section
+        writer.wait();
         std::cout << std::endl;
     }
 
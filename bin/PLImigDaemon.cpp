@@ -0,0 +1,170 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Forschungszentrum Jülich / Jan André Reuter.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "pipeline.h"
+#include "spoolqueue.h"
+#include "toolbox.h"
+#include "CLI/CLI.hpp"
+
+#include <chrono>
+#include <csignal>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef PLIMG_USE_MPI
+    #include <mpi.h>
+#endif
+
+namespace {
+    /// Set by SIGINT and SIGTERM. The current job is finished before the daemon stops.
+    volatile std::sig_atomic_t stopRequested = 0;
+
+    void requestStop(int) {
+        stopRequested = 1;
+    }
+
+    /**
+     * @brief Process a job with the command line of PLImigPipeline. All output of the job is written to its log.
+     * @param job Taken job
+     * @return True if all sections of the job were processed successfully
+     */
+    bool processJob(const PLImg::SpoolJob& job) {
+        std::ofstream log(job.logPath, std::ios::app);
+        std::streambuf* coutBuffer = std::cout.rdbuf(log.rdbuf());
+        std::streambuf* cerrBuffer = std::cerr.rdbuf(log.rdbuf());
+
+        std::vector<std::string> arguments = {"PLImigPipeline"};
+        arguments.insert(arguments.end(), job.arguments.begin(), job.arguments.end());
+        std::vector<char*> argv;
+        for(std::string& argument : arguments) {
+            argv.push_back(argument.data());
+        }
+        argv.push_back(nullptr);
+
+        // The daemon runs all jobs in one process
+        std::cout << "Resident memory values are those of the daemon, their peak includes all previous jobs" << std::endl;
+        auto start = std::chrono::steady_clock::now();
+        int result;
+        try {
+            result = runPipeline(int(arguments.size()), argv.data());
+        } catch(const std::exception& exception) {
+            std::cerr << "Job failed: " << exception.what() << std::endl;
+            result = EXIT_FAILURE;
+        }
+        std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+        std::cout << "Finished with exit code " << result << " after " << seconds.count() << " s" << std::endl;
+
+        std::cout.rdbuf(coutBuffer);
+        std::cerr.rdbuf(cerrBuffer);
+        std::cout << "Job " << job.name << (result == EXIT_SUCCESS ? " finished" : " failed")
+                  << " after " << seconds.count() << " s" << std::endl;
+        return result == EXIT_SUCCESS;
+    }
+}
+
+int main(int argc, char** argv) {
+    CLI::App app;
+
+    std::string spool_directory;
+    unsigned pollInterval;
+    bool once = false;
+    app.add_option("--spool", spool_directory, "Spool directory with the subdirectories incoming, running, done and failed")
+            ->required();
+    app.add_option("--poll", pollInterval, "Interval in milliseconds in which incoming is checked for new jobs")
+            ->default_val(1000)
+            ->check(CLI::PositiveNumber);
+    app.add_flag("--once", once, "Stop when incoming is empty instead of waiting for new jobs");
+    CLI11_PARSE(app, argc, argv);
+
+    #ifdef PLIMG_USE_MPI
+        // The jobs are processed by this process alone
+        int threadSupport;
+        MPI_Init_thread(&argc, &argv, MPI_THREAD_SERIALIZED, &threadSupport);
+        if(threadSupport < MPI_THREAD_SERIALIZED) {
+            // Every job would fail in runPipeline
+            std::cerr << "PLImigDaemon requires an MPI library which supports MPI_THREAD_SERIALIZED" << std::endl;
+            MPI_Finalize();
+            return EXIT_FAILURE;
+        }
+    #endif
+
+    PLImg::SpoolQueue queue(spool_directory);
+    unsigned recovered = queue.recover();
+    if(recovered > 0) {
+        std::cout << recovered << " interrupted jobs were queued again" << std::endl;
+    }
+    std::signal(SIGINT, requestStop);
+    std::signal(SIGTERM, requestStop);
+
+    // Initialize CUDA once. The context, the device buffers and the thread pools of OpenMP and OpenCV
+    // stay alive for all following jobs.
+    PLImg::cuda::runCUDAchecks();
+    PLImg::cuda::keepBuffers(true);
+    std::cout << "Waiting for jobs in " << queue.directory() << "/incoming" << std::endl;
+
+    unsigned finishedJobs = 0, failedJobs = 0;
+    while(!stopRequested) {
+        PLImg::SpoolJob job;
+        bool taken;
+        try {
+            taken = queue.take(job);
+        } catch(const std::exception& exception) {
+            // The job was moved to failed. Wait before the next attempt in case incoming itself can't be read.
+            std::cerr << exception.what() << std::endl;
+            ++finishedJobs;
+            ++failedJobs;
+            std::this_thread::sleep_for(std::chrono::milliseconds(pollInterval));
+            continue;
+        }
+        if(!taken) {
+            if(once) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(pollInterval));
+            continue;
+        }
+
+        std::cout << "Job " << job.name << " started. Log: " << job.logPath << std::endl;
+        bool success = processJob(job);
+        try {
+            queue.finish(job, success);
+        } catch(const std::exception& exception) {
+            // The job stays in running and is queued again by recover() when the daemon is restarted
+            std::cerr << "Job " << job.name << " couldn't be moved out of running: " << exception.what() << std::endl;
+            success = false;
+        }
+        ++finishedJobs;
+        failedJobs += !success;
+    }
+    std::cout << finishedJobs << " jobs processed, " << failedJobs << " failed" << std::endl;
+
+    PLImg::cuda::keepBuffers(false);
+    #ifdef PLIMG_USE_MPI
+        MPI_Finalize();
+    #endif
+    return failedJobs > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,103 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Forschungszentrum Jülich / Jan André Reuter.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "outputoptions.h"
+
+#include <map>
+#include <stdexcept>
+#include <string>
+
+void OutputOptions::validate() const {
+    if(!environmentError.empty()) {
+        throw std::invalid_argument(environmentError);
+    }
+    compression.validate();
+    if(outputFormat == "zarr") {
+        if(compression.scaleOffset >= 0 || (compression.filter != "none" && compression.filter != "deflate")) {
+            throw std::invalid_argument("Zarr stores can only be written with --compression deflate and --shuffle");
+        }
+        if(durable) {
+            throw std::invalid_argument("--durable is not supported for Zarr stores");
+        }
+    }
+}
+
+std::string OutputOptions::extension() const {
+    return outputFormat == "zarr" ? ".zarr" : ".h5";
+}
+
+CLI::Option_group* addOutputOptions(CLI::App& app, OutputOptions& options, CLI::App* inclinationGroup) {
+    if(inclinationGroup) {
+        inclinationGroup->add_option("--inclination-format", options.inclinationFormat, "Datatype of the written inclination. uint16 stores fixed point values with a scale_factor attribute")
+                ->transform(CLI::CheckedTransformer(std::map<std::string, PLImg::InclinationFormat>{
+                        {"float32", PLImg::InclinationFormat::Float32},
+                        {"float16", PLImg::InclinationFormat::Float16},
+                        {"uint16", PLImg::InclinationFormat::UInt16}}))
+                ->default_str("float32");
+    }
+
+    // Invalid environment variables are reported by validate() after the command line was parsed
+    try {
+        options.hdf5Configuration = PLImg::HDF5Configuration::fromEnvironment();
+    } catch(const std::invalid_argument& e) {
+        options.environmentError = e.what();
+    }
+    PLImg::HDF5Configuration& hdf5Configuration = options.hdf5Configuration;
+    auto hdf5 = app.add_option_group("HDF5 parameters", "Control the HDF5 file access. Defaults are read from the PLIMG_HDF5_* environment variables");
+    hdf5->add_option("--output-format", options.outputFormat, "Format of the written images. zarr writes a directory store per image, which doesn't need the lock of the HDF5 library")
+        ->check(CLI::IsMember({"hdf5", "zarr"}))
+        ->default_val("hdf5");
+    hdf5->add_option("--hdf5-chunk-cache", hdf5Configuration.chunkCacheSize, "Chunk cache size per dataset in bytes")
+        ->transform(CLI::AsSizeValue(false));
+    hdf5->add_option("--hdf5-chunk-slots", hdf5Configuration.chunkCacheSlots, "Number of hash table slots of the chunk cache");
+    hdf5->add_option("--hdf5-metadata-cache", hdf5Configuration.metadataCacheSize, "Initial metadata cache size in bytes")
+        ->transform(CLI::AsSizeValue(false));
+    hdf5->add_option("--hdf5-alignment", hdf5Configuration.alignment, "Alignment of file objects in bytes")
+        ->transform(CLI::AsSizeValue(false));
+    hdf5->add_option("--hdf5-alignment-threshold", hdf5Configuration.alignmentThreshold, "Minimal size of aligned file objects in bytes")
+        ->transform(CLI::AsSizeValue(false));
+    hdf5->add_option("--hdf5-page-buffer", hdf5Configuration.pageBufferSize, "Page buffer size in bytes")
+        ->transform(CLI::AsSizeValue(false));
+    hdf5->add_option("--hdf5-driver", hdf5Configuration.driver, "HDF5 virtual file driver")
+        ->check(CLI::IsMember({"sec2", "core", "direct"}));
+    hdf5->add_option("--hdf5-alloc-time", hdf5Configuration.allocTime, "Allocation time of the file space of written datasets")
+        ->check(CLI::IsMember({"default", "early", "incremental", "late"}));
+    hdf5->add_option("--hdf5-fill-time", hdf5Configuration.fillTime, "Time at which fill values are written to new datasets. never skips writing fill values")
+        ->check(CLI::IsMember({"ifset", "alloc", "never"}));
+    hdf5->add_option("--compression", options.compression.filter, "Compression filter of written datasets. lz4 and zstd require the HDF5 filter plugins")
+        ->check(CLI::IsMember({"none", "deflate", "lz4", "zstd"}))
+        ->default_val("none");
+    hdf5->add_option("--compression-level", options.compression.level, "Compression level of deflate (1-9) and zstd (1-22)")
+        ->check(CLI::Range(1, 22))
+        ->default_val(4);
+    hdf5->add_flag("--shuffle", options.compression.shuffle, "Apply the byte shuffle filter before compression");
+    hdf5->add_option("--scale-offset", options.compression.scaleOffset, "Store floating point datasets with the given number of decimal digits using the scale-offset filter")
+        ->default_val(-1);
+    hdf5->add_option("--pyramid-tile-size", options.pyramidTileSize, "Tile size of the image pyramid written to /pyramid. 0 only writes the full resolution")
+        ->default_val(256);
+    hdf5->add_option("--write-queue", options.writeQueue, "Number of images which may wait to be written in the background. 0 writes all images before continuing")
+        ->default_val(2);
+    hdf5->add_flag("--durable", options.durable, "Wait until each written file is stored on the storage device before continuing");
+    return hdf5;
+}
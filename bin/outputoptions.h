@@ -0,0 +1,86 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Forschungszentrum Jülich / Jan André Reuter.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef PLIMG_OUTPUTOPTIONS_H
+#define PLIMG_OUTPUTOPTIONS_H
+
+#include "hdf5configuration.h"
+#include "inclination.h"
+#include "writer.h"
+#include "CLI/CLI.hpp"
+
+#include <string>
+
+/**
+ * @file
+ * @brief Command line options of the written files shared by all programs
+ */
+
+/**
+ * @brief HDF5 file access, compression and format of the written files
+ */
+struct OutputOptions {
+    /// HDF5 file access. Defaults are read from the PLIMG_HDF5_* environment variables by addOutputOptions().
+    PLImg::HDF5Configuration hdf5Configuration;
+    /// Error of the PLIMG_HDF5_* environment variables. Empty if they are valid.
+    std::string environmentError;
+    /// Filters of the written datasets
+    PLImg::HDF5Compression compression;
+    /// Datatype of the written inclination
+    PLImg::InclinationFormat inclinationFormat = PLImg::InclinationFormat::Float32;
+    /// Tile size of the image pyramid. 0 only writes the full resolution.
+    unsigned pyramidTileSize = 256;
+    /// Number of images which may wait to be written in the background
+    unsigned writeQueue = 2;
+    /// Wait until each written file is stored on the storage device
+    bool durable = false;
+    /// Format of the written images: hdf5 or zarr
+    std::string outputFormat = "hdf5";
+
+    /**
+     * @brief Get the file ending of the written images
+     * @return .h5 for HDF5 files or .zarr for Zarr stores
+     */
+    std::string extension() const;
+
+    /**
+     * @brief Check the environment variables and the compression after the command line was parsed
+     * @throws std::invalid_argument if an environment variable or the compression level is invalid or the
+     * compression or --durable can't be used with Zarr stores
+     */
+    void validate() const;
+};
+
+/**
+ * Add the "HDF5 parameters" option group with the output format, HDF5 file access, compression, pyramid and write
+ * queue options to the application. Programs which write an inclination additionally get --inclination-format in the given group.
+ * @brief Add the options of the written files to a command line application
+ * @param app Command line application
+ * @param options Options which are set while parsing the command line
+ * @param inclinationGroup Group of --inclination-format. nullptr if no inclination is written.
+ * @return The added HDF5 option group
+ */
+CLI::Option_group* addOutputOptions(CLI::App& app, OutputOptions& options, CLI::App* inclinationGroup = nullptr);
+
+#endif //PLIMG_OUTPUTOPTIONS_H
@@ -0,0 +1,1170 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Forschungszentrum Jülich / Jan André Reuter.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "pipeline.h"
+#include "hdf5configuration.h"
+#include "reader.h"
+#include "writer.h"
+#include "maskgeneration.h"
+#include "inclination.h"
+#include "outofcore.h"
+#include "parametercache.h"
+#include "distributor.h"
+#include "prefetcher.h"
+#include "scheduler.h"
+#include "volumewriter.h"
+#include "outputoptions.h"
+#include "CLI/CLI.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <set>
+#include <vector>
+#include <string>
+#include <iostream>
+
+#ifdef TIME_MEASUREMENT
+    #pragma message("Time measurement enabled.")
+#endif
+
+int runPipeline(int argc, char** argv) {
+    #ifdef TIME_MEASUREMENT
+        auto start = std::chrono::high_resolution_clock::now();
+    #endif
+    CLI::App app;
+
+    // Get the number of threads for all following steps
+    int numThreads;
+    #pragma omp parallel
+    numThreads = omp_get_num_threads();
+    cv::setNumThreads(numThreads);
+
+    std::vector<std::string> transmittance_files;
+    std::vector<std::string> retardation_files;
+    std::string output_folder;
+    std::string dataset;
+    bool detailed = false;
+    unsigned prefetchDepth;
+    unsigned long long prefetchMemory;
+    unsigned subsample;
+    unsigned blockSize;
+    bool warmStart = false;
+    bool outOfCore = false;
+    std::string scratchDirectory;
+    std::string volume_path;
+    bool singleFile = false;
+    bool resume = false;
+    bool noParameterCache = false;
+    unsigned concurrentSections;
+    unsigned long long memoryBudget;
+    unsigned threadBudget;
+    std::string distribution;
+
+    float tmin, tmax, tret, ttra;
+    float im, ic, rmaxWhite, rmaxGray;
+
+    auto required = app.add_option_group("Required parameters");
+    required->add_option("--itra", transmittance_files, "Input transmittance files")
+            ->required()
+            ->check(CLI::ExistingFile);
+    required->add_option("--iret", retardation_files, "Input retardation files")
+            ->required()
+            ->check(CLI::ExistingFile);
+    required->add_option("-o, --output", output_folder, "Output folder")
+                    ->required()
+                    ->check(CLI::ExistingDirectory);
+
+    auto optional = app.add_option_group("Optional parameters");
+    optional->add_option("-d, --dataset", dataset, "HDF5 dataset")
+                    ->default_val("/Image");
+    optional->add_flag("--detailed", detailed);
+    optional->add_option("--prefetch", prefetchDepth, "Number of sections read in advance")
+                    ->default_val(1);
+    optional->add_option("--prefetch-memory", prefetchMemory, "Memory limit for sections read in advance in MiB. 0 uses half of the available memory")
+                    ->default_val(0);
+    optional->add_option("--sections", concurrentSections, "Maximum number of sections processed concurrently")
+                    ->default_val(1)
+                    ->check(CLI::PositiveNumber);
+    optional->add_option("--memory", memoryBudget, "Memory budget of all concurrently processed sections in MiB. 0 uses half of the available memory")
+                    ->default_val(0);
+    optional->add_option("--threads", threadBudget, "Number of threads distributed over the concurrently processed sections. 0 uses all cores")
+                    ->default_val(0);
+    optional->add_option("--distribution", distribution, "Distribution of the sections over the MPI ranks. dynamic hands out the next section to the first idle rank")
+                    ->check(CLI::IsMember({"static", "dynamic"}))
+                    ->default_val("static");
+    optional->add_option("--subsample", subsample, "Estimate the parameters on every n-th row and column")
+                    ->default_val(1)
+                    ->check(CLI::PositiveNumber);
+    optional->add_flag("--warm-start", warmStart, "Prefer the curvature peaks of T_back and R_thres near those of the previous section of the process");
+    optional->add_option("--block-size", blockSize, "Estimate the parameters once per block of n neighbouring sections from their combined histograms. 0 estimates them for each section")
+            ->default_val(0);
+    optional->add_flag("--out-of-core", outOfCore, "Process each section tile by tile in two passes, so that sections larger than --memory can be processed. Requires HDF5 or Zarr inputs. The inclination parameters are estimated from the median instead of the masked median transmittance, so the inclination differs slightly from an in-core run");
+    optional->add_option("--scratch", scratchDirectory, "Directory of scratch files to which large images are moved while the memory budget is exceeded. Empty never moves images out of memory");
+    optional->add_flag("--single-file", singleFile, "Write all outputs of a section into one file with a group per output");
+    optional->add_flag("--resume", resume, "Skip sections whose outputs were completely written by a previous run with the same parameters and inputs");
+    optional->add_flag("--no-parameter-cache", noParameterCache, "Compute all parameters again instead of loading them from the _Parameters.h5 sidecar of a previous run");
+    optional->add_option("--volume", volume_path, "Additionally write the masks and inclinations of all sections into one [z, y, x] volume file");
+    auto parameters = optional->add_option_group("Parameters", "Control the generated masks by setting parameters manually");
+    parameters->add_option("--ilower, --tthres", ttra, "Average transmittance value of brightest retardation values")
+              ->default_val(-1);
+    parameters->add_option("--rthres", tret, "Plateau in retardation histogram")
+              ->default_val(-1);
+    parameters->add_option("--irmax, --tref", tmin, "Average transmittance value of brightest retardation values")
+              ->default_val(-1);
+    parameters->add_option("--iupper, --tback", tmax, "Separator of gray matter and background")
+              ->default_val(-1);
+    parameters->add_option("--im, --tm", im, "Mean transmittance in the region with the highest retardation values")
+              ->default_val(-1);
+    parameters->add_option("--ic, --tc", ic, "Maximum of the transmittance histogram in the gray matter")
+              ->default_val(-1);
+    parameters->add_option("--rmaxWhite, --rrefhm", rmaxWhite, "Mean of the highest retardation values in the white matter")
+              ->default_val(-1);
+    parameters->add_option("--rmaxGray, --rreflm", rmaxGray, "Point of maximum curvature in the retardation histogram of the gray matter")
+              ->default_val(-1);
+    OutputOptions output;
+    auto hdf5 = addOutputOptions(app, output, optional);
+    CLI11_PARSE(app, argc, argv);
+    try {
+        output.validate();
+    } catch(const std::invalid_argument& e) {
+        std::cerr << e.what() << std::endl << "Run with --help for more information." << std::endl;
+        return EXIT_FAILURE;
+    }
+    // The slices of the volume are written collectively in a fixed order, all sections of a block are sampled by the
+    // same rank and warm starts use the previous section of the process. All of them need the static assignment
+    // of the sections.
+    bool dynamicDistribution = distribution == "dynamic";
+    if(dynamicDistribution && (!volume_path.empty() || blockSize > 0 || warmStart)) {
+        std::cerr << "--distribution dynamic can't be combined with --volume, --block-size or --warm-start" << std::endl;
+        return EXIT_FAILURE;
+    }
+    // Sections processed out of core are never held in memory completely
+    if(outOfCore && (detailed || !volume_path.empty() || blockSize > 0)) {
+        std::cerr << "--out-of-core can't be combined with --detailed, --volume or --block-size" << std::endl;
+        return EXIT_FAILURE;
+    }
+    PLImg::HDF5Configuration::setGlobal(output.hdf5Configuration);
+    #ifdef PLIMG_USE_MPI
+        // Each section runs on its own thread, even if only one section is processed at a time. The distribution of
+        // the sections and the collective writes of the volume call MPI from those threads one at a time.
+        int threadSupport;
+        MPI_Query_thread(&threadSupport);
+        if(threadSupport < MPI_THREAD_SERIALIZED) {
+            std::cerr << "PLImigPipeline requires an MPI library which supports MPI_THREAD_SERIALIZED" << std::endl;
+            return EXIT_FAILURE;
+        }
+    #endif
+
+    // Check the dimensions of both modalities before reading any pixel data
+    for(unsigned i = 0; i < transmittance_files.size() && i < retardation_files.size();) {
+        bool mismatch;
+        try {
+            mismatch = PLImg::Reader::probe(transmittance_files.at(i), dataset).dims !=
+                       PLImg::Reader::probe(retardation_files.at(i), dataset).dims;
+        } catch(const std::exception&) {
+            // Files which can't be probed fail their section when it is read
+            mismatch = false;
+        }
+        if(mismatch) {
+            std::cerr << "Transmittance and retardation dimensions do not match. Skipping "
+                      << transmittance_files.at(i) << std::endl;
+            transmittance_files.erase(transmittance_files.begin() + i);
+            retardation_files.erase(retardation_files.begin() + i);
+        } else {
+            ++i;
+        }
+    }
+
+    // Output files of a section. With --single-file all outputs of the section are written to groups of one file.
+    // Otherwise, each output is written to /Image of its own file.
+    struct SectionOutputs {
+        /// Empty if the transmittance is already median filtered
+        std::string median_transmittance_path;
+        std::string mask_path;
+        std::string inclination_path;
+        /// Empty without --detailed
+        std::string saturation_path;
+        /// Sidecar with the derived parameters of the section. See PLImg::ParameterCache.
+        std::string parameters_path;
+        std::string median_transmittance_group, mask_group, inclination_group, saturation_group;
+    };
+    auto sectionOutputs = [&](long long slice) {
+        SectionOutputs outputs;
+        std::string transmittance_path = transmittance_files.at(slice);
+        std::string transmittance_basename, mask_basename, inclination_basename;
+        #ifdef WIN32
+                unsigned long long int endPosition = transmittance_path.find_last_of('\\');
+        #else
+                unsigned long long int endPosition = transmittance_path.find_last_of('/');
+        #endif
+        if(endPosition != std::string::npos) {
+            transmittance_basename = transmittance_path.substr(endPosition+1);
+        } else {
+            transmittance_basename = transmittance_path;
+        }
+        for(const std::string& extension : std::array<std::string, 6> {".h5", ".zarr", ".tiff", ".tif", ".nii.gz", ".nii"}) {
+            endPosition = transmittance_basename.rfind(extension);
+            if(endPosition != std::string::npos) {
+                transmittance_basename = transmittance_basename.substr(0, endPosition);
+            }
+        }
+
+        // Get name of retardation and check if transmittance has median filer applied.
+        mask_basename = std::string(transmittance_basename);
+        auto pos = mask_basename.find("median");
+        if (pos != std::string::npos) {
+            int length = 6;
+            while(std::isdigit(mask_basename.at(pos + length))) {
+                ++length;
+            }
+            mask_basename = mask_basename.replace(pos, length, "");
+        }
+        if (mask_basename.find("NTransmittance") != std::string::npos) {
+            mask_basename = mask_basename.replace(mask_basename.find("NTransmittance"), 14, "Mask");
+        }
+        if (mask_basename.find("Transmittance") != std::string::npos) {
+            mask_basename = mask_basename.replace(mask_basename.find("Transmittance"), 13, "Mask");
+        }
+        inclination_basename = std::string(mask_basename);
+        if (mask_basename.find("Mask") != std::string::npos) {
+            inclination_basename = inclination_basename.replace(inclination_basename.find("Mask"), 4, "Inclination");
+        }
+        std::string saturation_basename(mask_basename);
+        std::string median_transmittance_basename(mask_basename);
+        std::string parameters_basename(mask_basename);
+        if (mask_basename.find("Mask") != std::string::npos) {
+            saturation_basename = saturation_basename.replace(saturation_basename.find("Mask"), 4, "Saturation");
+            median_transmittance_basename.replace(mask_basename.find("Mask"), 4, "median" + std::to_string(MEDIAN_KERNEL_SIZE) + "NTransmittance");
+            parameters_basename.replace(mask_basename.find("Mask"), 4, "Parameters");
+        } else {
+            parameters_basename += "_Parameters";
+        }
+        outputs.parameters_path = output_folder + "/" + parameters_basename + ".h5";
+
+        if(singleFile) {
+            std::string section_basename(mask_basename);
+            if (section_basename.find("Mask") != std::string::npos) {
+                section_basename = section_basename.replace(section_basename.find("Mask"), 4, "PLImig");
+            }
+            std::string section_path = output_folder + "/" + section_basename + output.extension();
+            outputs.median_transmittance_path = outputs.mask_path = outputs.inclination_path = outputs.saturation_path = section_path;
+            outputs.median_transmittance_group = "/NTransmittance";
+            outputs.mask_group = "/Mask";
+            outputs.inclination_group = "/Inclination";
+            outputs.saturation_group = "/Saturation";
+        } else {
+            outputs.median_transmittance_path = output_folder + "/" + median_transmittance_basename + output.extension();
+            outputs.mask_path = output_folder + "/" + mask_basename + output.extension();
+            outputs.inclination_path = output_folder + "/" + inclination_basename + output.extension();
+            outputs.saturation_path = output_folder + "/" + saturation_basename + output.extension();
+        }
+        if (transmittance_path.find("median") != std::string::npos) {
+            outputs.median_transmittance_path = "";
+        }
+        if (!detailed) {
+            outputs.saturation_path = "";
+        }
+        return outputs;
+    };
+
+    // Options which influence the results of a section. The input files of a section are part of its input identity,
+    // so adding sections to a batch doesn't invalidate the finished ones. Options which only change the speed, the
+    // memory usage or when the file space is allocated and filled are left out. The memory budget only changes the subsample stride of blocks and out-of-core runs.
+    std::set<std::string> independentOptions = {"--itra", "--iret", "--output", "--resume", "--threads", "--sections",
+                                                "--prefetch", "--prefetch-memory", "--distribution", "--scratch",
+                                                "--write-queue", "--durable", "--hdf5-chunk-cache", "--hdf5-chunk-slots",
+                                                "--hdf5-metadata-cache", "--hdf5-alignment",
+                                                "--hdf5-alignment-threshold", "--hdf5-page-buffer", "--hdf5-driver",
+                                                "--hdf5-alloc-time", "--hdf5-fill-time"};
+    if(blockSize == 0 && !outOfCore) {
+        independentOptions.insert("--memory");
+    }
+    std::string software_parameters;
+    std::set<const CLI::Option*> visitedOptions;
+    for(const CLI::App* group : {required, optional, parameters, hdf5}) {
+        for(const CLI::Option* option : group->get_options()) {
+            if(!visitedOptions.insert(option).second || option->count() == 0 ||
+               independentOptions.count(option->get_name()) > 0) {
+                continue;
+            }
+            software_parameters += option->get_name();
+            for(const std::string& value : option->results()) {
+                software_parameters += " " + value;
+            }
+            software_parameters += " ";
+        }
+    }
+    auto sectionComplete = [&](long long slice) {
+        SectionOutputs outputs = sectionOutputs(slice);
+        std::string identity = PLImg::HDF5Writer::inputIdentity({transmittance_files.at(slice), retardation_files.at(slice)});
+        for(const std::string& path : {outputs.median_transmittance_path, outputs.mask_path,
+                                       outputs.inclination_path, outputs.saturation_path}) {
+            if(!path.empty() && !PLImg::HDF5Writer::isComplete(path, identity, software_parameters)) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    // With MPI each rank processes every n-th section, or every n-th block of sections with --block-size. Without MPI
+    // all sections are processed by this process.
+    // With --distribution dynamic the ranks retrieve their sections from the distributor one at a time instead.
+    PLImg::HDF5VolumeWriter volume;
+    PLImg::SectionDistributor distributor(transmittance_files.size());
+    std::vector<long long> slices;
+    if(!dynamicDistribution) {
+        slices = PLImg::HDF5VolumeWriter::assignSlices(transmittance_files.size(), volume.rank(), volume.size(),
+                                                       std::max(blockSize, 1u));
+    }
+    // Ranks on the same node share its cores. The master of --distribution dynamic only distributes the sections.
+    int localRanks = distributor.localSize(dynamicDistribution);
+    if(threadBudget == 0 && localRanks > 1) {
+        threadBudget = unsigned(std::max(1, omp_get_num_procs() / localRanks));
+        cv::setNumThreads(int(threadBudget));
+    }
+
+    // Sections which were completely written by a previous run are skipped with --resume
+    std::vector<bool> completed;
+    // With --distribution dynamic sections are appended while others are processed
+    std::mutex slicesMutex;
+    auto sliceAt = [&](size_t index) {
+        std::lock_guard<std::mutex> lock(slicesMutex);
+        return slices.at(index);
+    };
+    auto completedAt = [&](size_t index) -> bool {
+        std::lock_guard<std::mutex> lock(slicesMutex);
+        return completed.at(index);
+    };
+    // Claim the section with the given index from the distributor if it wasn't claimed yet. Sections are claimed when
+    // the scheduler has a free slot or when the prefetcher reads ahead. Complete sections are skipped with --resume.
+    auto claimSection = [&](size_t index) {
+        std::lock_guard<std::mutex> lock(slicesMutex);
+        while(slices.size() <= index) {
+            long long slice = distributor.next();
+            if(slice < 0) {
+                return false;
+            }
+            if(resume && sectionComplete(slice)) {
+                std::cout << "Skipping complete section " << transmittance_files.at(slice) << std::endl;
+                continue;
+            }
+            slices.push_back(slice);
+            completed.push_back(false);
+        }
+        return true;
+    };
+    completed.assign(slices.size(), false);
+    if(resume && !dynamicDistribution) {
+        for(size_t index = 0; index < slices.size(); ++index) {
+            completed.at(index) = slices.at(index) >= 0 && sectionComplete(slices.at(index));
+        }
+        std::cout << std::count(completed.begin(), completed.end(), true) << " sections are already complete" << std::endl;
+    }
+
+    // Parameters of each block of sections with --block-size
+    struct BlockParameters {
+        float tthres, rthres, tref, tback;
+        float rplus, rminus, tplus, tminus;
+    };
+    std::map<long long, BlockParameters> blockParameters;
+
+    // Read the following sections while the current one is processed
+    std::unique_ptr<PLImg::Prefetcher> prefetcher;
+    auto startPrefetcher = [&]() {
+        // Sections processed out of core are read tile by tile instead
+        if(outOfCore) {
+            return;
+        }
+        if(dynamicDistribution) {
+            // The prefetcher claims up to --prefetch sections ahead of the scheduler
+            prefetcher = std::make_unique<PLImg::Prefetcher>([&, index = size_t(0)](std::vector<PLImg::PrefetchInput>& section) mutable {
+                if(!claimSection(index)) {
+                    return false;
+                }
+                long long slice = sliceAt(index++);
+                section = {{transmittance_files.at(slice), dataset, true}, {retardation_files.at(slice), dataset, true}};
+                return true;
+            }, prefetchDepth, prefetchMemory * 1024 * 1024);
+            return;
+        }
+        std::vector<std::vector<PLImg::PrefetchInput>> sections;
+        for(size_t index = 0; index < slices.size(); ++index) {
+            long long slice = slices.at(index);
+            if(slice >= 0 && !completed.at(index)) {
+                sections.push_back({{transmittance_files.at(slice), dataset, true},
+                                    {retardation_files.at(slice), dataset, true}});
+                // The median transmittance of a block was written by the first pass
+                SectionOutputs outputs = sectionOutputs(slice);
+                if(blockParameters.count(slice / std::max(blockSize, 1u)) > 0 && !outputs.median_transmittance_path.empty()) {
+                    sections.back().at(0).statistics = false;
+                    sections.back().push_back({outputs.median_transmittance_path, outputs.median_transmittance_group + "/Image", true});
+                }
+            }
+        }
+        prefetcher = std::make_unique<PLImg::Prefetcher>(sections, prefetchDepth, prefetchMemory * 1024 * 1024);
+    };
+
+    if(!volume_path.empty()) {
+        PLImg::Inclination inclination;
+        inclination.set_format(output.inclinationFormat);
+        // Smaller sections are written to the upper left corner of their slice
+        int volumeRows = 0, volumeCols = 0;
+        for(const std::string& file : transmittance_files) {
+            PLImg::ImageInfo info = PLImg::Reader::probe(file, dataset);
+            volumeRows = std::max(volumeRows, int(info.dims.at(0)));
+            volumeCols = std::max(volumeCols, int(info.dims.at(1)));
+        }
+        volume.set_path(volume_path);
+        volume.create_volume("/Mask", transmittance_files.size(), volumeRows, volumeCols, CV_8UC1);
+        volume.create_volume("/Inclination", transmittance_files.size(), volumeRows, volumeCols, inclination.type());
+        if(inclination.format() == PLImg::InclinationFormat::UInt16) {
+            volume.write_attribute("/Inclination", "_FillValue", INCLINATION_UINT16_FILL_VALUE);
+        }
+    }
+
+    // Several sections are processed concurrently if they fit into the memory budget.
+    // Transmittance, retardation, median transmittance, the copy of the median transmittance queued for writing,
+    // inclination and saturation are stored as 32-bit floating point images. Masks are stored as 8-bit images.
+    PLImg::SectionScheduler scheduler(memoryBudget * 1024 * 1024, threadBudget, concurrentSections);
+    // Sections processed out of core use the whole budget, so that only one of them runs at a time
+    unsigned long long outOfCoreBudget = memoryBudget > 0 ? memoryBudget * 1024 * 1024 : PLImg::Prefetcher::availableMemory() / 2;
+    auto estimateSection = [&](size_t index) -> unsigned long long {
+        long long slice = sliceAt(index);
+        if(slice < 0 || completedAt(index)) {
+            return 0;
+        }
+        if(outOfCore) {
+            return outOfCoreBudget;
+        }
+        try {
+            PLImg::ImageInfo transmittanceInfo = PLImg::Reader::probe(transmittance_files.at(slice), dataset);
+            return transmittanceInfo.numberOfPixels() * (6 * sizeof(float) + 3 * sizeof(unsigned char));
+        } catch(const std::exception&) {
+            // The error will be reported when the section is read
+            return 0;
+        }
+    };
+
+    // The median transmittance is written before its background is removed
+    auto writeMedianTransmittance = [&](PLImg::HDF5Writer& writer, long long slice, const std::shared_ptr<cv::Mat>& medTransmittance) {
+        SectionOutputs outputs = sectionOutputs(slice);
+        std::string median_dataset = outputs.median_transmittance_group + "/Image";
+        writer.set_path(outputs.median_transmittance_path);
+        writer.create_group(outputs.median_transmittance_group);
+        writer.write_dataset(median_dataset, medTransmittance, true);
+        writer.write_attribute(median_dataset, "median_kernel_size", int(MEDIAN_KERNEL_SIZE));
+        writer.writePLIMAttributes({{transmittance_files.at(slice), dataset}}, median_dataset, "NTransmittance", argc, argv);
+    };
+
+    // T_back and R_thres of the last section which passed the "prior" stage. Used as prior of the next section with
+    // --warm-start. Negative values disable the prior.
+    std::pair<float, float> prior(-1.0f, -1.0f);
+
+    // With --out-of-core a section is never read completely, see PLImg::OutOfCoreSection
+    auto processSectionOutOfCore = [&](size_t index) {
+        long long slice = sliceAt(index);
+        std::string transmittance_path = transmittance_files.at(slice);
+        std::string retardation_path = retardation_files.at(slice);
+        std::cout << transmittance_path << std::endl;
+        std::cout << retardation_path << std::endl;
+        SectionOutputs outputs = sectionOutputs(slice);
+        std::string identity = PLImg::HDF5Writer::inputIdentity({transmittance_path, retardation_path});
+        bool medianInput = transmittance_path.find("median") != std::string::npos;
+
+        PLImg::OutOfCoreSection section(transmittance_path, retardation_path, dataset, medianInput, outOfCoreBudget, subsample);
+        std::cout << "Processing " << section.grid().size() << " tiles of " << section.grid().tileSize()
+                  << " pixels, parameters are estimated on every " << section.stride() << "th pixel" << std::endl;
+
+        PLImg::HDF5Writer writer;
+        writer.set_compression(output.compression);
+        writer.set_durable(output.durable);
+        auto finishFile = [&](PLImg::HDF5Writer& file) {
+            file.mark_complete(identity, software_parameters);
+            file.close();
+        };
+
+        // First pass: median transmittance, subsample and the values of the background
+        std::string median_transmittance_path = transmittance_path;
+        std::string median_transmittance_dataset = dataset;
+        std::string median_dataset = outputs.median_transmittance_group + "/Image";
+        if(!medianInput) {
+            median_transmittance_path = outputs.median_transmittance_path;
+            median_transmittance_dataset = median_dataset;
+            writer.set_path(median_transmittance_path);
+            writer.create_group(outputs.median_transmittance_group);
+            writer.create_dataset(median_dataset, section.rows(), section.cols(), CV_32FC1);
+        }
+        section.sample(&writer, median_dataset);
+        if(!medianInput) {
+            writer.write_attribute(median_dataset, "median_kernel_size", int(MEDIAN_KERNEL_SIZE));
+            writer.writePLIMAttributes({{transmittance_path, dataset}}, median_dataset, "NTransmittance", argc, argv);
+            if(!singleFile) {
+                finishFile(writer);
+            }
+            std::cout << "Median-Transmittance generated" << std::endl;
+        }
+
+        PLImg::OutOfCoreParameters manual;
+        manual.tthres = ttra;
+        manual.rthres = tret;
+        manual.tref = tmin;
+        manual.tback = tmax;
+        manual.tc = im;
+        manual.tm = ic;
+        manual.rrefhm = rmaxWhite;
+        manual.rreflm = rmaxGray;
+        PLImg::OutOfCoreParameters parameters = section.estimate(manual);
+        std::cout << "Parameters estimated" << std::endl;
+
+        // Second pass: masks, probability and inclination. With --single-file both writers would open the same file.
+        PLImg::HDF5Writer inclinationFile;
+        PLImg::HDF5Writer& inclinationWriter = singleFile ? writer : inclinationFile;
+        inclinationWriter.set_compression(output.compression);
+        inclinationWriter.set_durable(output.durable);
+        PLImg::Inclination inclinationType;
+        inclinationType.set_format(output.inclinationFormat);
+        std::string mask_dataset = outputs.mask_group + "/Image";
+        std::string probability_dataset = outputs.mask_group + "/Probability";
+        std::string inclination_dataset = outputs.inclination_group + "/Image";
+        writer.set_path(outputs.mask_path);
+        writer.create_group(outputs.mask_group);
+        inclinationWriter.set_path(outputs.inclination_path);
+        inclinationWriter.create_group(outputs.inclination_group);
+        section.process(parameters, writer, mask_dataset, probability_dataset, inclinationWriter, inclination_dataset,
+                        output.inclinationFormat);
+
+        writer.writePLIMAttributes({{median_transmittance_path, median_transmittance_dataset}, {retardation_path, dataset}},
+                                   mask_dataset, "Mask", argc, argv);
+        writer.write_attribute(mask_dataset, "i_lower", parameters.tthres);
+        writer.write_attribute(mask_dataset, "r_thres", parameters.rthres);
+        writer.write_attribute(mask_dataset, "i_rmax", parameters.tref);
+        writer.write_attribute(mask_dataset, "i_upper", parameters.tback);
+        if(!singleFile) {
+            finishFile(writer);
+        }
+        std::cout << "Mask and probability mask generated and written" << std::endl;
+
+        inclinationWriter.write_attribute(inclination_dataset, "im", parameters.tc);
+        inclinationWriter.write_attribute(inclination_dataset, "ic", parameters.tm);
+        inclinationWriter.write_attribute(inclination_dataset, "rmax_white", parameters.rrefhm);
+        inclinationWriter.write_attribute(inclination_dataset, "rmax_gray", parameters.rreflm);
+        if(inclinationType.format() == PLImg::InclinationFormat::UInt16) {
+            // Degrees are scale_factor * value + add_offset. Pixels without an inclination are _FillValue.
+            inclinationWriter.write_attribute(inclination_dataset, "scale_factor", inclinationType.scaleFactor());
+            inclinationWriter.write_attribute(inclination_dataset, "add_offset", 0.0f);
+            inclinationWriter.write_attribute(inclination_dataset, "_FillValue", INCLINATION_UINT16_FILL_VALUE);
+        }
+        inclinationWriter.writePLIMAttributes({{transmittance_path, dataset}, {retardation_path, dataset},
+                                               {outputs.mask_path, mask_dataset}},
+                                              inclination_dataset, "Inclination", argc, argv);
+        finishFile(inclinationWriter);
+        std::cout << "Inclination generated and written" << std::endl << std::endl;
+    };
+
+    auto processSection = [&](size_t index) {
+        long long slice = sliceAt(index);
+        if(slice < 0) {
+            // Other ranks still write their last sections into the volume
+            if(!volume_path.empty()) {
+                scheduler.inOrder("volume", index, [&]() {
+                    volume.write_slice("/Mask", -1, cv::Mat());
+                    volume.write_slice("/Inclination", -1, cv::Mat());
+                });
+            }
+            return;
+        }
+        if(completedAt(index)) {
+            std::cout << "Skipping complete section " << transmittance_files.at(slice) << std::endl;
+            if(!volume_path.empty()) {
+                // Copy the results of the previous run into the volume
+                SectionOutputs outputs = sectionOutputs(slice);
+                std::string mask = outputs.mask_group + "/Image";
+                std::string incl = outputs.inclination_group + "/Image";
+                PLImg::Inclination inclination;
+                inclination.set_format(output.inclinationFormat);
+                cv::Mat inclinationImage = PLImg::Reader::imread(outputs.inclination_path, incl);
+                inclinationImage.convertTo(inclinationImage, inclination.type());
+                scheduler.inOrder("volume", index, [&]() {
+                    volume.write_slice("/Mask", slice, PLImg::Reader::imread(outputs.mask_path, mask));
+                    volume.write_slice_attribute("/Mask", "source", slice, transmittance_files.at(slice));
+                    for(const char* name : {"i_lower", "r_thres", "i_rmax", "i_upper"}) {
+                        volume.write_slice_attribute("/Mask", name, slice, PLImg::Reader::attribute(outputs.mask_path, mask, name));
+                    }
+                    volume.write_slice("/Inclination", slice, inclinationImage);
+                    volume.write_slice_attribute("/Inclination", "source", slice, transmittance_files.at(slice));
+                    for(const char* name : {"im", "ic", "rmax_white", "rmax_gray"}) {
+                        volume.write_slice_attribute("/Inclination", name, slice, PLImg::Reader::attribute(outputs.inclination_path, incl, name));
+                    }
+                    volume.write_slice_attribute("/Inclination", "scale_factor", slice, inclination.scaleFactor());
+                });
+            }
+            return;
+        }
+        if(outOfCore) {
+            processSectionOutOfCore(index);
+            return;
+        }
+
+        PLImg::HDF5Writer writer;
+        writer.set_compression(output.compression);
+        writer.set_durable(output.durable);
+        writer.set_pyramid(output.pyramidTileSize);
+        writer.set_asynchronous(output.writeQueue);
+        PLImg::MaskGeneration generation;
+        PLImg::Inclination inclination;
+        inclination.set_format(output.inclinationFormat);
+
+        std::string transmittance_path = transmittance_files.at(slice);
+        std::string retardation_path = retardation_files.at(slice);
+        std::cout << transmittance_path << std::endl;
+        std::cout << retardation_path << std::endl;
+        SectionOutputs outputs = sectionOutputs(slice);
+        std::string median_transmittance_path, median_transmittance_dataset;
+        const std::string& mask_path = outputs.mask_path;
+        const std::string& median_transmittance_group = outputs.median_transmittance_group;
+        const std::string& mask_group = outputs.mask_group;
+        const std::string& inclination_group = outputs.inclination_group;
+        const std::string& saturation_group = outputs.saturation_group;
+        // Written files are marked as complete for --resume after all of their outputs are written
+        std::string identity = PLImg::HDF5Writer::inputIdentity({transmittance_path, retardation_path});
+        auto finishFile = [&]() {
+            writer.mark_complete(identity, software_parameters);
+            writer.close();
+        };
+
+        std::cout << "Estimated peak memory: " << scheduler.estimatedMemory(index) / 1024 / 1024 << " MiB" << std::endl;
+
+        // The prefetcher returns the sections in order. A section which can't be read only fails itself,
+        // so the error is rethrown outside of the ordered stage.
+        PLImg::PrefetchedSection section;
+        std::exception_ptr loadError;
+        scheduler.inOrder("load", index, [&]() {
+            try {
+                section = prefetcher->next();
+            } catch(...) {
+                loadError = std::current_exception();
+            }
+        });
+        if(loadError) {
+            std::rethrow_exception(loadError);
+        }
+        std::shared_ptr<cv::Mat> transmittance = std::move(section.images.at(0));
+        std::shared_ptr<cv::Mat> retardation = std::move(section.images.at(1));
+        PLImg::ImageStatistics& transmittanceStatistics = section.statistics.at(0);
+        PLImg::ImageStatistics& retardationStatistics = section.statistics.at(1);
+        std::cout << "Files read" << std::endl;
+
+        std::shared_ptr<cv::Mat> medTransmittance;
+        // The transmittance stays on the GPU for the masked median filter if it fits. Median filtered inputs need neither filter.
+        bool medianInput = transmittance_path.find("median") != std::string::npos;
+        std::unique_ptr<PLImg::cuda::filters::FusedMedianFilter> medianFilter;
+        if(!medianInput) {
+            medianFilter = std::make_unique<PLImg::cuda::filters::FusedMedianFilter>(transmittance);
+        }
+        if(section.images.size() > 2) {
+            // Written by the first pass of --block-size
+            medTransmittance = std::move(section.images.at(2));
+            transmittanceStatistics = section.statistics.at(2);
+            transmittance = nullptr;
+            median_transmittance_path = outputs.median_transmittance_path;
+            median_transmittance_dataset = median_transmittance_group + "/Image";
+            if(medianFilter && !scratchDirectory.empty() && scheduler.memoryPressure() && medianFilter->spill(scratchDirectory)) {
+                std::cout << "Transmittance moved to a scratch file in " << scratchDirectory << std::endl;
+            }
+            std::cout << "Median-Transmittance read" << std::endl;
+        } else if (!medianInput) {
+            // Generate median transmittance
+            scheduler.rebalance();
+            medTransmittance = medianFilter->median();
+            // The original transmittance is only needed again by the masked median filter
+            transmittance = nullptr;
+            if(!scratchDirectory.empty() && scheduler.memoryPressure() && medianFilter->spill(scratchDirectory)) {
+                std::cout << "Transmittance moved to a scratch file in " << scratchDirectory << std::endl;
+            }
+            *medTransmittance = PLImg::Reader::convert(*medTransmittance, transmittanceStatistics);
+            median_transmittance_path = outputs.median_transmittance_path;
+            median_transmittance_dataset = median_transmittance_group + "/Image";
+            // removeBackground() modifies the median transmittance while it may still wait to be written
+            writeMedianTransmittance(writer, slice, output.writeQueue > 0 ? std::make_shared<cv::Mat>(medTransmittance->clone()) : medTransmittance);
+            if(!singleFile) {
+                finishFile();
+            }
+            std::cout << "Median-Transmittance generated" << std::endl;
+        } else {
+            medTransmittance = transmittance;
+            median_transmittance_path = transmittance_path;
+            median_transmittance_dataset = dataset;
+        }
+
+        scheduler.rebalance();
+        generation.setModalities(retardation, medTransmittance, retardationStatistics, transmittanceStatistics);
+        if(ttra >= 0) {
+            generation.set_tthres(ttra);
+        }
+        if(tret >= 0) {
+            generation.set_rthres(tret);
+        }
+        if(tmin >= 0) {
+            generation.set_tref(tmin);
+        }
+        if(tmax >= 0) {
+            generation.set_tback(tmax);
+        }
+
+        // With --block-size all parameters of the mask were estimated for the block of the section
+        bool blockEstimated = blockParameters.count(slice / std::max(blockSize, 1u)) > 0;
+        if(blockEstimated) {
+            const BlockParameters& block = blockParameters.at(slice / blockSize);
+            generation.set_tthres(block.tthres);
+            generation.set_rthres(block.rthres);
+            generation.set_tref(block.tref);
+            generation.set_tback(block.tback);
+            generation.set_probability_parameters(block.rplus, block.rminus, block.tplus, block.tminus);
+        }
+
+        // Parameters of a previous run are only used if the inputs and all values they depend on are unchanged.
+        // Overridden parameters are part of the key because the other mask parameters are derived from them.
+        // The thresholds also depend on the prior of --warm-start.
+        PLImg::ParameterCache cache(outputs.parameters_path);
+        std::map<std::string, float> cached;
+        auto cachedAll = [&cached](const std::vector<std::string>& names) {
+            return std::all_of(names.begin(), names.end(), [&cached](const std::string& name) { return cached.count(name) > 0; });
+        };
+        std::string maskKey;
+        bool maskCached = false;
+        auto estimateMaskParameters = [&](float priorTback, float priorRthres) {
+            maskKey = PLImg::ParameterCache::key(identity, {{"subsample", float(subsample)},
+                                                            {"i_lower", ttra}, {"r_thres", tret},
+                                                            {"i_rmax", tmin}, {"i_upper", tmax},
+                                                            {"prior_i_upper", priorTback}, {"prior_r_thres", priorRthres}});
+            maskCached = !blockEstimated && !noParameterCache && cache.load("MaskGeneration", maskKey, cached) &&
+                         cachedAll({"i_lower", "r_thres", "i_rmax", "i_upper"});
+            if(maskCached) {
+                generation.set_tthres(cached.at("i_lower"));
+                generation.set_rthres(cached.at("r_thres"));
+                generation.set_tref(cached.at("i_rmax"));
+                generation.set_tback(cached.at("i_upper"));
+                std::cout << "Mask parameters loaded from " << cache.filename() << std::endl;
+            } else if(subsample > 1 && !blockEstimated) {
+                // Estimate the parameters on a strided subsample. Only the masks will use the full resolution.
+                generation.estimateParameters(std::make_shared<cv::Mat>(PLImg::Reader::subsample(*retardation, subsample)),
+                                              std::make_shared<cv::Mat>(PLImg::Reader::subsample(*medTransmittance, subsample)));
+            }
+        };
+        if(warmStart && !blockEstimated) {
+            // The search of the thresholds prefers those of the previous section of this process. Each section waits for
+            // its predecessor, so the prior doesn't depend on the timing of concurrent sections. Like the loading stage,
+            // a failure only fails this section.
+            std::exception_ptr estimationError;
+            scheduler.inOrder("prior", index, [&]() {
+                try {
+                    generation.set_prior(prior.first, prior.second);
+                    estimateMaskParameters(prior.first, prior.second);
+                    prior = {generation.T_back(), generation.R_thres()};
+                } catch(...) {
+                    estimationError = std::current_exception();
+                }
+            });
+            if(estimationError) {
+                std::rethrow_exception(estimationError);
+            }
+        } else {
+            estimateMaskParameters(-1.0f, -1.0f);
+        }
+        generation.removeBackground();
+
+        writer.set_path(mask_path);
+        writer.create_group(mask_group);
+
+        writer.write_dataset(mask_group + "/Image", generation.fullMask(), true);
+        writer.writePLIMAttributes({{median_transmittance_path, median_transmittance_dataset}, {retardation_path, dataset}},
+                                   mask_group + "/Image", "Mask", argc, argv);
+        writer.write_attribute(mask_group + "/Image", "i_lower", generation.T_thres());
+        writer.write_attribute(mask_group + "/Image", "r_thres", generation.R_thres());
+        writer.write_attribute(mask_group + "/Image", "i_rmax", generation.T_ref());
+        writer.write_attribute(mask_group + "/Image", "i_upper", generation.T_back());
+        // writer.write_attribute("/Image", "version", PLImg::Version::versionHash() + ", " + PLImg::Version::timeStamp());
+        std::cout << "Mask generated and written" << std::endl;
+
+        std::map<std::string, float> maskParameters = {{"i_lower", generation.T_thres()}, {"r_thres", generation.R_thres()},
+                                                       {"i_rmax", generation.T_ref()}, {"i_upper", generation.T_back()}};
+        if(!maskCached && !blockEstimated) {
+            cache.store("MaskGeneration", maskKey, maskParameters);
+        }
+        // The bootstrap of the probability mask only depends on the mask parameters
+        std::string probabilityKey = PLImg::ParameterCache::key(identity, maskParameters);
+        bool probabilityCached = !blockEstimated && !noParameterCache && cache.load("Probability", probabilityKey, cached) &&
+                                 cachedAll({"r_plus", "r_minus", "t_plus", "t_minus"});
+        if(probabilityCached) {
+            generation.set_probability_parameters(cached.at("r_plus"), cached.at("r_minus"), cached.at("t_plus"), cached.at("t_minus"));
+        }
+        writer.write_dataset(mask_group + "/Probability", generation.probabilityMask());
+        std::map<std::string, float> probabilityParameters = {{"r_plus", generation.R_plus()}, {"r_minus", generation.R_minus()},
+                                                              {"t_plus", generation.T_plus()}, {"t_minus", generation.T_minus()}};
+        if(!probabilityCached && !blockEstimated) {
+            cache.store("Probability", probabilityKey, probabilityParameters);
+        }
+        std::cout << "Probability mask generated and written" << std::endl;
+
+        if (detailed) {
+            writer.write_dataset(mask_group + "/NoNerveFibers", generation.noNerveFiberMask());
+            std::cout << "Detailed masks generated and written" << std::endl;
+        }
+        if(!singleFile) {
+            finishFile();
+        }
+
+        scheduler.rebalance();
+        if (!medianInput) {
+            // Generate med10Transmittance
+            medTransmittance = medianFilter->maskedMedian(generation.fullMask());
+        } else {
+            medTransmittance = transmittance;
+        }
+        // The median transmittance was last used by the masks. The retardation is still needed for the inclination.
+        generation.releaseModalities();
+        std::cout << "Median filtered and masked transmittance generated" << std::endl;
+
+        // Set our read parameters
+        inclination.setModalities(medTransmittance, retardation, generation.probabilityMask(), generation.fullMask());
+        // The inclination parameters are independent of each other. Overriding one of them keeps the others cached.
+        std::map<std::string, float> inclinationDependencies(maskParameters);
+        inclinationDependencies.insert(probabilityParameters.begin(), probabilityParameters.end());
+        std::string inclinationKey = PLImg::ParameterCache::key(identity, inclinationDependencies);
+        std::map<std::string, float> manualInclinationParameters = {{"im", im}, {"ic", ic}, {"rmax_white", rmaxWhite}, {"rmax_gray", rmaxGray}};
+        std::map<std::string, float> cachedInclinationParameters = cache.loadInclination(inclinationKey, inclination,
+                                                                                        manualInclinationParameters, !noParameterCache);
+
+        // Create file and dataset. Write the inclination afterwards.
+        writer.set_path(outputs.inclination_path);
+        writer.create_group(inclination_group);
+        writer.write_dataset(inclination_group + "/Image", inclination.inclination(), true);
+        writer.write_attribute(inclination_group + "/Image", "im", inclination.T_c());
+        writer.write_attribute(inclination_group + "/Image", "ic", inclination.T_M());
+        writer.write_attribute(inclination_group + "/Image", "rmax_white", inclination.R_refHM());
+        writer.write_attribute(inclination_group + "/Image", "rmax_gray", inclination.R_refLM());
+        if(inclination.format() == PLImg::InclinationFormat::UInt16) {
+            // Degrees are scale_factor * value + add_offset. Pixels without an inclination are _FillValue.
+            writer.write_attribute(inclination_group + "/Image", "scale_factor", inclination.scaleFactor());
+            writer.write_attribute(inclination_group + "/Image", "add_offset", 0.0f);
+            writer.write_attribute(inclination_group + "/Image", "_FillValue", INCLINATION_UINT16_FILL_VALUE);
+        }
+        // writer.write_attribute("/Image", "version", PLImg::Version::versionHash() + ", " + PLImg::Version::timeStamp());
+
+        writer.writePLIMAttributes({{transmittance_path, dataset}, {retardation_path, dataset}, {mask_path, mask_group + "/Image"}},
+                                   inclination_group + "/Image", "Inclination", argc, argv);
+        std::cout << "Inclination generated and written" << std::endl;
+        if(!singleFile) {
+            finishFile();
+        }
+
+        cache.storeInclination(inclinationKey, inclination, manualInclinationParameters, cachedInclinationParameters);
+
+        if(!volume_path.empty()) {
+            // Collective writes of all ranks have to be called in the same order
+            scheduler.inOrder("volume", index, [&]() {
+                volume.write_slice("/Mask", slice, *generation.fullMask());
+                volume.write_slice_attribute("/Mask", "source", slice, transmittance_path);
+                volume.write_slice_attribute("/Mask", "i_lower", slice, generation.T_thres());
+                volume.write_slice_attribute("/Mask", "r_thres", slice, generation.R_thres());
+                volume.write_slice_attribute("/Mask", "i_rmax", slice, generation.T_ref());
+                volume.write_slice_attribute("/Mask", "i_upper", slice, generation.T_back());
+                volume.write_slice("/Inclination", slice, *inclination.inclination());
+                volume.write_slice_attribute("/Inclination", "source", slice, transmittance_path);
+                volume.write_slice_attribute("/Inclination", "im", slice, inclination.T_c());
+                volume.write_slice_attribute("/Inclination", "ic", slice, inclination.T_M());
+                volume.write_slice_attribute("/Inclination", "rmax_white", slice, inclination.R_refHM());
+                volume.write_slice_attribute("/Inclination", "rmax_gray", slice, inclination.R_refLM());
+                volume.write_slice_attribute("/Inclination", "scale_factor", slice, inclination.scaleFactor());
+            });
+            std::cout << "Section written to volume slice " << slice << std::endl;
+        }
+
+        if(detailed) {
+            // Create file and dataset. Write the inclination afterwards.
+            writer.set_path(outputs.saturation_path);
+            writer.create_group(saturation_group);
+            writer.write_dataset(saturation_group + "/Image", inclination.saturation(), true);
+            writer.write_attribute(saturation_group + "/Image", "im", inclination.T_c());
+            writer.write_attribute(saturation_group + "/Image", "ic", inclination.T_M());
+            writer.write_attribute(saturation_group + "/Image", "rmax_white", inclination.R_refHM());
+            writer.write_attribute(saturation_group + "/Image", "rmax_gray", inclination.R_refLM());
+            // writer.write_attribute("/Image", "version", PLImg::Version::versionHash() + ", " + PLImg::Version::timeStamp());
+            writer.writePLIMAttributes({{transmittance_path, dataset}, {retardation_path, dataset}, {mask_path, mask_group + "/Image"}},
+                                       saturation_group + "/Image", "Inclination Saturation", argc, argv);
+            std::cout << "Saturation image generated and written" << std::endl;
+            if(!singleFile) {
+                finishFile();
+            }
+        }
+        if(singleFile) {
+            // The reference files are opened once for all outputs of the section
+            finishFile();
+        }
+
+        // Report errors of the background writer for each section
+        writer.wait();
+        std::cout << "Resident memory of the process: " << PLImg::SectionScheduler::residentMemory() / 1024 / 1024 << " MiB, peak "
+                  << PLImg::SectionScheduler::peakResidentMemory() / 1024 / 1024 << " MiB" << std::endl;
+        std::cout << std::endl;
+    };
+    // Failed sections are reported at the end instead of aborting all other sections. The collective writes of the
+    // volume can't skip a section, so a failure still aborts the run with --volume.
+    auto processReportedSection = [&](size_t index) {
+        auto sectionStart = std::chrono::steady_clock::now();
+        long long slice = sliceAt(index);
+        std::string error;
+        try {
+            processSection(index);
+        } catch(const std::exception& exception) {
+            if(!volume_path.empty()) {
+                throw;
+            }
+            error = exception.what();
+            std::cerr << "Processing of " << transmittance_files.at(slice) << " failed: " << error << std::endl;
+        }
+        if(slice >= 0 && !completedAt(index)) {
+            std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - sectionStart;
+            distributor.report(slice, seconds.count(), error);
+        }
+    };
+    // With --block-size the parameters of all sections of a block are estimated once. The first pass median filters
+    // the transmittance of each section, writes it and keeps a strided subsample of both modalities. A quarter of the
+    // memory budget is reserved for the subsamples of a block, so the stride may be larger than --subsample. As soon as
+    // all sections of a block are sampled, its parameters are estimated from the subsamples of all of them. The second
+    // pass reads the written median transmittance instead of filtering it again. The whole block is assigned to this
+    // rank, so the sections of a block which are already complete are sampled as well.
+    if(blockSize > 0) {
+        struct BlockSamples {
+            std::vector<std::shared_ptr<cv::Mat>> retardations, transmittances;
+            unsigned stride = 1;
+            size_t remaining = 0;
+        };
+        std::map<long long, BlockSamples> blockSamples;
+        std::vector<long long> sampledSlices;
+        for(size_t index = 0; index < slices.size(); ++index) {
+            long long block = slices.at(index) / blockSize;
+            if(slices.at(index) >= 0 && !completed.at(index) && blockSamples.count(block) == 0) {
+                long long firstSlice = block * blockSize;
+                long long endSlice = std::min(firstSlice + (long long) blockSize, (long long) transmittance_files.size());
+                unsigned long long blockPixels = 0;
+                for(long long slice = firstSlice; slice < endSlice; ++slice) {
+                    sampledSlices.push_back(slice);
+                    try {
+                        blockPixels += PLImg::Reader::probe(transmittance_files.at(slice), dataset).numberOfPixels();
+                    } catch(const std::exception&) {
+                        // The section is left out of its block
+                    }
+                }
+                BlockSamples& samples = blockSamples[block];
+                samples.retardations.resize(endSlice - firstSlice);
+                samples.transmittances.resize(endSlice - firstSlice);
+                samples.remaining = endSlice - firstSlice;
+                double sampleBudget = std::max(1.0, scheduler.memoryBudget() / 4.0);
+                samples.stride = std::max(subsample, unsigned(std::ceil(std::sqrt(blockPixels * 2.0 * sizeof(float) / sampleBudget))));
+            }
+        }
+
+        // Sections whose median transmittance was completely written before are not filtered again. With --single-file
+        // the file is only marked as complete after all outputs of the section are written.
+        auto medianWritten = [&](long long slice) {
+            SectionOutputs outputs = sectionOutputs(slice);
+            if(outputs.median_transmittance_path.empty()) {
+                return false;
+            }
+            if(singleFile) {
+                return sectionComplete(slice);
+            }
+            return PLImg::HDF5Writer::isComplete(outputs.median_transmittance_path,
+                                                 PLImg::HDF5Writer::inputIdentity({transmittance_files.at(slice), retardation_files.at(slice)}),
+                                                 software_parameters);
+        };
+        std::vector<bool> filtered(sampledSlices.size());
+        std::vector<std::vector<PLImg::PrefetchInput>> sampledSections;
+        for(size_t index = 0; index < sampledSlices.size(); ++index) {
+            long long slice = sampledSlices.at(index);
+            SectionOutputs outputs = sectionOutputs(slice);
+            filtered.at(index) = !outputs.median_transmittance_path.empty() && !medianWritten(slice);
+            if(outputs.median_transmittance_path.empty() || filtered.at(index)) {
+                sampledSections.push_back({{transmittance_files.at(slice), dataset, true}, {retardation_files.at(slice), dataset, true}});
+            } else {
+                sampledSections.push_back({{outputs.median_transmittance_path, outputs.median_transmittance_group + "/Image", true},
+                                           {retardation_files.at(slice), dataset, true}});
+            }
+        }
+
+        PLImg::Prefetcher samplePrefetcher(sampledSections, prefetchDepth, prefetchMemory * 1024 * 1024);
+        std::mutex samplesMutex;
+        auto estimateSamples = [&](size_t index) -> unsigned long long {
+            try {
+                return PLImg::Reader::probe(transmittance_files.at(sampledSlices.at(index)), dataset).numberOfPixels() * 4 * sizeof(float);
+            } catch(const std::exception&) {
+                return 0;
+            }
+        };
+        auto sampleSection = [&](size_t index) {
+            long long slice = sampledSlices.at(index);
+            long long block = slice / blockSize;
+            std::shared_ptr<cv::Mat> medTransmittance, retardation;
+            try {
+                PLImg::PrefetchedSection section;
+                std::exception_ptr loadError;
+                scheduler.inOrder("load", index, [&]() {
+                    try {
+                        section = samplePrefetcher.next();
+                    } catch(...) {
+                        loadError = std::current_exception();
+                    }
+                });
+                if(loadError) {
+                    std::rethrow_exception(loadError);
+                }
+                medTransmittance = std::move(section.images.at(0));
+                retardation = std::move(section.images.at(1));
+                if(filtered.at(index)) {
+                    scheduler.rebalance();
+                    medTransmittance = PLImg::cuda::filters::medianFilter(medTransmittance);
+                    *medTransmittance = PLImg::Reader::convert(*medTransmittance, section.statistics.at(0));
+                    PLImg::HDF5Writer writer;
+                    writer.set_compression(output.compression);
+                    writer.set_durable(output.durable);
+                    writer.set_pyramid(output.pyramidTileSize);
+                    writeMedianTransmittance(writer, slice, medTransmittance);
+                    if(singleFile) {
+                        writer.close();
+                    } else {
+                        writer.mark_complete(PLImg::HDF5Writer::inputIdentity({transmittance_files.at(slice), retardation_files.at(slice)}),
+                                             software_parameters);
+                        writer.close();
+                    }
+                    std::cout << "Median-Transmittance of " << transmittance_files.at(slice) << " generated" << std::endl;
+                }
+            } catch(const std::exception& exception) {
+                // The section fails again in the second pass and is reported there
+                std::cerr << "Sampling of " << transmittance_files.at(slice) << " failed: " << exception.what() << std::endl;
+                medTransmittance = retardation = nullptr;
+            }
+
+            BlockSamples* samples;
+            {
+                std::lock_guard<std::mutex> lock(samplesMutex);
+                samples = &blockSamples.at(block);
+            }
+            if(medTransmittance) {
+                auto sampledTransmittance = std::make_shared<cv::Mat>(PLImg::Reader::subsample(*medTransmittance, samples->stride));
+                auto sampledRetardation = std::make_shared<cv::Mat>(PLImg::Reader::subsample(*retardation, samples->stride));
+                medTransmittance = retardation = nullptr;
+                std::lock_guard<std::mutex> lock(samplesMutex);
+                samples->transmittances.at(slice - block * blockSize) = sampledTransmittance;
+                samples->retardations.at(slice - block * blockSize) = sampledRetardation;
+            }
+            {
+                std::lock_guard<std::mutex> lock(samplesMutex);
+                if(--samples->remaining > 0) {
+                    return;
+                }
+            }
+
+            // The last sampled section of a block estimates its parameters
+            std::vector<std::shared_ptr<cv::Mat>> retardations, transmittances;
+            for(size_t i = 0; i < samples->transmittances.size(); ++i) {
+                if(samples->transmittances.at(i)) {
+                    retardations.push_back(std::move(samples->retardations.at(i)));
+                    transmittances.push_back(std::move(samples->transmittances.at(i)));
+                }
+            }
+            if(transmittances.empty()) {
+                std::cerr << "No section of block " << block << " could be sampled" << std::endl;
+                return;
+            }
+            PLImg::MaskGeneration generation;
+            if(ttra >= 0) {
+                generation.set_tthres(ttra);
+            }
+            if(tret >= 0) {
+                generation.set_rthres(tret);
+            }
+            if(tmin >= 0) {
+                generation.set_tref(tmin);
+            }
+            if(tmax >= 0) {
+                generation.set_tback(tmax);
+            }
+            scheduler.rebalance();
+            try {
+                generation.estimateParameters(retardations, transmittances);
+            } catch(const std::exception& exception) {
+                std::cerr << "Estimation of block " << block << " failed, its sections are estimated one by one: "
+                          << exception.what() << std::endl;
+                return;
+            }
+            std::lock_guard<std::mutex> lock(samplesMutex);
+            blockParameters[block] = {generation.T_thres(), generation.R_thres(), generation.T_ref(), generation.T_back(),
+                                      generation.R_plus(), generation.R_minus(), generation.T_plus(), generation.T_minus()};
+            std::cout << "Parameters of sections " << block * blockSize << " to " << block * blockSize + samples->transmittances.size() - 1
+                      << " with a stride of " << samples->stride << ": T_thres:" << generation.T_thres() << ", R_thres:" << generation.R_thres()
+                      << ", T_ref:" << generation.T_ref() << ", T_back:" << generation.T_back() << std::endl;
+        };
+        scheduler.run(sampledSlices.size(), estimateSamples, sampleSection);
+    }
+
+    if(!dynamicDistribution) {
+        startPrefetcher();
+        scheduler.run(slices.size(), estimateSection, processReportedSection);
+    } else if(distributor.master()) {
+        distributor.serve();
+    } else {
+        // A section is claimed as soon as a slot is free, so that no section waits for a busy rank
+        startPrefetcher();
+        scheduler.run(claimSection, estimateSection, processReportedSection);
+    }
+    prefetcher = nullptr;
+    unsigned peakSections = scheduler.peakSections();
+    unsigned long long peakMemory = scheduler.peakMemory();
+    if(peakSections > 1) {
+        std::cout << "Up to " << peakSections << " sections were processed concurrently with an estimated peak memory of "
+                  << peakMemory / 1024 / 1024 << " MiB" << std::endl;
+    }
+    std::cout << "Peak resident memory of the process: " << PLImg::SectionScheduler::peakResidentMemory() / 1024 / 1024
+              << " MiB with a memory budget of " << scheduler.memoryBudget() / 1024 / 1024 << " MiB" << std::endl;
+    std::vector<PLImg::SectionReport> reports = distributor.gather();
+    if(distributor.rank() == 0) {
+        std::cout << PLImg::SectionDistributor::summary(reports, transmittance_files);
+    }
+    bool failed = std::any_of(reports.begin(), reports.end(), [](const PLImg::SectionReport& report) {
+        return !report.error.empty();
+    });
+
+    volume.close();
+
+    #ifdef TIME_MEASUREMENT
+        auto end = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
+
+        std::cout << "Runtime was " << duration.count() << std::endl;
+    #endif
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
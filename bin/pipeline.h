@@ -0,0 +1,45 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Forschungszentrum Jülich / Jan André Reuter.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef PLIMG_PIPELINE_H
+#define PLIMG_PIPELINE_H
+
+/**
+ * @file
+ * @brief Processing of PLImigPipeline shared with PLImigDaemon
+ */
+
+/**
+ * Parse the command line of PLImigPipeline and process all given sections. The function can be called repeatedly
+ * by the same process. If PLImig is compiled with MPI, MPI has to be initialized before with MPI_THREAD_SERIALIZED,
+ * as the sections call MPI from their own threads. Otherwise the function fails. The reported resident memory is the one of the calling process, so its peak
+ * includes all previous calls.
+ * @brief Run PLImigPipeline
+ * @param argc Number of arguments
+ * @param argv Arguments. The first one is the program name.
+ * @return EXIT_SUCCESS if all sections were processed successfully
+ */
+int runPipeline(int argc, char** argv);
+
+#endif //PLIMG_PIPELINE_H
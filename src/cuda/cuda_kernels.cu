@@ -55,12 +55,34 @@ __device__ void shellSort(float* array, unsigned int low, unsigned int high) {
     }
 }
 
+__device__ void loadMedianTile(const float* image, int image_stride, float* tile, int2 imageDims) {
+    // Top left pixel of the tile. Each tile contains the pixels of its block and a border of MEDIAN_KERNEL_SIZE.
+    long long tileX = (long long) blockIdx.x * blockDim.x - MEDIAN_KERNEL_SIZE;
+    long long tileY = (long long) blockIdx.y * blockDim.y - MEDIAN_KERNEL_SIZE;
+    // All threads of the block load the tile together. Pixels outside of the image are never used.
+    for(unsigned int i = threadIdx.y * blockDim.x + threadIdx.x; i < MEDIAN_TILE_SIZE * MEDIAN_TILE_SIZE; i += blockDim.x * blockDim.y) {
+        long long x = tileX + i % MEDIAN_TILE_SIZE;
+        long long y = tileY + i / MEDIAN_TILE_SIZE;
+        if(x >= 0 && x < imageDims.x && y >= 0 && y < imageDims.y) {
+            tile[i] = image[x + y * image_stride];
+        }
+    }
+}
+
 __global__ void medianFilterKernel(const float* image, int image_stride,
                                    float* result_image, int result_image_stride,
                                    int2 imageDims) {
+    // Each pixel is part of the neighbourhood of up to 4 * MEDIAN_KERNEL_SIZE^2 other pixels. Read it once per block.
+    __shared__ float tile[MEDIAN_TILE_SIZE * MEDIAN_TILE_SIZE];
+    loadMedianTile(image, image_stride, tile, imageDims);
+    __syncthreads();
+
     // Calculate actual position in image based on thread number and block number
     long long x = (long long) blockIdx.x * blockDim.x + threadIdx.x;
     long long y = (long long) blockIdx.y * blockDim.y + threadIdx.y;
+    // Position of the pixel in the tile
+    unsigned int tx = threadIdx.x + MEDIAN_KERNEL_SIZE;
+    unsigned int ty = threadIdx.y + MEDIAN_KERNEL_SIZE;
     // The valid values will be counted to ensure that the median will be calculated correctly
     unsigned int validValues = 0;
     int cy_bound;
@@ -75,7 +97,7 @@ __global__ void medianFilterKernel(const float* image, int image_stride,
             cy_bound = sqrtf(MEDIAN_KERNEL_SIZE * MEDIAN_KERNEL_SIZE - cx * cx);
             for (int cy = -cy_bound; cy <= cy_bound; ++cy) {
                 // Save values in buffer
-                buffer[validValues] = image[x + cx + (y + cy) * image_stride];
+                buffer[validValues] = tile[tx + cx + (ty + cy) * MEDIAN_TILE_SIZE];
                 ++validValues;
             }
         }
@@ -89,9 +111,17 @@ __global__ void medianFilterMaskedKernel(const float* image, int image_stride,
                                          float* result_image, int result_image_stride,
                                          const unsigned char* mask, int mask_stride,
                                          int2 imageDims) {
+    // Each pixel is part of the neighbourhood of up to 4 * MEDIAN_KERNEL_SIZE^2 other pixels. Read it once per block.
+    __shared__ float tile[MEDIAN_TILE_SIZE * MEDIAN_TILE_SIZE];
+    loadMedianTile(image, image_stride, tile, imageDims);
+    __syncthreads();
+
     // Calculate actual position in image based on thread number and block number
     long long x = (long long) blockIdx.x * blockDim.x + threadIdx.x;
     long long y = (long long) blockIdx.y * blockDim.y + threadIdx.y;
+    // Position of the pixel in the tile
+    unsigned int tx = threadIdx.x + MEDIAN_KERNEL_SIZE;
+    unsigned int ty = threadIdx.y + MEDIAN_KERNEL_SIZE;
     // The valid values will be counted to ensure that the median will be calculated correctly
     unsigned int validValues = 0;
     int cy_bound;
@@ -108,7 +138,7 @@ __global__ void medianFilterMaskedKernel(const float* image, int image_stride,
                 // If the pixel in the kernel matches the current pixel on the gray / white mask
                 if (mask[x + y * mask_stride] == mask[x + cx + (y + cy) * mask_stride]) {
                     // Save values in buffer
-                    buffer[validValues] = image[x + cx + (y + cy) * image_stride];
+                    buffer[validValues] = tile[tx + cx + (ty + cy) * MEDIAN_TILE_SIZE];
                     ++validValues;
                 }
             }
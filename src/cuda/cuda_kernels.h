@@ -33,8 +33,15 @@
 constexpr auto MEDIAN_KERNEL_SIZE = 5;
 /// Number of CUDA Kernel threads used for kernel execution
 constexpr auto CUDA_KERNEL_NUM_THREADS = 32;
+/// Width and height of the image tile in shared memory used by the median filter kernels of a block
+constexpr auto MEDIAN_TILE_SIZE = CUDA_KERNEL_NUM_THREADS + 2 * MEDIAN_KERNEL_SIZE;
 
 __device__ void shellSort(float* array, unsigned int low, unsigned int high);
+/**
+ * @brief Load the pixels of the current block and their neighbourhood into shared memory. Requires blocks of
+ * CUDA_KERNEL_NUM_THREADS x CUDA_KERNEL_NUM_THREADS threads.
+ */
+__device__ void loadMedianTile(const float* image, int image_stride, float* tile, int2 imageDims);
 
 __global__ void medianFilterKernel(const float* image, int image_stride,
                                    float* result_image, int result_image_stride,
@@ -23,6 +23,16 @@
  */
 
 #include "cuda/cuda_toolbox.h"
+#include <array>
+
+namespace {
+    /// Device pointer and size of each scratch buffer
+    std::array<std::pair<void*, size_t>, 3> scratchBuffers{};
+    /// Keep the scratch buffers between the calls
+    bool keepScratchBuffers = false;
+    /// Number of calls of cudaDeviceReset() by CHECK_CUDA
+    unsigned long long resets = 0;
+}
 
 cv::Mat PLImg::cuda::raw::labeling::CUDAConnectedComponents(const cv::Mat& image, uint* maxLabelNumber) {
     // Prepare image for CUDA kernel
@@ -182,25 +192,28 @@ cv::Mat PLImg::cuda::raw::labeling::CUDAConnectedComponentsUF(const cv::Mat &ima
 }
 
 void PLImg::cuda::raw::filters::CUDAmedianFilter(cv::Mat& image, cv::Mat& result) {
-    float* deviceImage, *deviceResult;
+    // Allocate GPU memory for the original image and copy it from CPU to GPU
+    float* deviceImage = (float*) scratch(0, (unsigned long long) image.cols * image.rows * image.elemSize());
+    CHECK_CUDA(cudaMemcpy(deviceImage, image.data, (unsigned long long) image.cols * image.rows * image.elemSize(), cudaMemcpyHostToDevice));
+    CUDAmedianFilter(deviceImage, result);
+}
+
+void PLImg::cuda::raw::filters::CUDAmedianFilter(const float* deviceImage, cv::Mat& result) {
+    float* deviceResult;
     int nSrcStep, nResStep;
     int2 subImageDims;
     // Apply median filter
     // Calculate offsets for image and result. Starting at the edge would result in errors because we would
     // go out of bounds.
     dim3 threadsPerBlock, numBlocks;
-    // Allocate GPU memory for the original image and its result
-    CHECK_CUDA(cudaMalloc((void **) &deviceImage, (unsigned long long) image.cols * image.rows * image.elemSize()));
-    // Length of columns
-    nSrcStep = image.cols;
+    // The image on the GPU has the same dimensions as the result. Length of columns
+    nSrcStep = result.cols;
 
-    CHECK_CUDA(cudaMalloc((void **) &deviceResult, (unsigned long long) image.cols * image.rows * image.elemSize()));
+    // Allocate GPU memory for the result
+    deviceResult = (float*) scratch(1, (unsigned long long) result.cols * result.rows * result.elemSize());
     // Length of columns
     nResStep = result.cols;
 
-    // Copy image from CPU to GPU
-    CHECK_CUDA(cudaMemcpy(deviceImage, image.data, (unsigned long long) image.cols * image.rows * image.elemSize(), cudaMemcpyHostToDevice));
-
     // Apply median filter
     subImageDims = {result.cols, result.rows};
     threadsPerBlock = dim3(CUDA_KERNEL_NUM_THREADS, CUDA_KERNEL_NUM_THREADS);
@@ -211,16 +224,22 @@ void PLImg::cuda::raw::filters::CUDAmedianFilter(cv::Mat& image, cv::Mat& result
                                                        subImageDims);
 
     // Copy result from GPU back to CPU
-    CHECK_CUDA(cudaMemcpy(result.data, deviceResult, (unsigned long long) image.cols * image.rows * image.elemSize(), cudaMemcpyDeviceToHost));
+    CHECK_CUDA(cudaMemcpy(result.data, deviceResult, (unsigned long long) result.cols * result.rows * result.elemSize(), cudaMemcpyDeviceToHost));
 
     // Free reserved memory
-    CHECK_CUDA(cudaFree(deviceImage));
-    CHECK_CUDA(cudaFree(deviceResult));
+    recycleScratch();
     CHECK_CUDA(cudaDeviceSynchronize());
 }
 
 void PLImg::cuda::raw::filters::CUDAmedianFilterMasked(cv::Mat& image, cv::Mat& mask, cv::Mat& result) {
-    float* deviceImage, *deviceResult;
+    // Allocate GPU memory for the original image and copy it from CPU to GPU
+    float* deviceImage = (float*) scratch(0, (unsigned long long) image.cols * image.rows * image.elemSize());
+    CHECK_CUDA(cudaMemcpy(deviceImage, image.data, (unsigned long long) image.cols * image.rows * image.elemSize(), cudaMemcpyHostToDevice));
+    CUDAmedianFilterMasked(deviceImage, mask, result);
+}
+
+void PLImg::cuda::raw::filters::CUDAmedianFilterMasked(const float* deviceImage, cv::Mat& mask, cv::Mat& result) {
+    float* deviceResult;
     uchar* deviceMask;
     unsigned long long nSrcStep, nMaskStep, nResStep;
     // Apply median filter
@@ -229,25 +248,23 @@ void PLImg::cuda::raw::filters::CUDAmedianFilterMasked(cv::Mat& image, cv::Mat&
     dim3 threadsPerBlock, numBlocks;
     int2 subImageDims;
 
-    // Allocate GPU memory for the original image, mask and its result
-    CHECK_CUDA(cudaMalloc((void **) &deviceImage, (unsigned long long) image.cols * image.rows * image.elemSize()));
-    // Length of columns
-    nSrcStep = image.cols;
+    // The image on the GPU has the same dimensions as the result. Length of columns
+    nSrcStep = result.cols;
 
-    CHECK_CUDA(cudaMalloc((void **) &deviceMask, (unsigned long long) mask.rows * mask.cols * mask.elemSize()));
+    // Allocate GPU memory for the mask and the result
+    deviceMask = (uchar*) scratch(2, (unsigned long long) mask.rows * mask.cols * mask.elemSize());
     // Length of columns
     nMaskStep = mask.cols;
 
-    CHECK_CUDA(cudaMalloc((void **) &deviceResult, (unsigned long long) image.cols * image.rows * image.elemSize()));
+    deviceResult = (float*) scratch(1, (unsigned long long) result.cols * result.rows * result.elemSize());
     // Length of columns
     nResStep = result.cols;
 
-    // Copy image from CPU to GPU
-    CHECK_CUDA(cudaMemcpy(deviceImage, image.data, (unsigned long long) image.cols * image.rows * image.elemSize(), cudaMemcpyHostToDevice));
+    // Copy mask from CPU to GPU
     CHECK_CUDA(cudaMemcpy(deviceMask, mask.data, (unsigned long long) mask.cols * mask.rows * mask.elemSize(), cudaMemcpyHostToDevice));
 
     // Apply median filter
-    subImageDims = {image.cols, image.rows};
+    subImageDims = {result.cols, result.rows};
     threadsPerBlock = dim3(CUDA_KERNEL_NUM_THREADS, CUDA_KERNEL_NUM_THREADS);
     numBlocks = dim3(ceil(float(subImageDims.x) / threadsPerBlock.x), ceil(float(subImageDims.y) / threadsPerBlock.y));
     // Run median filter
@@ -256,23 +273,35 @@ void PLImg::cuda::raw::filters::CUDAmedianFilterMasked(cv::Mat& image, cv::Mat&
                                                              deviceMask, nMaskStep,
                                                              subImageDims);
 
-    CHECK_CUDA(cudaMemcpy(result.data, deviceResult, (unsigned long long) image.cols * image.rows * image.elemSize(), cudaMemcpyDeviceToHost));
+    CHECK_CUDA(cudaMemcpy(result.data, deviceResult, (unsigned long long) result.cols * result.rows * result.elemSize(), cudaMemcpyDeviceToHost));
 
     // Free reserved memory
-    CHECK_CUDA(cudaFree(deviceImage));
-    CHECK_CUDA(cudaFree(deviceResult));
-    CHECK_CUDA(cudaFree(deviceMask));
+    recycleScratch();
     CHECK_CUDA(cudaDeviceSynchronize());
 }
 
+float* PLImg::cuda::raw::uploadImage(const cv::Mat& image) {
+    float* deviceImage;
+    CHECK_CUDA(cudaMalloc((void **) &deviceImage, (unsigned long long) image.cols * image.rows * sizeof(float)));
+    CHECK_CUDA(cudaMemcpy(deviceImage, image.data, (unsigned long long) image.cols * image.rows * sizeof(float), cudaMemcpyHostToDevice));
+    return deviceImage;
+}
+
+void PLImg::cuda::raw::freeImage(float* deviceImage, unsigned long long generation) {
+    // cudaDeviceReset() freed the image already
+    if(deviceImage && generation == deviceGeneration()) {
+        cudaFree(deviceImage);
+    }
+}
+
 cv::Mat PLImg::cuda::raw::CUDAhistogram(const cv::Mat &image, float minLabel, float maxLabel, uint numBins) {
     float* deviceImage;
     uint* deviceHistogram;
 
-    CHECK_CUDA(cudaMalloc(&deviceImage, (unsigned long long) image.cols * image.rows * sizeof(float)));
+    deviceImage = (float*) scratch(0, (unsigned long long) image.cols * image.rows * sizeof(float));
     CHECK_CUDA(cudaMemcpy(deviceImage, image.data, (unsigned long long) image.cols * image.rows * sizeof(float), cudaMemcpyHostToDevice));
 
-    CHECK_CUDA(cudaMalloc(&deviceHistogram, numBins * sizeof(uint)));
+    deviceHistogram = (uint*) scratch(1, numBins * sizeof(uint));
     CHECK_CUDA(cudaMemset(deviceHistogram, 0, numBins * sizeof(uint)));
 
     dim3 threadsPerBlock = dim3(CUDA_KERNEL_NUM_THREADS, CUDA_KERNEL_NUM_THREADS);
@@ -288,9 +317,59 @@ cv::Mat PLImg::cuda::raw::CUDAhistogram(const cv::Mat &image, float minLabel, fl
     }
     CHECK_CUDA(cudaDeviceSynchronize());
     CHECK_CUDA(cudaMemcpy(hostHistogram.data, deviceHistogram, numBins * sizeof(uint), cudaMemcpyDeviceToHost));
-    CHECK_CUDA(cudaFree(deviceHistogram));
-    CHECK_CUDA(cudaFree(deviceImage));
+    recycleScratch();
 
     return hostHistogram;
 }
 
+void* PLImg::cuda::raw::scratch(unsigned slot, size_t bytes) {
+    std::pair<void*, size_t>& buffer = scratchBuffers.at(slot);
+    if(buffer.second < bytes) {
+        if(buffer.first) {
+            CHECK_CUDA(cudaFree(buffer.first));
+            buffer = {nullptr, 0};
+        }
+        CHECK_CUDA(cudaMalloc(&buffer.first, bytes));
+        buffer.second = bytes;
+    }
+    return buffer.first;
+}
+
+void PLImg::cuda::raw::recycleScratch() {
+    if(!keepScratchBuffers) {
+        releaseScratch();
+    }
+}
+
+void PLImg::cuda::raw::keepScratch(bool keep) {
+    keepScratchBuffers = keep;
+    recycleScratch();
+}
+
+void PLImg::cuda::raw::releaseScratch() {
+    for(std::pair<void*, size_t>& buffer : scratchBuffers) {
+        if(buffer.first) {
+            void* pointer = buffer.first;
+            buffer = {nullptr, 0};
+            CHECK_CUDA(cudaFree(pointer));
+        }
+    }
+}
+
+void PLImg::cuda::raw::discardScratch() {
+    scratchBuffers.fill({nullptr, 0});
+    ++resets;
+}
+
+unsigned long long PLImg::cuda::raw::deviceGeneration() {
+    return resets;
+}
+
+size_t PLImg::cuda::raw::scratchSize() {
+    size_t size = 0;
+    for(const std::pair<void*, size_t>& buffer : scratchBuffers) {
+        size += buffer.second;
+    }
+    return size;
+}
+
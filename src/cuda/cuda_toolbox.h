@@ -55,6 +55,12 @@ namespace PLImg::cuda::raw {
          * @return
          */
         void CUDAmedianFilter(cv::Mat& image, cv::Mat& result);
+        /**
+         * @brief Apply the median filter to an image which is already stored on the GPU
+         * @param deviceImage Image on the GPU with the same dimensions as the result
+         * @param result Padded result
+         */
+        void CUDAmedianFilter(const float* deviceImage, cv::Mat& result);
         /**
          * @brief CUDAmedianFilterMasked
          * @param image
@@ -62,9 +68,66 @@ namespace PLImg::cuda::raw {
          * @return
          */
         void CUDAmedianFilterMasked(cv::Mat& image, cv::Mat& mask, cv::Mat& result);
+        /**
+         * @brief Apply the masked median filter to an image which is already stored on the GPU
+         * @param deviceImage Image on the GPU with the same dimensions as the mask and the result
+         * @param mask Padded mask
+         * @param result Padded result
+         */
+        void CUDAmedianFilterMasked(const float* deviceImage, cv::Mat& mask, cv::Mat& result);
     }
 
     cv::Mat CUDAhistogram(const cv::Mat& image, float minLabel, float maxLabel, uint numBins);
+
+    /**
+     * The median filters and histograms use up to three device buffers per call. Allocating them takes a
+     * noticeable part of the runtime for small chunks. With keepScratch(true) the buffers are kept after each call and
+     * are only reallocated if a larger buffer is needed. Requires the GPU lock.
+     * @brief Get a device buffer with at least the given size
+     * @param slot Index of the buffer. Buffers used at the same time need different slots.
+     * @param bytes Minimal size of the buffer
+     * @return Device pointer
+     */
+    void* scratch(unsigned slot, size_t bytes);
+    /**
+     * @brief Free all scratch buffers unless they are kept. Called at the end of each function using scratch().
+     */
+    void recycleScratch();
+    /**
+     * @brief Keep the scratch buffers between the calls. The default frees them after each call.
+     * @param keep True to keep the buffers
+     */
+    void keepScratch(bool keep);
+    /**
+     * @brief Free all scratch buffers
+     */
+    void releaseScratch();
+    /**
+     * @brief Forget all scratch buffers without freeing them, e.g. after cudaDeviceReset() freed them already
+     */
+    void discardScratch();
+    /**
+     * @brief Size of all scratch buffers in bytes. This memory is available for the next call.
+     */
+    size_t scratchSize();
+    /**
+     * CHECK_CUDA resets the device after each error, which frees all device memory. Memory which is kept on the GPU
+     * over several calls is only valid as long as the generation doesn't change.
+     * @brief Number of device resets since the start of the program
+     */
+    unsigned long long deviceGeneration();
+    /**
+     * @brief Copy a 32-bit floating point image to a new buffer on the GPU
+     * @param image Continuous image
+     * @return Device pointer which has to be freed with freeImage()
+     */
+    float* uploadImage(const cv::Mat& image);
+    /**
+     * @brief Free an image of uploadImage() unless the device was reset in the meantime
+     * @param deviceImage Device pointer returned by uploadImage()
+     * @param generation deviceGeneration() when the image was uploaded
+     */
+    void freeImage(float* deviceImage, unsigned long long generation);
 }
 
 
@@ -5,11 +5,16 @@
 #ifndef PLIMIG_DEFINE_H
 #define PLIMIG_DEFINE_H
 
+namespace PLImg::cuda::raw {
+    void discardScratch();
+}
+
 #define CHECK_CUDA(S) do { \
     cudaError_t e = S; \
     if (e != cudaSuccess) { \
         fprintf(stderr, "CUDA error at %s:%d: %d\n", __FILE__, __LINE__, e); \
         cudaDeviceReset(); \
+        PLImg::cuda::raw::discardScratch(); \
         if(e == cudaErrorMemoryAllocation) { \
             throw PLImg::GPUOutOfMemoryException(); \
         } else { \
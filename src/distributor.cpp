@@ -0,0 +1,242 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Forschungszentrum Jülich / Jan André Reuter.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "distributor.h"
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <map>
+#include <sstream>
+
+namespace {
+    #ifdef PLIMG_USE_MPI
+    /// Tag of a worker asking for its next section
+    constexpr int SECTION_REQUEST_TAG = 4201;
+    /// Tag of the master answering with a section index
+    constexpr int SECTION_ASSIGNMENT_TAG = 4202;
+
+    void appendReport(std::string& buffer, const PLImg::SectionReport& report) {
+        buffer.append(reinterpret_cast<const char*>(&report.section), sizeof(report.section));
+        buffer.append(reinterpret_cast<const char*>(&report.rank), sizeof(report.rank));
+        buffer.append(reinterpret_cast<const char*>(&report.seconds), sizeof(report.seconds));
+        unsigned long long length = report.error.size();
+        buffer.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        buffer.append(report.error);
+    }
+
+    PLImg::SectionReport readReport(const std::string& buffer, size_t& position) {
+        PLImg::SectionReport report;
+        std::memcpy(&report.section, buffer.data() + position, sizeof(report.section));
+        position += sizeof(report.section);
+        std::memcpy(&report.rank, buffer.data() + position, sizeof(report.rank));
+        position += sizeof(report.rank);
+        std::memcpy(&report.seconds, buffer.data() + position, sizeof(report.seconds));
+        position += sizeof(report.seconds);
+        unsigned long long length;
+        std::memcpy(&length, buffer.data() + position, sizeof(length));
+        position += sizeof(length);
+        report.error = buffer.substr(position, length);
+        position += length;
+        return report;
+    }
+    #endif
+}
+
+#ifdef PLIMG_USE_MPI
+PLImg::SectionDistributor::SectionDistributor(unsigned long long sections, MPI_Comm communicator) :
+        m_communicator(communicator), m_sections(sections), m_nextSection(0), m_exhausted(false) {}
+#else
+PLImg::SectionDistributor::SectionDistributor(unsigned long long sections) :
+        m_sections(sections), m_nextSection(0), m_exhausted(false) {}
+#endif
+
+int PLImg::SectionDistributor::rank() const {
+    #ifdef PLIMG_USE_MPI
+        int rank;
+        MPI_Comm_rank(m_communicator, &rank);
+        return rank;
+    #else
+        return 0;
+    #endif
+}
+
+int PLImg::SectionDistributor::size() const {
+    #ifdef PLIMG_USE_MPI
+        int size;
+        MPI_Comm_size(m_communicator, &size);
+        return size;
+    #else
+        return 1;
+    #endif
+}
+
+int PLImg::SectionDistributor::localSize(bool excludeMaster) const {
+    #ifdef PLIMG_USE_MPI
+        MPI_Comm local;
+        MPI_Comm_split_type(m_communicator, MPI_COMM_TYPE_SHARED, rank(), MPI_INFO_NULL, &local);
+        int size;
+        MPI_Comm_size(local, &size);
+        if(excludeMaster) {
+            int isMaster = master() ? 1 : 0;
+            int masters;
+            MPI_Allreduce(&isMaster, &masters, 1, MPI_INT, MPI_SUM, local);
+            size -= masters;
+        }
+        MPI_Comm_free(&local);
+        return size;
+    #else
+        (void) excludeMaster;
+        return 1;
+    #endif
+}
+
+bool PLImg::SectionDistributor::master() const {
+    return rank() == 0 && size() > 1;
+}
+
+void PLImg::SectionDistributor::serve() {
+    #ifdef PLIMG_USE_MPI
+        if(!master()) {
+            return;
+        }
+        int finishedWorkers = 0;
+        while(finishedWorkers < size() - 1) {
+            int request;
+            MPI_Status status;
+            MPI_Recv(&request, 1, MPI_INT, MPI_ANY_SOURCE, SECTION_REQUEST_TAG, m_communicator, &status);
+            long long section = -1;
+            if(m_nextSection < m_sections) {
+                section = (long long) m_nextSection++;
+            } else {
+                ++finishedWorkers;
+            }
+            MPI_Send(&section, 1, MPI_LONG_LONG, status.MPI_SOURCE, SECTION_ASSIGNMENT_TAG, m_communicator);
+        }
+    #endif
+}
+
+long long PLImg::SectionDistributor::next() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_exhausted) {
+        return -1;
+    }
+    long long section = -1;
+    if(size() > 1) {
+        #ifdef PLIMG_USE_MPI
+            int request = 0;
+            MPI_Send(&request, 1, MPI_INT, 0, SECTION_REQUEST_TAG, m_communicator);
+            MPI_Recv(&section, 1, MPI_LONG_LONG, 0, SECTION_ASSIGNMENT_TAG, m_communicator, MPI_STATUS_IGNORE);
+        #endif
+    } else if(m_nextSection < m_sections) {
+        section = (long long) m_nextSection++;
+    }
+    m_exhausted = section < 0;
+    return section;
+}
+
+void PLImg::SectionDistributor::report(long long section, double seconds, const std::string& error) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    SectionReport report;
+    report.section = section;
+    report.rank = rank();
+    report.seconds = seconds;
+    report.error = error;
+    m_reports.push_back(report);
+}
+
+std::vector<PLImg::SectionReport> PLImg::SectionDistributor::gather() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<SectionReport> reports;
+    #ifdef PLIMG_USE_MPI
+        std::string buffer;
+        for(const SectionReport& report : m_reports) {
+            appendReport(buffer, report);
+        }
+        int length = int(buffer.size());
+        std::vector<int> lengths(size());
+        MPI_Gather(&length, 1, MPI_INT, lengths.data(), 1, MPI_INT, 0, m_communicator);
+        std::vector<int> displacements(size(), 0);
+        for(int i = 1; i < size(); ++i) {
+            displacements.at(i) = displacements.at(i - 1) + lengths.at(i - 1);
+        }
+        std::string received;
+        if(rank() == 0) {
+            received.resize(displacements.back() + lengths.back());
+        }
+        MPI_Gatherv(buffer.data(), length, MPI_CHAR, &received[0], lengths.data(), displacements.data(),
+                    MPI_CHAR, 0, m_communicator);
+        if(rank() != 0) {
+            return m_reports;
+        }
+        size_t position = 0;
+        while(position < received.size()) {
+            reports.push_back(readReport(received, position));
+        }
+    #else
+        reports = m_reports;
+    #endif
+    std::sort(reports.begin(), reports.end(), [](const SectionReport& a, const SectionReport& b) {
+        return a.section < b.section;
+    });
+    return reports;
+}
+
+std::string PLImg::SectionDistributor::summary(const std::vector<SectionReport>& reports,
+                                               const std::vector<std::string>& names) {
+    struct RankSummary {
+        unsigned sections = 0;
+        unsigned failures = 0;
+        double seconds = 0;
+    };
+    std::map<int, RankSummary> ranks;
+    for(const SectionReport& report : reports) {
+        RankSummary& rank = ranks[report.rank];
+        ++rank.sections;
+        rank.failures += !report.error.empty();
+        rank.seconds += report.seconds;
+    }
+
+    std::stringstream stream;
+    stream << std::fixed << std::setprecision(1);
+    unsigned failures = 0;
+    for(const auto& rank : ranks) {
+        stream << "Rank " << rank.first << ": " << rank.second.sections << " sections in " << rank.second.seconds << " s";
+        if(rank.second.failures > 0) {
+            stream << ", " << rank.second.failures << " failed";
+        }
+        stream << std::endl;
+        failures += rank.second.failures;
+    }
+    stream << reports.size() - failures << " of " << reports.size() << " sections were processed successfully" << std::endl;
+    for(const SectionReport& report : reports) {
+        if(!report.error.empty()) {
+            stream << "Section " << report.section;
+            if(report.section >= 0 && (unsigned long long) report.section < names.size()) {
+                stream << " (" << names.at(report.section) << ")";
+            }
+            stream << " failed on rank " << report.rank << ": " << report.error << std::endl;
+        }
+    }
+    return stream.str();
+}
@@ -0,0 +1,159 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Forschungszentrum Jülich / Jan André Reuter.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef PLIMG_DISTRIBUTOR_H
+#define PLIMG_DISTRIBUTOR_H
+
+#include <mutex>
+#include <string>
+#include <vector>
+#ifdef PLIMG_USE_MPI
+    #include <mpi.h>
+#endif
+
+/**
+ * @file
+ * @brief PLImg::SectionDistributor class
+ */
+namespace PLImg {
+    /**
+     * @brief Runtime and result of a single processed section
+     */
+    struct SectionReport {
+        /// Index of the section
+        long long section = -1;
+        /// Rank which processed the section
+        int rank = 0;
+        /// Processing time in seconds
+        double seconds = 0;
+        /// Error message. Empty if the section was processed successfully.
+        std::string error;
+    };
+
+    /**
+     * Sections differ in size and in the amount of tissue, so a static assignment of sections to processes leaves
+     * processes idle while others still work on large sections. The SectionDistributor hands out sections on demand.
+     * With more than one MPI process, rank 0 is the master which only answers the requests of all other ranks in serve().
+     * The workers retrieve the next unprocessed section with next() until it returns -1. Without MPI or with a single process,
+     * next() returns all sections in order.
+     *
+     * Independent of the distribution, each process records the runtime and errors of its sections with report().
+     * gather() collects the reports of all ranks on rank 0.
+     * @brief Dynamic master/worker distribution of sections over MPI processes
+     */
+    class SectionDistributor {
+    public:
+        #ifdef PLIMG_USE_MPI
+        /**
+         * @brief Create a distributor for all ranks of the communicator. MPI has to be initialized before.
+         * @param sections Number of sections which will be distributed
+         * @param communicator Ranks which process the sections together
+         */
+        explicit SectionDistributor(unsigned long long sections, MPI_Comm communicator = MPI_COMM_WORLD);
+        #else
+        /**
+         * @brief Create a distributor for a single process
+         * @param sections Number of sections which will be distributed
+         */
+        explicit SectionDistributor(unsigned long long sections);
+        #endif
+
+        /**
+         * @brief Rank of this process in the communicator. Always 0 without MPI.
+         * @return Rank of this process
+         */
+        int rank() const;
+        /**
+         * @brief Number of processes in the communicator. Always 1 without MPI.
+         * @return Number of processes
+         */
+        int size() const;
+        /**
+         * Processes on the same node share its cores. The thread budget of each process should be divided accordingly.
+         * Collective over all ranks of the communicator.
+         * @brief Number of processes of the communicator running on the node of this process
+         * @param excludeMaster Don't count the master, e.g. because it only distributes the sections with serve()
+         * @return Number of processes on this node. Always 1 without MPI.
+         */
+        int localSize(bool excludeMaster = false) const;
+        /**
+         * @brief Check if this process only distributes the sections
+         * @return True for rank 0 if more than one process is used
+         */
+        bool master() const;
+
+        /**
+         * Answer the requests of all workers until every worker was told that no sections are left.
+         * Has to be called by the master only.
+         * @brief Distribute all sections to the workers
+         */
+        void serve();
+        /**
+         * Retrieve the next section which wasn't processed by any rank yet. Once -1 was returned, all further calls return -1
+         * without communication. This method is thread safe.
+         * @brief Get the next section of this worker
+         * @return Index of the section or -1 if all sections were distributed
+         */
+        long long next();
+
+        /**
+         * @brief Record the runtime and the result of a section processed by this rank. This method is thread safe.
+         * @param section Index of the section
+         * @param seconds Processing time in seconds
+         * @param error Error message. Empty if the section was processed successfully.
+         */
+        void report(long long section, double seconds, const std::string& error = "");
+        /**
+         * Collective over all ranks of the communicator.
+         * @brief Collect the reports of all ranks on rank 0
+         * @return Reports of all ranks sorted by section on rank 0. The reports of this rank on all other ranks.
+         */
+        std::vector<SectionReport> gather();
+
+        /**
+         * @brief Summarize the reports per rank and list all failed sections
+         * @param reports Reports from gather()
+         * @param names Optional names of the sections, e.g. the input files, used for the failed sections
+         * @return Human readable summary
+         */
+        static std::string summary(const std::vector<SectionReport>& reports, const std::vector<std::string>& names = {});
+
+    private:
+        #ifdef PLIMG_USE_MPI
+        MPI_Comm m_communicator;
+        #endif
+        /// Number of sections which will be distributed
+        unsigned long long m_sections;
+        /// Next section if no master is used
+        unsigned long long m_nextSection;
+        /// True after next() returned -1
+        bool m_exhausted;
+        /// Reports of the sections processed by this rank
+        std::vector<SectionReport> m_reports;
+        /// Serializes the calls of next() and report() from concurrently processed sections
+        std::mutex m_mutex;
+    };
+}
+
+#endif //PLIMG_DISTRIBUTOR_H
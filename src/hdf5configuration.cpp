@@ -0,0 +1,257 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Forschungszentrum Jülich / Jan André Reuter.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "hdf5configuration.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+
+namespace {
+    std::mutex& configurationMutex() {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    PLImg::HDF5Configuration& globalConfiguration() {
+        // Programs report invalid environment variables when parsing their command line. The global configuration
+        // is also used by programs which don't, and must not throw when it's initialized.
+        static PLImg::HDF5Configuration configuration = []() {
+            try {
+                return PLImg::HDF5Configuration::fromEnvironment();
+            } catch(const std::invalid_argument& e) {
+                std::cerr << e.what() << ". Using the default HDF5 configuration." << std::endl;
+                return PLImg::HDF5Configuration();
+            }
+        }();
+        return configuration;
+    }
+
+    void readEnvironmentSize(const char* name, unsigned long long& value) {
+        const char* environment = std::getenv(name);
+        if(environment && *environment) {
+            try {
+                value = PLImg::HDF5Configuration::parseSize(environment);
+            } catch(const std::invalid_argument& e) {
+                throw std::invalid_argument(std::string(e.what()) + " in " + name);
+            }
+        }
+    }
+}
+
+PLImg::HDF5Configuration PLImg::HDF5Configuration::fromEnvironment() {
+    HDF5Configuration configuration;
+    readEnvironmentSize("PLIMG_HDF5_CHUNK_CACHE_SIZE", configuration.chunkCacheSize);
+    readEnvironmentSize("PLIMG_HDF5_CHUNK_CACHE_SLOTS", configuration.chunkCacheSlots);
+    readEnvironmentSize("PLIMG_HDF5_METADATA_CACHE_SIZE", configuration.metadataCacheSize);
+    readEnvironmentSize("PLIMG_HDF5_ALIGNMENT", configuration.alignment);
+    readEnvironmentSize("PLIMG_HDF5_ALIGNMENT_THRESHOLD", configuration.alignmentThreshold);
+    readEnvironmentSize("PLIMG_HDF5_PAGE_BUFFER_SIZE", configuration.pageBufferSize);
+    const char* driver = std::getenv("PLIMG_HDF5_DRIVER");
+    if(driver && *driver) {
+        configuration.driver = driver;
+    }
+    const char* allocTime = std::getenv("PLIMG_HDF5_ALLOC_TIME");
+    if(allocTime && *allocTime) {
+        configuration.allocTime = allocTime;
+    }
+    const char* fillTime = std::getenv("PLIMG_HDF5_FILL_TIME");
+    if(fillTime && *fillTime) {
+        configuration.fillTime = fillTime;
+    }
+    return configuration;
+}
+
+PLImg::HDF5Configuration PLImg::HDF5Configuration::global() {
+    std::lock_guard<std::mutex> lock(configurationMutex());
+    return globalConfiguration();
+}
+
+void PLImg::HDF5Configuration::setGlobal(const HDF5Configuration& configuration) {
+    std::lock_guard<std::mutex> lock(configurationMutex());
+    globalConfiguration() = configuration;
+}
+
+hid_t PLImg::HDF5Configuration::fileAccessPropertyList(bool pageBuffer) const {
+    hid_t fapl = H5Pcreate(H5P_FILE_ACCESS);
+
+    if(driver == "core") {
+        // Keep the whole file in memory and write it to disk when the file is closed
+        H5Pset_fapl_core(fapl, 64 * 1024 * 1024, true);
+    } else if(driver == "direct") {
+        #ifdef H5_HAVE_DIRECT
+            H5Pset_fapl_direct(fapl, 4096, 4096, 16 * 1024 * 1024);
+        #else
+            H5Pclose(fapl);
+            throw std::runtime_error("The HDF5 library was built without support for the direct driver.");
+        #endif
+    } else if(driver == "sec2") {
+        H5Pset_fapl_sec2(fapl);
+    } else {
+        H5Pclose(fapl);
+        throw std::invalid_argument("Unknown HDF5 driver " + driver + ". Supported drivers are sec2, core and direct.");
+    }
+
+    if(chunkCacheSize > 0 || chunkCacheSlots > 0) {
+        int metadataElements;
+        size_t slots, bytes;
+        double preemption;
+        H5Pget_cache(fapl, &metadataElements, &slots, &bytes, &preemption);
+        H5Pset_cache(fapl, metadataElements, chunkCacheSlots > 0 ? chunkCacheSlots : slots,
+                     chunkCacheSize > 0 ? chunkCacheSize : bytes, preemption);
+    }
+
+    if(metadataCacheSize > 0) {
+        H5AC_cache_config_t config;
+        config.version = H5AC__CURR_CACHE_CONFIG_VERSION;
+        H5Pget_mdc_config(fapl, &config);
+        config.set_initial_size = true;
+        config.initial_size = metadataCacheSize;
+        config.min_size = std::max<size_t>(config.min_size, metadataCacheSize);
+        config.max_size = std::max<size_t>(config.max_size, metadataCacheSize);
+        H5Pset_mdc_config(fapl, &config);
+    }
+
+    if(alignment > 1) {
+        H5Pset_alignment(fapl, alignmentThreshold, alignment);
+    }
+
+    if(pageBuffer && pageBufferSize > 0) {
+        H5Pset_page_buffer_size(fapl, pageBufferSize, 0, 0);
+    }
+    return fapl;
+}
+
+hid_t PLImg::HDF5Configuration::fileCreationPropertyList() const {
+    hid_t fcpl = H5Pcreate(H5P_FILE_CREATE);
+    // The page buffer can only be used with paged file space management
+    if(pageBufferSize > 0) {
+        H5Pset_file_space_strategy(fcpl, H5F_FSPACE_STRATEGY_PAGE, false, 1);
+        if(alignment > 1) {
+            H5Pset_file_space_page_size(fcpl, std::min(alignment, pageBufferSize));
+        }
+    }
+    return fcpl;
+}
+
+hid_t PLImg::HDF5Configuration::datasetCreationPropertyList() const {
+    hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+
+    if(allocTime == "early") {
+        H5Pset_alloc_time(dcpl, H5D_ALLOC_TIME_EARLY);
+    } else if(allocTime == "incremental") {
+        H5Pset_alloc_time(dcpl, H5D_ALLOC_TIME_INCR);
+    } else if(allocTime == "late") {
+        H5Pset_alloc_time(dcpl, H5D_ALLOC_TIME_LATE);
+    } else if(allocTime != "default") {
+        H5Pclose(dcpl);
+        throw std::invalid_argument("Unknown HDF5 allocation time " + allocTime + ". Supported values are default, early, incremental and late.");
+    }
+
+    if(fillTime == "alloc") {
+        H5Pset_fill_time(dcpl, H5D_FILL_TIME_ALLOC);
+    } else if(fillTime == "never") {
+        // Every written image covers its whole dataset. Writing fill values first only doubles the written bytes.
+        H5Pset_fill_time(dcpl, H5D_FILL_TIME_NEVER);
+    } else if(fillTime == "ifset") {
+        H5Pset_fill_time(dcpl, H5D_FILL_TIME_IFSET);
+    } else {
+        H5Pclose(dcpl);
+        throw std::invalid_argument("Unknown HDF5 fill time " + fillTime + ". Supported values are ifset, alloc and never.");
+    }
+    return dcpl;
+}
+
+hid_t PLImg::HDF5Configuration::open(const std::string& filename, unsigned flags) const {
+    hid_t fapl = fileAccessPropertyList(true);
+    hid_t file;
+    H5E_BEGIN_TRY {
+        file = H5Fopen(filename.c_str(), flags, fapl);
+    } H5E_END_TRY
+    H5Pclose(fapl);
+
+    if(file < 0 && pageBufferSize > 0) {
+        // The file was not written with paged file space management
+        fapl = fileAccessPropertyList(false);
+        H5E_BEGIN_TRY {
+            file = H5Fopen(filename.c_str(), flags, fapl);
+        } H5E_END_TRY
+        H5Pclose(fapl);
+    }
+    return file;
+}
+
+hid_t PLImg::HDF5Configuration::create(const std::string& filename) const {
+    hid_t fcpl = fileCreationPropertyList();
+    hid_t fapl = fileAccessPropertyList(true);
+    hid_t file = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, fcpl, fapl);
+    H5Pclose(fapl);
+    H5Pclose(fcpl);
+    return file;
+}
+
+unsigned long long PLImg::HDF5Configuration::parseSize(const std::string& value) {
+    // std::stoull skips whitespace and accepts signs, so that -1 would wrap around
+    if(value.empty() || !std::isdigit((unsigned char) value.front())) {
+        throw std::invalid_argument("Invalid size " + value);
+    }
+    size_t position;
+    unsigned long long size;
+    try {
+        size = std::stoull(value, &position);
+    } catch(const std::exception&) {
+        throw std::invalid_argument("Invalid size " + value);
+    }
+    std::string suffix = value.substr(position);
+    if(suffix.empty() || suffix == "B") {
+        return size;
+    }
+    if(suffix.size() > 1) {
+        throw std::invalid_argument("Invalid size " + value);
+    }
+    unsigned shift;
+    switch(suffix.at(0)) {
+        case 'k':
+        case 'K':
+            shift = 10;
+            break;
+        case 'm':
+        case 'M':
+            shift = 20;
+            break;
+        case 'g':
+        case 'G':
+            shift = 30;
+            break;
+        default:
+            throw std::invalid_argument("Invalid size " + value);
+    }
+    if(size > (std::numeric_limits<unsigned long long>::max() >> shift)) {
+        throw std::invalid_argument("Invalid size " + value);
+    }
+    return size << shift;
+}
@@ -0,0 +1,140 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Forschungszentrum Jülich / Jan André Reuter.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef PLIMG_HDF5CONFIGURATION_H
+#define PLIMG_HDF5CONFIGURATION_H
+
+#include <hdf5.h>
+#include <string>
+
+/**
+ * @file
+ * @brief PLImg::HDF5Configuration class
+ */
+namespace PLImg {
+    /**
+     * The default HDF5 file access properties use a chunk cache of 1 MiB per dataset, no alignment, no page buffer
+     * and the sec2 driver. This is a poor fit for large chunked datasets on parallel file systems. The HDF5Configuration
+     * collects all file access, file creation and dataset creation properties used by PLImg. A global configuration is applied to all files
+     * opened by PLImg::Reader and PLImg::HDF5Writer. It is initialized from the following environment variables and can be
+     * changed with setGlobal(const HDF5Configuration&), e.g. from command line parameters:
+     *
+     * | Variable | Member |
+     * | -------- | ------ |
+     * | PLIMG_HDF5_CHUNK_CACHE_SIZE | chunkCacheSize |
+     * | PLIMG_HDF5_CHUNK_CACHE_SLOTS | chunkCacheSlots |
+     * | PLIMG_HDF5_METADATA_CACHE_SIZE | metadataCacheSize |
+     * | PLIMG_HDF5_ALIGNMENT | alignment |
+     * | PLIMG_HDF5_ALIGNMENT_THRESHOLD | alignmentThreshold |
+     * | PLIMG_HDF5_PAGE_BUFFER_SIZE | pageBufferSize |
+     * | PLIMG_HDF5_DRIVER | driver |
+     * | PLIMG_HDF5_ALLOC_TIME | allocTime |
+     * | PLIMG_HDF5_FILL_TIME | fillTime |
+     *
+     * Sizes accept the suffixes K, M and G (e.g. 64M) with a base of 1024.
+     * @brief HDF5 file access and creation properties
+     */
+    class HDF5Configuration {
+    public:
+        /// Size of the chunk cache of each dataset in bytes. 0 keeps the HDF5 default.
+        unsigned long long chunkCacheSize = 0;
+        /// Number of hash table slots of the chunk cache. 0 keeps the HDF5 default.
+        unsigned long long chunkCacheSlots = 0;
+        /// Initial and minimal size of the metadata cache in bytes. 0 keeps the HDF5 default.
+        unsigned long long metadataCacheSize = 0;
+        /// Alignment of file objects in bytes. Values of 0 or 1 disable the alignment.
+        unsigned long long alignment = 0;
+        /// Only file objects with at least this size in bytes will be aligned.
+        unsigned long long alignmentThreshold = 65536;
+        /// Size of the page buffer in bytes. New files will be created with paged file space management. 0 disables the page buffer.
+        unsigned long long pageBufferSize = 0;
+        /// Virtual file driver. Supported values are sec2, core and direct.
+        std::string driver = "sec2";
+        /// Allocation time of the file space of new datasets: default, early, incremental or late. default keeps the HDF5 default of the dataset layout.
+        std::string allocTime = "default";
+        /// Time at which fill values are written to new datasets: ifset, alloc or never. With never, pixels which were not written are undefined.
+        std::string fillTime = "ifset";
+
+        /**
+         * @brief Create a configuration from the PLIMG_HDF5_* environment variables
+         * @return Configuration with all set environment variables applied
+         * @throws std::invalid_argument if a size in an environment variable is invalid
+         */
+        static HDF5Configuration fromEnvironment();
+        /**
+         * The global configuration is initialized with fromEnvironment(). If the environment variables are invalid,
+         * a warning is printed and the default configuration is used instead.
+         * @brief Get the configuration which is used for all files opened by PLImg
+         * @return Current global configuration
+         */
+        static HDF5Configuration global();
+        /**
+         * @brief Set the configuration which is used for all files opened by PLImg
+         * @param configuration New global configuration
+         */
+        static void setGlobal(const HDF5Configuration& configuration);
+
+        /**
+         * @brief Create a file access property list with all properties of this configuration.
+         * @param pageBuffer Apply the page buffer size. Files without paged file space management can't be opened with a page buffer.
+         * @return HDF5 property list which has to be closed with H5Pclose
+         */
+        hid_t fileAccessPropertyList(bool pageBuffer = true) const;
+        /**
+         * @brief Create a file creation property list with all properties of this configuration.
+         * @return HDF5 property list which has to be closed with H5Pclose
+         */
+        hid_t fileCreationPropertyList() const;
+        /**
+         * @brief Create a dataset creation property list with the allocation and fill time of this configuration.
+         * @return HDF5 property list which has to be closed with H5Pclose
+         */
+        hid_t datasetCreationPropertyList() const;
+        /**
+         * Open an existing HDF5 file with the file access properties of this configuration. If the file was not
+         * written with paged file space management, it will be opened without the page buffer.
+         * @brief Open an existing HDF5 file
+         * @param filename Path of the file
+         * @param flags H5F_ACC_RDONLY or H5F_ACC_RDWR
+         * @return HDF5 file identifier or a negative value if the file could not be opened
+         */
+        hid_t open(const std::string& filename, unsigned flags) const;
+        /**
+         * @brief Create a new HDF5 file with the file creation and access properties of this configuration.
+         * @param filename Path of the file
+         * @return HDF5 file identifier or a negative value if the file could not be created
+         */
+        hid_t create(const std::string& filename) const;
+
+        /**
+         * @brief Parse a size with an optional suffix K, M or G.
+         * @param value Size as string, e.g. 512, 64K, 16M or 1G
+         * @return Size in bytes
+         * @throws std::invalid_argument if the value isn't a non-negative integer with at most one unit or the size overflows
+         */
+        static unsigned long long parseSize(const std::string& value);
+    };
+}
+
+#endif //PLIMG_HDF5CONFIGURATION_H
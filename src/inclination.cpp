@@ -23,16 +23,78 @@
  */
 
 #include "inclination.h"
+#include <algorithm>
+#include <limits>
+
+namespace {
+    /// Largest half precision value below 90°
+    constexpr float INCLINATION_FLOAT16_BELOW_90 = 89.9375f;
+
+    /**
+     * @brief Store an inclination with the datatype of the inclination map
+     * @param inclination Inclination map of type CV_32FC1, CV_16FC1 or CV_16UC1
+     * @param idx Index of the pixel
+     * @param degrees Inclination in degree
+     */
+    inline void storeInclination(cv::Mat& inclination, unsigned long long idx, float degrees) {
+        switch(inclination.depth()) {
+            case CV_16U: {
+                // Fixed point values can't represent NaN. Those pixels get the reserved fill value.
+                long value = std::isnan(degrees) ? INCLINATION_UINT16_FILL_VALUE :
+                             std::lround(std::clamp(degrees, 0.0f, 90.0f) / INCLINATION_UINT16_SCALE);
+                // Inclinations below 90° must not be rounded up to 90°. saturation() would count them as saturated.
+                if(degrees < 90.0f) {
+                    value = std::min(value, long(INCLINATION_UINT16_FILL_VALUE) - 2);
+                }
+                ((unsigned short*) inclination.data)[idx] = (unsigned short) value;
+                break;
+            }
+            case CV_16F: {
+                // Inclinations from 89.96875° on would be rounded up to 90°, which saturation() counts as saturated
+                cv::float16_t value(std::min(degrees, 90.0f));
+                if(degrees < 90.0f && float(value) >= 90.0f) {
+                    value = cv::float16_t(INCLINATION_FLOAT16_BELOW_90);
+                }
+                ((cv::float16_t*) inclination.data)[idx] = value;
+                break;
+            }
+            default:
+                ((float*) inclination.data)[idx] = degrees;
+        }
+    }
+
+    /**
+     * @brief Load an inclination in degree from an inclination map of any supported datatype
+     * @param inclination Inclination map of type CV_32FC1, CV_16FC1 or CV_16UC1
+     * @param idx Index of the pixel
+     * @return Inclination in degree
+     */
+    inline float loadInclination(const cv::Mat& inclination, unsigned long long idx) {
+        switch(inclination.depth()) {
+            case CV_16U: {
+                // Computed in double precision so that 65534 is exactly 90°
+                unsigned short value = ((const unsigned short*) inclination.data)[idx];
+                return value == INCLINATION_UINT16_FILL_VALUE ? std::numeric_limits<float>::quiet_NaN() :
+                       float(value * 90.0 / (INCLINATION_UINT16_FILL_VALUE - 1));
+            }
+            case CV_16F:
+                return float(((const cv::float16_t*) inclination.data)[idx]);
+            default:
+                return ((const float*) inclination.data)[idx];
+        }
+    }
+}
 
 PLImg::Inclination::Inclination() : m_transmittance(), m_retardation(), m_blurredMask(), m_mask(),
                                     m_tc(nullptr), m_tm(nullptr), m_rrefhm(nullptr), m_rreflm(nullptr),
-                                    m_regionGrowingMask(nullptr) {}
+                                    m_regionGrowingMask(nullptr), m_format(InclinationFormat::Float32) {}
 
 PLImg::Inclination::Inclination(sharedMat transmittance, sharedMat retardation,
                                 sharedMat blurredMask, sharedMat mask) :
                                 m_transmittance(std::move(transmittance)), m_retardation(std::move(retardation)), m_blurredMask(std::move(blurredMask)),
                                 m_mask(std::move(mask)), m_tc(nullptr), m_tm(nullptr), m_rrefhm(nullptr),
-                                m_rreflm(nullptr), m_regionGrowingMask(nullptr), m_inclination(nullptr), m_saturation(nullptr) {}
+                                m_rreflm(nullptr), m_regionGrowingMask(nullptr), m_inclination(nullptr), m_saturation(nullptr),
+                                m_format(InclinationFormat::Float32) {}
 
 void PLImg::Inclination::setModalities(sharedMat transmittance, sharedMat retardation,
                                        sharedMat blurredMask, sharedMat mask) {
@@ -50,13 +112,13 @@ void PLImg::Inclination::setModalities(sharedMat transmittance, sharedMat retard
     m_saturation = nullptr;
 }
 
-void PLImg::Inclination::set_Tc(float ic) {
-    m_tm = std::make_unique<float>(ic);
+void PLImg::Inclination::set_Tc(float im) {
+    m_tc = std::make_unique<float>(im);
     m_inclination = nullptr;
 }
 
-void PLImg::Inclination::set_TM(float im) {
-    m_tc = std::make_unique<float>(im);
+void PLImg::Inclination::set_TM(float ic) {
+    m_tm = std::make_unique<float>(ic);
     m_inclination = nullptr;
 }
 
@@ -70,6 +132,32 @@ void PLImg::Inclination::set_RrefHM(float rmaxWhite) {
     m_inclination = nullptr;
 }
 
+void PLImg::Inclination::set_format(InclinationFormat format) {
+    m_format = format;
+    m_inclination = nullptr;
+    m_saturation = nullptr;
+}
+
+PLImg::InclinationFormat PLImg::Inclination::format() const {
+    return m_format;
+}
+
+int PLImg::Inclination::type() const {
+    switch(m_format) {
+        case InclinationFormat::Float16:
+            return CV_16FC1;
+        case InclinationFormat::UInt16:
+            return CV_16UC1;
+        case InclinationFormat::Float32:
+        default:
+            return CV_32FC1;
+    }
+}
+
+float PLImg::Inclination::scaleFactor() const {
+    return m_format == InclinationFormat::UInt16 ? INCLINATION_UINT16_SCALE : 1.0f;
+}
+
 float PLImg::Inclination::T_M() {
     if(!m_tm) {
         // ic will be calculated by taking the gray portion of the
@@ -195,7 +283,8 @@ sharedMat PLImg::Inclination::regionGrowingMask() {
 
 sharedMat PLImg::Inclination::inclination() {
     if(!m_inclination) {
-        m_inclination = std::make_shared<cv::Mat>(m_retardation->rows, m_retardation->cols, CV_32FC1);
+        // Reduced precision formats are written directly so that no full size 32-bit map is kept in memory
+        m_inclination = std::make_shared<cv::Mat>(m_retardation->rows, m_retardation->cols, type());
         float tmpVal;
         float blurredMaskVal;
         float transmittanceVal;
@@ -205,7 +294,7 @@ sharedMat PLImg::Inclination::inclination() {
         float logIcIm = logf(fmax(1e-15, T_M() / T_c()));
 
         // Get pointers from OpenCV matrices to prevent overflow errors when image is larger than UINT_MAX
-        float* inclinationPtr = (float*) m_inclination->data;
+        cv::Mat& inclinationMat = *m_inclination;
         const float* retardationPtr = (float*) m_retardation->data;
         const float* transmittancePtr = (float*) m_transmittance->data;
         const float* blurredMaskptr = (float*) m_blurredMask->data;
@@ -246,10 +335,10 @@ sharedMat PLImg::Inclination::inclination() {
                 if(tmpVal > 1.0f) {
                     tmpVal = 1.0f;
                 }
-                inclinationPtr[idx] = acosf(tmpVal) * 180.0f / M_PI;
+                storeInclination(inclinationMat, idx, acosf(tmpVal) * 180.0f / M_PI);
             // Else set inclination value to 90°
             } else {
-                inclinationPtr[idx] = 90.0f;
+                storeInclination(inclinationMat, idx, 90.0f);
             }
         }
     }
@@ -258,17 +347,17 @@ sharedMat PLImg::Inclination::inclination() {
 
 sharedMat PLImg::Inclination::saturation() {
     if(!m_saturation) {
-        m_saturation = std::make_shared<cv::Mat>(m_retardation->rows, m_retardation->cols, CV_8UC1);
+        m_saturation = std::make_shared<cv::Mat>(m_retardation->rows, m_retardation->cols, CV_8UC1, cv::Scalar(0));
         float inc_val;
 
         // Get pointers from OpenCV matrices to prevent overflow errors when image is larger than UINT_MAX
-        const float* inclinationPtr = (float*) m_inclination->data;
+        const cv::Mat& inclinationMat = *inclination();
         const float* retardationPtr = (float*) m_retardation->data;
         unsigned char* saturationPtr = (unsigned char*) m_saturation->data;
 
         #pragma omp parallel for default(shared) private(inc_val)
         for(unsigned long long idx = 0; idx < ((unsigned long long) m_inclination->rows * m_inclination->cols); ++idx) {
-            inc_val = inclinationPtr[idx];
+            inc_val = loadInclination(inclinationMat, idx);
             if((inc_val <= 0) || (inc_val >= 90)) {
                 if (inc_val <= 0) {
                    if (retardationPtr[idx] > R_refHM()) {
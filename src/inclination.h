@@ -33,11 +33,32 @@
 
 typedef std::shared_ptr<cv::Mat> sharedMat;
 
+/// Degrees per step of inclinations stored as 16-bit unsigned integers. 0° is stored as 0 and 90° as 65534.
+constexpr float INCLINATION_UINT16_SCALE = 90.0f / 65534.0f;
+/// Inclinations stored as 16-bit unsigned integers use this value for pixels without an inclination (NaN).
+constexpr unsigned short INCLINATION_UINT16_FILL_VALUE = 65535;
+
 /**
  * @file
  * @brief PLImg::Inclination class
  */
 namespace PLImg {
+    /**
+     * Inclinations are computed as 32-bit floating point values. Consumers of the inclination only need a resolution of
+     * about 0.01°, so the inclination can also be stored with half the memory and file size.
+     * @brief Datatype of the inclination map
+     */
+    enum class InclinationFormat {
+        /// 32-bit floating point degrees (CV_32FC1)
+        Float32,
+        /// 16-bit floating point degrees (CV_16FC1). The resolution is 0.06° near 90°. Inclinations below 90° are
+        /// stored as at most 89.9375°, so that rounding doesn't mark them as saturated.
+        Float16,
+        /// 16-bit unsigned fixed point values (CV_16UC1). Degrees are value * INCLINATION_UINT16_SCALE. NaN is stored as
+        /// INCLINATION_UINT16_FILL_VALUE.
+        UInt16
+    };
+
     /**
      * The class Inclination will handle the parameters as well as the generation of the inclination parameter map
      * based on 3D-PLI measurements. Needed parameter maps for this class can be generated using MaskGeneration in this library.
@@ -94,15 +115,15 @@ namespace PLImg {
         float R_refHM();
 
         /**
-         * Set the im value manually. This will reset the current inclination as it is probably different.
-         * @param im Manually set im value
+         * Set the ic value manually. This will reset the current inclination as it is probably different.
+         * @param ic Manually set ic value which will be returned by T_M()
          */
-        void set_TM(float im);
+        void set_TM(float ic);
         /**
-         * Set the ic value manually. This will reset the current inclination as it is probably different.
-         * @param ic Manually set ic value
+         * Set the im value manually. This will reset the current inclination as it is probably different.
+         * @param im Manually set im value which will be returned by T_c()
          */
-        void set_Tc(float ic);
+        void set_Tc(float im);
         /**
          * Set the rmaxGray value manually. This will reset the current inclination as it is probably different.
          * @param rmaxGray Manually set rmaxGray value
@@ -114,6 +135,29 @@ namespace PLImg {
          */
         void set_RrefHM(float rmaxWhite);
 
+        /**
+         * Set the datatype of the inclination map. This will reset the current inclination.
+         * @param format Datatype which will be returned by inclination()
+         */
+        void set_format(InclinationFormat format);
+        /**
+         * @brief Get the datatype of the inclination map
+         * @return Datatype which will be returned by inclination()
+         */
+        InclinationFormat format() const;
+        /**
+         * @brief Get the OpenCV type of the inclination map
+         * @return CV_32FC1, CV_16FC1 or CV_16UC1 depending on format()
+         */
+        int type() const;
+        /**
+         * Stored inclination values have to be multiplied with this factor to get degrees. Consumers of written
+         * inclinations can read it from the scale_factor attribute.
+         * @brief Get the scale of the stored inclination values
+         * @return INCLINATION_UINT16_SCALE for InclinationFormat::UInt16, 1 otherwise
+         */
+        float scaleFactor() const;
+
         /**
          * This method will compute the inclination values based on the given parameter maps
          * through Inclination(sharedMat transmittance, sharedMat retardation, sharedMat probabilityMask, sharedMat whiteMask, sharedMat grayMask)
@@ -141,8 +185,9 @@ namespace PLImg {
          *                      }
          * \f]
          * Invalid values for the \f$\cos^{-1}\f$ are correted so that they will return either 0 or 1.
-         * The calculated inclination values are finally converted to degree.
-         * @return Shared pointer of a OpenCV matrix containing the inclination values for each pixel in degree.
+         * The calculated inclination values are finally converted to degree and stored with the datatype selected by
+         * set_format(InclinationFormat).
+         * @return Shared pointer of a OpenCV matrix containing the inclination values for each pixel in degree or in steps of scaleFactor().
          */
         sharedMat inclination();
         /**
@@ -173,6 +218,8 @@ namespace PLImg {
         sharedMat m_transmittance, m_retardation, m_inclination, m_saturation;
         ///
         sharedMat m_blurredMask, m_mask;
+        /// Datatype of m_inclination
+        InclinationFormat m_format;
 
     };
 }
@@ -46,6 +46,8 @@ PLImg::MaskGeneration::MaskGeneration(std::shared_ptr<cv::Mat> retardation, std:
 void PLImg::MaskGeneration::setModalities(std::shared_ptr<cv::Mat> retardation, std::shared_ptr<cv::Mat> transmittance) {
     this->m_retardation = std::move(retardation);
     this->m_transmittance = std::move(transmittance);
+    this->m_retardationStatistics = ImageStatistics();
+    this->m_transmittanceStatistics = ImageStatistics();
     resetParameters();
 
     if(m_transmittance) {
@@ -64,11 +66,176 @@ void PLImg::MaskGeneration::setModalities(std::shared_ptr<cv::Mat> retardation,
     }
 }
 
+void PLImg::MaskGeneration::setModalities(std::shared_ptr<cv::Mat> retardation, std::shared_ptr<cv::Mat> transmittance,
+                                          const ImageStatistics& retardationStatistics,
+                                          const ImageStatistics& transmittanceStatistics) {
+    this->m_retardation = std::move(retardation);
+    this->m_transmittance = std::move(transmittance);
+    resetParameters();
+
+    // The histograms will be changed when removing the background. Don't change the histograms of the caller.
+    // Missing statistics are calculated here, as the value ranges are only taken from the statistics.
+    auto copyStatistics = [](const std::shared_ptr<cv::Mat>& image, const ImageStatistics& statistics,
+                             const std::string& modality) {
+        ImageStatistics result;
+        if(!statistics.empty()) {
+            result = statistics;
+            result.histogram = statistics.histogram.clone();
+        } else if(image) {
+            PLImg::Reader::convert(*image, result);
+        } else {
+            throw std::invalid_argument("The " + modality + " has neither an image nor statistics");
+        }
+        return result;
+    };
+    this->m_retardationStatistics = copyStatistics(m_retardation, retardationStatistics, "retardation");
+    this->m_transmittanceStatistics = copyStatistics(m_transmittance, transmittanceStatistics, "transmittance");
+
+    m_minTransmittance = fmax(m_transmittanceStatistics.min, 0.0f);
+    m_maxTransmittance = m_transmittanceStatistics.max;
+    m_minRetardation = fmax(m_retardationStatistics.min, 0.0f);
+    m_maxRetardation = m_retardationStatistics.max;
+}
+
 void PLImg::MaskGeneration::resetParameters() {
     this->m_tref = nullptr;
     this->m_tback = nullptr;
     this->m_rthres = nullptr;
     this->m_tthres = nullptr;
+    this->m_rplus = nullptr;
+    this->m_rminus = nullptr;
+    this->m_tplus = nullptr;
+    this->m_tminus = nullptr;
+    this->m_whiteMask = nullptr;
+    this->m_grayMask = nullptr;
+    this->m_fullMask = nullptr;
+    this->m_probabilityMask = nullptr;
+}
+
+void PLImg::MaskGeneration::releaseModalities() {
+    this->m_retardation = nullptr;
+    this->m_transmittance = nullptr;
+    this->m_retardationStatistics = ImageStatistics();
+    this->m_transmittanceStatistics = ImageStatistics();
+    this->m_whiteMask = nullptr;
+    this->m_grayMask = nullptr;
+}
+
+void PLImg::MaskGeneration::estimateParameters(const std::shared_ptr<cv::Mat>& retardation,
+                                               const std::shared_ptr<cv::Mat>& transmittance) {
+    ImageStatistics retardationStatistics, transmittanceStatistics;
+    auto subsampledRetardation = std::make_shared<cv::Mat>(Reader::convert(*retardation, retardationStatistics));
+    auto subsampledTransmittance = std::make_shared<cv::Mat>(Reader::convert(*transmittance, transmittanceStatistics));
+
+    MaskGeneration generation;
+    generation.setModalities(subsampledRetardation, subsampledTransmittance, retardationStatistics, transmittanceStatistics);
+    generation.set_prior(m_priorTback ? *m_priorTback : -1.0f, m_priorRthres ? *m_priorRthres : -1.0f);
+    // Keep manually set parameters
+    if(m_tback) {
+        generation.set_tback(*m_tback);
+    }
+    if(m_tref) {
+        generation.set_tref(*m_tref);
+    }
+    if(m_rthres) {
+        generation.set_rthres(*m_rthres);
+    }
+    if(m_tthres) {
+        generation.set_tthres(*m_tthres);
+    }
+    generation.removeBackground();
+
+    set_tback(generation.T_back());
+    set_tref(generation.T_ref());
+    set_rthres(generation.R_thres());
+    set_tthres(generation.T_thres());
+    this->m_whiteMask = nullptr;
+    this->m_grayMask = nullptr;
+    this->m_fullMask = nullptr;
+    this->m_probabilityMask = nullptr;
+}
+
+void PLImg::MaskGeneration::estimateParameters(const std::vector<std::shared_ptr<cv::Mat>>& retardations,
+                                               const std::vector<std::shared_ptr<cv::Mat>>& transmittances) {
+    if(retardations.empty() || retardations.size() != transmittances.size()) {
+        throw std::invalid_argument("Each section needs a retardation and a transmittance");
+    }
+    unsigned long long numberOfPixels = 0;
+    for(size_t i = 0; i < retardations.size(); ++i) {
+        if(retardations.at(i)->size() != transmittances.at(i)->size()) {
+            throw std::invalid_argument("Retardation and transmittance of a section differ in size");
+        }
+        numberOfPixels += retardations.at(i)->total();
+    }
+    if(numberOfPixels == 0) {
+        throw std::invalid_argument("The sections contain no pixels");
+    }
+
+    // The histograms don't depend on the position of the pixels. The pixels of all sections are arranged in a nearly
+    // square image, so that the bootstrap can draw halves of both dimensions. Less than one row of pixels is dropped.
+    int cols = int(std::ceil(std::sqrt(double(numberOfPixels))));
+    int rows = int(numberOfPixels / cols);
+    cv::Mat combinedRetardation(rows, cols, CV_32FC1), combinedTransmittance(rows, cols, CV_32FC1);
+    auto* retardationPtr = (float*) combinedRetardation.data;
+    auto* transmittancePtr = (float*) combinedTransmittance.data;
+    unsigned long long position = 0;
+    const unsigned long long combinedPixels = (unsigned long long) rows * cols;
+    for(size_t i = 0; i < retardations.size() && position < combinedPixels; ++i) {
+        cv::Mat retardation, transmittance;
+        retardations.at(i)->convertTo(retardation, CV_32FC1);
+        transmittances.at(i)->convertTo(transmittance, CV_32FC1);
+        for(int row = 0; row < retardation.rows && position < combinedPixels; ++row) {
+            auto length = (unsigned long long) std::min<unsigned long long>(retardation.cols, combinedPixels - position);
+            std::copy_n(retardation.ptr<float>(row), length, retardationPtr + position);
+            std::copy_n(transmittance.ptr<float>(row), length, transmittancePtr + position);
+            position += length;
+        }
+    }
+
+    ImageStatistics retardationStatistics, transmittanceStatistics;
+    auto sampledRetardation = std::make_shared<cv::Mat>(Reader::convert(combinedRetardation, retardationStatistics));
+    auto sampledTransmittance = std::make_shared<cv::Mat>(Reader::convert(combinedTransmittance, transmittanceStatistics));
+    MaskGeneration generation;
+    generation.setModalities(sampledRetardation, sampledTransmittance, retardationStatistics, transmittanceStatistics);
+    generation.set_prior(m_priorTback ? *m_priorTback : -1.0f, m_priorRthres ? *m_priorRthres : -1.0f);
+    // Keep manually set parameters
+    if(m_tback) {
+        generation.set_tback(*m_tback);
+    }
+    if(m_rthres) {
+        generation.set_rthres(*m_rthres);
+    }
+    if(m_tthres) {
+        generation.set_tthres(*m_tthres);
+    }
+    if(m_tref) {
+        generation.set_tref(*m_tref);
+    } else {
+        // Mean of the largest connected component of each section, weighted by the size of the components
+        const float tback = generation.T_back();
+        double sum = 0;
+        unsigned long long count = 0;
+        for(size_t i = 0; i < retardations.size(); ++i) {
+            cv::Mat retardation, transmittance;
+            retardations.at(i)->convertTo(retardation, CV_32FC1);
+            transmittances.at(i)->convertTo(transmittance, CV_32FC1);
+            cv::Mat backgroundMask = retardation > 0 & transmittance > 0 & transmittance < tback;
+            cv::Mat mask = cuda::labeling::largestAreaConnectedComponents(retardation, backgroundMask);
+            int componentPixels = cv::countNonZero(mask);
+            if(componentPixels > 0) {
+                sum += cv::mean(transmittance, mask)[0] * componentPixels;
+                count += componentPixels;
+            }
+        }
+        generation.set_tref(count > 0 ? float(sum / count) : 0.0f);
+    }
+    generation.removeBackground();
+
+    set_tback(generation.T_back());
+    set_tref(generation.T_ref());
+    set_rthres(generation.R_thres());
+    set_tthres(generation.T_thres());
+    set_probability_parameters(generation.R_plus(), generation.R_minus(), generation.T_plus(), generation.T_minus());
     this->m_whiteMask = nullptr;
     this->m_grayMask = nullptr;
     this->m_fullMask = nullptr;
@@ -77,8 +244,91 @@ void PLImg::MaskGeneration::resetParameters() {
 
 void PLImg::MaskGeneration::removeBackground() {
     auto transmittanceThreshold = this->T_back();
-    m_transmittance->setTo(m_maxTransmittance, *m_transmittance > transmittanceThreshold);
-    m_retardation->setTo(m_minRetardation, *m_transmittance > transmittanceThreshold);
+    if(m_transmittanceStatistics.empty() || m_retardationStatistics.empty()) {
+        m_transmittance->setTo(m_maxTransmittance, *m_transmittance > transmittanceThreshold);
+        m_retardation->setTo(m_minRetardation, *m_transmittance > transmittanceThreshold);
+        m_transmittanceStatistics = ImageStatistics();
+        m_retardationStatistics = ImageStatistics();
+        return;
+    }
+
+    // Remove the background and update the histograms of both statistics in the same pass.
+    const auto transmittanceValue = float(m_maxTransmittance);
+    const auto retardationValue = float(m_minRetardation);
+    const int transmittanceBin = m_transmittanceStatistics.bin(transmittanceValue);
+    const int retardationBin = m_retardationStatistics.bin(retardationValue);
+
+    // Get pointers from OpenCV matrices to prevent overflow errors when image is larger than UINT_MAX
+    float* transmittancePtr = (float*) m_transmittance->data;
+    float* retardationPtr = (float*) m_retardation->data;
+    int* transmittanceHistogramPtr = (int*) m_transmittanceStatistics.histogram.data;
+    int* retardationHistogramPtr = (int*) m_retardationStatistics.histogram.data;
+    long long transmittanceNonZero = 0;
+    long long retardationNonZero = 0;
+
+    #pragma omp parallel default(shared) reduction(+ : transmittanceNonZero, retardationNonZero)
+    {
+        std::vector<int> transmittanceDelta(STATISTICS_NUMBER_OF_BINS, 0);
+        std::vector<int> retardationDelta(STATISTICS_NUMBER_OF_BINS, 0);
+        int bin;
+
+        #pragma omp for schedule(static)
+        for(unsigned long long idx = 0; idx < ((unsigned long long) m_transmittance->rows * m_transmittance->cols); ++idx) {
+            if(transmittancePtr[idx] > transmittanceThreshold) {
+                bin = m_transmittanceStatistics.bin(transmittancePtr[idx]);
+                if(bin >= 0) --transmittanceDelta[bin];
+                if(transmittanceBin >= 0) ++transmittanceDelta[transmittanceBin];
+                transmittanceNonZero += (transmittanceValue != 0.0f) - (transmittancePtr[idx] != 0.0f);
+                transmittancePtr[idx] = transmittanceValue;
+
+                bin = m_retardationStatistics.bin(retardationPtr[idx]);
+                if(bin >= 0) --retardationDelta[bin];
+                if(retardationBin >= 0) ++retardationDelta[retardationBin];
+                retardationNonZero += (retardationValue != 0.0f) - (retardationPtr[idx] != 0.0f);
+                retardationPtr[idx] = retardationValue;
+            }
+        }
+
+        #pragma omp critical
+        for(bin = 0; bin < STATISTICS_NUMBER_OF_BINS; ++bin) {
+            transmittanceHistogramPtr[bin] += transmittanceDelta[bin];
+            retardationHistogramPtr[bin] += retardationDelta[bin];
+        }
+    }
+    m_transmittanceStatistics.nonZero += transmittanceNonZero;
+    m_retardationStatistics.nonZero += retardationNonZero;
+}
+
+cv::Mat PLImg::MaskGeneration::histogram(const std::shared_ptr<cv::Mat>& image, const ImageStatistics& statistics,
+                                         float minLabel, float maxLabel, uint numBins) {
+    if(!statistics.empty() && statistics.max > statistics.min) {
+        // Check if the requested range starts and ends at a bin border of the fine histogram and if the
+        // number of fine bins in the range is a multiple of the requested number of bins.
+        const double fineBinWidth = (statistics.max - statistics.min) / double(STATISTICS_NUMBER_OF_BINS);
+        const double startBin = (double(minLabel) - statistics.min) / fineBinWidth;
+        const double endBin = (double(maxLabel) - statistics.min) / fineBinWidth;
+        const long long roundedStartBin = std::llround(startBin);
+        const long long roundedEndBin = std::llround(endBin);
+        const bool aligned = std::abs(startBin - double(roundedStartBin)) < 1e-2 &&
+                             std::abs(endBin - double(roundedEndBin)) < 1e-2;
+        // An offset like minimum + 1e-15 is used to ignore zeros. Those can be removed through the number of non zero pixels.
+        const bool excludesZeros = roundedStartBin == 0 && statistics.min == 0 && minLabel > 0;
+        const bool validStart = roundedStartBin > 0 || minLabel == float(statistics.min) || excludesZeros;
+
+        if(aligned && validStart && roundedStartBin >= 0 && roundedEndBin <= STATISTICS_NUMBER_OF_BINS &&
+           roundedEndBin > roundedStartBin && (roundedEndBin - roundedStartBin) % numBins == 0) {
+            const long long binsPerBin = (roundedEndBin - roundedStartBin) / numBins;
+            cv::Mat hist = cv::Mat::zeros(numBins, 1, CV_32SC1);
+            for(long long bin = roundedStartBin; bin < roundedEndBin; ++bin) {
+                hist.at<int>((bin - roundedStartBin) / binsPerBin) += statistics.histogram.at<int>(bin);
+            }
+            if(excludesZeros) {
+                hist.at<int>(0) -= int(image->total() - statistics.nonZero);
+            }
+            return hist;
+        }
+    }
+    return PLImg::cuda::histogram(*image, minLabel, maxLabel, numBins);
 }
 
 void PLImg::MaskGeneration::set_tback(float tMax) {
@@ -97,12 +347,37 @@ void PLImg::MaskGeneration::set_tthres(float tTra) {
     this->m_tthres = std::make_unique<float>(tTra);
 }
 
+void PLImg::MaskGeneration::set_prior(float t_back, float r_thres) {
+    this->m_priorTback = t_back >= 0 ? std::make_unique<float>(t_back) : nullptr;
+    this->m_priorRthres = r_thres >= 0 ? std::make_unique<float>(r_thres) : nullptr;
+}
+
+void PLImg::MaskGeneration::set_background(float transmittance, float retardation) {
+    this->m_maxTransmittance = transmittance;
+    this->m_minRetardation = fmax(retardation, 0.0f);
+}
+
+int PLImg::MaskGeneration::priorBin(float minLabel, float maxLabel, float prior, unsigned numBins) {
+    if(!(prior >= minLabel && prior < maxLabel)) {
+        return -1;
+    }
+    return std::min(int(numBins) - 1, int((prior - minLabel) / (maxLabel - minLabel) * float(numBins)));
+}
+
+void PLImg::MaskGeneration::set_probability_parameters(float r_plus, float r_minus, float t_plus, float t_minus) {
+    this->m_rplus = std::make_unique<float>(r_plus);
+    this->m_rminus = std::make_unique<float>(r_minus);
+    this->m_tplus = std::make_unique<float>(t_plus);
+    this->m_tminus = std::make_unique<float>(t_minus);
+    this->m_probabilityMask = nullptr;
+}
+
 float PLImg::MaskGeneration::T_thres() {
     if(!m_tthres) {
         float temp_tTra = T_ref();
 
         // Generate histogram for potential correction of tMin for tTra
-        cv::Mat hist = PLImg::cuda::histogram(*m_transmittance, m_minTransmittance, m_maxTransmittance, MAX_NUMBER_OF_BINS);
+        cv::Mat hist = histogram(m_transmittance, m_transmittanceStatistics, m_minTransmittance, m_maxTransmittance, MAX_NUMBER_OF_BINS);
 
         int startPosition = temp_tTra / (float(m_maxTransmittance) - float(m_minTransmittance)) * float(MAX_NUMBER_OF_BINS);
         int endPosition = T_back() / (float(m_maxTransmittance) - float(m_minTransmittance)) * float(MAX_NUMBER_OF_BINS);
@@ -134,7 +409,7 @@ float PLImg::MaskGeneration::T_thres() {
 
 float PLImg::MaskGeneration::R_thres() {
     if(!m_rthres) {
-        cv::Mat intHist = PLImg::cuda::histogram(*m_retardation, m_minRetardation + 1e-15, m_maxRetardation, MAX_NUMBER_OF_BINS);
+        cv::Mat intHist = histogram(m_retardation, m_retardationStatistics, m_minRetardation + 1e-15, m_maxRetardation, MAX_NUMBER_OF_BINS);
         cv::Mat hist;
         intHist.convertTo(hist, CV_32FC1);
         cv::normalize(hist, hist, 0.0f, 1.0f, cv::NORM_MINMAX, CV_32FC1);
@@ -155,25 +430,44 @@ float PLImg::MaskGeneration::R_thres() {
         int width = Histogram::peakWidth(hist, startPosition, 1);
         endPosition = ceil(MIN_NUMBER_OF_BINS * 20.0f * width / MAX_NUMBER_OF_BINS);
 
-        for(unsigned NUMBER_OF_BINS = MIN_NUMBER_OF_BINS; NUMBER_OF_BINS <= MAX_NUMBER_OF_BINS; NUMBER_OF_BINS *= 2) {
-            hist = PLImg::cuda::histogram(*m_retardation, histogramMinimalValue, m_maxRetardation, NUMBER_OF_BINS);
-            cv::normalize(hist, hist, 0.0f, 1.0f, cv::NORM_MINMAX, CV_32FC1);
-
-            auto kappa = Histogram::curvature(hist, histogramMinimalValue, m_maxRetardation);
+        auto curvature = [this, histogramMinimalValue](unsigned numberOfBins, cv::Mat& normalizedHist, cv::Mat& kappa) {
+            normalizedHist = histogram(m_retardation, m_retardationStatistics, histogramMinimalValue, m_maxRetardation, numberOfBins);
+            cv::normalize(normalizedHist, normalizedHist, 0.0f, 1.0f, cv::NORM_MINMAX, CV_32FC1);
+            kappa = Histogram::curvature(normalizedHist, histogramMinimalValue, m_maxRetardation);
             cv::normalize(kappa, kappa, 0.0f, 1.0f, cv::NORM_MINMAX, CV_32FC1);
-
-            // If more than one prominent peak is in the histogram, start at the second peak and not at the beginning
+        };
+        // If more than one prominent peak is in the histogram, start at the last peak and not at the beginning.
+        // The first curvature peak after it is selected. -1 if there is no curvature peak in the window.
+        auto firstCurvaturePeak = [](const cv::Mat& hist, const cv::Mat& kappa, int& startPosition, int endPosition) {
             auto peaks = PLImg::Histogram::peaks(hist, startPosition, endPosition);
             if(!peaks.empty()) {
                 startPosition = peaks.at(peaks.size() - 1);
             }
-
-            int resultingBin;
             auto kappaPeaks = PLImg::Histogram::peaks(kappa, startPosition, endPosition);
-            if(kappaPeaks.empty()) {
+            return kappaPeaks.empty() ? -1 : int(kappaPeaks.at(0));
+        };
+
+        // Refine the search from the coarsest to the finest resolution
+        for(unsigned NUMBER_OF_BINS = MIN_NUMBER_OF_BINS; NUMBER_OF_BINS <= MAX_NUMBER_OF_BINS; NUMBER_OF_BINS *= 2) {
+            cv::Mat kappa;
+            curvature(NUMBER_OF_BINS, hist, kappa);
+
+            int resultingBin = -1;
+            // The prior only narrows the first window. The full window is used if there is no curvature peak near it.
+            int bin = NUMBER_OF_BINS == MIN_NUMBER_OF_BINS && m_priorRthres ?
+                      priorBin(histogramMinimalValue, m_maxRetardation, *m_priorRthres, NUMBER_OF_BINS) : -1;
+            if(bin >= 0) {
+                int priorStart = std::max(startPosition, bin - PRIOR_WINDOW_BINS);
+                int priorEnd = std::min(endPosition, bin + PRIOR_WINDOW_BINS + 1);
+                if(priorStart < priorEnd) {
+                    resultingBin = firstCurvaturePeak(hist, kappa, priorStart, priorEnd);
+                }
+            }
+            if(resultingBin < 0) {
+                resultingBin = firstCurvaturePeak(hist, kappa, startPosition, endPosition);
+            }
+            if(resultingBin < 0) {
                 resultingBin = std::max_element(kappa.begin<float>() + startPosition, kappa.begin<float>() + endPosition) - kappa.begin<float>();
-            } else {
-                resultingBin = kappaPeaks.at(0);
             }
 
             float stepSize = float(m_maxRetardation - histogramMinimalValue) / float(NUMBER_OF_BINS);
@@ -199,7 +493,7 @@ float PLImg::MaskGeneration::T_ref() {
 
 float PLImg::MaskGeneration::T_back() {
     if(!m_tback) {
-        cv::Mat fullHist = PLImg::cuda::histogram(*m_transmittance, m_minTransmittance, m_maxTransmittance, MAX_NUMBER_OF_BINS);
+        cv::Mat fullHist = histogram(m_transmittance, m_transmittanceStatistics, m_minTransmittance, m_maxTransmittance, MAX_NUMBER_OF_BINS);
         fullHist.convertTo(fullHist, CV_32FC1);
 
         // Determine start and end on full histogram
@@ -207,7 +501,7 @@ float PLImg::MaskGeneration::T_back() {
         startPosition = MAX_NUMBER_OF_BINS / 3;
         endPosition = std::max_element(fullHist.begin<float>() + startPosition, fullHist.end<float>()) - fullHist.begin<float>();
         float histMaximum = endPosition * (m_maxTransmittance - m_minTransmittance) / MAX_NUMBER_OF_BINS + m_minTransmittance;
-        fullHist = PLImg::cuda::histogram(*m_transmittance, m_minTransmittance,
+        fullHist = histogram(m_transmittance, m_transmittanceStatistics, m_minTransmittance,
                                           histMaximum,
                                           MAX_NUMBER_OF_BINS);
         fullHist.convertTo(fullHist, CV_32FC1);
@@ -233,16 +527,30 @@ float PLImg::MaskGeneration::T_back() {
             endPosition = MIN_NUMBER_OF_BINS;
             startPosition = fmin(endPosition - 1, MIN_NUMBER_OF_BINS * float(startPosition)/MAX_NUMBER_OF_BINS);
 
-            float temp_tMax;
-            for(unsigned NUMBER_OF_BINS = MIN_NUMBER_OF_BINS; NUMBER_OF_BINS <= MAX_NUMBER_OF_BINS; NUMBER_OF_BINS = NUMBER_OF_BINS << 1) {
-                cv::Mat hist = PLImg::cuda::histogram(*m_transmittance, m_minTransmittance,
+            auto curvature = [this, histMaximum](unsigned numberOfBins) {
+                cv::Mat hist = histogram(m_transmittance, m_transmittanceStatistics, m_minTransmittance,
                                                       histMaximum,
-                                                      NUMBER_OF_BINS);
+                                                      numberOfBins);
                 cv::normalize(hist, hist, 0, 1, cv::NORM_MINMAX, CV_32FC1);
+                return Histogram::curvature(hist, m_minTransmittance, histMaximum);
+            };
 
+            float temp_tMax;
+            // Refine the search from the coarsest to the finest resolution
+            for(unsigned NUMBER_OF_BINS = MIN_NUMBER_OF_BINS; NUMBER_OF_BINS <= MAX_NUMBER_OF_BINS; NUMBER_OF_BINS = NUMBER_OF_BINS << 1) {
                 float stepSize = float(histMaximum - m_minTransmittance) / float(NUMBER_OF_BINS);
-                auto kappa = Histogram::curvature(hist, m_minTransmittance, histMaximum);
-                auto kappaPeaks = Histogram::peaks(kappa, startPosition+1, endPosition-1);
+                auto kappa = curvature(NUMBER_OF_BINS);
+                std::vector<unsigned> kappaPeaks;
+                // The prior only narrows the first window. The full window is used if there is no curvature peak near it.
+                int bin = NUMBER_OF_BINS == MIN_NUMBER_OF_BINS && m_priorTback ?
+                          priorBin(m_minTransmittance, histMaximum, *m_priorTback, NUMBER_OF_BINS) : -1;
+                if(bin >= 0) {
+                    kappaPeaks = Histogram::peaks(kappa, std::max(startPosition, bin - PRIOR_WINDOW_BINS) + 1,
+                                                  std::min(endPosition, bin + PRIOR_WINDOW_BINS + 1) - 1);
+                }
+                if(kappaPeaks.empty()) {
+                    kappaPeaks = Histogram::peaks(kappa, startPosition+1, endPosition-1);
+                }
                 int resultingBin;
 
                 if (kappaPeaks.empty()) {
@@ -262,6 +570,34 @@ float PLImg::MaskGeneration::T_back() {
     return *this->m_tback;
 }
 
+float PLImg::MaskGeneration::R_plus() {
+    if(!m_rplus) {
+        bootstrapProbabilityParameters();
+    }
+    return *this->m_rplus;
+}
+
+float PLImg::MaskGeneration::R_minus() {
+    if(!m_rminus) {
+        bootstrapProbabilityParameters();
+    }
+    return *this->m_rminus;
+}
+
+float PLImg::MaskGeneration::T_plus() {
+    if(!m_tplus) {
+        bootstrapProbabilityParameters();
+    }
+    return *this->m_tplus;
+}
+
+float PLImg::MaskGeneration::T_minus() {
+    if(!m_tminus) {
+        bootstrapProbabilityParameters();
+    }
+    return *this->m_tminus;
+}
+
 std::shared_ptr<cv::Mat> PLImg::MaskGeneration::grayMask() {
     if(!m_grayMask) {
         cv::Mat mask = (*m_transmittance >= T_thres()) & (*m_transmittance <= T_back()) & (*m_retardation <= R_thres());
@@ -301,124 +637,130 @@ std::shared_ptr<cv::Mat> PLImg::MaskGeneration::noNerveFiberMask() {
     return std::make_shared<cv::Mat>(mask);
 }
 
-std::shared_ptr<cv::Mat> PLImg::MaskGeneration::probabilityMask() {
-    if(!m_probabilityMask) {
-        std::vector<float> above_rthres;
-        std::vector<float> below_rthres;
-        std::vector<float> above_tthres;
-        std::vector<float> below_tthres;
-        m_probabilityMask = std::make_shared<cv::Mat>(m_retardation->rows, m_retardation->cols, CV_32FC1);
-
-        // We're trying to calculate the maximum possible number of threads than can be used simultaneously to calculate multiple iterations at once.
-        float predictedMemoryUsage = PLImg::cuda::getHistogramMemoryEstimation(Image::randomizedModalities(m_transmittance, m_retardation, 0.5f)[0], MAX_NUMBER_OF_BINS);
-        // Calculate the number of threads that will be used based on the free memory and the maximum number of threads
-        int numberOfThreads;
-        #pragma omp parallel
-        numberOfThreads = omp_get_num_threads();
-        numberOfThreads = fmax(1, fmin(numberOfThreads, uint(float(PLImg::cuda::getFreeMemory()) / predictedMemoryUsage)));
-
-        std::cout << "OpenMP version used during compilation (doesn't have to match the executing OpenMP version): " << _OPENMP << std::endl;
-        #if _OPENMP < 201611
-            omp_set_nested(true);
-        #endif
+void PLImg::MaskGeneration::bootstrapProbabilityParameters() {
+    std::vector<float> above_rthres;
+    std::vector<float> below_rthres;
+    std::vector<float> above_tthres;
+    std::vector<float> below_tthres;
+
+    // We're trying to calculate the maximum possible number of threads than can be used simultaneously to calculate multiple iterations at once.
+    float predictedMemoryUsage = PLImg::cuda::getHistogramMemoryEstimation(Image::randomizedModalities(m_transmittance, m_retardation, 0.5f)[0], MAX_NUMBER_OF_BINS);
+    // Calculate the number of threads that will be used based on the free memory and the maximum number of threads
+    int numberOfThreads;
+    #pragma omp parallel
+    numberOfThreads = omp_get_num_threads();
+    numberOfThreads = fmax(1, fmin(numberOfThreads, uint(float(PLImg::cuda::getFreeMemory()) / predictedMemoryUsage)));
+
+    std::cout << "OpenMP version used during compilation (doesn't have to match the executing OpenMP version): " << _OPENMP << std::endl;
+    #if _OPENMP < 201611
+        omp_set_nested(true);
+    #endif
+    #ifdef __GNUC__
+        auto omp_levels = omp_get_max_active_levels();
+        omp_set_max_active_levels(3);
+    #endif
+    ushort numberOfFinishedIterations = 0;
+    #pragma omp parallel shared(numberOfThreads, above_rthres, below_rthres, above_tthres, below_tthres, numberOfFinishedIterations)
+    {
+        #pragma omp single
+        {
+            std::cout << "Computing " << numberOfThreads << " iterations in parallel with max. " << omp_get_max_threads() / numberOfThreads << " threads per iteration." << std::endl;
+        }
         #ifdef __GNUC__
-            auto omp_levels = omp_get_max_active_levels();
-            omp_set_max_active_levels(3);
+            omp_set_num_threads(omp_get_max_threads() / numberOfThreads);
         #endif
-        ushort numberOfFinishedIterations = 0;
-        #pragma omp parallel shared(numberOfThreads, above_rthres, below_rthres, above_tthres, below_tthres, numberOfFinishedIterations)
-        {
-            #pragma omp single
-            {
-                std::cout << "Computing " << numberOfThreads << " iterations in parallel with max. " << omp_get_max_threads() / numberOfThreads << " threads per iteration." << std::endl;
+
+        // Only work with valid threads. The other threads won't do any work.
+        if(omp_get_thread_num() < numberOfThreads) {
+            std::shared_ptr<cv::Mat> small_retardation;
+            std::shared_ptr<cv::Mat> small_transmittance;
+            MaskGeneration generation(small_retardation, small_transmittance);
+
+            float r_thres, t_thres;
+            unsigned int ownNumberOfIterations = PROBABILITY_MASK_ITERATIONS / numberOfThreads;
+            int overhead = PROBABILITY_MASK_ITERATIONS % numberOfThreads;
+            if (overhead > 0 && omp_get_thread_num() < overhead) {
+                ++ownNumberOfIterations;
             }
-            #ifdef __GNUC__
-                omp_set_num_threads(omp_get_max_threads() / numberOfThreads);
-            #endif
-
-            // Only work with valid threads. The other threads won't do any work.
-            if(omp_get_thread_num() < numberOfThreads) {
-                std::shared_ptr<cv::Mat> small_retardation;
-                std::shared_ptr<cv::Mat> small_transmittance;
-                MaskGeneration generation(small_retardation, small_transmittance);
-
-                float r_thres, t_thres;
-                unsigned int ownNumberOfIterations = PROBABILITY_MASK_ITERATIONS / numberOfThreads;
-                int overhead = PROBABILITY_MASK_ITERATIONS % numberOfThreads;
-                if (overhead > 0 && omp_get_thread_num() < overhead) {
-                    ++ownNumberOfIterations;
-                }
 
-                for (unsigned int i = 0; i < ownNumberOfIterations; ++i) {
-                    auto small_modalities = Image::randomizedModalities(m_transmittance, m_retardation, 0.5f);
-                    small_transmittance = std::make_shared<cv::Mat>(small_modalities[0]);
-                    small_retardation = std::make_shared<cv::Mat>(small_modalities[1]);
-
-                    generation.setModalities(small_retardation, small_transmittance);
-                    generation.set_tref(this->T_ref());
-                    generation.set_tback(this->T_back());
-
-                    r_thres = generation.R_thres();
-                    if (r_thres >= this->R_thres()) {
-                        #pragma omp critical
-                        above_rthres.push_back(r_thres);
-                    } else if (r_thres <= this->R_thres()) {
-                        #pragma omp critical
-                        below_rthres.push_back(r_thres);
-                    }
-
-                    t_thres = generation.T_thres();
-                    if (t_thres >= this->T_thres()) {
-                        #pragma omp critical
-                        above_tthres.push_back(t_thres);
-                    } else if (t_thres <= this->T_thres() && t_thres > 0) {
-                        #pragma omp critical
-                        below_tthres.push_back(t_thres);
-                    }
+            for (unsigned int i = 0; i < ownNumberOfIterations; ++i) {
+                auto small_modalities = Image::randomizedModalities(m_transmittance, m_retardation, 0.5f);
+                small_transmittance = std::make_shared<cv::Mat>(small_modalities[0]);
+                small_retardation = std::make_shared<cv::Mat>(small_modalities[1]);
+
+                generation.setModalities(small_retardation, small_transmittance);
+                generation.set_tref(this->T_ref());
+                generation.set_tback(this->T_back());
 
+                r_thres = generation.R_thres();
+                if (r_thres >= this->R_thres()) {
                     #pragma omp critical
-                    {
-                        ++numberOfFinishedIterations;
-                        std::cout << "\rProbability Mask Generation: Iteration " << numberOfFinishedIterations << " of "
-                                  << PROBABILITY_MASK_ITERATIONS;
-                        std::flush(std::cout);
-                    };
+                    above_rthres.push_back(r_thres);
+                } else if (r_thres <= this->R_thres()) {
+                    #pragma omp critical
+                    below_rthres.push_back(r_thres);
                 }
-                small_transmittance = nullptr;
-                small_retardation = nullptr;
-                generation.setModalities(nullptr, nullptr);
+
+                t_thres = generation.T_thres();
+                if (t_thres >= this->T_thres()) {
+                    #pragma omp critical
+                    above_tthres.push_back(t_thres);
+                } else if (t_thres <= this->T_thres() && t_thres > 0) {
+                    #pragma omp critical
+                    below_tthres.push_back(t_thres);
+                }
+
+                #pragma omp critical
+                {
+                    ++numberOfFinishedIterations;
+                    std::cout << "\rProbability Mask Generation: Iteration " << numberOfFinishedIterations << " of "
+                              << PROBABILITY_MASK_ITERATIONS;
+                    std::flush(std::cout);
+                };
             }
+            small_transmittance = nullptr;
+            small_retardation = nullptr;
+            generation.setModalities(nullptr, nullptr);
         }
-        #ifdef __GNUC__
-            omp_set_max_active_levels(omp_levels);
-        #endif
-        #if _OPENMP < 201611
-            omp_set_nested(false);
-        #endif
+    }
+    #ifdef __GNUC__
+        omp_set_max_active_levels(omp_levels);
+    #endif
+    #if _OPENMP < 201611
+        omp_set_nested(false);
+    #endif
 
-        std::cout << std::endl;
+    std::cout << std::endl;
 
-        float diff_rthres_p, diff_rthres_m, diff_tthres_p, diff_tthres_m;
-        if (above_rthres.empty()) {
-            diff_rthres_p = R_thres();
-        } else {
-            diff_rthres_p = std::accumulate(above_rthres.begin(), above_rthres.end(), 0.0f) / above_rthres.size();
-        }
-        if (below_rthres.empty()) {
-            diff_rthres_m = R_thres();
-        } else {
-            diff_rthres_m = std::accumulate(below_rthres.begin(), below_rthres.end(), 0.0f) / below_rthres.size();
-        }
-        if (above_tthres.empty()) {
-            diff_tthres_p = T_thres();
-        } else {
-            diff_tthres_p = std::accumulate(above_tthres.begin(), above_tthres.end(), 0.0f) / above_tthres.size();
-        }
-        if (below_tthres.empty()) {
-            diff_tthres_m = T_thres();
-        } else {
-            diff_tthres_m = std::accumulate(below_tthres.begin(), below_tthres.end(), 0.0f) / below_tthres.size();
-        }
+    if (above_rthres.empty()) {
+        m_rplus = std::make_unique<float>(R_thres());
+    } else {
+        m_rplus = std::make_unique<float>(std::accumulate(above_rthres.begin(), above_rthres.end(), 0.0f) / above_rthres.size());
+    }
+    if (below_rthres.empty()) {
+        m_rminus = std::make_unique<float>(R_thres());
+    } else {
+        m_rminus = std::make_unique<float>(std::accumulate(below_rthres.begin(), below_rthres.end(), 0.0f) / below_rthres.size());
+    }
+    if (above_tthres.empty()) {
+        m_tplus = std::make_unique<float>(T_thres());
+    } else {
+        m_tplus = std::make_unique<float>(std::accumulate(above_tthres.begin(), above_tthres.end(), 0.0f) / above_tthres.size());
+    }
+    if (below_tthres.empty()) {
+        m_tminus = std::make_unique<float>(T_thres());
+    } else {
+        m_tminus = std::make_unique<float>(std::accumulate(below_tthres.begin(), below_tthres.end(), 0.0f) / below_tthres.size());
+    }
+}
+
+std::shared_ptr<cv::Mat> PLImg::MaskGeneration::probabilityMask() {
+    if(!m_probabilityMask) {
+        float diff_rthres_p = R_plus();
+        float diff_rthres_m = R_minus();
+        float diff_tthres_p = T_plus();
+        float diff_tthres_m = T_minus();
+        m_probabilityMask = std::make_shared<cv::Mat>(m_retardation->rows, m_retardation->cols, CV_32FC1);
 
         std::cout << "Probability parameters: R+:"  << diff_rthres_p << ", R-:" << diff_rthres_m <<
                                                     ", T+:" << diff_tthres_p << ", T-:" << diff_tthres_m
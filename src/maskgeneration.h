@@ -29,12 +29,16 @@
 #include <iostream>
 #include <memory>
 #include <omp.h>
+#include <vector>
 #include <opencv2/opencv.hpp>
 
+#include "reader.h"
 #include "toolbox.h"
 
 /// Number of iterations that will be used to generate the probabilityMask() parameter.
 constexpr auto PROBABILITY_MASK_ITERATIONS = 200;
+/// Number of bins with MIN_NUMBER_OF_BINS bins by which the first search window of R_thres() and T_back() extends around a prior.
+constexpr auto PRIOR_WINDOW_BINS = 2;
 
 /**
  * @file
@@ -65,12 +69,65 @@ namespace PLImg {
          * @param transmittance Shared pointer of an OpenCV matrix containing the normalized transmittance of a single 3D-PLI measurement.
          */
         void setModalities(std::shared_ptr<cv::Mat> retardation, std::shared_ptr<cv::Mat> transmittance);
+        /**
+         * Set retardation and transmittance together with their statistics from Reader::imread(const std::string&, const std::string&, ImageStatistics&)
+         * or Reader::convert(const cv::Mat&, ImageStatistics&). The value ranges will be taken from the statistics
+         * and histograms which can be derived from the fine histograms of the statistics will not be calculated again.
+         * Empty statistics are calculated from their image. All previously generated or set parameters will be deleted in the process.
+         * @brief Set retardation and transmittance with precalculated statistics
+         * @param retardation Shared pointer of an OpenCV matrix containing the retardation of a single 3D-PLI measurement.
+         * @param transmittance Shared pointer of an OpenCV matrix containing the normalized transmittance of a single 3D-PLI measurement.
+         * @param retardationStatistics Statistics of the retardation.
+         * @param transmittanceStatistics Statistics of the transmittance.
+         * @throws std::invalid_argument if the statistics of a modality without an image are empty
+         */
+        void setModalities(std::shared_ptr<cv::Mat> retardation, std::shared_ptr<cv::Mat> transmittance,
+                           const ImageStatistics& retardationStatistics, const ImageStatistics& transmittanceStatistics);
+
+        /**
+         * The parameters T_back(), T_ref(), R_thres() and T_thres() only depend on the histograms of both modalities.
+         * Those histograms are nearly identical for a strided subsample of the images, e.g. from
+         * Reader::imread(const std::string&, const std::string&, unsigned) or Reader::subsample(const cv::Mat&, unsigned).
+         * This method calculates all parameters on the given subsample and sets them for the modalities of this object.
+         * Parameters which were already set manually are kept. Only the masks will use the full resolution images afterwards.
+         * The background of the subsampled images will be removed in the process.
+         * @brief Estimate all parameters on subsampled modalities
+         * @param retardation Shared pointer of an OpenCV matrix containing the subsampled retardation.
+         * @param transmittance Shared pointer of an OpenCV matrix containing the subsampled normalized transmittance.
+         */
+        void estimateParameters(const std::shared_ptr<cv::Mat>& retardation, const std::shared_ptr<cv::Mat>& transmittance);
+
+        /**
+         * Neighbouring sections of a stack have nearly identical histograms and can share their parameters. Like
+         * estimateParameters(const std::shared_ptr<cv::Mat>&, const std::shared_ptr<cv::Mat>&), this method calculates
+         * all parameters on strided subsamples, but the histograms combine the pixels of all sections. The subsamples
+         * may differ in size and are never padded. T_ref() is the mean transmittance of the largest connected component
+         * of each section, so that the tissue of different sections is never merged into one component. The bootstrap
+         * of the probability parameters runs once on all sections as well. Parameters which were already set manually
+         * are kept. The background of the subsampled images will be removed in the process.
+         * @brief Estimate all parameters on subsampled modalities of several sections
+         * @param retardations Subsampled retardations of all sections
+         * @param transmittances Subsampled normalized median transmittances of all sections in the same order
+         * @throws std::invalid_argument if the number or the sizes of the modalities don't match or no section is given
+         */
+        void estimateParameters(const std::vector<std::shared_ptr<cv::Mat>>& retardations,
+                                const std::vector<std::shared_ptr<cv::Mat>>& transmittances);
 
         /**
          * @brief resetParameters
          */
         void resetParameters();
 
+        /**
+         * The modalities are usually needed longer by the caller, e.g. for the inclination, while the median filtered
+         * transmittance is replaced by the masked median filtered transmittance. Releasing the modalities after the last
+         * mask was generated frees their memory as soon as the caller releases them as well. All parameters, fullMask()
+         * and probabilityMask() are kept if they were generated before. Other parameters and masks can't be generated
+         * until setModalities() is called again.
+         * @brief Release the modalities and the intermediate white and gray mask
+         */
+        void releaseModalities();
+
         /**
          * By using the parameter tMax() we can separate the tissue from the background. Using this information,
          * the resulting mask quality can be enhanced significantly, if the background fills the majority of the 
@@ -107,6 +164,30 @@ namespace PLImg {
          */
         float T_back();
 
+        /**
+         * probabilityMask() repeats the search of R_thres() and T_thres() PROBABILITY_MASK_ITERATIONS times on random halves
+         * of the modalities. The mean of all results above R_thres() is R+. If this was calculated or set already, the
+         * known value will be returned instead.
+         * @brief Mean of the bootstrapped retardation thresholds above R_thres()
+         * @return Floating point value with the mean of the bootstrapped thresholds above R_thres()
+         */
+        float R_plus();
+        /**
+         * @brief Mean of the bootstrapped retardation thresholds below R_thres()
+         * @return Floating point value with the mean of the bootstrapped thresholds below R_thres()
+         */
+        float R_minus();
+        /**
+         * @brief Mean of the bootstrapped transmittance thresholds above T_thres()
+         * @return Floating point value with the mean of the bootstrapped thresholds above T_thres()
+         */
+        float T_plus();
+        /**
+         * @brief Mean of the bootstrapped transmittance thresholds below T_thres()
+         * @return Floating point value with the mean of the bootstrapped thresholds below T_thres()
+         */
+        float T_minus();
+
         /**
          * Set the tRet value manually. This will reset whiteMask() and grayMask()
          * @param t_ret tRet value which will be used for further calculations
@@ -127,6 +208,37 @@ namespace PLImg {
          * @param t_max tMax value which will be used for further calculations
          */
         void set_tback(float t_max);
+        /**
+         * Set the results of the bootstrap of probabilityMask() manually, e.g. from a previous run stored in a ParameterCache.
+         * The bootstrap will be skipped afterwards. This will reset probabilityMask().
+         * @param r_plus R+ value which will be used for further calculations
+         * @param r_minus R- value which will be used for further calculations
+         * @param t_plus T+ value which will be used for further calculations
+         * @param t_minus T- value which will be used for further calculations
+         */
+        void set_probability_parameters(float r_plus, float r_minus, float t_plus, float t_minus);
+        /**
+         * Consecutive sections of a stack have very similar histograms, but their curvature can have several peaks of similar
+         * height. T_back() and R_thres() refine their search from MIN_NUMBER_OF_BINS to MAX_NUMBER_OF_BINS bins. With a prior,
+         * the window with MIN_NUMBER_OF_BINS bins is narrowed to PRIOR_WINDOW_BINS bins around the prior, so the curvature peak
+         * of the similar image is preferred. The peaks are selected with the same rules as without a prior and the refinement
+         * is unchanged. If there is no curvature peak near the prior, the full window is used.
+         * The prior is kept when the modalities or parameters are reset. T_thres() already searches with MAX_NUMBER_OF_BINS bins
+         * only and doesn't use a prior.
+         * @brief Set parameters of a similar image, e.g. the previous section, as starting point of the search
+         * @param t_back T_back() of the similar image. Negative values disable the prior.
+         * @param r_thres R_thres() of the similar image. Negative values disable the prior.
+         */
+        void set_prior(float t_back, float r_thres);
+        /**
+         * removeBackground() replaces the background with the brightest transmittance and the lowest retardation of the
+         * modalities. When a large section is processed tile by tile, those values have to be taken from the whole section
+         * instead, so that all tiles are filled with the same values. setModalities() resets the values again.
+         * @brief Set the values which replace the background
+         * @param transmittance Transmittance of the background, i.e. the maximum transmittance of the section
+         * @param retardation Retardation of the background, i.e. the minimum retardation of the section
+         */
+        void set_background(float transmittance, float retardation);
 
         /**
          * The gray mask will be generated by using tTra(), tRet() and tMax(). The formula for the gray matter is defined as:
@@ -170,8 +282,38 @@ namespace PLImg {
         std::shared_ptr<cv::Mat> probabilityMask();
 
     private:
+        /**
+         * Calculate the histogram of an image. If the histogram can be derived from the fine histogram in the statistics
+         * of the image, no pass over the image is necessary. Otherwise PLImg::cuda::histogram will be used.
+         * @param image Image of which the histogram shall be calculated.
+         * @param statistics Statistics of the image. Might be empty.
+         * @param minLabel Lower bound of the histogram
+         * @param maxLabel Upper bound of the histogram
+         * @param numBins Number of bins
+         * @return Histogram matching PLImg::cuda::histogram(*image, minLabel, maxLabel, numBins)
+         */
+        static cv::Mat histogram(const std::shared_ptr<cv::Mat>& image, const ImageStatistics& statistics,
+                                 float minLabel, float maxLabel, uint numBins);
+        /**
+         * Calculate R_plus(), R_minus(), T_plus() and T_minus() by repeating the search of R_thres() and T_thres()
+         * PROBABILITY_MASK_ITERATIONS times on random halves of the modalities.
+         */
+        void bootstrapProbabilityParameters();
+        /**
+         * @brief Bin of a prior in a histogram
+         * @param minLabel Lower bound of the histogram
+         * @param maxLabel Upper bound of the histogram
+         * @param prior Value of the prior
+         * @param numBins Number of bins of the histogram
+         * @return Bin of the prior or -1 if the prior is outside of the histogram
+         */
+        static int priorBin(float minLabel, float maxLabel, float prior, unsigned numBins);
+
         std::shared_ptr<cv::Mat> m_retardation, m_transmittance;
+        ImageStatistics m_retardationStatistics, m_transmittanceStatistics;
         std::unique_ptr<float> m_rthres, m_tthres, m_tref, m_tback;
+        std::unique_ptr<float> m_rplus, m_rminus, m_tplus, m_tminus;
+        std::unique_ptr<float> m_priorTback, m_priorRthres;
         std::shared_ptr<cv::Mat> m_grayMask, m_whiteMask, m_fullMask;
         std::shared_ptr<cv::Mat> m_probabilityMask;
 
@@ -0,0 +1,242 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Forschungszentrum Jülich / Jan André Reuter.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "outofcore.h"
+#include "maskgeneration.h"
+#include "reader.h"
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+PLImg::OutOfCoreSection::OutOfCoreSection(const std::string& transmittancePath, const std::string& retardationPath,
+                                          const std::string& dataset, bool medianInput, unsigned long long memoryBudget,
+                                          unsigned subsample, int tileSize) :
+        m_transmittancePath(transmittancePath), m_retardationPath(retardationPath), m_dataset(dataset),
+        m_medianInput(medianInput), m_rows(0), m_cols(0), m_stride(std::max(subsample, 1u)), m_grid(1, 1, 1),
+        m_maxTransmittance(0.0f), m_minRetardation(std::numeric_limits<float>::max()), m_sampled(false) {
+    ImageInfo info = Reader::probe(transmittancePath, dataset);
+    if(Reader::probe(retardationPath, dataset).dims != info.dims) {
+        throw std::invalid_argument("The retardation " + retardationPath + " doesn't match the transmittance " + transmittancePath + "!");
+    }
+    m_rows = int(info.dims.at(0));
+    m_cols = int(info.dims.at(1));
+    // A quarter of the budget is used for the subsample, the rest for the tiles
+    while(info.numberOfPixels() / (m_stride * m_stride) * OUT_OF_CORE_SUBSAMPLE_BYTES > memoryBudget / 4) {
+        ++m_stride;
+    }
+    if(tileSize <= 0) {
+        tileSize = TileGrid::tileSize(memoryBudget / 4 * 3, OUT_OF_CORE_TILE_BYTES, 2 * MEDIAN_KERNEL_SIZE,
+                                      int(hdf5_writer_chunk_dimensions[0]));
+    }
+    m_grid = TileGrid(m_rows, m_cols, tileSize);
+}
+
+const PLImg::TileGrid& PLImg::OutOfCoreSection::grid() const {
+    return m_grid;
+}
+
+int PLImg::OutOfCoreSection::rows() const {
+    return m_rows;
+}
+
+int PLImg::OutOfCoreSection::cols() const {
+    return m_cols;
+}
+
+unsigned PLImg::OutOfCoreSection::stride() const {
+    return m_stride;
+}
+
+void PLImg::OutOfCoreSection::sample(HDF5Writer* medianWriter, const std::string& medianDataset) {
+    int stride = int(m_stride);
+    m_subsampledTransmittance = cv::Mat((m_rows + stride - 1) / stride, (m_cols + stride - 1) / stride, CV_32FC1);
+    m_subsampledRetardation = cv::Mat(m_subsampledTransmittance.rows, m_subsampledTransmittance.cols, CV_32FC1);
+    m_maxTransmittance = 0.0f;
+    m_minRetardation = std::numeric_limits<float>::max();
+    for(size_t i = 0; i < m_grid.size(); ++i) {
+        cv::Rect tile = m_grid.tile(i);
+        ImageStatistics transmittanceStatistics, retardationStatistics;
+        cv::Mat transmittanceTile;
+        if(!m_medianInput) {
+            auto paddedTransmittance = std::make_shared<cv::Mat>(Reader::convert(
+                    Reader::imread(m_transmittancePath, m_dataset, m_grid.padded(i, MEDIAN_KERNEL_SIZE)), transmittanceStatistics));
+            auto medianTransmittance = cuda::filters::medianFilter(paddedTransmittance);
+            transmittanceTile = (*medianTransmittance)(m_grid.inner(i, MEDIAN_KERNEL_SIZE)).clone();
+            if(medianWriter) {
+                medianWriter->write_tile(medianDataset, tile, transmittanceTile);
+            }
+            // The statistics of the background are those of the median transmittance
+            transmittanceStatistics = ImageStatistics();
+            transmittanceTile = Reader::convert(transmittanceTile, transmittanceStatistics);
+        } else {
+            transmittanceTile = Reader::convert(Reader::imread(m_transmittancePath, m_dataset, tile), transmittanceStatistics);
+        }
+        cv::Mat retardationTile = Reader::convert(Reader::imread(m_retardationPath, m_dataset, tile), retardationStatistics);
+        m_maxTransmittance = std::max(m_maxTransmittance, float(transmittanceStatistics.max));
+        m_minRetardation = std::min(m_minRetardation, float(retardationStatistics.min));
+
+        // Select every stride-th row and column of the section
+        int rowOffset = (stride - tile.y % stride) % stride;
+        int colOffset = (stride - tile.x % stride) % stride;
+        if(rowOffset < tile.height && colOffset < tile.width) {
+            cv::Rect selection(colOffset, rowOffset, tile.width - colOffset, tile.height - rowOffset);
+            cv::Mat subsampledTile = Reader::subsample(transmittanceTile(selection), m_stride);
+            cv::Rect destination((tile.x + colOffset) / stride, (tile.y + rowOffset) / stride,
+                                 subsampledTile.cols, subsampledTile.rows);
+            subsampledTile.copyTo(m_subsampledTransmittance(destination));
+            Reader::subsample(retardationTile(selection), m_stride).copyTo(m_subsampledRetardation(destination));
+        }
+        std::cout << "\rFirst pass: tile " << i + 1 << " of " << m_grid.size() << std::flush;
+    }
+    std::cout << std::endl;
+    m_sampled = true;
+}
+
+PLImg::OutOfCoreParameters PLImg::OutOfCoreSection::estimate(const OutOfCoreParameters& manual) {
+    if(!m_sampled || m_subsampledTransmittance.empty()) {
+        throw std::runtime_error("The subsample has to be collected by sample() before the parameters are estimated!");
+    }
+    // The transmittance and the retardation are converted with separate statistics
+    ImageStatistics transmittanceStatistics, retardationStatistics;
+    auto transmittance = std::make_shared<cv::Mat>(Reader::convert(m_subsampledTransmittance, transmittanceStatistics));
+    auto retardation = std::make_shared<cv::Mat>(Reader::convert(m_subsampledRetardation, retardationStatistics));
+    m_subsampledTransmittance.release();
+    m_subsampledRetardation.release();
+
+    MaskGeneration generation;
+    generation.setModalities(retardation, transmittance, retardationStatistics, transmittanceStatistics);
+    if(manual.tthres >= 0) {
+        generation.set_tthres(manual.tthres);
+    }
+    if(manual.rthres >= 0) {
+        generation.set_rthres(manual.rthres);
+    }
+    if(manual.tref >= 0) {
+        generation.set_tref(manual.tref);
+    }
+    if(manual.tback >= 0) {
+        generation.set_tback(manual.tback);
+    }
+    generation.removeBackground();
+    // The masks of the full section are not known yet, so the median transmittance replaces the masked median transmittance
+    Inclination inclination;
+    inclination.setModalities(transmittance, retardation, generation.probabilityMask(), generation.fullMask());
+    if(manual.tc >= 0) {
+        inclination.set_Tc(manual.tc);
+    }
+    if(manual.tm >= 0) {
+        inclination.set_TM(manual.tm);
+    }
+    if(manual.rrefhm >= 0) {
+        inclination.set_RrefHM(manual.rrefhm);
+    }
+    if(manual.rreflm >= 0) {
+        inclination.set_RrefLM(manual.rreflm);
+    }
+
+    OutOfCoreParameters parameters;
+    parameters.tthres = generation.T_thres();
+    parameters.rthres = generation.R_thres();
+    parameters.tref = generation.T_ref();
+    parameters.tback = generation.T_back();
+    parameters.rplus = generation.R_plus();
+    parameters.rminus = generation.R_minus();
+    parameters.tplus = generation.T_plus();
+    parameters.tminus = generation.T_minus();
+    parameters.tc = inclination.T_c();
+    parameters.tm = inclination.T_M();
+    parameters.rrefhm = inclination.R_refHM();
+    parameters.rreflm = inclination.R_refLM();
+    return parameters;
+}
+
+void PLImg::OutOfCoreSection::process(const OutOfCoreParameters& parameters, HDF5Writer& maskWriter,
+                                      const std::string& maskDataset, const std::string& probabilityDataset,
+                                      HDF5Writer& inclinationWriter, const std::string& inclinationDataset,
+                                      InclinationFormat format) {
+    if(!m_sampled) {
+        throw std::runtime_error("The values of the background have to be collected by sample() before the second pass!");
+    }
+    Inclination inclinationType;
+    inclinationType.set_format(format);
+    maskWriter.create_dataset(maskDataset, m_rows, m_cols, CV_8UC1);
+    maskWriter.create_dataset(probabilityDataset, m_rows, m_cols, CV_32FC1);
+    inclinationWriter.create_dataset(inclinationDataset, m_rows, m_cols, inclinationType.type());
+    for(size_t i = 0; i < m_grid.size(); ++i) {
+        // The masks are needed around the tile for the masked median filter
+        cv::Rect haloRegion = m_grid.padded(i, MEDIAN_KERNEL_SIZE);
+        cv::Rect tileInHalo = m_grid.inner(i, MEDIAN_KERNEL_SIZE);
+        ImageStatistics transmittanceStatistics, retardationStatistics;
+        std::shared_ptr<cv::Mat> transmittance, medTransmittance;
+        if(!m_medianInput) {
+            // Median filtering twice the halo yields the exact median transmittance around the tile
+            cv::Rect outerRegion = m_grid.padded(i, 2 * MEDIAN_KERNEL_SIZE);
+            cv::Rect haloInOuter(haloRegion.x - outerRegion.x, haloRegion.y - outerRegion.y, haloRegion.width, haloRegion.height);
+            auto original = std::make_shared<cv::Mat>(Reader::convert(
+                    Reader::imread(m_transmittancePath, m_dataset, outerRegion), transmittanceStatistics));
+            medTransmittance = std::make_shared<cv::Mat>((*cuda::filters::medianFilter(original))(haloInOuter).clone());
+            transmittance = std::make_shared<cv::Mat>((*original)(haloInOuter).clone());
+        } else {
+            medTransmittance = std::make_shared<cv::Mat>(Reader::convert(
+                    Reader::imread(m_transmittancePath, m_dataset, haloRegion), transmittanceStatistics));
+        }
+        auto retardation = std::make_shared<cv::Mat>(Reader::convert(
+                Reader::imread(m_retardationPath, m_dataset, haloRegion), retardationStatistics));
+
+        MaskGeneration generation;
+        generation.setModalities(retardation, medTransmittance);
+        generation.set_tthres(parameters.tthres);
+        generation.set_rthres(parameters.rthres);
+        generation.set_tref(parameters.tref);
+        generation.set_tback(parameters.tback);
+        generation.set_probability_parameters(parameters.rplus, parameters.rminus, parameters.tplus, parameters.tminus);
+        generation.set_background(m_maxTransmittance, m_minRetardation);
+        generation.removeBackground();
+        std::shared_ptr<cv::Mat> mask = generation.fullMask();
+        std::shared_ptr<cv::Mat> probability = generation.probabilityMask();
+        if(!m_medianInput) {
+            medTransmittance = cuda::filters::medianFilterMasked(transmittance, mask);
+            transmittance = nullptr;
+        }
+
+        // The inclination is calculated pixel by pixel and only needs the tile itself
+        auto maskTile = std::make_shared<cv::Mat>((*mask)(tileInHalo).clone());
+        auto probabilityTile = std::make_shared<cv::Mat>((*probability)(tileInHalo).clone());
+        Inclination inclination(std::make_shared<cv::Mat>((*medTransmittance)(tileInHalo).clone()),
+                                std::make_shared<cv::Mat>((*retardation)(tileInHalo).clone()),
+                                probabilityTile, maskTile);
+        inclination.set_format(format);
+        inclination.set_Tc(parameters.tc);
+        inclination.set_TM(parameters.tm);
+        inclination.set_RrefHM(parameters.rrefhm);
+        inclination.set_RrefLM(parameters.rreflm);
+
+        maskWriter.write_tile(maskDataset, m_grid.tile(i), *maskTile);
+        maskWriter.write_tile(probabilityDataset, m_grid.tile(i), *probabilityTile);
+        inclinationWriter.write_tile(inclinationDataset, m_grid.tile(i), *inclination.inclination());
+        std::cout << "\rSecond pass: tile " << i + 1 << " of " << m_grid.size() << std::flush;
+    }
+    std::cout << std::endl;
+}
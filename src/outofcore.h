@@ -0,0 +1,152 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Forschungszentrum Jülich / Jan André Reuter.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef PLIMG_OUTOFCORE_H
+#define PLIMG_OUTOFCORE_H
+
+#include <memory>
+#include <opencv2/core.hpp>
+#include <string>
+
+#include "inclination.h"
+#include "tilegrid.h"
+#include "writer.h"
+
+/**
+ * @file
+ * @brief PLImg::OutOfCoreSection class
+ */
+namespace PLImg {
+    /// Memory per pixel of a tile and its halo in the second pass of an out-of-core section
+    constexpr unsigned long long OUT_OF_CORE_TILE_BYTES = 64;
+    /// Memory per pixel of the subsample on which the parameters of an out-of-core section are estimated
+    constexpr unsigned long long OUT_OF_CORE_SUBSAMPLE_BYTES = 32;
+
+    /**
+     * @brief Parameters of the masks and the inclination of a section. Negative values are estimated.
+     */
+    struct OutOfCoreParameters {
+        /// Parameters of PLImg::MaskGeneration
+        float tthres = -1, rthres = -1, tref = -1, tback = -1;
+        /// Parameters of the probability mask. They are always estimated.
+        float rplus = -1, rminus = -1, tplus = -1, tminus = -1;
+        /// Parameters of PLImg::Inclination
+        float tc = -1, tm = -1, rrefhm = -1, rreflm = -1;
+    };
+
+    /**
+     * A section processed out of core is never read completely. sample() median filters the transmittance tile by
+     * tile and collects a strided subsample of both modalities, on which estimate() determines all parameters.
+     * process() then generates the masks, the masked median transmittance and the inclination of each tile.
+     * Each tile is read with a halo, so that its median filtered transmittance matches the one of the full section.
+     * The masks match those of an in-core run with the same parameters. The inclination parameters are estimated
+     * from the median transmittance instead of the masked median transmittance, as the masks of the section are
+     * not known before the second pass. The inclination therefore differs slightly from an in-core run.
+     * @brief Two pass processing of a section tile by tile
+     */
+    class OutOfCoreSection {
+    public:
+        /**
+         * A quarter of the memory budget is used for the subsample, the rest for the tiles.
+         * @brief Probe the inputs and divide the section into tiles
+         * @param transmittancePath Transmittance or median transmittance (HDF5 or Zarr)
+         * @param retardationPath Retardation (HDF5 or Zarr)
+         * @param dataset Dataset of both inputs
+         * @param medianInput True if the transmittance is already median filtered
+         * @param memoryBudget Memory budget in bytes
+         * @param subsample Minimal stride of the subsample
+         * @param tileSize Number of rows and columns of a tile. 0 derives it from the memory budget.
+         * @throws std::invalid_argument if the retardation doesn't match the transmittance
+         */
+        OutOfCoreSection(const std::string& transmittancePath, const std::string& retardationPath,
+                         const std::string& dataset, bool medianInput, unsigned long long memoryBudget,
+                         unsigned subsample = 1, int tileSize = 0);
+
+        /**
+         * @brief Tiles of the section
+         * @return Division of the section into tiles
+         */
+        const TileGrid& grid() const;
+        /**
+         * @brief Number of rows of the section
+         * @return Number of rows of the input images
+         */
+        int rows() const;
+        /**
+         * @brief Number of columns of the section
+         * @return Number of columns of the input images
+         */
+        int cols() const;
+        /**
+         * @brief Stride of the subsample
+         * @return Every stride-th row and column is used for the estimation of the parameters
+         */
+        unsigned stride() const;
+
+        /**
+         * @brief First pass. Median filters the transmittance and collects the subsample and the values of the background.
+         * @param medianWriter Writer into whose median_dataset the median transmittance is written tile by tile.
+         * The dataset has to be created before. Nothing is written if it is nullptr or the input is already median filtered.
+         * @param medianDataset Dataset of the median transmittance
+         */
+        void sample(HDF5Writer* medianWriter = nullptr, const std::string& medianDataset = "");
+        /**
+         * The subsample is released afterwards.
+         * @brief Estimate all parameters on the subsample of sample()
+         * @param manual Parameters which were set by the user. Negative values are estimated.
+         * @return Parameters of the second pass
+         * @throws std::runtime_error if sample() wasn't called before
+         */
+        OutOfCoreParameters estimate(const OutOfCoreParameters& manual);
+        /**
+         * Datasets are created by this method. maskWriter and inclinationWriter may be the same writer.
+         * @brief Second pass. Generates the masks and the inclination of each tile.
+         * @param parameters Parameters returned by estimate()
+         * @param maskWriter Writer of the mask and the probability mask
+         * @param maskDataset Dataset of the mask
+         * @param probabilityDataset Dataset of the probability mask
+         * @param inclinationWriter Writer of the inclination
+         * @param inclinationDataset Dataset of the inclination
+         * @param format Datatype of the inclination
+         * @throws std::runtime_error if sample() wasn't called before
+         */
+        void process(const OutOfCoreParameters& parameters, HDF5Writer& maskWriter, const std::string& maskDataset,
+                     const std::string& probabilityDataset, HDF5Writer& inclinationWriter,
+                     const std::string& inclinationDataset, InclinationFormat format);
+
+    private:
+        std::string m_transmittancePath, m_retardationPath, m_dataset;
+        bool m_medianInput;
+        int m_rows, m_cols;
+        unsigned m_stride;
+        TileGrid m_grid;
+        /// Strided subsample of the median transmittance and the retardation
+        cv::Mat m_subsampledTransmittance, m_subsampledRetardation;
+        /// Values of the background of the full section
+        float m_maxTransmittance, m_minRetardation;
+        bool m_sampled;
+    };
+}
+
+#endif //PLIMG_OUTOFCORE_H
@@ -0,0 +1,195 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Forschungszentrum Jülich / Jan André Reuter.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "parametercache.h"
+#include "hdf5configuration.h"
+#include "inclination.h"
+#include "reader.h"
+#include "version.h"
+#include <H5Cpp.h>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+    /// Setters and getters of the cached inclination parameters
+    struct InclinationParameter {
+        const char* name;
+        void (PLImg::Inclination::*setter)(float);
+        float (PLImg::Inclination::*getter)();
+    };
+    const InclinationParameter inclinationParameters[] = {
+            {"im", &PLImg::Inclination::set_Tc, &PLImg::Inclination::T_c},
+            {"ic", &PLImg::Inclination::set_TM, &PLImg::Inclination::T_M},
+            {"rmax_white", &PLImg::Inclination::set_RrefHM, &PLImg::Inclination::R_refHM},
+            {"rmax_gray", &PLImg::Inclination::set_RrefLM, &PLImg::Inclination::R_refLM}
+    };
+
+    /**
+     * @brief Get a manually set parameter
+     * @param manual Manually set parameters
+     * @param name Name of the parameter
+     * @return Manually set value or -1 if it wasn't set
+     */
+    float manualValue(const std::map<std::string, float>& manual, const std::string& name) {
+        auto it = manual.find(name);
+        return it == manual.end() ? -1.0f : it->second;
+    }
+
+    /**
+     * @brief Open the group of a stage if it was stored for the given key
+     * @param file Opened sidecar file
+     * @param stage Name of the stage
+     * @param key Expected key of the stage
+     * @param group Group of the stage if the key matches
+     * @return True if the group exists and was stored for the key
+     */
+    bool openStage(const H5::H5File& file, const std::string& stage, const std::string& key, H5::Group& group) {
+        if(H5Lexists(file.getId(), stage.c_str(), H5P_DEFAULT) <= 0) {
+            return false;
+        }
+        group = file.openGroup(stage);
+        if(!group.attrExists("key")) {
+            return false;
+        }
+        std::string storedKey;
+        H5::Attribute attr = group.openAttribute("key");
+        attr.read(attr.getStrType(), storedKey);
+        return storedKey == key;
+    }
+}
+
+PLImg::ParameterCache::ParameterCache(std::string filename) : m_filename(std::move(filename)) {}
+
+const std::string& PLImg::ParameterCache::filename() const {
+    return m_filename;
+}
+
+bool PLImg::ParameterCache::load(const std::string& stage, const std::string& key,
+                                 std::map<std::string, float>& parameters) const {
+    if(!Reader::fileExists(m_filename)) {
+        return false;
+    }
+    auto lock = Reader::lockHDF5();
+    H5::Exception::dontPrint();
+    try {
+        H5::H5File file(m_filename, H5F_ACC_RDONLY);
+        H5::Group group;
+        if(!openStage(file, stage, key, group)) {
+            return false;
+        }
+        std::map<std::string, float> stored;
+        for(int i = 0; i < group.getNumAttrs(); ++i) {
+            H5::Attribute attr = group.openAttribute((unsigned) i);
+            if(attr.getName() != "key") {
+                float value;
+                attr.read(H5::PredType::NATIVE_FLOAT, &value);
+                stored[attr.getName()] = value;
+            }
+        }
+        parameters = std::move(stored);
+        return true;
+    } catch(H5::Exception& exception) {
+        // An unreadable sidecar is treated like a missing one. The parameters will be computed again.
+        return false;
+    }
+}
+
+void PLImg::ParameterCache::store(const std::string& stage, const std::string& key,
+                                  const std::map<std::string, float>& parameters) {
+    auto lock = Reader::lockHDF5();
+    HDF5Configuration configuration = HDF5Configuration::global();
+    hid_t fileId;
+    if(Reader::fileExists(m_filename)) {
+        fileId = configuration.open(m_filename, H5F_ACC_RDWR);
+    } else {
+        fileId = configuration.create(m_filename);
+    }
+    if(fileId < 0) {
+        throw std::runtime_error("Could not open parameter cache " + m_filename + " for writing");
+    }
+    H5::H5File file(fileId);
+    H5Fclose(fileId);
+
+    try {
+        // Replace the stage, so that no values of a different key remain
+        if(H5Lexists(file.getId(), stage.c_str(), H5P_DEFAULT) > 0) {
+            file.unlink(stage);
+        }
+        H5::Group group = file.createGroup(stage);
+        H5::StrType stringType(H5::PredType::C_S1, H5T_VARIABLE);
+        group.createAttribute("key", stringType, H5::DataSpace(H5S_SCALAR)).write(stringType, key);
+        for(const auto& parameter : parameters) {
+            group.createAttribute(parameter.first, H5::PredType::NATIVE_FLOAT, H5::DataSpace(H5S_SCALAR))
+                 .write(H5::PredType::NATIVE_FLOAT, &parameter.second);
+        }
+        file.flush(H5F_SCOPE_LOCAL);
+    } catch(H5::Exception& exception) {
+        throw std::runtime_error("Could not write stage " + stage + " to parameter cache " + m_filename + ": " + exception.getDetailMsg());
+    }
+}
+
+std::map<std::string, float> PLImg::ParameterCache::loadInclination(const std::string& key, Inclination& inclination,
+                                                                   const std::map<std::string, float>& manual,
+                                                                   bool useCache) const {
+    std::map<std::string, float> loaded;
+    if(useCache) {
+        load("Inclination", key, loaded);
+    }
+    for(const auto& parameter : inclinationParameters) {
+        float value = manualValue(manual, parameter.name);
+        if(value >= 0) {
+            (inclination.*parameter.setter)(value);
+        } else if(loaded.count(parameter.name) > 0) {
+            (inclination.*parameter.setter)(loaded.at(parameter.name));
+        }
+    }
+    return loaded;
+}
+
+void PLImg::ParameterCache::storeInclination(const std::string& key, Inclination& inclination,
+                                             const std::map<std::string, float>& manual,
+                                             const std::map<std::string, float>& loaded) {
+    std::map<std::string, float> parameters(loaded);
+    for(const auto& parameter : inclinationParameters) {
+        if(manualValue(manual, parameter.name) < 0) {
+            parameters[parameter.name] = (inclination.*parameter.getter)();
+        }
+    }
+    if(parameters != loaded) {
+        store("Inclination", key, parameters);
+    }
+}
+
+std::string PLImg::ParameterCache::key(const std::string& identity, const std::map<std::string, float>& dependencies) {
+    std::stringstream stream;
+    stream << std::setprecision(std::numeric_limits<float>::max_digits10);
+    stream << Version::versionHash() << ";" << identity;
+    for(const auto& dependency : dependencies) {
+        stream << dependency.first << "=" << dependency.second << ";";
+    }
+    return stream.str();
+}
@@ -0,0 +1,125 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Forschungszentrum Jülich / Jan André Reuter.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef PLIMG_PARAMETERCACHE_H
+#define PLIMG_PARAMETERCACHE_H
+
+#include <map>
+#include <string>
+
+/**
+ * @file
+ * @brief PLImg::ParameterCache class
+ */
+namespace PLImg {
+    class Inclination;
+
+    /**
+     * The parameters of MaskGeneration and Inclination only depend on the input images and on the parameters which
+     * were set manually. Searching the thresholds in the histograms and the bootstrap of MaskGeneration::probabilityMask()
+     * take most of the runtime of a section. The ParameterCache stores the derived parameters of a section in a small
+     * HDF5 sidecar file, so that a later run of the same section only has to do the per-pixel computations.
+     *
+     * The sidecar contains one group per stage, e.g. /MaskGeneration or /Inclination. Each group stores its parameters
+     * as float attributes and the key it was computed for as the string attribute "key".
+     * A stage is only loaded if its key matches. Keys are created with key(const std::string&, const std::map<std::string, float>&)
+     * from the identity of the input files and all values the stage depends on.
+     * @brief Sidecar file with the derived parameters of a section
+     */
+    class ParameterCache {
+    public:
+        /**
+         * @brief Create a cache for a sidecar file. The file is only created when the first stage is stored.
+         * @param filename Path of the HDF5 sidecar file.
+         */
+        explicit ParameterCache(std::string filename);
+
+        /**
+         * @brief Get the path of the sidecar file
+         * @return Path of the HDF5 sidecar file
+         */
+        const std::string& filename() const;
+
+        /**
+         * Load all parameters of a stage. Nothing is loaded if the sidecar doesn't exist, the stage is missing or
+         * was stored for a different key.
+         * @brief Load the parameters of a stage
+         * @param stage Name of the stage, e.g. "MaskGeneration".
+         * @param key Key of the current inputs. See key(const std::string&, const std::map<std::string, float>&).
+         * @param parameters Map which will be filled with all parameters of the stage.
+         * @return True if the stage was stored for the given key.
+         */
+        bool load(const std::string& stage, const std::string& key, std::map<std::string, float>& parameters) const;
+
+        /**
+         * Store the parameters of a stage. Previously stored values of the stage are replaced. Other stages are kept.
+         * @brief Store the parameters of a stage
+         * @param stage Name of the stage, e.g. "MaskGeneration".
+         * @param key Key of the current inputs.
+         * @param parameters Parameters of the stage.
+         */
+        void store(const std::string& stage, const std::string& key, const std::map<std::string, float>& parameters);
+
+        /**
+         * The inclination parameters are independent of each other. A manually set parameter is applied instead of
+         * the cached one and keeps the other cached parameters valid.
+         * @brief Apply the cached and manually set parameters of the "Inclination" stage
+         * @param key Key of the current inputs.
+         * @param inclination Inclination whose parameters are set
+         * @param manual Manually set im, ic, rmax_white and rmax_gray. Negative values use the cached parameter.
+         * @param useCache False only applies the manually set parameters
+         * @return Loaded parameters, which are passed to storeInclination()
+         */
+        std::map<std::string, float> loadInclination(const std::string& key, Inclination& inclination,
+                                                     const std::map<std::string, float>& manual, bool useCache = true) const;
+        /**
+         * Manually set parameters are not stored, so that a later run without them computes the parameter again.
+         * The stage is only written if a parameter changed.
+         * @brief Store the computed parameters of the "Inclination" stage
+         * @param key Key of the current inputs.
+         * @param inclination Inclination after the inclination was generated
+         * @param manual Manually set parameters which were passed to loadInclination()
+         * @param loaded Parameters returned by loadInclination()
+         */
+        void storeInclination(const std::string& key, Inclination& inclination, const std::map<std::string, float>& manual,
+                              const std::map<std::string, float>& loaded);
+
+        /**
+         * Create the key of a stage. The key contains the software revision, the identity of the inputs,
+         * e.g. from HDF5Writer::inputIdentity(), and the values of all parameters the stage depends on.
+         * Values are stored with full float precision.
+         * @brief Create the key of a stage
+         * @param identity Identity of the input files
+         * @param dependencies Values the stage depends on, e.g. manually set parameters or the parameters of a previous stage.
+         * @return Key which can be used for load() and store()
+         */
+        static std::string key(const std::string& identity, const std::map<std::string, float>& dependencies = {});
+
+    private:
+        /// Path of the sidecar file
+        std::string m_filename;
+    };
+}
+
+#endif //PLIMG_PARAMETERCACHE_H
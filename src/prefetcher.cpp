@@ -0,0 +1,164 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Forschungszentrum Jülich / Jan André Reuter.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "prefetcher.h"
+#ifdef __GNUC__
+    #include <unistd.h>
+#else
+    #define NOMINMAX
+    #include <Windows.h>
+#endif
+
+PLImg::Prefetcher::Prefetcher(std::vector<std::vector<PrefetchInput>> sections, unsigned depth,
+                              unsigned long long memoryLimit) :
+        m_sections(std::make_move_iterator(sections.begin()), std::make_move_iterator(sections.end())),
+        m_exhausted(true), m_depth(depth), m_memoryLimit(memoryLimit),
+        m_nextSection(0), m_returnedSections(0), m_queuedMemory(0) {
+    if(m_memoryLimit == 0) {
+        m_memoryLimit = availableMemory() / 2;
+    }
+    schedule();
+}
+
+PLImg::Prefetcher::Prefetcher(Source source, unsigned depth, unsigned long long memoryLimit) :
+        m_source(std::move(source)), m_exhausted(false), m_depth(depth), m_memoryLimit(memoryLimit),
+        m_nextSection(0), m_returnedSections(0), m_queuedMemory(0) {
+    if(m_memoryLimit == 0) {
+        m_memoryLimit = availableMemory() / 2;
+    }
+    schedule();
+}
+
+bool PLImg::Prefetcher::hasNext() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return available();
+}
+
+PLImg::PrefetchedSection PLImg::Prefetcher::next() {
+    std::future<PrefetchedSection> current;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(!available()) {
+            throw std::out_of_range("No more sections available in prefetcher.");
+        }
+        // The section was not read in advance. Start reading it now.
+        if(m_queue.empty()) {
+            scheduleSection(estimateMemory(m_sections.at(m_nextSection)));
+        }
+        current = std::move(m_queue.front().second);
+        m_queuedMemory -= m_queue.front().first;
+        m_queue.pop_front();
+        ++m_returnedSections;
+
+        // Continue reading the following sections while the current one is processed
+        schedule();
+    }
+    return current.get();
+}
+
+bool PLImg::Prefetcher::available() {
+    return m_returnedSections < m_sections.size() || fetch();
+}
+
+bool PLImg::Prefetcher::fetch() {
+    if(m_exhausted) {
+        return false;
+    }
+    std::vector<PrefetchInput> section;
+    if(!m_source(section)) {
+        m_exhausted = true;
+        return false;
+    }
+    m_sections.push_back(std::move(section));
+    return true;
+}
+
+void PLImg::Prefetcher::schedule() {
+    while(m_queue.size() < m_depth && (m_nextSection < m_sections.size() || fetch())) {
+        unsigned long long memory = estimateMemory(m_sections.at(m_nextSection));
+        if(m_queuedMemory + memory > m_memoryLimit) {
+            break;
+        }
+        scheduleSection(memory);
+    }
+}
+
+void PLImg::Prefetcher::scheduleSection(unsigned long long memory) {
+    const std::vector<PrefetchInput>& section = m_sections.at(m_nextSection);
+    m_queue.emplace_back(memory, std::async(std::launch::async, &Prefetcher::readSection, std::cref(section)));
+    m_queuedMemory += memory;
+    ++m_nextSection;
+}
+
+PLImg::PrefetchedSection PLImg::Prefetcher::readSection(const std::vector<PrefetchInput>& section) {
+    PrefetchedSection result;
+    result.images.resize(section.size());
+    result.statistics.resize(section.size());
+
+    // Read all images of the section concurrently. The first image is read by the current thread.
+    std::vector<std::future<void>> reads;
+    auto readImage = [&section, &result](size_t i) {
+        const PrefetchInput& input = section.at(i);
+        if(input.statistics) {
+            result.images.at(i) = std::make_shared<cv::Mat>(
+                    Reader::imread(input.filename, input.dataset, result.statistics.at(i)));
+        } else {
+            result.images.at(i) = std::make_shared<cv::Mat>(Reader::imread(input.filename, input.dataset));
+        }
+    };
+    for(size_t i = 1; i < section.size(); ++i) {
+        reads.emplace_back(std::async(std::launch::async, readImage, i));
+    }
+    if(!section.empty()) {
+        readImage(0);
+    }
+    for(auto& read : reads) {
+        read.get();
+    }
+    return result;
+}
+
+unsigned long long PLImg::Prefetcher::estimateMemory(const std::vector<PrefetchInput>& section) {
+    unsigned long long memory = 0;
+    for(const PrefetchInput& input : section) {
+        try {
+            ImageInfo info = Reader::probe(input.filename, input.dataset);
+            memory += info.numberOfPixels() * (input.statistics ? sizeof(float) : info.elementSize);
+        } catch(const std::exception&) {
+            // The error will be reported when the image is read.
+        }
+    }
+    return memory;
+}
+
+unsigned long long PLImg::Prefetcher::availableMemory() {
+    #ifdef __GNUC__
+        return (unsigned long long) sysconf(_SC_AVPHYS_PAGES) * (unsigned long long) sysconf(_SC_PAGE_SIZE);
+    #else
+        MEMORYSTATUSEX status;
+        status.dwLength = sizeof(status);
+        GlobalMemoryStatusEx(&status);
+        return status.ullAvailPhys;
+    #endif
+}
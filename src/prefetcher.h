@@ -0,0 +1,173 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Forschungszentrum Jülich / Jan André Reuter.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef PLIMG_PREFETCHER_H
+#define PLIMG_PREFETCHER_H
+
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <opencv2/core.hpp>
+#include <string>
+#include <vector>
+
+#include "reader.h"
+
+/**
+ * @file
+ * @brief PLImg::Prefetcher class
+ */
+namespace PLImg {
+    /**
+     * @brief Single image which will be read by the Prefetcher
+     */
+    struct PrefetchInput {
+        /// Path of the image file
+        std::string filename;
+        /// HDF5 dataset of the image
+        std::string dataset = "/Image";
+        /// Convert the image to 32-bit floating point values and calculate its ImageStatistics while reading
+        bool statistics = false;
+    };
+
+    /**
+     * @brief All images of a section read by the Prefetcher
+     */
+    struct PrefetchedSection {
+        /// Images in the same order as the PrefetchInput entries of the section
+        std::vector<std::shared_ptr<cv::Mat>> images;
+        /// Statistics of the images. Empty statistics for inputs without PrefetchInput::statistics.
+        std::vector<ImageStatistics> statistics;
+    };
+
+    /**
+     * Batch processing of many sections spends a significant amount of time waiting for Reader::imread.
+     * The Prefetcher reads the images of the following sections on background threads while the current section is
+     * processed. All images of a section are read concurrently. The number of sections which are read ahead
+     * is limited by the prefetch depth and by a memory limit. The memory needed for a section is estimated with
+     * Reader::probe before the section is scheduled.
+     * Sections have to be retrieved in order with next().
+     * @brief Asynchronous reader for the images of a list of sections
+     */
+    class Prefetcher {
+    public:
+        /**
+         * Sections which are distributed while others are processed, e.g. by a SectionDistributor, aren't known in advance.
+         * The source is called whenever the prefetcher needs another section.
+         * @brief Function which stores the images of the next section in its argument
+         * @return False if there are no further sections
+         */
+        using Source = std::function<bool(std::vector<PrefetchInput>&)>;
+
+        /**
+         * @brief Create a prefetcher and start reading the first sections
+         * @param sections Images of each section which will be read. The sections will be returned in this order.
+         * @param depth Number of sections which will be read in advance while the current section is processed.
+         * A depth of 0 disables prefetching and each section will be read when next() is called.
+         * @param memoryLimit Maximum number of bytes which may be used by sections that were read in advance.
+         * 0 will use half of the currently available memory.
+         */
+        explicit Prefetcher(std::vector<std::vector<PrefetchInput>> sections, unsigned depth = 1,
+                            unsigned long long memoryLimit = 0);
+        /**
+         * @brief Create a prefetcher for sections retrieved from a source and start reading the first sections
+         * @param source Called for each further section. The sections will be returned in this order.
+         * @param depth Number of sections which will be read in advance while the current section is processed.
+         * @param memoryLimit Maximum number of bytes which may be used by sections that were read in advance.
+         * 0 will use half of the currently available memory.
+         */
+        explicit Prefetcher(Source source, unsigned depth = 1, unsigned long long memoryLimit = 0);
+        /**
+         * Check if there are sections which weren't returned by next() yet. The source is asked for the next section
+         * if all sections retrieved from it were returned. This method is thread safe.
+         * @brief Check if there are sections which weren't returned by next() yet.
+         * @return True if next() can be called.
+         */
+        bool hasNext();
+        /**
+         * Returns the images of the next section. If the section was not read in advance, this method will block
+         * until all images of the section are read. Exceptions thrown while reading the images are rethrown here.
+         * This method is thread safe.
+         * @brief Get the images of the next section
+         * @return Images and statistics of the next section
+         */
+        PrefetchedSection next();
+        /**
+         * @brief Estimate the memory needed to hold all images of a section after reading it.
+         * @param section Images of the section
+         * @return Estimated number of bytes
+         */
+        static unsigned long long estimateMemory(const std::vector<PrefetchInput>& section);
+        /**
+         * @brief Get the amount of physical memory which is currently available.
+         * @return Available memory in bytes
+         */
+        static unsigned long long availableMemory();
+    private:
+        /**
+         * @brief Check if there are sections which weren't returned by next() yet. Requires m_mutex.
+         */
+        bool available();
+        /**
+         * @brief Retrieve the next section from the source. Requires m_mutex.
+         * @return False if the source has no further sections
+         */
+        bool fetch();
+        /**
+         * @brief Start reading the following sections until the depth or memory limit is reached. Requires m_mutex.
+         */
+        void schedule();
+        /**
+         * @brief Start reading the section m_nextSection in the background
+         * @param memory Estimated memory of the section
+         */
+        void scheduleSection(unsigned long long memory);
+        static PrefetchedSection readSection(const std::vector<PrefetchInput>& section);
+
+        /// Sections which are read in the background keep a reference to their entry
+        std::deque<std::vector<PrefetchInput>> m_sections;
+        /// Empty if all sections were passed to the constructor
+        Source m_source;
+        /// True after the source returned false
+        bool m_exhausted;
+        ///
+        unsigned m_depth;
+        ///
+        unsigned long long m_memoryLimit;
+        /// Index of the next section which will be scheduled
+        size_t m_nextSection;
+        /// Number of sections which were returned by next()
+        size_t m_returnedSections;
+        /// Sections which are currently read in the background with their estimated memory
+        std::deque<std::pair<unsigned long long, std::future<PrefetchedSection>>> m_queue;
+        /// Estimated memory of all sections in m_queue
+        unsigned long long m_queuedMemory;
+        /// Serializes next() and hasNext() of concurrently processed sections
+        std::mutex m_mutex;
+    };
+}
+
+#endif //PLIMG_PREFETCHER_H
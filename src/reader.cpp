@@ -23,6 +23,141 @@
  */
 
 #include "reader.h"
+#include "hdf5configuration.h"
+#include "zarr.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <tiffio.h>
+#include <type_traits>
+
+namespace {
+    /**
+     * Converts the source image to 32-bit floating point values and calculates the statistics of the image.
+     * Images with 8-bit or 16-bit values have at most 65536 distinct values. Their occurrences are counted in the
+     * same pass in which the image is converted, and the value range, the number of non zero pixels and the histogram
+     * are derived from those counts afterwards. The histogram of other images needs the value range and is
+     * calculated on the converted image with thread local histograms.
+     * @tparam T Datatype of the source image
+     * @param source Continuous single channel image
+     * @param destination Continuous CV_32FC1 image with the same dimensions. May share its data with source if T is float.
+     * @param statistics Resulting statistics
+     */
+    template<typename T>
+    void convertWithStatistics(const cv::Mat& source, cv::Mat& destination, PLImg::ImageStatistics& statistics) {
+        const unsigned long long numberOfPixels = (unsigned long long) source.rows * source.cols;
+        // Get pointers from OpenCV matrices to prevent overflow errors when image is larger than UINT_MAX
+        const T* sourcePtr = (const T*) source.data;
+        float* destinationPtr = (float*) destination.data;
+
+        if constexpr(sizeof(T) <= 2) {
+            // The bit pattern of a value is its index in the table of occurrences
+            using Key = std::conditional_t<sizeof(T) == 1, uint8_t, uint16_t>;
+            constexpr size_t numberOfKeys = size_t(std::numeric_limits<Key>::max()) + 1;
+            std::vector<unsigned long long> occurrences(numberOfKeys, 0);
+            #pragma omp parallel default(shared)
+            {
+                std::vector<unsigned long long> localOccurrences(numberOfKeys, 0);
+                #pragma omp for schedule(static)
+                for(unsigned long long idx = 0; idx < numberOfPixels; ++idx) {
+                    Key key;
+                    std::memcpy(&key, &sourcePtr[idx], sizeof(T));
+                    ++localOccurrences[key];
+                    destinationPtr[idx] = float(sourcePtr[idx]);
+                }
+                #pragma omp critical
+                for(size_t key = 0; key < numberOfKeys; ++key) {
+                    occurrences[key] += localOccurrences[key];
+                }
+            }
+
+            std::vector<float> values(numberOfKeys);
+            float minValue = std::numeric_limits<float>::max();
+            float maxValue = std::numeric_limits<float>::lowest();
+            unsigned long long nonZero = 0;
+            for(size_t key = 0; key < numberOfKeys; ++key) {
+                const Key bits = Key(key);
+                T value;
+                std::memcpy(&value, &bits, sizeof(T));
+                values[key] = float(value);
+                if(occurrences[key] == 0) {
+                    continue;
+                }
+                minValue = std::min(minValue, values[key]);
+                maxValue = std::max(maxValue, values[key]);
+                if(values[key] != 0.0f) {
+                    nonZero += occurrences[key];
+                }
+            }
+            // Empty images or images only containing NaN values
+            if(minValue > maxValue) {
+                minValue = 0.0f;
+                maxValue = 0.0f;
+            }
+            statistics.min = minValue;
+            statistics.max = maxValue;
+            statistics.nonZero = nonZero;
+            statistics.histogram = cv::Mat::zeros(STATISTICS_NUMBER_OF_BINS, 1, CV_32SC1);
+            int* histogramPtr = (int*) statistics.histogram.data;
+            for(size_t key = 0; key < numberOfKeys; ++key) {
+                const int bin = statistics.bin(values[key]);
+                if(occurrences[key] > 0 && bin >= 0) {
+                    histogramPtr[bin] += int(occurrences[key]);
+                }
+            }
+            return;
+        }
+
+        float minValue = std::numeric_limits<float>::max();
+        float maxValue = std::numeric_limits<float>::lowest();
+        unsigned long long nonZero = 0;
+        #pragma omp parallel for reduction(min : minValue) reduction(max : maxValue) reduction(+ : nonZero) default(shared) schedule(static)
+        for(unsigned long long idx = 0; idx < numberOfPixels; ++idx) {
+            const float value = float(sourcePtr[idx]);
+            // Floating point images are used directly and do not need to be copied.
+            if constexpr(!std::is_same_v<T, float>) {
+                destinationPtr[idx] = value;
+            }
+            if(value < minValue) {
+                minValue = value;
+            }
+            if(value > maxValue) {
+                maxValue = value;
+            }
+            if(value != 0.0f) {
+                ++nonZero;
+            }
+        }
+        // Empty images or images only containing NaN values
+        if(minValue > maxValue) {
+            minValue = 0.0f;
+            maxValue = 0.0f;
+        }
+        statistics.min = minValue;
+        statistics.max = maxValue;
+        statistics.nonZero = nonZero;
+        statistics.histogram = cv::Mat::zeros(STATISTICS_NUMBER_OF_BINS, 1, CV_32SC1);
+
+        int* histogramPtr = (int*) statistics.histogram.data;
+        #pragma omp parallel default(shared)
+        {
+            std::vector<int> localHistogram(STATISTICS_NUMBER_OF_BINS, 0);
+            #pragma omp for schedule(static)
+            for(unsigned long long idx = 0; idx < numberOfPixels; ++idx) {
+                const int bin = statistics.bin(destinationPtr[idx]);
+                if(bin >= 0) {
+                    ++localHistogram[bin];
+                }
+            }
+            #pragma omp critical
+            for(int bin = 0; bin < STATISTICS_NUMBER_OF_BINS; ++bin) {
+                histogramPtr[bin] += localHistogram[bin];
+            }
+        }
+    }
+}
 
 bool PLImg::Reader::fileExists(const std::string& filename) {
     std::filesystem::path file{ filename };
@@ -30,29 +165,125 @@ bool PLImg::Reader::fileExists(const std::string& filename) {
 }
 
 cv::Mat PLImg::Reader::imread(const std::string& filename, const std::string& dataset) {
+    return imread(filename, dataset, 1u);
+}
+
+cv::Mat PLImg::Reader::imread(const std::string& filename, const std::string& dataset, unsigned stride) {
     // Check if file exists
     if(fileExists(filename)) {
         // Opening the file has to be handeled differently depending on the file ending.
         // This will be done here.
-        if(filename.substr(filename.size()-2) == "h5") {
-            return readHDF5(filename, dataset);
+        if(isZarr(filename)) {
+            return subsample(readZarr(filename, dataset), stride);
+        } else if(filename.substr(filename.size()-2) == "h5") {
+            return readHDF5(filename, dataset, stride);
         } else if(filename.substr(filename.size()-3) == "nii" || filename.substr(filename.size()-6) == "nii.gz"){
-            return readNIFTI(filename);
+            return subsample(readNIFTI(filename), stride);
         } else {
-            return readTiff(filename);
+            return readTiff(filename, stride);
         }
     } else {
         throw std::filesystem::filesystem_error("File not found: " + filename, std::error_code(10, std::generic_category()));
     }
 }
 
-cv::Mat PLImg::Reader::readHDF5(const std::string &filename, const std::string &dataset) {
-    hid_t file, dspace, dset;
+cv::Mat PLImg::Reader::imread(const std::string& filename, const std::string& dataset, const cv::Rect& region) {
+    if(!fileExists(filename)) {
+        throw std::filesystem::filesystem_error("File not found: " + filename, std::error_code(10, std::generic_category()));
+    }
+    if(region.empty()) {
+        throw std::runtime_error("Cannot read an empty region of " + filename);
+    }
+    if(isZarr(filename)) {
+        return readZarr(filename, dataset, region);
+    } else if(filename.substr(filename.size()-2) == "h5") {
+        return readHDF5(filename, dataset, 1, region);
+    } else {
+        throw std::runtime_error("Reading a region is only supported for HDF5 files and Zarr stores: " + filename);
+    }
+}
+
+cv::Mat PLImg::Reader::imread(const std::string& filename, const std::string& dataset, ImageStatistics& statistics) {
+    return convert(imread(filename, dataset), statistics);
+}
+
+cv::Mat PLImg::Reader::subsample(const cv::Mat& image, unsigned stride) {
+    if(stride <= 1) {
+        return image;
+    }
+    cv::Mat result((image.rows + stride - 1) / stride, (image.cols + stride - 1) / stride, image.type());
+    const size_t elementSize = image.elemSize();
+
+    #pragma omp parallel for default(shared) schedule(static)
+    for(int row = 0; row < result.rows; ++row) {
+        const uchar* sourcePtr = image.ptr<uchar>(row * stride);
+        uchar* destinationPtr = result.ptr<uchar>(row);
+        for(int col = 0; col < result.cols; ++col) {
+            std::memcpy(destinationPtr + col * elementSize, sourcePtr + (size_t) col * stride * elementSize, elementSize);
+        }
+    }
+    return result;
+}
+
+cv::Mat PLImg::Reader::convert(const cv::Mat& image, ImageStatistics& statistics) {
+    if(image.channels() != 1) {
+        throw std::runtime_error("Only single channel images can be converted to floating point values!");
+    }
+    cv::Mat source = image.isContinuous() ? image : image.clone();
+    cv::Mat result;
+    if(source.depth() == CV_32F) {
+        result = source;
+    } else {
+        result = cv::Mat(source.rows, source.cols, CV_32FC1);
+    }
+
+    switch(source.depth()) {
+        case CV_8U:
+            convertWithStatistics<uchar>(source, result, statistics);
+            break;
+        case CV_8S:
+            convertWithStatistics<schar>(source, result, statistics);
+            break;
+        case CV_16U:
+            convertWithStatistics<ushort>(source, result, statistics);
+            break;
+        case CV_16S:
+            convertWithStatistics<short>(source, result, statistics);
+            break;
+        case CV_32S:
+            convertWithStatistics<int>(source, result, statistics);
+            break;
+        case CV_16F:
+            convertWithStatistics<cv::float16_t>(source, result, statistics);
+            break;
+        case CV_32F:
+            convertWithStatistics<float>(source, result, statistics);
+            break;
+        case CV_64F:
+            convertWithStatistics<double>(source, result, statistics);
+            break;
+        default:
+            throw std::runtime_error("Datatype is currently not supported. Please contact the maintainer of the program!");
+    }
+    return result;
+}
+
+cv::Mat PLImg::Reader::readHDF5(const std::string &filename, const std::string &dataset, unsigned stride,
+                                const cv::Rect& region) {
+    auto lock = lockHDF5();
+    hid_t file, dspace, dset, memspace = H5S_ALL;
     hsize_t dims[2];
     // Open file read only
-    file = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    file = HDF5Configuration::global().open(filename, H5F_ACC_RDONLY);
+    if(file < 0) {
+        throw std::runtime_error("Could not open HDF5 file " + filename);
+    }
     // Open dataset
     dset = H5Dopen(file, dataset.c_str(), H5P_DEFAULT);
+    if(dset < 0) {
+        H5Fclose(file);
+        throw std::runtime_error("Could not open dataset " + dataset + " in " + filename);
+    }
     // Get dataspace
     dspace = H5Dget_space(dset);
     // Get image dimensions
@@ -61,20 +292,59 @@ cv::Mat PLImg::Reader::readHDF5(const std::string &filename, const std::string &
     // OpenCV does use other names and integers for its own datatype handling.
     // Check the HDF5 type and convert it to a valid OpenCV mat type.
     hid_t type = H5Dget_type(dset);
+    hid_t memType = type;
     int matType;
     if(H5Tequal(type, H5T_NATIVE_UCHAR)) {
         matType = CV_8UC1;
     } else if(H5Tequal(type, H5T_NATIVE_FLOAT)) {
         matType = CV_32FC1;
+    } else if(H5Tget_class(type) == H5T_FLOAT && H5Tget_size(type) == 2) {
+        // Half precision values are converted to 32-bit floating point values by HDF5
+        matType = CV_32FC1;
+        memType = H5T_NATIVE_FLOAT;
     } else if(H5Tequal(type, H5T_NATIVE_INT)) {
         matType = CV_32SC1;
+    } else if(H5Tequal(type, H5T_NATIVE_USHORT)) {
+        matType = CV_16UC1;
+    } else if(H5Tequal(type, H5T_NATIVE_DOUBLE)) {
+        matType = CV_64FC1;
     } else {
         throw std::runtime_error("Datatype is currently not supported. Please contact the maintainer of the program!");
     }
+    hsize_t start[2] = {0, 0};
+    if(!region.empty()) {
+        if(region.x < 0 || region.y < 0 || hsize_t(region.y + region.height) > dims[0] ||
+           hsize_t(region.x + region.width) > dims[1]) {
+            H5Tclose(type);
+            H5Sclose(dspace);
+            H5Dclose(dset);
+            H5Fclose(file);
+            throw std::runtime_error("Region exceeds the dimensions of " + filename + dataset);
+        }
+        start[0] = hsize_t(region.y);
+        start[1] = hsize_t(region.x);
+        dims[0] = hsize_t(region.height);
+        dims[1] = hsize_t(region.width);
+    }
+    hid_t filespace = H5S_ALL;
+    if(stride > 1 || !region.empty()) {
+        // Select every stride-th row and column of the region. Only the selected elements will be read from the file.
+        stride = std::max(stride, 1u);
+        hsize_t strides[2] = {stride, stride};
+        hsize_t count[2] = {(dims[0] + stride - 1) / stride, (dims[1] + stride - 1) / stride};
+        H5Sselect_hyperslab(dspace, H5S_SELECT_SET, start, strides, count, nullptr);
+        memspace = H5Screate_simple(2, count, nullptr);
+        filespace = dspace;
+        dims[0] = count[0];
+        dims[1] = count[1];
+    }
     // Create OpenCV mat and copy content from dataset to mat
     cv::Mat image(dims[0], dims[1], matType);
-    H5Dread(dset, type, dspace, H5S_ALL, H5S_ALL, image.data);
+    H5Dread(dset, memType, memspace, filespace, H5P_DEFAULT, image.data);
 
+    if(memspace != H5S_ALL) {
+        H5Sclose(memspace);
+    }
     H5Tclose(type);
     H5Sclose(dspace);
     H5Dclose(dset);
@@ -83,6 +353,16 @@ cv::Mat PLImg::Reader::readHDF5(const std::string &filename, const std::string &
     return image;
 }
 
+cv::Mat PLImg::Reader::readZarr(const std::string& filename, const std::string& dataset, const cv::Rect& region) {
+    std::string path = ZarrArray::arrayPath(filename, dataset);
+    return ZarrArray::read(path).readImage(path, region);
+}
+
+bool PLImg::Reader::isZarr(const std::string& filename) {
+    std::string path = ZarrArray::arrayPath(filename, "");
+    return path.size() >= 5 && path.substr(path.size() - 5) == ".zarr";
+}
+
 cv::Mat PLImg::Reader::readNIFTI(const std::string &filename) {
     nifti_image * img = nifti_image_read(filename.c_str(), 1);
     // Get image dimensions
@@ -92,12 +372,18 @@ cv::Mat PLImg::Reader::readNIFTI(const std::string &filename) {
     uint datatype = img->datatype;
     uint cv_type;
     switch(datatype) {
+        case 64:
+            cv_type = CV_64FC1;
+            break;
         case 16:
             cv_type = CV_32FC1;
             break;
         case 8:
             cv_type = CV_32SC1;
             break;
+        case 512:
+            cv_type = CV_16UC1;
+            break;
         case 4:
             cv_type = CV_16SC1;
             break;
@@ -105,7 +391,7 @@ cv::Mat PLImg::Reader::readNIFTI(const std::string &filename) {
             cv_type = CV_8SC1;
         break;
         default:
-            throw std::runtime_error("Did expect 32-bit floating point or 8/16/32-bit integer image!");
+            throw std::runtime_error("Did expect 32/64-bit floating point or 8/16/32-bit integer image!");
     }
     // Create OpenCV image with the image data
     cv::Mat image(height, width, cv_type);
@@ -113,13 +399,357 @@ cv::Mat PLImg::Reader::readNIFTI(const std::string &filename) {
     return image;
 }
 
-cv::Mat PLImg::Reader::readTiff(const std::string &filename) {
-    return cv::imread(filename, cv::IMREAD_ANYDEPTH);
+cv::Mat PLImg::Reader::readTiff(const std::string &filename, unsigned stride) {
+    if(stride <= 1) {
+        return cv::imread(filename, cv::IMREAD_ANYDEPTH);
+    }
+
+    ImageInfo info = probeTiff(filename);
+    TIFF* tif = TIFFOpen(filename.c_str(), "r");
+    if(!tif) {
+        throw std::runtime_error("Could not open TIFF file " + filename);
+    }
+    uint16_t samplesPerPixel;
+    TIFFGetFieldDefaulted(tif, TIFFTAG_SAMPLESPERPIXEL, &samplesPerPixel);
+    // Images which can't be read with single sample rows will be read completely and subsampled afterwards
+    if(samplesPerPixel != 1) {
+        TIFFClose(tif);
+        return subsample(cv::imread(filename, cv::IMREAD_ANYDEPTH), stride);
+    }
+    // The samples are copied byte by byte into the image
+    if(info.elementSize != CV_ELEM_SIZE(info.type)) {
+        TIFFClose(tif);
+        throw std::runtime_error("Sample size of TIFF file " + filename + " doesn't match its datatype " + info.dtype);
+    }
+
+    const unsigned long long height = info.dims.at(0);
+    const unsigned long long width = info.dims.at(1);
+    const unsigned long long blockHeight = info.chunkDims.at(0);
+    const unsigned long long blockWidth = info.layout == "tiles" ? info.chunkDims.at(1) : width;
+    const size_t elementSize = info.elementSize;
+    cv::Mat image((height + stride - 1) / stride, (width + stride - 1) / stride, info.type);
+
+    std::vector<uchar> buffer(info.layout == "tiles" ? TIFFTileSize(tif) : TIFFStripSize(tif));
+    for(unsigned long long blockRow = 0; blockRow < height; blockRow += blockHeight) {
+        const unsigned long long blockEnd = std::min(blockRow + blockHeight, height);
+        // Skip strips and tiles without a selected row
+        const unsigned long long firstRow = (blockRow + stride - 1) / stride * stride;
+        if(firstRow >= blockEnd) {
+            continue;
+        }
+        for(unsigned long long blockCol = 0; blockCol < width; blockCol += blockWidth) {
+            if(info.layout == "tiles") {
+                if(TIFFReadTile(tif, buffer.data(), blockCol, blockRow, 0, 0) < 0) {
+                    TIFFClose(tif);
+                    throw std::runtime_error("Could not read tile of TIFF file " + filename);
+                }
+            } else if(TIFFReadEncodedStrip(tif, TIFFComputeStrip(tif, blockRow, 0), buffer.data(), -1) < 0) {
+                TIFFClose(tif);
+                throw std::runtime_error("Could not read strip of TIFF file " + filename);
+            }
+
+            const unsigned long long blockColEnd = std::min(blockCol + blockWidth, width);
+            const unsigned long long firstCol = (blockCol + stride - 1) / stride * stride;
+            for(unsigned long long row = firstRow; row < blockEnd; row += stride) {
+                const uchar* sourcePtr = buffer.data() + (row - blockRow) * blockWidth * elementSize;
+                uchar* destinationPtr = image.ptr<uchar>(row / stride);
+                for(unsigned long long col = firstCol; col < blockColEnd; col += stride) {
+                    std::memcpy(destinationPtr + (col / stride) * elementSize, sourcePtr + (col - blockCol) * elementSize, elementSize);
+                }
+            }
+        }
+    }
+
+    TIFFClose(tif);
+    return image;
+}
+
+PLImg::ImageInfo PLImg::Reader::probe(const std::string& filename, const std::string& dataset) {
+    if(fileExists(filename)) {
+        if(isZarr(filename)) {
+            return probeZarr(filename, dataset);
+        } else if(filename.substr(filename.size()-2) == "h5") {
+            return probeHDF5(filename, dataset);
+        } else if(filename.substr(filename.size()-3) == "nii" || filename.substr(filename.size()-6) == "nii.gz"){
+            return probeNIFTI(filename);
+        } else {
+            return probeTiff(filename);
+        }
+    } else {
+        throw std::filesystem::filesystem_error("File not found: " + filename, std::error_code(10, std::generic_category()));
+    }
+}
+
+PLImg::ImageInfo PLImg::Reader::probeZarr(const std::string& filename, const std::string& dataset) {
+    ZarrArray array = ZarrArray::read(ZarrArray::arrayPath(filename, dataset));
+    ImageInfo info;
+    info.dims = array.shape;
+    info.type = array.type();
+    info.elementSize = info.type == CV_8UC1 ? 1 : 4;
+    info.dtype = info.type == CV_32FC1 ? "float32" : info.type == CV_32SC1 ? "int32" : "uint8";
+    info.layout = "chunked";
+    info.chunkDims = array.chunks;
+    if(array.shuffle) {
+        info.filters.emplace_back("shuffle");
+    }
+    if(array.level >= 0) {
+        info.filters.emplace_back("zlib");
+    }
+    return info;
+}
+
+PLImg::ImageInfo PLImg::Reader::probeHDF5(const std::string& filename, const std::string& dataset) {
+    auto lock = lockHDF5();
+    ImageInfo info;
+    hid_t file, dset, dspace, type, plist;
+    file = HDF5Configuration::global().open(filename, H5F_ACC_RDONLY);
+    if(file < 0) {
+        throw std::runtime_error("Could not open HDF5 file " + filename);
+    }
+    dset = H5Dopen(file, dataset.c_str(), H5P_DEFAULT);
+    if(dset < 0) {
+        H5Fclose(file);
+        throw std::runtime_error("Could not open dataset " + dataset + " in " + filename);
+    }
+
+    // Get image dimensions
+    dspace = H5Dget_space(dset);
+    int ndims = H5Sget_simple_extent_ndims(dspace);
+    std::vector<hsize_t> dims(ndims);
+    H5Sget_simple_extent_dims(dspace, dims.data(), nullptr);
+    info.dims.assign(dims.begin(), dims.end());
+
+    // Get datatype. Only the types supported by readHDF5 will get a valid OpenCV type.
+    type = H5Dget_type(dset);
+    info.elementSize = H5Tget_size(type);
+    if(H5Tget_class(type) == H5T_FLOAT) {
+        info.dtype = "float" + std::to_string(8 * info.elementSize);
+    } else if(H5Tget_class(type) == H5T_INTEGER) {
+        info.dtype = std::string(H5Tget_sign(type) == H5T_SGN_NONE ? "uint" : "int") + std::to_string(8 * info.elementSize);
+    } else {
+        info.dtype = "unknown";
+    }
+    if(H5Tequal(type, H5T_NATIVE_UCHAR)) {
+        info.type = CV_8UC1;
+    } else if(H5Tequal(type, H5T_NATIVE_FLOAT) || (H5Tget_class(type) == H5T_FLOAT && info.elementSize == 2)) {
+        info.type = CV_32FC1;
+    } else if(H5Tequal(type, H5T_NATIVE_INT)) {
+        info.type = CV_32SC1;
+    } else if(H5Tequal(type, H5T_NATIVE_USHORT)) {
+        info.type = CV_16UC1;
+    } else if(H5Tequal(type, H5T_NATIVE_DOUBLE)) {
+        info.type = CV_64FC1;
+    }
+
+    // Get storage layout, chunk dimensions and filters
+    plist = H5Dget_create_plist(dset);
+    switch(H5Pget_layout(plist)) {
+        case H5D_COMPACT:
+            info.layout = "compact";
+            break;
+        case H5D_CONTIGUOUS:
+            info.layout = "contiguous";
+            break;
+        case H5D_CHUNKED: {
+            info.layout = "chunked";
+            std::vector<hsize_t> chunkDims(ndims);
+            H5Pget_chunk(plist, ndims, chunkDims.data());
+            info.chunkDims.assign(chunkDims.begin(), chunkDims.end());
+            break;
+        }
+        case H5D_VIRTUAL:
+            info.layout = "virtual";
+            break;
+        default:
+            info.layout = "unknown";
+    }
+    int numberOfFilters = H5Pget_nfilters(plist);
+    for(int i = 0; i < numberOfFilters; ++i) {
+        unsigned int flags;
+        size_t numberOfValues = 0;
+        char name[256] = "";
+        H5Z_filter_t filter = H5Pget_filter2(plist, i, &flags, &numberOfValues, nullptr, sizeof(name), name, nullptr);
+        info.filters.emplace_back(name[0] != '\0' ? std::string(name) : "filter " + std::to_string(filter));
+    }
+
+    H5Pclose(plist);
+    H5Tclose(type);
+    H5Sclose(dspace);
+    H5Dclose(dset);
+    H5Fclose(file);
+
+    return info;
+}
+
+PLImg::ImageInfo PLImg::Reader::probeTiff(const std::string& filename) {
+    ImageInfo info;
+    TIFF* tif = TIFFOpen(filename.c_str(), "r");
+    if(!tif) {
+        throw std::runtime_error("Could not open TIFF file " + filename);
+    }
+
+    uint32_t width = 0, height = 0;
+    uint16_t bitsPerSample, sampleFormat, compression;
+    TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &width);
+    TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &height);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_BITSPERSAMPLE, &bitsPerSample);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_SAMPLEFORMAT, &sampleFormat);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_COMPRESSION, &compression);
+    info.dims = {height, width};
+    info.elementSize = bitsPerSample / 8;
+
+    // cv::imread with cv::IMREAD_ANYDEPTH will keep the datatype of the TIFF file. The OpenCV type has to match the
+    // size of the samples, as readTiff copies the samples directly into the image.
+    if(sampleFormat == SAMPLEFORMAT_IEEEFP) {
+        info.dtype = "float" + std::to_string(bitsPerSample);
+    } else if(sampleFormat == SAMPLEFORMAT_INT) {
+        info.dtype = "int" + std::to_string(bitsPerSample);
+    } else {
+        info.dtype = "uint" + std::to_string(bitsPerSample);
+    }
+    static const std::map<std::string, int> types = {
+            {"uint8", CV_8UC1}, {"uint16", CV_16UC1},
+            {"int8", CV_8SC1}, {"int16", CV_16SC1}, {"int32", CV_32SC1},
+            {"float16", CV_16FC1}, {"float32", CV_32FC1}, {"float64", CV_64FC1}
+    };
+    auto type = types.find(info.dtype);
+    if(type == types.end()) {
+        TIFFClose(tif);
+        throw std::runtime_error("Unsupported datatype " + info.dtype + " of TIFF file " + filename);
+    }
+    info.type = type->second;
+
+    if(TIFFIsTiled(tif)) {
+        uint32_t tileWidth = 0, tileHeight = 0;
+        TIFFGetField(tif, TIFFTAG_TILEWIDTH, &tileWidth);
+        TIFFGetField(tif, TIFFTAG_TILELENGTH, &tileHeight);
+        info.layout = "tiles";
+        info.chunkDims = {tileHeight, tileWidth};
+    } else {
+        uint32_t rowsPerStrip = height;
+        TIFFGetFieldDefaulted(tif, TIFFTAG_ROWSPERSTRIP, &rowsPerStrip);
+        info.layout = "strips";
+        info.chunkDims = {std::min(rowsPerStrip, height), width};
+    }
+
+    switch(compression) {
+        case COMPRESSION_NONE:
+            break;
+        case COMPRESSION_LZW:
+            info.filters.emplace_back("lzw");
+            break;
+        case COMPRESSION_ADOBE_DEFLATE:
+        case COMPRESSION_DEFLATE:
+            info.filters.emplace_back("deflate");
+            break;
+        case COMPRESSION_PACKBITS:
+            info.filters.emplace_back("packbits");
+            break;
+        case COMPRESSION_JPEG:
+            info.filters.emplace_back("jpeg");
+            break;
+        default:
+            info.filters.emplace_back("compression " + std::to_string(compression));
+    }
+
+    TIFFClose(tif);
+    return info;
+}
+
+PLImg::ImageInfo PLImg::Reader::probeNIFTI(const std::string& filename) {
+    ImageInfo info;
+    // Only read the header of the NIfTI file
+    nifti_image* img = nifti_image_read(filename.c_str(), 0);
+    if(!img) {
+        throw std::runtime_error("Could not open NIfTI file " + filename);
+    }
+    info.dims = {(unsigned long long) img->ny, (unsigned long long) img->nx};
+    info.elementSize = img->nbyper;
+    info.layout = "contiguous";
+    switch(img->datatype) {
+        case 64:
+            info.dtype = "float64";
+            info.type = CV_64FC1;
+            break;
+        case 16:
+            info.dtype = "float32";
+            info.type = CV_32FC1;
+            break;
+        case 8:
+            info.dtype = "int32";
+            info.type = CV_32SC1;
+            break;
+        case 512:
+            info.dtype = "uint16";
+            info.type = CV_16UC1;
+            break;
+        case 4:
+            info.dtype = "int16";
+            info.type = CV_16SC1;
+            break;
+        case 2:
+            info.dtype = "uint8";
+            info.type = CV_8SC1;
+            break;
+        default:
+            info.dtype = "unknown";
+    }
+    if(filename.substr(filename.size()-3) == ".gz") {
+        info.filters.emplace_back("gzip");
+    }
+    nifti_image_free(img);
+    return info;
+}
+
+double PLImg::Reader::attribute(const std::string& filename, const std::string& dataset, const std::string& name) {
+    if(isZarr(filename)) {
+        std::map<std::string, std::string> attributes = ZarrWriter::read_attributes(filename, dataset);
+        auto value = attributes.find(name);
+        if(value == attributes.end()) {
+            throw std::runtime_error("Could not open attribute " + name + " of " + dataset + " in " + filename);
+        }
+        try {
+            size_t length = 0;
+            double number = std::stod(value->second, &length);
+            if(length == value->second.size()) {
+                return number;
+            }
+        } catch(const std::exception&) {}
+        throw std::runtime_error("Attribute " + name + " of " + dataset + " in " + filename + " is not numeric");
+    }
+    auto lock = lockHDF5();
+    hid_t file = HDF5Configuration::global().open(filename, H5F_ACC_RDONLY);
+    if(file < 0) {
+        throw std::runtime_error("Could not open HDF5 file " + filename);
+    }
+    hid_t attr = H5Aopen_by_name(file, dataset.c_str(), name.c_str(), H5P_DEFAULT, H5P_DEFAULT);
+    if(attr < 0) {
+        H5Fclose(file);
+        throw std::runtime_error("Could not open attribute " + name + " of " + dataset + " in " + filename);
+    }
+    double value;
+    herr_t status = H5Aread(attr, H5T_NATIVE_DOUBLE, &value);
+    H5Aclose(attr);
+    H5Fclose(file);
+    if(status < 0) {
+        throw std::runtime_error("Attribute " + name + " of " + dataset + " in " + filename + " is not numeric");
+    }
+    return value;
+}
+
+std::unique_lock<std::recursive_mutex> PLImg::Reader::lockHDF5() {
+    static std::recursive_mutex mutex;
+    #ifdef H5_HAVE_THREADSAFE
+        return std::unique_lock<std::recursive_mutex>(mutex, std::defer_lock);
+    #else
+        return std::unique_lock<std::recursive_mutex>(mutex);
+    #endif
 }
 
 std::vector<std::string> PLImg::Reader::datasets(const std::string &filename) {
+    auto lock = lockHDF5();
     std::vector<std::string> names;
-    hid_t file = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    hid_t file = HDF5Configuration::global().open(filename, H5F_ACC_RDONLY);
     names = datasets(file);
     H5Fclose(file);
     return names;
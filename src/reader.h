@@ -25,19 +25,102 @@
 #ifndef PLIMG_READER_H
 #define PLIMG_READER_H
 
+#include <algorithm>
 #include <filesystem>
+#include <mutex>
 #include <vector>
 #include <hdf5.h>
 #include <nifti/nifti1_io.h>
 #include <opencv2/core.hpp>
 #include <opencv2/imgcodecs.hpp>
+#include <string>
 #include <sys/stat.h>
 
+/// Number of bins of the histogram in ImageStatistics. This is a multiple of all bin counts used by MaskGeneration
+/// so that those histograms can be derived from it without reading the image again.
+constexpr auto STATISTICS_NUMBER_OF_BINS = 16384;
+
 /**
  * @file
  * @brief PLImg::Reader class
  */
 namespace PLImg {
+    /**
+     * Statistics of an image which are calculated while the image is converted to 32-bit floating point values.
+     * Passing those statistics to MaskGeneration prevents additional passes over the image to find the value range
+     * and to calculate histograms in the full value range.
+     * @brief Value range, number of non zero pixels and fine histogram of an image
+     */
+    struct ImageStatistics {
+        /// Minimal value of the image. NaN values are ignored.
+        double min = 0;
+        /// Maximal value of the image. NaN values are ignored.
+        double max = 0;
+        /// Number of pixels which are not zero.
+        unsigned long long nonZero = 0;
+        /// Histogram with STATISTICS_NUMBER_OF_BINS bins in the range [min, max] as CV_32SC1.
+        cv::Mat histogram;
+
+        /**
+         * @brief Check if the statistics were calculated
+         * @return True if no histogram is present.
+         */
+        bool empty() const {
+            return histogram.empty();
+        }
+
+        /**
+         * Determine the histogram bin of a value. The binning matches PLImg::cuda::histogram with
+         * STATISTICS_NUMBER_OF_BINS bins in the range [min, max].
+         * @param value Value which shall be sorted into the histogram
+         * @return Bin of the value or -1 if the value is not within [min, max]
+         */
+        int bin(float value) const {
+            if(!(value >= float(min) && value <= float(max))) {
+                return -1;
+            }
+            const float binWidth = (float(max) - float(min)) / float(STATISTICS_NUMBER_OF_BINS);
+            if(binWidth <= 0.0f) {
+                return 0;
+            }
+            return std::min(int((value - float(min)) / binWidth), STATISTICS_NUMBER_OF_BINS - 1);
+        }
+    };
+
+    /**
+     * Metadata of an image which can be retrieved without reading any pixel of the image. This allows to plan
+     * the memory usage and the execution of a program before the image itself is loaded.
+     * @brief Dimensions, datatype and storage layout of an image
+     */
+    struct ImageInfo {
+        /// Dimensions of the stored image. The first dimension is the number of rows, the second the number of columns.
+        std::vector<unsigned long long> dims;
+        /// Name of the stored datatype (uint8, int16, uint16, int32, float32, float64, ...)
+        std::string dtype;
+        /// OpenCV type which will be returned by Reader::imread(const std::string&, const std::string&). -1 if the datatype is not supported.
+        int type = -1;
+        /// Size of a single stored element in bytes
+        size_t elementSize = 0;
+        /// Storage layout of the image (contiguous, chunked, compact, virtual, strips or tiles)
+        std::string layout;
+        /// Dimensions of a HDF5 chunk, TIFF tile or TIFF strip. Empty for other layouts.
+        std::vector<unsigned long long> chunkDims;
+        /// Filters or compression applied to the stored image
+        std::vector<std::string> filters;
+
+        /**
+         * @brief Number of pixels in the image
+         * @return Product of all dimensions
+         */
+        unsigned long long numberOfPixels() const {
+            unsigned long long pixels = dims.empty() ? 0 : 1;
+            for(auto dim : dims) {
+                pixels *= dim;
+            }
+            return pixels;
+        }
+    };
+
     class Reader {
     public:
         /**
@@ -47,32 +130,113 @@ namespace PLImg {
          */
         static bool fileExists(const std::string& filename);
         /**
-         * Opens and reads an image with file ending .h5, .nii or .tiff
+         * Opens and reads an image with file ending .h5, .nii, .tiff or a .zarr store
          * @param filename Path to the file which shall be opened.
          * @param dataset HDF5 dataset from which the image shall be read.
          * @return OpenCV Matrix containing the image.
          */
         static cv::Mat imread(const std::string& filename, const std::string& dataset="/Image");
+        /**
+         * Opens and reads an image with file ending .h5, .nii, .tiff or a .zarr store. The image will be converted to 32-bit
+         * floating point values. The value range, number of non zero pixels and a fine histogram are
+         * calculated alongside the conversion.
+         * @param filename Path to the file which shall be opened.
+         * @param dataset HDF5 dataset from which the image shall be read.
+         * @param statistics Statistics of the returned image.
+         * @return OpenCV Matrix containing the image as CV_32FC1.
+         */
+        static cv::Mat imread(const std::string& filename, const std::string& dataset, ImageStatistics& statistics);
+        /**
+         * Opens and reads every stride-th row and column of an image with file ending .h5, .nii or .tiff.
+         * HDF5 datasets are read with a strided hyperslab and TIFF strips or tiles which do not contain a selected
+         * row are skipped. NIfTI images are read completely and subsampled afterwards.
+         * @param filename Path to the file which shall be opened.
+         * @param dataset HDF5 dataset from which the image shall be read.
+         * @param stride Distance between two selected rows or columns. A stride of 1 reads the full image.
+         * @return OpenCV Matrix containing the subsampled image.
+         */
+        static cv::Mat imread(const std::string& filename, const std::string& dataset, unsigned stride);
+        /**
+         * Opens and reads a rectangular region of an image with file ending .h5 or a .zarr store. HDF5 datasets are
+         * read with a hyperslab and only the Zarr chunks overlapping the region are decompressed. This allows processing
+         * images which don't fit into the main memory tile by tile.
+         * @param filename Path to the file which shall be opened.
+         * @param dataset HDF5 dataset from which the image shall be read.
+         * @param region Region of the image which shall be read. Has to lie within the image.
+         * @return OpenCV Matrix containing the region with its original datatype.
+         * @throws std::runtime_error if the region exceeds the image or the file format doesn't support partial reads.
+         */
+        static cv::Mat imread(const std::string& filename, const std::string& dataset, const cv::Rect& region);
+        /**
+         * Select every stride-th row and column of an image.
+         * @param image Image which shall be subsampled
+         * @param stride Distance between two selected rows or columns.
+         * @return Copy of the selected pixels. If the stride is 1 or less, the image itself is returned.
+         */
+        static cv::Mat subsample(const cv::Mat& image, unsigned stride);
+        /**
+         * Converts an image with 8/16-bit unsigned, 32-bit signed integer or 32/64-bit floating point values to
+         * 32-bit floating point values and calculates its statistics in the same pass.
+         * Images which already are CV_32FC1 will not be copied.
+         * @param image Image which shall be converted
+         * @param statistics Statistics of the returned image.
+         * @return OpenCV Matrix containing the image as CV_32FC1.
+         */
+        static cv::Mat convert(const cv::Mat& image, ImageStatistics& statistics);
+        /**
+         * Reads the metadata of an image with file ending .h5, .nii, .tiff or a .zarr store without loading the image itself.
+         * @param filename Path to the file which shall be opened.
+         * @param dataset HDF5 dataset of which the metadata shall be read.
+         * @return Dimensions, datatype and storage layout of the image
+         */
+        static ImageInfo probe(const std::string& filename, const std::string& dataset="/Image");
+        /**
+         * Reads a numeric attribute of a dataset or group within a HDF5 file or a Zarr store.
+         * @param filename Path to the HDF5 file or Zarr store
+         * @param dataset Dataset or group of the attribute
+         * @param name Name of the attribute
+         * @return Value of the attribute converted to double
+         * @throws std::runtime_error if the attribute doesn't exist or isn't numeric
+         */
+        static double attribute(const std::string& filename, const std::string& dataset, const std::string& name);
         /**
          * Returns a list of all readable datasets within the given HDF5 file
          * @param filename Path to the file which shall be opened.
          * @return Vector of readable datasets
          */
         static std::vector<std::string> datasets(const std::string& filename);
+        /**
+         * The HDF5 library may only be used by one thread at a time unless it was built with thread-safety enabled.
+         * All HDF5 calls in PLImg acquire this lock, which allows reading images on background threads while
+         * other files are written. If the HDF5 library is thread-safe, the returned lock does not hold the mutex.
+         * @brief Acquire the global HDF5 lock
+         * @return Lock which is released when it goes out of scope
+         */
+        static std::unique_lock<std::recursive_mutex> lockHDF5();
+        /**
+         * @brief Check if the path is a Zarr directory store
+         * @param filename Path which shall be checked
+         * @return True if the path ends with .zarr
+         */
+        static bool isZarr(const std::string& filename);
     private:
         /**
          * Opens and reads an image with file ending .h5
          * @param filename Path to the file which shall be opened.
          * @param dataset HDF5 dataset from which the image shall be read.
+         * @param stride Distance between two rows or columns which will be read.
+         * @param region Region which shall be read. An empty region reads the full image.
          * @return OpenCV Matrix containing the image.
          */
-        static cv::Mat readHDF5(const std::string& filename, const std::string& dataset="/Image");
+        static cv::Mat readHDF5(const std::string& filename, const std::string& dataset="/Image", unsigned stride=1,
+                                const cv::Rect& region=cv::Rect());
         /**
          * Opens and reads an image with file ending .tiff
          * @param filename Path to the file which shall be opened.
+         * @param stride Distance between two rows or columns which will be read.
          * @return OpenCV Matrix containing the image.
          */
-        static cv::Mat readTiff(const std::string& filename);
+        static cv::Mat readTiff(const std::string& filename, unsigned stride=1);
         /**
          * Opens and reads an image with file ending .nii
          * @param filename Path to the file which shall be opened.
@@ -80,6 +244,20 @@ namespace PLImg {
          */
         static cv::Mat readNIFTI(const std::string& filename);
 
+        /**
+         * Opens and reads an array of a Zarr directory store
+         * @param filename Directory of the store ending with .zarr
+         * @param dataset Array within the store
+         * @param region Region which shall be read. An empty region reads the full image.
+         * @return OpenCV Matrix containing the image.
+         */
+        static cv::Mat readZarr(const std::string& filename, const std::string& dataset="/Image",
+                                const cv::Rect& region=cv::Rect());
+        static ImageInfo probeZarr(const std::string& filename, const std::string& dataset="/Image");
+        static ImageInfo probeHDF5(const std::string& filename, const std::string& dataset="/Image");
+        static ImageInfo probeTiff(const std::string& filename);
+        static ImageInfo probeNIFTI(const std::string& filename);
+
         static std::vector<std::string> datasets(hid_t group_id);
     };
 
@@ -0,0 +1,267 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Forschungszentrum Jülich / Jan André Reuter.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "scheduler.h"
+#include "prefetcher.h"
+#include <algorithm>
+#include <omp.h>
+#include <stdexcept>
+#include <thread>
+#ifdef __GNUC__
+    #include <fstream>
+    #include <sys/resource.h>
+    #include <unistd.h>
+#else
+    #define NOMINMAX
+    #include <Windows.h>
+    #include <psapi.h>
+#endif
+
+PLImg::SectionScheduler::SectionScheduler(unsigned long long memoryBudget, unsigned threads, unsigned maxSections) :
+        m_memoryBudget(memoryBudget), m_threads(threads), m_maxSections(maxSections),
+        m_usedMemory(0), m_peakMemory(0), m_runningSections(0), m_peakSections(0) {
+    if(m_memoryBudget == 0) {
+        m_memoryBudget = Prefetcher::availableMemory() / 2;
+    }
+    if(m_threads == 0) {
+        m_threads = std::max(1, omp_get_num_procs());
+    }
+    if(m_maxSections == 0) {
+        m_maxSections = m_threads;
+    }
+}
+
+void PLImg::SectionScheduler::run(size_t sections, const std::function<unsigned long long(size_t)>& estimate,
+                                  const std::function<void(size_t)>& process) {
+    run([sections](size_t section) { return section < sections; }, estimate, process);
+}
+
+void PLImg::SectionScheduler::run(const std::function<bool(size_t)>& claim,
+                                  const std::function<unsigned long long(size_t)>& estimate,
+                                  const std::function<void(size_t)>& process) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_finished.clear();
+        m_estimates.clear();
+        m_passed.clear();
+        m_error = nullptr;
+        m_peakMemory = 0;
+        m_peakSections = 0;
+    }
+
+    // The running sections are aborted at their next stage if a section can't be started. Destroying joinable
+    // workers would terminate the process, so they are always joined before the error is rethrown.
+    auto abort = [this]() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(!m_error) {
+            m_error = std::current_exception();
+        }
+        m_condition.notify_all();
+    };
+    std::vector<std::thread> workers;
+    for(size_t section = 0;; ++section) {
+        {
+            // Wait for a free slot before the section is claimed
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this]() {
+                return m_error || m_runningSections < m_maxSections;
+            });
+            if(m_error) {
+                break;
+            }
+        }
+        unsigned long long memory;
+        try {
+            if(!claim(section)) {
+                break;
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_finished.push_back(false);
+                m_estimates.push_back(0);
+            }
+            memory = estimate(section);
+        } catch(...) {
+            abort();
+            break;
+        }
+        std::unique_lock<std::mutex> lock(m_mutex);
+        // Start the section when it fits into the budget. A single section may exceed the budget.
+        m_condition.wait(lock, [this, memory]() {
+            return m_error || m_runningSections == 0 ||
+                   (m_runningSections < m_maxSections && m_usedMemory + memory <= m_memoryBudget);
+        });
+        if(m_error) {
+            break;
+        }
+        m_usedMemory += memory;
+        ++m_runningSections;
+        m_peakMemory = std::max(m_peakMemory, m_usedMemory);
+        m_peakSections = std::max(m_peakSections, m_runningSections);
+        m_estimates.at(section) = memory;
+        lock.unlock();
+
+        auto worker = [this, section, memory, &process]() {
+            std::exception_ptr error;
+            try {
+                rebalance();
+                process(section);
+            } catch(...) {
+                error = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if(error && !m_error) {
+                m_error = error;
+            }
+            m_finished.at(section) = true;
+            m_usedMemory -= memory;
+            --m_runningSections;
+            m_condition.notify_all();
+        };
+        try {
+            workers.emplace_back(worker);
+        } catch(...) {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_finished.at(section) = true;
+                m_usedMemory -= memory;
+                --m_runningSections;
+            }
+            abort();
+            break;
+        }
+    }
+
+    for(std::thread& worker : workers) {
+        worker.join();
+    }
+    if(m_error) {
+        std::rethrow_exception(m_error);
+    }
+}
+
+void PLImg::SectionScheduler::inOrder(const std::string& stage, size_t section, const std::function<void()>& function) {
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if(m_passed[stage].size() < m_finished.size()) {
+            m_passed[stage].resize(m_finished.size(), false);
+        }
+        m_condition.wait(lock, [this, &stage, section]() {
+            return m_error || previousSectionsPassed(stage, section);
+        });
+        if(m_error) {
+            throw std::runtime_error("Section " + std::to_string(section) + " was aborted because another section failed.");
+        }
+    }
+    try {
+        function();
+    } catch(...) {
+        // The following sections would wait for this stage forever
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(!m_error) {
+            m_error = std::current_exception();
+        }
+        m_condition.notify_all();
+        throw;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_passed[stage].at(section) = true;
+    m_condition.notify_all();
+}
+
+unsigned PLImg::SectionScheduler::rebalance() {
+    unsigned threads;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        unsigned sections = std::max(1u, m_runningSections);
+        threads = std::max(1u, (m_threads + sections - 1) / sections);
+    }
+    omp_set_num_threads(int(threads));
+    return threads;
+}
+
+unsigned PLImg::SectionScheduler::runningSections() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_runningSections;
+}
+
+unsigned long long PLImg::SectionScheduler::peakMemory() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_peakMemory;
+}
+
+unsigned long long PLImg::SectionScheduler::estimatedMemory(size_t section) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_estimates.at(section);
+}
+
+unsigned PLImg::SectionScheduler::peakSections() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_peakSections;
+}
+
+bool PLImg::SectionScheduler::previousSectionsPassed(const std::string& stage, size_t section) const {
+    const std::vector<bool>& passed = m_passed.at(stage);
+    for(size_t previous = 0; previous < section; ++previous) {
+        if(!passed.at(previous) && !m_finished.at(previous)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+unsigned long long PLImg::SectionScheduler::memoryBudget() const {
+    return m_memoryBudget;
+}
+
+bool PLImg::SectionScheduler::memoryPressure() const {
+    return residentMemory() > m_memoryBudget;
+}
+
+unsigned long long PLImg::SectionScheduler::residentMemory() {
+    #ifdef __GNUC__
+        // The second value of /proc/self/statm is the number of resident pages
+        std::ifstream statm("/proc/self/statm");
+        unsigned long long pages = 0, residentPages = 0;
+        statm >> pages >> residentPages;
+        return residentPages * (unsigned long long) sysconf(_SC_PAGE_SIZE);
+    #else
+        PROCESS_MEMORY_COUNTERS counters;
+        GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+        return counters.WorkingSetSize;
+    #endif
+}
+
+unsigned long long PLImg::SectionScheduler::peakResidentMemory() {
+    #ifdef __GNUC__
+        // ru_maxrss is given in KiB and only updated from time to time, so it can be below the current resident memory
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return std::max((unsigned long long) usage.ru_maxrss * 1024, residentMemory());
+    #else
+        PROCESS_MEMORY_COUNTERS counters;
+        GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+        return counters.PeakWorkingSetSize;
+    #endif
+}
@@ -0,0 +1,173 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Forschungszentrum Jülich / Jan André Reuter.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef PLIMG_SCHEDULER_H
+#define PLIMG_SCHEDULER_H
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @file
+ * @brief PLImg::SectionScheduler class
+ */
+namespace PLImg {
+    /**
+     * Large parts of the processing of a section only use a single core or the GPU, e.g. the threshold search,
+     * the median filter or writing the results. The SectionScheduler processes multiple sections concurrently, so that
+     * the stages of one section overlap with the stages of other sections. A section is started when its estimated
+     * memory fits into the memory budget together with all running sections. Sections are started in order.
+     * The thread budget is distributed over all running sections. Stages which have to be executed in the order of
+     * the sections, like retrieving the images from the Prefetcher, are wrapped with inOrder().
+     * @brief Concurrent processing of sections under a memory and thread budget
+     */
+    class SectionScheduler {
+    public:
+        /**
+         * @brief Create a scheduler
+         * @param memoryBudget Maximum estimated memory of all running sections in bytes. 0 will use half of the
+         * currently available memory. A section is always started if no other section is running.
+         * @param threads Number of threads which are distributed over the running sections. 0 uses all cores.
+         * @param maxSections Maximum number of sections processed at the same time. 0 limits the sections by the
+         * memory budget and the number of threads only.
+         */
+        explicit SectionScheduler(unsigned long long memoryBudget = 0, unsigned threads = 0, unsigned maxSections = 0);
+        /**
+         * Process all sections and block until they are finished. Each section is processed on its own thread.
+         * If a section or the estimate of a section throws an exception, no further sections are started. The first
+         * exception is rethrown after all running sections are finished.
+         * @brief Process all sections concurrently
+         * @param sections Number of sections
+         * @param estimate Estimated peak memory of a section in bytes
+         * @param process Processing of a section. It is called with the index of the section.
+         */
+        void run(size_t sections, const std::function<unsigned long long(size_t)>& estimate,
+                 const std::function<void(size_t)>& process);
+        /**
+         * Process sections which aren't known in advance, e.g. sections distributed by a SectionDistributor.
+         * The next section is claimed as soon as fewer than the maximum number of sections are running, so that it
+         * isn't withheld from other processes while no slot is free. Otherwise like run() with a fixed number of sections.
+         * @brief Process sections concurrently until no further section can be claimed
+         * @param claim Called with the index of the next section. Returns false if there are no further sections.
+         * @param estimate Estimated peak memory of a section in bytes
+         * @param process Processing of a section. It is called with the index of the section.
+         */
+        void run(const std::function<bool(size_t)>& claim, const std::function<unsigned long long(size_t)>& estimate,
+                 const std::function<void(size_t)>& process);
+        /**
+         * Execute a stage of a section after all previous sections have executed the same stage or are finished.
+         * Stages with the same name are never executed concurrently.
+         * @brief Execute a stage in the order of the sections
+         * @param stage Name of the stage
+         * @param section Index of the calling section
+         * @param function Stage which will be executed
+         * @throws std::runtime_error if another section failed while waiting
+         */
+        void inOrder(const std::string& stage, size_t section, const std::function<void()>& function);
+        /**
+         * Set the number of OpenMP threads of the calling section to its share of the thread budget. The share
+         * changes while sections are started and finished. Sections should call this method at the beginning of
+         * each stage.
+         * @brief Distribute the thread budget over the running sections
+         * @return Number of OpenMP threads of the calling section
+         */
+        unsigned rebalance();
+        /**
+         * @brief Number of sections which are currently processed
+         */
+        unsigned runningSections();
+        /**
+         * @brief Maximum estimated memory of all running sections in bytes during the last call of run()
+         */
+        unsigned long long peakMemory();
+        /**
+         * @brief Estimated memory of a started section of the current or last call of run()
+         * @param section Index of the section
+         * @return Estimate in bytes which was returned for the section
+         */
+        unsigned long long estimatedMemory(size_t section);
+        /**
+         * @brief Maximum number of concurrently running sections during the last call of run()
+         */
+        unsigned peakSections();
+        /**
+         * @brief Memory budget of all running sections in bytes
+         */
+        unsigned long long memoryBudget() const;
+        /**
+         * The estimates of the sections may be exceeded, e.g. by images which wait in the queue of a background writer.
+         * Large images which are only needed later should be spilled to a ScratchImage under memory pressure.
+         * @brief Check if the process uses more memory than the memory budget
+         * @return True if residentMemory() exceeds memoryBudget()
+         */
+        bool memoryPressure() const;
+        /**
+         * @brief Physical memory currently used by this process
+         * @return Resident set size in bytes
+         */
+        static unsigned long long residentMemory();
+        /**
+         * @brief Maximum physical memory used by this process since it was started
+         * @return Peak resident set size in bytes
+         */
+        static unsigned long long peakResidentMemory();
+    private:
+        /// Check if all sections before the given section passed the stage. Requires m_mutex.
+        bool previousSectionsPassed(const std::string& stage, size_t section) const;
+
+        ///
+        unsigned long long m_memoryBudget;
+        ///
+        unsigned m_threads;
+        ///
+        unsigned m_maxSections;
+        /// Estimated memory of all running sections
+        unsigned long long m_usedMemory;
+        ///
+        unsigned long long m_peakMemory;
+        ///
+        unsigned m_runningSections;
+        ///
+        unsigned m_peakSections;
+        /// Finished sections of the current run. Grows while sections are claimed.
+        std::vector<bool> m_finished;
+        /// Estimated memory of the started sections of the current run
+        std::vector<unsigned long long> m_estimates;
+        /// Sections which passed each stage of inOrder()
+        std::map<std::string, std::vector<bool>> m_passed;
+        /// First exception of a section
+        std::exception_ptr m_error;
+        ///
+        std::mutex m_mutex;
+        ///
+        std::condition_variable m_condition;
+    };
+}
+
+#endif //PLIMG_SCHEDULER_H
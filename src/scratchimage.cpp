@@ -0,0 +1,152 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Forschungszentrum Jülich / Jan André Reuter.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+
+#include "scratchimage.h"
+#include <atomic>
+#include <filesystem>
+#include <stdexcept>
+#ifdef __GNUC__
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <unistd.h>
+#else
+    #include <fstream>
+    #include <process.h>
+#endif
+
+PLImg::ScratchImage::ScratchImage() : m_path(), m_rows(0), m_cols(0), m_type(0) {}
+
+PLImg::ScratchImage::~ScratchImage() {
+    discard();
+}
+
+void PLImg::ScratchImage::spill(std::shared_ptr<cv::Mat>& image, const std::string& directory) {
+    if(spilled()) {
+        throw std::runtime_error("Another image was already spilled to " + m_path);
+    }
+    std::filesystem::create_directories(directory);
+    const size_t rowSize = image->cols * image->elemSize();
+    #ifdef __GNUC__
+        std::string path = (std::filesystem::path(directory) / "PLImig_XXXXXX.scratch").string();
+        int file = mkstemps(path.data(), 8);
+        if(file < 0) {
+            throw std::runtime_error("Could not create a scratch file in " + directory);
+        }
+        bool written = true;
+        for(int row = 0; row < image->rows && written; ++row) {
+            const char* data = image->ptr<char>(row);
+            size_t remaining = rowSize;
+            while(remaining > 0) {
+                ssize_t count = write(file, data, remaining);
+                if(count <= 0) {
+                    written = false;
+                    break;
+                }
+                data += count;
+                remaining -= size_t(count);
+            }
+        }
+        close(file);
+    #else
+        static std::atomic<unsigned long long> counter(0);
+        std::string path = (std::filesystem::path(directory) / ("PLImig_" + std::to_string(_getpid()) + "_" +
+                                                                std::to_string(counter++) + ".scratch")).string();
+        std::ofstream file(path, std::ios::binary);
+        for(int row = 0; row < image->rows && file; ++row) {
+            file.write(image->ptr<char>(row), std::streamsize(rowSize));
+        }
+        bool written = bool(file);
+        file.close();
+    #endif
+    if(!written) {
+        std::error_code error;
+        std::filesystem::remove(path, error);
+        throw std::runtime_error("Could not write the scratch file " + path);
+    }
+    m_path = path;
+    m_rows = image->rows;
+    m_cols = image->cols;
+    m_type = image->type();
+    image = nullptr;
+}
+
+bool PLImg::ScratchImage::spilled() const {
+    return !m_path.empty();
+}
+
+std::shared_ptr<cv::Mat> PLImg::ScratchImage::restore() {
+    if(!spilled()) {
+        throw std::runtime_error("No image was spilled to a scratch file");
+    }
+    const unsigned long long bytes = size();
+    if(bytes == 0) {
+        std::filesystem::remove(m_path);
+        m_path.clear();
+        return std::make_shared<cv::Mat>(m_rows, m_cols, m_type);
+    }
+    #ifdef __GNUC__
+        int file = open(m_path.c_str(), O_RDONLY);
+        void* data = file < 0 ? MAP_FAILED : mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+        if(file >= 0) {
+            close(file);
+        }
+        if(data == MAP_FAILED) {
+            throw std::runtime_error("Could not map the scratch file " + m_path);
+        }
+        // The mapping stays valid after the file was removed
+        std::filesystem::remove(m_path);
+        m_path.clear();
+        return std::shared_ptr<cv::Mat>(new cv::Mat(m_rows, m_cols, m_type, data), [data, bytes](cv::Mat* image) {
+            delete image;
+            munmap(data, bytes);
+        });
+    #else
+        auto image = std::make_shared<cv::Mat>(m_rows, m_cols, m_type);
+        std::ifstream file(m_path, std::ios::binary);
+        file.read(image->ptr<char>(), std::streamsize(bytes));
+        if(!file) {
+            throw std::runtime_error("Could not read the scratch file " + m_path);
+        }
+        file.close();
+        std::filesystem::remove(m_path);
+        m_path.clear();
+        return image;
+    #endif
+}
+
+void PLImg::ScratchImage::discard() {
+    if(!m_path.empty()) {
+        std::error_code error;
+        std::filesystem::remove(m_path, error);
+        m_path.clear();
+    }
+}
+
+unsigned long long PLImg::ScratchImage::size() const {
+    if(!spilled()) {
+        return 0;
+    }
+    return (unsigned long long) m_rows * m_cols * CV_ELEM_SIZE(m_type);
+}
@@ -0,0 +1,98 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Forschungszentrum Jülich / Jan André Reuter.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+
+#ifndef PLIMG_SCRATCHIMAGE_H
+#define PLIMG_SCRATCHIMAGE_H
+
+#include <memory>
+#include <opencv2/core.hpp>
+#include <string>
+
+/**
+ * @file
+ * @brief PLImg::ScratchImage class
+ */
+namespace PLImg {
+    /**
+     * Some large images of a section are only needed again much later, e.g. the original transmittance between the median
+     * filter and the masked median filter. Under memory pressure, spill() writes such an image to a scratch file and releases
+     * it. restore() maps the file into memory again, so that only the pages which are actually used are read. The scratch file
+     * is removed when the image is restored or the ScratchImage is destroyed.
+     * @brief Image which is temporarily stored in a memory-mapped scratch file
+     */
+    class ScratchImage {
+    public:
+        /**
+         * @brief Create an empty ScratchImage without a scratch file
+         */
+        ScratchImage();
+        /**
+         * @brief Remove the scratch file if the image wasn't restored
+         */
+        ~ScratchImage();
+        ScratchImage(const ScratchImage&) = delete;
+        ScratchImage& operator=(const ScratchImage&) = delete;
+
+        /**
+         * Write the image to a new scratch file and reset the shared pointer. The memory of the image is only freed if
+         * no other shared pointer or OpenCV matrix references it.
+         * @brief Move an image into a scratch file
+         * @param image Image which will be spilled. The pointer is reset afterwards.
+         * @param directory Directory of the scratch file. Ranks of multiple processes may use the same directory.
+         * @throws std::runtime_error if an image was already spilled or the scratch file can't be written
+         */
+        void spill(std::shared_ptr<cv::Mat>& image, const std::string& directory);
+        /**
+         * @brief Check if an image is stored in the scratch file
+         * @return True after spill() until restore() is called
+         */
+        bool spilled() const;
+        /**
+         * The returned image is mapped privately, so changes are not written back to the file. The mapping is removed when
+         * the last reference of the returned shared pointer is released.
+         * @brief Map the spilled image into memory and remove the scratch file
+         * @return Shared pointer of the spilled image
+         * @throws std::runtime_error if no image was spilled or the scratch file can't be mapped
+         */
+        std::shared_ptr<cv::Mat> restore();
+        /**
+         * @brief Remove the scratch file without restoring the image
+         */
+        void discard();
+        /**
+         * @brief Size of the spilled image
+         * @return Number of bytes of the scratch file. 0 if no image is spilled.
+         */
+        unsigned long long size() const;
+
+    private:
+        /// Path of the scratch file. Empty if no image is spilled.
+        std::string m_path;
+        /// Dimensions and OpenCV type of the spilled image
+        int m_rows, m_cols, m_type;
+    };
+}
+
+#endif //PLIMG_SCRATCHIMAGE_H
@@ -0,0 +1,137 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Forschungszentrum Jülich / Jan André Reuter.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "spoolqueue.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+    /// Subdirectories of the spool directory
+    constexpr const char* INCOMING = "incoming";
+    constexpr const char* RUNNING = "running";
+    constexpr const char* DONE = "done";
+    constexpr const char* FAILED = "failed";
+    /// Extension of job files
+    constexpr const char* JOB_EXTENSION = ".job";
+    /// Extension of log files
+    constexpr const char* LOG_EXTENSION = ".log";
+
+    std::string logName(const std::string& jobName) {
+        return std::filesystem::path(jobName).replace_extension(LOG_EXTENSION).string();
+    }
+}
+
+PLImg::SpoolQueue::SpoolQueue(std::string directory) : m_directory(std::move(directory)) {
+    for(const char* subdirectory : {INCOMING, RUNNING, DONE, FAILED}) {
+        std::error_code error;
+        std::filesystem::create_directories(std::filesystem::path(m_directory) / subdirectory, error);
+        if(error) {
+            throw std::runtime_error("Could not create spool directory " + m_directory + "/" + subdirectory + ": " + error.message());
+        }
+    }
+}
+
+const std::string& PLImg::SpoolQueue::directory() const {
+    return m_directory;
+}
+
+unsigned PLImg::SpoolQueue::recover() {
+    std::filesystem::path directory(m_directory);
+    unsigned recovered = 0;
+    for(const auto& entry : std::filesystem::directory_iterator(directory / RUNNING)) {
+        if(entry.path().extension() == JOB_EXTENSION) {
+            std::filesystem::rename(entry.path(), directory / INCOMING / entry.path().filename());
+            ++recovered;
+        } else {
+            // The log of the interrupted run is replaced when the job is taken again
+            std::filesystem::remove(entry.path());
+        }
+    }
+    return recovered;
+}
+
+bool PLImg::SpoolQueue::take(SpoolJob& job) {
+    std::filesystem::path directory(m_directory);
+    std::vector<std::pair<std::filesystem::file_time_type, std::string>> waiting;
+    for(const auto& entry : std::filesystem::directory_iterator(directory / INCOMING)) {
+        std::error_code error;
+        auto modified = entry.last_write_time(error);
+        if(!error && entry.is_regular_file(error) && entry.path().extension() == JOB_EXTENSION) {
+            waiting.emplace_back(modified, entry.path().filename().string());
+        }
+    }
+    std::sort(waiting.begin(), waiting.end());
+
+    for(const auto& candidate : waiting) {
+        std::filesystem::path running = directory / RUNNING / candidate.second;
+        std::error_code error;
+        // Another process may have taken the job in the meantime
+        std::filesystem::rename(directory / INCOMING / candidate.second, running, error);
+        if(error) {
+            continue;
+        }
+        job.name = candidate.second;
+        job.path = running.string();
+        job.logPath = (directory / RUNNING / logName(candidate.second)).string();
+        std::ofstream(job.logPath, std::ios::trunc);
+        try {
+            job.arguments = readArguments(job.path);
+        } catch(const std::exception& exception) {
+            std::ofstream(job.logPath, std::ios::app) << exception.what() << std::endl;
+            finish(job, false);
+            throw;
+        }
+        return true;
+    }
+    return false;
+}
+
+void PLImg::SpoolQueue::finish(const SpoolJob& job, bool success) {
+    std::filesystem::path target = std::filesystem::path(m_directory) / (success ? DONE : FAILED);
+    std::filesystem::rename(job.path, target / job.name);
+    std::error_code error;
+    std::filesystem::rename(job.logPath, target / logName(job.name), error);
+}
+
+std::vector<std::string> PLImg::SpoolQueue::readArguments(const std::string& path) {
+    std::ifstream file(path);
+    if(!file) {
+        throw std::runtime_error("Could not read job file " + path);
+    }
+    std::vector<std::string> arguments;
+    std::string line;
+    while(std::getline(file, line)) {
+        // Job files written on Windows
+        if(!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if(!line.empty() && line.front() != '#') {
+            arguments.push_back(line);
+        }
+    }
+    return arguments;
+}
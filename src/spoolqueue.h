@@ -0,0 +1,115 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Forschungszentrum Jülich / Jan André Reuter.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef PLIMG_SPOOLQUEUE_H
+#define PLIMG_SPOOLQUEUE_H
+
+#include <string>
+#include <vector>
+
+/**
+ * @file
+ * @brief PLImg::SpoolQueue class
+ */
+namespace PLImg {
+    /**
+     * @brief Job taken from a SpoolQueue
+     */
+    struct SpoolJob {
+        /// File name of the job without directory
+        std::string name;
+        /// Path of the job file while it is processed
+        std::string path;
+        /// Path of the log file of the job while it is processed
+        std::string logPath;
+        /// Command line arguments of the job, one per line of the job file
+        std::vector<std::string> arguments;
+    };
+
+    /**
+     * A spool directory is a job queue on the file system which can be filled by any program without a connection
+     * to the process working on the jobs. Jobs are files ending with ".job" in the subdirectory incoming.
+     * Each line of a job file is one command line argument. Empty lines and lines starting with # are ignored.
+     * To avoid taking a partially written job, write the job file with another extension and rename it afterwards.
+     *
+     * take() moves the oldest job to running, where a log file with the same name and the extension ".log" is
+     * created next to it. finish() moves the job and its log to done or failed. Renaming a file is atomic,
+     * so several processes can take jobs from the same spool directory.
+     * @brief Job queue in a spool directory
+     */
+    class SpoolQueue {
+    public:
+        /**
+         * @brief Open a spool directory. The directory and its subdirectories are created if they don't exist.
+         * @param directory Path of the spool directory
+         * @throws std::runtime_error if the directories can't be created
+         */
+        explicit SpoolQueue(std::string directory);
+
+        /**
+         * @brief Get the path of the spool directory
+         * @return Path of the spool directory
+         */
+        const std::string& directory() const;
+
+        /**
+         * Jobs which are still in running after a crash are moved back to incoming, so that they are processed again.
+         * Only call this method if no other process uses the spool directory.
+         * @brief Requeue interrupted jobs
+         * @return Number of requeued jobs
+         */
+        unsigned recover();
+
+        /**
+         * Move the oldest job of incoming to running and read its arguments. Jobs with the same modification time are
+         * taken in the order of their names.
+         * @brief Take the next job
+         * @param job Taken job
+         * @return False if no job is waiting
+         * @throws std::runtime_error if the job file can't be read. The job is moved to failed.
+         */
+        bool take(SpoolJob& job);
+
+        /**
+         * @brief Move a job and its log to done or failed
+         * @param job Job returned by take()
+         * @param success True if the job was processed successfully
+         */
+        void finish(const SpoolJob& job, bool success);
+
+        /**
+         * @brief Read the arguments of a job file
+         * @param path Path of the job file
+         * @return One argument per non empty line which doesn't start with #
+         * @throws std::runtime_error if the file can't be read
+         */
+        static std::vector<std::string> readArguments(const std::string& path);
+
+    private:
+        /// Path of the spool directory
+        std::string m_directory;
+    };
+}
+
+#endif //PLIMG_SPOOLQUEUE_H
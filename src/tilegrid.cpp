@@ -0,0 +1,75 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Forschungszentrum Jülich / Jan André Reuter.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+
+#include "tilegrid.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+PLImg::TileGrid::TileGrid(int rows, int cols, int tileSize) : m_rows(rows), m_cols(cols), m_tileSize(tileSize) {
+    if(tileSize <= 0) {
+        throw std::invalid_argument("The tile size has to be positive!");
+    }
+    m_tilesPerRow = (cols + tileSize - 1) / tileSize;
+    m_numberOfTiles = size_t((rows + tileSize - 1) / tileSize) * size_t(m_tilesPerRow);
+}
+
+size_t PLImg::TileGrid::size() const {
+    return m_numberOfTiles;
+}
+
+int PLImg::TileGrid::tileSize() const {
+    return m_tileSize;
+}
+
+cv::Rect PLImg::TileGrid::tile(size_t index) const {
+    if(index >= m_numberOfTiles) {
+        throw std::out_of_range("Tile index out of range");
+    }
+    int x = int(index % m_tilesPerRow) * m_tileSize;
+    int y = int(index / m_tilesPerRow) * m_tileSize;
+    return {x, y, std::min(m_tileSize, m_cols - x), std::min(m_tileSize, m_rows - y)};
+}
+
+cv::Rect PLImg::TileGrid::padded(size_t index, int halo) const {
+    cv::Rect area = tile(index);
+    cv::Rect grown(area.x - halo, area.y - halo, area.width + 2 * halo, area.height + 2 * halo);
+    return grown & cv::Rect(0, 0, m_cols, m_rows);
+}
+
+cv::Rect PLImg::TileGrid::inner(size_t index, int halo) const {
+    cv::Rect area = tile(index);
+    cv::Rect region = padded(index, halo);
+    return {area.x - region.x, area.y - region.y, area.width, area.height};
+}
+
+int PLImg::TileGrid::tileSize(unsigned long long budget, unsigned long long bytesPerPixel, int halo, int alignment) {
+    // Largest padded tile which fits into the budget
+    int size = int(std::sqrt(double(budget) / double(std::max(bytesPerPixel, 1ull)))) - 2 * halo;
+    if(alignment > 0 && size >= alignment) {
+        return size / alignment * alignment;
+    }
+    return std::max(256, size / 256 * 256);
+}
@@ -0,0 +1,110 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Forschungszentrum Jülich / Jan André Reuter.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+
+#ifndef PLIMG_TILEGRID_H
+#define PLIMG_TILEGRID_H
+
+#include <opencv2/core.hpp>
+
+/**
+ * @file
+ * @brief PLImg::TileGrid class
+ */
+namespace PLImg {
+    /**
+     * Sections which are larger than the main memory are processed tile by tile. Neighbourhood operations like the
+     * median filter need the pixels around a tile as well. padded() grows a tile by such a halo, clipped to the image,
+     * and inner() returns the position of the tile within the padded region. Operations which replicate the border of
+     * their input produce the same results for the tile as for the full image, as long as the halo is at least their radius.
+     * @brief Division of an image into rectangular tiles with an optional halo
+     */
+    class TileGrid {
+    public:
+        /**
+         * @brief Divide an image into tiles of equal size. Tiles at the right and bottom border may be smaller.
+         * @param rows Number of rows of the image
+         * @param cols Number of columns of the image
+         * @param tileSize Number of rows and columns of a tile
+         * @throws std::invalid_argument if the tile size isn't positive
+         */
+        TileGrid(int rows, int cols, int tileSize);
+
+        /**
+         * @brief Number of tiles
+         * @return Number of tiles of the image
+         */
+        size_t size() const;
+        /**
+         * @brief Number of rows and columns of a tile
+         * @return Tile size which was passed to the constructor
+         */
+        int tileSize() const;
+        /**
+         * @brief Get a tile. The tiles are ordered row by row.
+         * @param index Index of the tile
+         * @return Position and size of the tile within the image
+         */
+        cv::Rect tile(size_t index) const;
+        /**
+         * @brief Get a tile together with the pixels around it
+         * @param index Index of the tile
+         * @param halo Number of pixels added on each side of the tile
+         * @return Tile grown by halo pixels on each side, clipped to the image
+         */
+        cv::Rect padded(size_t index, int halo) const;
+        /**
+         * @brief Get the position of a tile within its padded region
+         * @param index Index of the tile
+         * @param halo Number of pixels added on each side of the tile
+         * @return Position and size of tile(index) relative to padded(index, halo)
+         */
+        cv::Rect inner(size_t index, int halo) const;
+
+        /**
+         * Processing a tile needs bytesPerPixel bytes for each pixel of the tile and its halo. The tile size is a multiple of
+         * alignment if such a tile fits into the budget, so that tiles match the chunks of the written datasets.
+         * Otherwise the largest fitting multiple of 256 pixels is used.
+         * @brief Calculate the largest tile size which fits into a memory budget
+         * @param budget Memory budget in bytes
+         * @param bytesPerPixel Memory needed per pixel
+         * @param halo Number of pixels added on each side of a tile
+         * @param alignment Preferred multiple of the tile size, e.g. the chunk size of the written datasets
+         * @return Tile size of at least 256 pixels
+         */
+        static int tileSize(unsigned long long budget, unsigned long long bytesPerPixel, int halo, int alignment);
+
+    private:
+        /// Number of rows and columns of the image
+        int m_rows, m_cols;
+        /// Number of rows and columns of a tile
+        int m_tileSize;
+        /// Number of tiles per row of tiles
+        int m_tilesPerRow;
+        /// Number of tiles
+        size_t m_numberOfTiles;
+    };
+}
+
+#endif //PLIMG_TILEGRID_H
@@ -24,6 +24,17 @@
 
 #include "toolbox.h"
 
+namespace {
+    /**
+     * @brief Filters which keep their image on the GPU. Guarded by PLImg::cuda::lockGPU().
+     * @return Set of the filters
+     */
+    std::set<PLImg::cuda::filters::FusedMedianFilter*>& parkedFilters() {
+        static std::set<PLImg::cuda::filters::FusedMedianFilter*> filters;
+        return filters;
+    }
+}
+
 int PLImg::Histogram::peakWidth(cv::Mat hist, int peakPosition, float direction, float targetHeight) {
     float height = hist.at<float>(peakPosition) * targetHeight;
     int i = peakPosition;
@@ -208,12 +219,45 @@ bool PLImg::cuda::runCUDAchecks() {
 }
 
 size_t PLImg::cuda::getFreeMemory() {
+    auto lock = lockGPU();
     PLImg::cuda::runCUDAchecks();
     size_t free;
     CHECK_CUDA(cudaMemGetInfo(&free, nullptr));
+    // Kept scratch buffers are reused by the next call
+    return free + PLImg::cuda::raw::scratchSize();
+}
+
+size_t PLImg::cuda::getFreeMemory(size_t required) {
+    auto lock = lockGPU();
+    size_t free = getFreeMemory();
+    if(free < required && releaseParkedImages() > 0) {
+        free = getFreeMemory();
+    }
     return free;
 }
 
+size_t PLImg::cuda::releaseParkedImages() {
+    auto lock = lockGPU();
+    size_t released = 0;
+    // release() removes the filter from the set
+    std::set<PLImg::cuda::filters::FusedMedianFilter*> filters(parkedFilters());
+    for(auto* filter : filters) {
+        released += filter->m_deviceBytes;
+        filter->release();
+    }
+    return released;
+}
+
+void PLImg::cuda::keepBuffers(bool keep) {
+    auto lock = lockGPU();
+    PLImg::cuda::raw::keepScratch(keep);
+}
+
+std::unique_lock<std::recursive_mutex> PLImg::cuda::lockGPU() {
+    static std::recursive_mutex mutex;
+    return std::unique_lock<std::recursive_mutex>(mutex);
+}
+
 size_t PLImg::cuda::getTotalMemory() {
     PLImg::cuda::runCUDAchecks();
     size_t total;
@@ -232,10 +276,16 @@ size_t PLImg::cuda::getHistogramMemoryEstimation(const cv::Mat& image, uint numB
 }
 
 cv::Mat PLImg::cuda::histogram(const cv::Mat &image, float minLabel, float maxLabel, uint numBins) {
+    auto lock = lockGPU();
     PLImg::cuda::runCUDAchecks();
 
+    // Only convert the image if necessary. Floating point images can be used directly.
     cv::Mat histImage;
-    image.convertTo(histImage, CV_32FC1);
+    if(image.type() == CV_32FC1) {
+        histImage = image;
+    } else {
+        image.convertTo(histImage, CV_32FC1);
+    }
     cv::Mat hist(numBins, 1, CV_32SC1);
     hist.setTo(0);
 
@@ -244,8 +294,9 @@ cv::Mat PLImg::cuda::histogram(const cv::Mat &image, float minLabel, float maxLa
     unsigned chunksPerDim;
 
     float predictedMemoryUsage = getHistogramMemoryEstimation(image, numBins);
-    if (predictedMemoryUsage > double(PLImg::cuda::getFreeMemory())) {
-        numberOfChunks = fmax(numberOfChunks, pow(4, ceil(log(predictedMemoryUsage / double(PLImg::cuda::getFreeMemory())) / log(4))));
+    double freeMemory = double(PLImg::cuda::getFreeMemory(size_t(predictedMemoryUsage)));
+    if (predictedMemoryUsage > freeMemory) {
+        numberOfChunks = fmax(numberOfChunks, pow(4, ceil(log(predictedMemoryUsage / freeMemory) / log(4))));
     }
 
     bool gpu_exception = false;
@@ -267,15 +318,23 @@ cv::Mat PLImg::cuda::histogram(const cv::Mat &image, float minLabel, float maxLa
                 yMax = fmin((it / chunksPerDim + 1) * image.rows / chunksPerDim, image.rows);
 
                 croppedImage = cv::Mat(histImage, cv::Rect(xMin, yMin, xMax - xMin, yMax - yMin));
-                croppedImage.copyTo(subImage);
+                // A single chunk covers the whole image and doesn't need to be copied
+                if(croppedImage.isContinuous()) {
+                    subImage = croppedImage;
+                } else {
+                    croppedImage.copyTo(subImage);
+                }
                 croppedImage.release();
 
                 cv::Mat subHist = PLImg::cuda::raw::CUDAhistogram(subImage, minLabel, maxLabel, numBins);
                 cv::add(hist, subHist, hist);
             }
         } catch (PLImg::GPUOutOfMemoryException& e) {
-            std::cerr << "Ran out of memory because prediction was not accurate enough. Increasing number of chunks" << std::endl;
-            numberOfChunks = numberOfChunks * 4;
+            // Retry with the same number of chunks if images kept by FusedMedianFilter were released
+            if(releaseParkedImages() == 0) {
+                std::cerr << "Ran out of memory because prediction was not accurate enough. Increasing number of chunks" << std::endl;
+                numberOfChunks = numberOfChunks * 4;
+            }
             gpu_exception = true;
         }
     } while(gpu_exception);
@@ -293,6 +352,7 @@ size_t PLImg::cuda::filters::getMedianFilterMaskedMemoryEstimation(const std::sh
 }
 
 std::shared_ptr<cv::Mat> PLImg::cuda::filters::medianFilter(const std::shared_ptr<cv::Mat>& image) {
+    auto lock = lockGPU();
     PLImg::cuda::runCUDAchecks();
 
     // Create a result image with the same dimensions as our input image
@@ -305,8 +365,9 @@ std::shared_ptr<cv::Mat> PLImg::cuda::filters::medianFilter(const std::shared_pt
     uint numberOfChunks = 1;
     // If the total free memory is smaller than the estimated amount of memory, calculate the number of chunks
     // with the power of four (1, 4, 16, 256, 1024, ...)
-    if(getMedianFilterMemoryEstimation(image) > double(PLImg::cuda::getFreeMemory())) {
-        numberOfChunks = fmax(1, pow(4.0, ceil(log(getMedianFilterMemoryEstimation(image) / double(PLImg::cuda::getFreeMemory())) / log(4))));
+    double freeMemory = double(PLImg::cuda::getFreeMemory(getMedianFilterMemoryEstimation(image)));
+    if(getMedianFilterMemoryEstimation(image) > freeMemory) {
+        numberOfChunks = fmax(1, pow(4.0, ceil(log(getMedianFilterMemoryEstimation(image) / freeMemory) / log(4))));
     }
     // Each dimensions will get the same number of chunks. Calculate them by using the square root.
     uint chunksPerDim;
@@ -346,8 +407,11 @@ std::shared_ptr<cv::Mat> PLImg::cuda::filters::medianFilter(const std::shared_pt
                 subResult(srcRect).copyTo(result(dstRect));
             }
         }  catch (PLImg::GPUOutOfMemoryException& e) {
-            std::cerr << "Ran out of memory because prediction was not accurate enough. Increasing number of chunks" << std::endl;
-            numberOfChunks = numberOfChunks * 4;
+            // Retry with the same number of chunks if images kept by FusedMedianFilter were released
+            if(releaseParkedImages() == 0) {
+                std::cerr << "Ran out of memory because prediction was not accurate enough. Increasing number of chunks" << std::endl;
+                numberOfChunks = numberOfChunks * 4;
+            }
             gpu_exception = true;
         }
     } while(gpu_exception);
@@ -364,6 +428,7 @@ std::shared_ptr<cv::Mat> PLImg::cuda::filters::medianFilter(const std::shared_pt
 
 std::shared_ptr<cv::Mat> PLImg::cuda::filters::medianFilterMasked(const std::shared_ptr<cv::Mat>& image,
                                                                   const std::shared_ptr<cv::Mat>& mask) {
+    auto lock = lockGPU();
     PLImg::cuda::runCUDAchecks();
     // Copy the result back to the CPU
     cv::Mat result = cv::Mat(image->rows, image->cols, image->type());
@@ -373,7 +438,7 @@ std::shared_ptr<cv::Mat> PLImg::cuda::filters::medianFilterMasked(const std::sha
     // The image might be too large to be saved completely in the video memory.
     // Therefore chunks will be used if the amount of memory is too small.
     uint numberOfChunks = 1;
-    unsigned long freeMem = getFreeMemory();
+    unsigned long freeMem = getFreeMemory(getMedianFilterMaskedMemoryEstimation(image, mask));
     // If the total free memory is smaller than the estimated amount of memory, calculate the number of chunks
     // with the power of four (1, 4, 16, 256, 1024, ...)
     if(getMedianFilterMaskedMemoryEstimation(image, mask) > double(freeMem)) {
@@ -424,8 +489,11 @@ std::shared_ptr<cv::Mat> PLImg::cuda::filters::medianFilterMasked(const std::sha
 
             }
         } catch (PLImg::GPUOutOfMemoryException& e) {
-            std::cerr << "Ran out of memory because prediction was not accurate enough. Increasing number of chunks" << std::endl;
-            numberOfChunks = numberOfChunks * 4;
+            // Retry with the same number of chunks if images kept by FusedMedianFilter were released
+            if(releaseParkedImages() == 0) {
+                std::cerr << "Ran out of memory because prediction was not accurate enough. Increasing number of chunks" << std::endl;
+                numberOfChunks = numberOfChunks * 4;
+            }
             gpu_exception = true;
         }
     } while(gpu_exception);
@@ -439,6 +507,94 @@ std::shared_ptr<cv::Mat> PLImg::cuda::filters::medianFilterMasked(const std::sha
     return std::make_shared<cv::Mat>(result);
 }
 
+PLImg::cuda::filters::FusedMedianFilter::FusedMedianFilter(std::shared_ptr<cv::Mat> image) :
+        m_image(std::move(image)), m_deviceImage(nullptr), m_deviceGeneration(0), m_deviceBytes(0) {}
+
+PLImg::cuda::filters::FusedMedianFilter::~FusedMedianFilter() {
+    release();
+}
+
+void PLImg::cuda::filters::FusedMedianFilter::release() {
+    auto lock = lockGPU();
+    if(m_deviceImage) {
+        PLImg::cuda::raw::freeImage(m_deviceImage, m_deviceGeneration);
+        m_deviceImage = nullptr;
+        m_deviceBytes = 0;
+    }
+    parkedFilters().erase(this);
+}
+
+std::shared_ptr<cv::Mat> PLImg::cuda::filters::FusedMedianFilter::median() {
+    auto lock = lockGPU();
+    PLImg::cuda::runCUDAchecks();
+    release();
+    // The image, the result and the mask of maskedMedian() have to fit into the GPU memory at the same time
+    if(m_image->type() != CV_32FC1 || getMedianFilterMaskedMemoryEstimation(m_image, m_image) > double(getFreeMemory())) {
+        return medianFilter(m_image);
+    }
+
+    // The padded image is only needed until it is copied to the GPU
+    cv::Mat result;
+    {
+        cv::Mat paddedImage;
+        cv::copyMakeBorder(*m_image, paddedImage, MEDIAN_KERNEL_SIZE, MEDIAN_KERNEL_SIZE, MEDIAN_KERNEL_SIZE, MEDIAN_KERNEL_SIZE, cv::BORDER_REPLICATE);
+        result = cv::Mat(paddedImage.rows, paddedImage.cols, CV_32FC1);
+        try {
+            m_deviceGeneration = PLImg::cuda::raw::deviceGeneration();
+            m_deviceImage = PLImg::cuda::raw::uploadImage(paddedImage);
+            m_deviceBytes = paddedImage.total() * paddedImage.elemSize();
+            parkedFilters().insert(this);
+            PLImg::cuda::raw::filters::CUDAmedianFilter(m_deviceImage, result);
+        } catch (PLImg::GPUOutOfMemoryException& e) {
+            // Other sections use the GPU as well. Filter the image in chunks.
+            release();
+            return medianFilter(m_image);
+        }
+    }
+    return std::make_shared<cv::Mat>(result(cv::Rect(MEDIAN_KERNEL_SIZE, MEDIAN_KERNEL_SIZE, m_image->cols, m_image->rows)).clone());
+}
+
+std::shared_ptr<cv::Mat> PLImg::cuda::filters::FusedMedianFilter::maskedMedian(const std::shared_ptr<cv::Mat>& mask) {
+    auto lock = lockGPU();
+    PLImg::cuda::runCUDAchecks();
+    // The image isn't on the GPU if median() wasn't called, used chunks, was released by releaseParkedImages() or the
+    // device was reset in the meantime
+    if(!m_deviceImage || m_deviceGeneration != PLImg::cuda::raw::deviceGeneration()) {
+        release();
+        return medianFilterMasked(takeImage(), mask);
+    }
+
+    cv::Mat paddedMask;
+    cv::copyMakeBorder(*mask, paddedMask, MEDIAN_KERNEL_SIZE, MEDIAN_KERNEL_SIZE, MEDIAN_KERNEL_SIZE, MEDIAN_KERNEL_SIZE, cv::BORDER_REPLICATE);
+    cv::Mat result(paddedMask.rows, paddedMask.cols, CV_32FC1);
+    try {
+        PLImg::cuda::raw::filters::CUDAmedianFilterMasked(m_deviceImage, paddedMask, result);
+    } catch (PLImg::GPUOutOfMemoryException& e) {
+        // A spilled image is only mapped again if the GPU runs out of memory
+        release();
+        return medianFilterMasked(takeImage(), mask);
+    }
+    release();
+    m_image = nullptr;
+    m_scratch.discard();
+    return std::make_shared<cv::Mat>(result(cv::Rect(MEDIAN_KERNEL_SIZE, MEDIAN_KERNEL_SIZE, mask->cols, mask->rows)).clone());
+}
+
+bool PLImg::cuda::filters::FusedMedianFilter::spill(const std::string& directory) {
+    if(!m_image || m_image.use_count() > 1) {
+        return false;
+    }
+    m_scratch.spill(m_image, directory);
+    return true;
+}
+
+std::shared_ptr<cv::Mat> PLImg::cuda::filters::FusedMedianFilter::takeImage() {
+    if(m_scratch.spilled()) {
+        return m_scratch.restore();
+    }
+    return std::move(m_image);
+}
+
 size_t PLImg::cuda::labeling::getLargestAreaConnectedComponentsMemoryEstimation(const cv::Mat& image) {
     size_t memoryEstimation = getConnectedComponentsMemoryEstimation(image) +
         getConnectedComponentsLargestComponentMemoryEstimation(image);
@@ -459,6 +615,7 @@ size_t PLImg::cuda::labeling::getConnectedComponentsLargestComponentMemoryEstima
 }
 
 cv::Mat PLImg::cuda::labeling::largestAreaConnectedComponents(const cv::Mat& image, cv::Mat mask, float percentPixels) {
+    auto lock = lockGPU();
     float pixelThreshold;
     if(mask.empty()) {
         pixelThreshold = float(image.cols) * float(image.rows) * percentPixels / 100.0f;
@@ -514,6 +671,7 @@ cv::Mat PLImg::cuda::labeling::largestAreaConnectedComponents(const cv::Mat& ima
 }
 
 cv::Mat PLImg::cuda::labeling::connectedComponents(const cv::Mat &image) {
+    auto lock = lockGPU();
     PLImg::cuda::runCUDAchecks();
     cv::Mat result = cv::Mat(image.rows, image.cols, CV_32SC1);
 
@@ -521,8 +679,9 @@ cv::Mat PLImg::cuda::labeling::connectedComponents(const cv::Mat &image) {
     unsigned numberOfChunks = 1;
     unsigned chunksPerDim;
     float predictedMemoryUsage = getConnectedComponentsMemoryEstimation(image);
-    if (predictedMemoryUsage > double(PLImg::cuda::getFreeMemory())) {
-        numberOfChunks = fmax(numberOfChunks, pow(4, ceil(log(predictedMemoryUsage / double(PLImg::cuda::getFreeMemory())) / log(4))));
+    double freeMemory = double(PLImg::cuda::getFreeMemory(size_t(predictedMemoryUsage)));
+    if (predictedMemoryUsage > freeMemory) {
+        numberOfChunks = fmax(numberOfChunks, pow(4, ceil(log(predictedMemoryUsage / freeMemory) / log(4))));
     }
 
     // Chunked connected components algorithm.
@@ -569,8 +728,11 @@ cv::Mat PLImg::cuda::labeling::connectedComponents(const cv::Mat &image) {
                 subResult(srcRect).copyTo(result(dstRect));
             }
         } catch (PLImg::GPUOutOfMemoryException& e) {
-            std::cerr << "Ran out of memory because prediction was not accurate enough. Increasing number of chunks" << std::endl;
-            numberOfChunks = numberOfChunks * 4;
+            // Retry with the same number of chunks if images kept by FusedMedianFilter were released
+            if(releaseParkedImages() == 0) {
+                std::cerr << "Ran out of memory because prediction was not accurate enough. Increasing number of chunks" << std::endl;
+                numberOfChunks = numberOfChunks * 4;
+            }
             gpu_exception = true;
         }
     } while (gpu_exception);
@@ -696,6 +858,7 @@ void PLImg::cuda::labeling::connectedComponentsMergeChunks(cv::Mat &image, int n
 }
 
 std::pair<cv::Mat, int> PLImg::cuda::labeling::largestComponent(const cv::Mat &connectedComponentsImage) {
+    auto lock = lockGPU();
     PLImg::cuda::runCUDAchecks();
 
     // Get the number of threads for all following steps
@@ -27,7 +27,9 @@
 #include "cuda/cuda_toolbox.h"
 #include "cuda/define.h"
 #include "cuda/exceptions.h"
+#include "scratchimage.h"
 #include <chrono>
+#include <mutex>
 #include <numeric>
 #include <omp.h>
 #include <opencv2/opencv.hpp>
@@ -104,6 +106,33 @@ namespace PLImg {
          * @return Total amount of free VRAM in bytes.
          */
         size_t getFreeMemory();
+        /**
+         * The images which FusedMedianFilter keeps on the GPU between its filters are released first if fewer than
+         * required bytes are free. Their filters fall back to medianFilterMasked().
+         * @brief Get the free amount of memory in bytes for an operation
+         * @param required Estimated memory usage of the operation in bytes
+         * @return Total amount of free VRAM in bytes.
+         */
+        size_t getFreeMemory(size_t required);
+        /**
+         * @brief Release the images which all FusedMedianFilter instances keep on the GPU
+         * @return Number of released bytes
+         */
+        size_t releaseParkedImages();
+        /**
+         * Sections processed concurrently share the GPU. The memory estimations of the CUDA functions assume that
+         * the free memory isn't used by other threads. All CUDA functions of PLImg acquire this lock.
+         * @brief Acquire the global GPU lock
+         * @return Lock which is released when it goes out of scope
+         */
+        std::unique_lock<std::recursive_mutex> lockGPU();
+        /**
+         * Long running processes like PLImigDaemon keep the device buffers of the median filters and histograms
+         * between the calls instead of allocating them for each chunk.
+         * @brief Keep the device buffers between the calls of the CUDA functions
+         * @param keep True to keep the buffers. False frees them.
+         */
+        void keepBuffers(bool keep);
 
         size_t getHistogramMemoryEstimation(const cv::Mat& image, uint numBins);
         cv::Mat histogram(const cv::Mat& image, float minLabel, float maxLabel, uint numBins);
@@ -134,6 +163,73 @@ namespace PLImg {
              * @return Shared pointer of the filtered image.
              */
             std::shared_ptr<cv::Mat> medianFilterMasked(const std::shared_ptr<cv::Mat>& image, const std::shared_ptr<cv::Mat>& mask);
+
+            /**
+             * The mask of a section is generated from the median filtered transmittance. Afterwards the original
+             * transmittance is filtered again with the masked median filter. If the padded transmittance, the result and
+             * the mask fit into the free GPU memory, the FusedMedianFilter keeps the transmittance on the GPU between both
+             * filters. The transmittance is then padded and copied to the GPU only once and the masked median filter only
+             * copies the mask. Otherwise both methods fall back to medianFilter() and medianFilterMasked(). Other CUDA
+             * functions release the kept transmittance if they need its memory, see releaseParkedImages().
+             * @brief Median filter and masked median filter of the same image
+             */
+            class FusedMedianFilter {
+            public:
+                /**
+                 * @brief Create the filters for an image
+                 * @param image 32-bit floating point image which will be filtered
+                 */
+                explicit FusedMedianFilter(std::shared_ptr<cv::Mat> image);
+                /**
+                 * @brief Free the image on the GPU if maskedMedian() wasn't called
+                 */
+                ~FusedMedianFilter();
+                FusedMedianFilter(const FusedMedianFilter&) = delete;
+                FusedMedianFilter& operator=(const FusedMedianFilter&) = delete;
+
+                /**
+                 * @brief Apply the circular median filter like medianFilter()
+                 * @return Shared pointer of the filtered image.
+                 */
+                std::shared_ptr<cv::Mat> median();
+                /**
+                 * Apply the circular median filter with a separation mask like medianFilterMasked(). The image is released
+                 * afterwards, so this method can only be called once.
+                 * @brief Apply the masked median filter to the image
+                 * @param mask 8-bit mask for the median filter.
+                 * @return Shared pointer of the filtered image.
+                 */
+                std::shared_ptr<cv::Mat> maskedMedian(const std::shared_ptr<cv::Mat>& mask);
+                /**
+                 * Between both filters the image is only needed if it isn't kept on the GPU. Spilling it to a ScratchImage
+                 * frees its memory. The image is only spilled if the caller doesn't hold a reference to it anymore, as the
+                 * memory wouldn't be released otherwise. maskedMedian() maps the image again if it has to fall back to
+                 * medianFilterMasked().
+                 * @brief Move the image into a scratch file until maskedMedian() is called
+                 * @param directory Directory of the scratch file
+                 * @return True if the image was moved and its memory released
+                 */
+                bool spill(const std::string& directory);
+
+            private:
+                friend size_t PLImg::cuda::releaseParkedImages();
+
+                /// Free the image on the GPU
+                void release();
+                /// Take the image from memory or from the scratch file
+                std::shared_ptr<cv::Mat> takeImage();
+
+                /// Unpadded image
+                std::shared_ptr<cv::Mat> m_image;
+                /// Unpadded image after spill()
+                PLImg::ScratchImage m_scratch;
+                /// Padded image on the GPU. nullptr if it isn't kept.
+                float* m_deviceImage;
+                /// Device generation when the image was copied to the GPU
+                unsigned long long m_deviceGeneration;
+                /// Size of the padded image on the GPU in bytes
+                size_t m_deviceBytes;
+            };
         }
 
         namespace labeling {
@@ -0,0 +1,458 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Forschungszentrum Jülich / Jan André Reuter.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "volumewriter.h"
+#include "hdf5configuration.h"
+#include "reader.h"
+#include "writer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+
+namespace {
+    void appendString(std::string& buffer, const std::string& value) {
+        unsigned long long length = value.size();
+        buffer.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        buffer.append(value);
+    }
+
+    std::string readString(const std::string& buffer, size_t& position) {
+        unsigned long long length;
+        std::memcpy(&length, buffer.data() + position, sizeof(length));
+        position += sizeof(length);
+        std::string value = buffer.substr(position, length);
+        position += length;
+        return value;
+    }
+
+    template<typename T>
+    void appendValue(std::string& buffer, T value) {
+        buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template<typename T>
+    T readValue(const std::string& buffer, size_t& position) {
+        T value;
+        std::memcpy(&value, buffer.data() + position, sizeof(T));
+        position += sizeof(T);
+        return value;
+    }
+
+    H5::Attribute recreateAttribute(H5::DataSet& dset, const std::string& parameter_name, const H5::DataType& type,
+                                    const H5::DataSpace& space) {
+        if(dset.attrExists(parameter_name)) {
+            dset.removeAttr(parameter_name);
+        }
+        return dset.createAttribute(parameter_name, type, space);
+    }
+}
+
+#ifdef PLIMG_USE_MPI
+PLImg::HDF5VolumeWriter::HDF5VolumeWriter(MPI_Comm communicator) : m_communicator(communicator), m_filename() {}
+#else
+PLImg::HDF5VolumeWriter::HDF5VolumeWriter() : m_filename() {}
+#endif
+
+PLImg::HDF5VolumeWriter::~HDF5VolumeWriter() {
+    try {
+        close();
+    } catch(const std::exception& exception) {
+        std::cerr << "Could not close volume " << m_filename << ": " << exception.what() << std::endl;
+    }
+}
+
+int PLImg::HDF5VolumeWriter::rank() const {
+    #ifdef PLIMG_USE_MPI
+        int rank;
+        MPI_Comm_rank(m_communicator, &rank);
+        return rank;
+    #else
+        return 0;
+    #endif
+}
+
+int PLImg::HDF5VolumeWriter::size() const {
+    #ifdef PLIMG_USE_MPI
+        int size;
+        MPI_Comm_size(m_communicator, &size);
+        return size;
+    #else
+        return 1;
+    #endif
+}
+
+std::vector<long long> PLImg::HDF5VolumeWriter::assignSlices(unsigned long long slices, int rank, int size, unsigned blockSize) {
+    if(size < 1 || rank < 0 || rank >= size) {
+        throw std::invalid_argument("Invalid rank " + std::to_string(rank) + " for " + std::to_string(size) + " processes");
+    }
+    if(blockSize == 0) {
+        throw std::invalid_argument("The block size has to be at least 1");
+    }
+    unsigned long long blocks = (slices + blockSize - 1) / blockSize;
+    unsigned long long rounds = (blocks + size - 1) / size;
+    std::vector<long long> assigned;
+    for(unsigned long long round = 0; round < rounds; ++round) {
+        unsigned long long block = round * size + rank;
+        for(unsigned long long slice = block * blockSize; slice < (block + 1) * blockSize; ++slice) {
+            assigned.push_back(slice < slices ? (long long) slice : -1);
+        }
+    }
+    return assigned;
+}
+
+std::string PLImg::HDF5VolumeWriter::path() const {
+    return m_filename;
+}
+
+void PLImg::HDF5VolumeWriter::set_path(const std::string& filename) {
+    close();
+    auto lock = Reader::lockHDF5();
+    std::filesystem::path folder = std::filesystem::path(filename).parent_path();
+    if(!folder.empty()) {
+        std::error_code err;
+        std::filesystem::create_directories(folder, err);
+    }
+
+    HDF5Configuration configuration = HDF5Configuration::global();
+    // All ranks have to either create or open the file. The decision of rank 0 is used.
+    bool exists = PLImg::Reader::fileExists(filename);
+    #ifdef PLIMG_USE_MPI
+        int existsFlag = exists;
+        MPI_Bcast(&existsFlag, 1, MPI_INT, 0, m_communicator);
+        exists = existsFlag;
+        // The page buffer is not supported by the MPI-IO driver
+        hid_t fapl = configuration.fileAccessPropertyList(false);
+        H5Pset_fapl_mpio(fapl, m_communicator, MPI_INFO_NULL);
+        H5Pset_all_coll_metadata_ops(fapl, true);
+        H5Pset_coll_metadata_write(fapl, true);
+    #else
+        hid_t fapl = configuration.fileAccessPropertyList(true);
+    #endif
+
+    hid_t file;
+    if(exists) {
+        H5E_BEGIN_TRY {
+            file = H5Fopen(filename.c_str(), H5F_ACC_RDWR, fapl);
+        } H5E_END_TRY
+    } else {
+        hid_t fcpl = configuration.fileCreationPropertyList();
+        H5E_BEGIN_TRY {
+            file = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, fcpl, fapl);
+        } H5E_END_TRY
+        H5Pclose(fcpl);
+    }
+    H5Pclose(fapl);
+    if(!all(file >= 0)) {
+        // The file is opened collectively. If only some ranks opened it, it can neither be used nor closed
+        // collectively and the job is aborted.
+        #ifdef PLIMG_USE_MPI
+            if(!all(file < 0)) {
+                std::cerr << "Volume " << filename << " could only be opened by some ranks. Aborting." << std::endl;
+                MPI_Abort(m_communicator, EXIT_FAILURE);
+            }
+        #endif
+        throw std::runtime_error("Could not open volume " + filename);
+    }
+    // H5File keeps its own reference to the file
+    m_hdf5file = H5::H5File(file);
+    H5Fclose(file);
+    m_filename = filename;
+}
+
+void PLImg::HDF5VolumeWriter::create_volume(const std::string& dataset, unsigned long long slices, int rows, int cols, int type) {
+    auto lock = Reader::lockHDF5();
+    agree(!m_filename.empty(), "No volume file is open");
+    H5::Exception::dontPrint();
+    H5::DataSet dset;
+    bool exists = true;
+    try {
+        dset = m_hdf5file.openDataSet(dataset);
+    } catch(...) {
+        exists = false;
+    }
+    if(!exists) {
+        bool created = true;
+        try {
+            hsize_t dims[3] = {slices, static_cast<hsize_t>(rows), static_cast<hsize_t>(cols)};
+            hsize_t chunk_dims[3] = {1, std::min(hdf5_volume_writer_chunk_dimensions[0], dims[1]),
+                                     std::min(hdf5_volume_writer_chunk_dimensions[1], dims[2])};
+            hid_t dcpl = HDF5Configuration::global().datasetCreationPropertyList();
+            H5::DSetCreatPropList ds_creatplist(dcpl);
+            H5Pclose(dcpl);
+            ds_creatplist.setChunk(3, chunk_dims);
+            m_hdf5file.createDataSet(dataset, HDF5Writer::hdf5Type(type), H5::DataSpace(3, dims), ds_creatplist).close();
+        } catch(...) {
+            created = false;
+        }
+        agree(created, "Could not create volume " + dataset);
+        return;
+    }
+    // Existing volumes can be reused if their shape and datatype match
+    H5::DataSpace dataSpace = dset.getSpace();
+    hsize_t dims[3] = {0, 0, 0};
+    bool matches = dataSpace.getSimpleExtentNdims() == 3;
+    if(matches) {
+        dataSpace.getSimpleExtentDims(dims);
+        matches = dims[0] == slices && dims[1] == hsize_t(rows) && dims[2] == hsize_t(cols) &&
+                  dset.getDataType() == HDF5Writer::hdf5Type(type);
+    }
+    agree(matches, "Selected path is not empty and slices, colums or rows do not match. Please check your path!");
+}
+
+void PLImg::HDF5VolumeWriter::write_slice(const std::string& dataset, long long slice, const cv::Mat& image) {
+    auto lock = Reader::lockHDF5();
+    H5::Exception::dontPrint();
+    H5::DataSet dset;
+    hsize_t dims[3] = {0, 0, 0};
+    bool valid = !m_filename.empty();
+    if(valid) {
+        try {
+            dset = m_hdf5file.openDataSet(dataset);
+            H5::DataSpace dataSpace = dset.getSpace();
+            valid = dataSpace.getSimpleExtentNdims() == 3;
+            if(valid) {
+                dataSpace.getSimpleExtentDims(dims);
+            }
+        } catch(...) {
+            valid = false;
+        }
+    }
+    if(valid && slice >= 0) {
+        valid = hsize_t(slice) < dims[0] && hsize_t(image.rows) <= dims[1] && hsize_t(image.cols) <= dims[2] &&
+                dset.getDataType() == HDF5Writer::hdf5Type(image.type());
+    } else if(valid) {
+        valid = image.empty();
+    }
+    // Throw on all ranks. Otherwise the other ranks would wait forever in the collective write.
+    agree(valid, "Could not write slice " + std::to_string(slice) + " of volume " + dataset +
+                 ". Please check the slice index, dimensions and datatype on all ranks.");
+
+    H5::DataSpace fileSpace = dset.getSpace();
+    H5::DataSpace memSpace;
+    cv::Mat data;
+    unsigned char empty = 0;
+    if(slice >= 0) {
+        data = image.isContinuous() ? image : image.clone();
+        hsize_t offset[3] = {hsize_t(slice), 0, 0};
+        hsize_t count[3] = {1, hsize_t(data.rows), hsize_t(data.cols)};
+        fileSpace.selectHyperslab(H5S_SELECT_SET, count, offset);
+        memSpace = H5::DataSpace(3, count);
+    } else {
+        // Ranks without a section take part in the collective write with an empty selection
+        hsize_t count[3] = {1, 1, 1};
+        fileSpace.selectNone();
+        memSpace = H5::DataSpace(3, count);
+        memSpace.selectNone();
+    }
+
+    hid_t dxpl = H5Pcreate(H5P_DATASET_XFER);
+    #ifdef PLIMG_USE_MPI
+        H5Pset_dxpl_mpio(dxpl, H5FD_MPIO_COLLECTIVE);
+    #endif
+    herr_t status = H5Dwrite(dset.getId(), slice >= 0 ? HDF5Writer::hdf5Type(data.type()).getId() : dset.getDataType().getId(),
+                             memSpace.getId(), fileSpace.getId(), dxpl, slice >= 0 ? data.data : &empty);
+    H5Pclose(dxpl);
+    agree(status >= 0, "Could not write slice " + std::to_string(slice) + " of volume " + dataset);
+}
+
+void PLImg::HDF5VolumeWriter::write_slice_attribute(const std::string& dataset, const std::string& parameter_name,
+                                                    unsigned long long slice, double value) {
+    m_numericAttributes[dataset][parameter_name][slice] = value;
+}
+
+void PLImg::HDF5VolumeWriter::write_slice_attribute(const std::string& dataset, const std::string& parameter_name,
+                                                    unsigned long long slice, const std::string& value) {
+    m_stringAttributes[dataset][parameter_name][slice] = value;
+}
+
+void PLImg::HDF5VolumeWriter::write_attribute(const std::string& dataset, const std::string& parameter_name, const std::string& value) {
+    write_type_attribute(dataset, parameter_name, H5::StrType(H5::PredType::C_S1, value.size() + 1), value.c_str());
+}
+
+void PLImg::HDF5VolumeWriter::write_attribute(const std::string& dataset, const std::string& parameter_name, unsigned short value) {
+    write_type_attribute(dataset, parameter_name, H5::PredType::NATIVE_USHORT, &value);
+}
+
+void PLImg::HDF5VolumeWriter::write_type_attribute(const std::string& dataset, const std::string& parameter_name,
+                                                   const H5::DataType& type, const void* value) {
+    auto lock = Reader::lockHDF5();
+    H5::Exception::dontPrint();
+    // The metadata has to be changed identically on all ranks. Check the dataset before changing anything.
+    H5::DataSet dset;
+    bool opened = true;
+    try {
+        dset = m_hdf5file.openDataSet(dataset);
+    } catch(...) {
+        opened = false;
+    }
+    agree(opened, "Could not open volume " + dataset);
+    bool written = true;
+    try {
+        H5::Attribute attr = recreateAttribute(dset, parameter_name, type, H5::DataSpace(H5S_SCALAR));
+        attr.write(type, value);
+    } catch(...) {
+        written = false;
+    }
+    agree(written, "Could not write attribute " + parameter_name + " of volume " + dataset);
+}
+
+void PLImg::HDF5VolumeWriter::close() {
+    if(m_filename.empty()) {
+        return;
+    }
+    auto lock = Reader::lockHDF5();
+    try {
+        write_slice_attributes();
+    } catch(...) {
+        m_hdf5file.close();
+        m_filename = "";
+        throw;
+    }
+    m_hdf5file.close();
+    m_filename = "";
+}
+
+void PLImg::HDF5VolumeWriter::write_slice_attributes() {
+    // Attributes have to be written collectively with the same values on all ranks.
+    // Serialize the local attributes and exchange them first.
+    std::string buffer;
+    for(const auto& [dataset, attributes] : m_numericAttributes) {
+        for(const auto& [name, values] : attributes) {
+            for(const auto& [slice, value] : values) {
+                buffer.push_back('d');
+                appendString(buffer, dataset);
+                appendString(buffer, name);
+                appendValue(buffer, slice);
+                appendValue(buffer, value);
+            }
+        }
+    }
+    for(const auto& [dataset, attributes] : m_stringAttributes) {
+        for(const auto& [name, values] : attributes) {
+            for(const auto& [slice, value] : values) {
+                buffer.push_back('s');
+                appendString(buffer, dataset);
+                appendString(buffer, name);
+                appendValue(buffer, slice);
+                appendString(buffer, value);
+            }
+        }
+    }
+    m_numericAttributes.clear();
+    m_stringAttributes.clear();
+
+    #ifdef PLIMG_USE_MPI
+        int numberOfRanks = size();
+        int length = int(buffer.size());
+        std::vector<int> lengths(numberOfRanks);
+        MPI_Allgather(&length, 1, MPI_INT, lengths.data(), 1, MPI_INT, m_communicator);
+        std::vector<int> displacements(numberOfRanks, 0);
+        for(int i = 1; i < numberOfRanks; ++i) {
+            displacements.at(i) = displacements.at(i - 1) + lengths.at(i - 1);
+        }
+        std::string received(displacements.back() + lengths.back(), '\0');
+        MPI_Allgatherv(buffer.data(), length, MPI_CHAR, received.data(), lengths.data(), displacements.data(),
+                       MPI_CHAR, m_communicator);
+        buffer = std::move(received);
+    #endif
+
+    std::map<std::string, std::map<std::string, std::map<unsigned long long, double>>> numericAttributes;
+    std::map<std::string, std::map<std::string, std::map<unsigned long long, std::string>>> stringAttributes;
+    size_t position = 0;
+    while(position < buffer.size()) {
+        char kind = buffer.at(position++);
+        std::string dataset = readString(buffer, position);
+        std::string name = readString(buffer, position);
+        auto slice = readValue<unsigned long long>(buffer, position);
+        if(kind == 'd') {
+            numericAttributes[dataset][name][slice] = readValue<double>(buffer, position);
+        } else {
+            stringAttributes[dataset][name][slice] = readString(buffer, position);
+        }
+    }
+
+    H5::Exception::dontPrint();
+    bool written = true;
+    try {
+        for(const auto& [dataset, attributes] : numericAttributes) {
+            H5::DataSet dset = m_hdf5file.openDataSet(dataset);
+            hsize_t dims[3];
+            dset.getSpace().getSimpleExtentDims(dims);
+            for(const auto& [name, values] : attributes) {
+                std::vector<double> data(dims[0], std::numeric_limits<double>::quiet_NaN());
+                for(const auto& [slice, value] : values) {
+                    if(slice < dims[0]) {
+                        data.at(slice) = value;
+                    }
+                }
+                H5::Attribute attr = recreateAttribute(dset, name, H5::PredType::NATIVE_DOUBLE, H5::DataSpace(1, dims));
+                attr.write(H5::PredType::NATIVE_DOUBLE, data.data());
+            }
+        }
+        for(const auto& [dataset, attributes] : stringAttributes) {
+            H5::DataSet dset = m_hdf5file.openDataSet(dataset);
+            hsize_t dims[3];
+            dset.getSpace().getSimpleExtentDims(dims);
+            for(const auto& [name, values] : attributes) {
+                std::vector<std::string> data(dims[0]);
+                for(const auto& [slice, value] : values) {
+                    if(slice < dims[0]) {
+                        data.at(slice) = value;
+                    }
+                }
+                std::vector<const char*> pointers;
+                for(const auto& value : data) {
+                    pointers.push_back(value.c_str());
+                }
+                H5::StrType str_type(H5::PredType::C_S1, H5T_VARIABLE);
+                H5::Attribute attr = recreateAttribute(dset, name, str_type, H5::DataSpace(1, dims));
+                attr.write(str_type, pointers.data());
+            }
+        }
+    } catch(...) {
+        written = false;
+    }
+    agree(written, "Could not write the slice attributes of volume " + m_filename);
+}
+
+bool PLImg::HDF5VolumeWriter::all(bool condition) const {
+    #ifdef PLIMG_USE_MPI
+        int local = condition;
+        int global;
+        MPI_Allreduce(&local, &global, 1, MPI_INT, MPI_LAND, m_communicator);
+        return global;
+    #else
+        return condition;
+    #endif
+}
+
+void PLImg::HDF5VolumeWriter::agree(bool condition, const std::string& message) const {
+    if(!all(condition)) {
+        throw std::runtime_error(message);
+    }
+}
@@ -0,0 +1,219 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Forschungszentrum Jülich / Jan André Reuter.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef PLIMG_VOLUMEWRITER_H
+#define PLIMG_VOLUMEWRITER_H
+
+#include <H5Cpp.h>
+#include <map>
+#include <opencv2/core.hpp>
+#include <string>
+#include <vector>
+#ifdef PLIMG_USE_MPI
+    #include <mpi.h>
+#endif
+
+/// Chunk dimensions of a single slice in a volume. Chunks never span more than one slice.
+constexpr hsize_t hdf5_volume_writer_chunk_dimensions[2] = {2048, 2048};
+
+/**
+ * @file
+ * @brief PLImg::HDF5VolumeWriter class
+ */
+namespace PLImg {
+    /**
+     * Sections of a brain are stacked into a three dimensional [z, y, x] volume for the reconstruction.
+     * The HDF5VolumeWriter writes each processed section directly into its slice of a shared volume file instead of
+     * collecting all section files in a second pass.
+     *
+     * If PLImg is built with PLIMG_MPI, the volume file is opened with the MPI-IO driver of a parallel HDF5 library.
+     * Every rank processes different sections and writes its slices collectively. All methods except
+     * write_slice_attribute() are collective and have to be called by all ranks of the communicator in the same order
+     * and with the same arguments (apart from the slice and image of write_slice()). Errors of the collective methods
+     * are thrown on all ranks, so that no rank waits for the others in the next collective call. If the file could only
+     * be opened by some of the ranks, the job is aborted with MPI_Abort. Without MPI the volume is written by a single
+     * process with the same interface.
+     *
+     * Per slice attributes like the generated parameters of each section are collected locally and written as arrays
+     * with one entry per slice when the file is closed. Slices without a value contain NaN or an empty string.
+     * @brief Write sections as slices of a three dimensional HDF5 dataset
+     */
+    class HDF5VolumeWriter {
+    public:
+        #ifdef PLIMG_USE_MPI
+        /**
+         * @brief Create a volume writer for all ranks of the communicator. MPI has to be initialized before.
+         * @param communicator Ranks which write the volume together
+         */
+        explicit HDF5VolumeWriter(MPI_Comm communicator = MPI_COMM_WORLD);
+        #else
+        /**
+         * @brief Create a volume writer for a single process
+         */
+        HDF5VolumeWriter();
+        #endif
+        /**
+         * @brief Closes the volume file. Collective if a file is still open.
+         */
+        ~HDF5VolumeWriter();
+
+        /**
+         * @brief Rank of this process in the communicator. Always 0 without MPI.
+         * @return Rank of this process
+         */
+        int rank() const;
+        /**
+         * @brief Number of processes in the communicator. Always 1 without MPI.
+         * @return Number of processes
+         */
+        int size() const;
+        /**
+         * Sections are distributed round-robin over all ranks. Collective writes need the same number of calls on
+         * each rank, so ranks with fewer sections get -1 as their last entries. Those rounds have to be passed to
+         * write_slice() without an image. With a block size, blocks of neighbouring sections are distributed instead,
+         * so that all sections of a block are processed by the same rank.
+         * @brief Get the slices processed by a rank
+         * @param slices Number of slices in the volume
+         * @param rank Rank of the process
+         * @param size Number of processes
+         * @param blockSize Number of neighbouring slices which are assigned to the same rank
+         * @return Slice indices of the rank, padded with -1 to the same length on all ranks
+         */
+        static std::vector<long long> assignSlices(unsigned long long slices, int rank, int size, unsigned blockSize = 1);
+
+        /**
+         * @brief Currently opened volume file
+         * @return Path of the file or an empty string if no file is open
+         */
+        std::string path() const;
+        /**
+         * Open the volume file. The file will be created if it doesn't exist. Otherwise it will be opened in append mode.
+         * A previously opened file is closed first.
+         * @brief Open the volume file (collective)
+         * @param filename Path of the volume file
+         */
+        void set_path(const std::string& filename);
+        /**
+         * Create a dataset with the dimensions [slices, rows, cols]. Each slice is stored in chunks of
+         * hdf5_volume_writer_chunk_dimensions. An existing dataset is reused if its dimensions and datatype match.
+         * @brief Create a volume dataset (collective)
+         * @param dataset Path of the dataset in the file
+         * @param slices Number of slices
+         * @param rows Number of rows of each slice
+         * @param cols Number of columns of each slice
+         * @param type OpenCV type of the slices. Supported are CV_8UC1, CV_16UC1, CV_16FC1, CV_32SC1 and CV_32FC1.
+         */
+        void create_volume(const std::string& dataset, unsigned long long slices, int rows, int cols, int type);
+        /**
+         * Write one image into its slice of the volume. Images smaller than the volume are written to the upper left
+         * corner of the slice. Each rank writes its own slice. Ranks without a section in this round pass a negative
+         * slice index and an empty image. If any rank passes an invalid slice or image, all ranks throw.
+         * @brief Write a section into the volume (collective)
+         * @param dataset Path of the volume dataset
+         * @param slice Index of the slice or -1 if this rank has nothing to write
+         * @param image Image of the section with the type of the volume
+         */
+        void write_slice(const std::string& dataset, long long slice, const cv::Mat& image);
+        /**
+         * @brief Set a numerical attribute of a single slice. The attribute is written when the file is closed.
+         * @param dataset Path of the volume dataset
+         * @param parameter_name Name of the attribute
+         * @param slice Index of the slice
+         * @param value Value of the attribute
+         */
+        void write_slice_attribute(const std::string& dataset, const std::string& parameter_name, unsigned long long slice, double value);
+        /**
+         * @brief Set a string attribute of a single slice. The attribute is written when the file is closed.
+         * @param dataset Path of the volume dataset
+         * @param parameter_name Name of the attribute
+         * @param slice Index of the slice
+         * @param value Value of the attribute
+         */
+        void write_slice_attribute(const std::string& dataset, const std::string& parameter_name, unsigned long long slice, const std::string& value);
+        /**
+         * @brief Write a string attribute of the whole volume (collective). All ranks have to pass the same value.
+         * @param dataset Path of the volume dataset
+         * @param parameter_name Name of the attribute
+         * @param value Value of the attribute
+         */
+        void write_attribute(const std::string& dataset, const std::string& parameter_name, const std::string& value);
+        /**
+         * @brief Write an unsigned short attribute of the whole volume (collective). All ranks have to pass the same value.
+         * @param dataset Path of the volume dataset
+         * @param parameter_name Name of the attribute
+         * @param value Value of the attribute
+         */
+        void write_attribute(const std::string& dataset, const std::string& parameter_name, unsigned short value);
+        /**
+         * Collect the slice attributes of all ranks, write them to the volume datasets and close the file.
+         * @brief Close the volume file (collective)
+         */
+        void close();
+
+    private:
+        /**
+         * @brief Exchange the slice attributes of all ranks and write them to the file.
+         */
+        void write_slice_attributes();
+        /**
+         * @brief Write a scalar attribute of the whole volume (collective)
+         * @param dataset Path of the volume dataset
+         * @param parameter_name Name of the attribute
+         * @param type HDF5 datatype of the attribute
+         * @param value Pointer to the value of the attribute
+         */
+        void write_type_attribute(const std::string& dataset, const std::string& parameter_name, const H5::DataType& type,
+                                  const void* value);
+        /**
+         * @brief Check on all ranks if the condition holds
+         * @param condition Local result
+         * @return True if the condition holds on all ranks
+         */
+        bool all(bool condition) const;
+        /**
+         * Errors are agreed on before they are thrown. Otherwise the ranks without an error would wait forever in the
+         * next collective call.
+         * @brief Throw on all ranks if the condition does not hold on any rank
+         * @param condition Local result
+         * @param message Message of the exception
+         * @throws std::runtime_error on all ranks if the condition is false on at least one rank
+         */
+        void agree(bool condition, const std::string& message) const;
+
+        #ifdef PLIMG_USE_MPI
+        /// Communicator of all ranks writing the volume
+        MPI_Comm m_communicator;
+        #endif
+        /// Path of the opened volume file
+        std::string m_filename;
+        /// Opened volume file
+        H5::H5File m_hdf5file;
+        /// Numerical slice attributes of this rank: dataset -> attribute -> slice -> value
+        std::map<std::string, std::map<std::string, std::map<unsigned long long, double>>> m_numericAttributes;
+        /// String slice attributes of this rank: dataset -> attribute -> slice -> value
+        std::map<std::string, std::map<std::string, std::map<unsigned long long, std::string>>> m_stringAttributes;
+    };
+}
+
+#endif //PLIMG_VOLUMEWRITER_H
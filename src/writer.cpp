@@ -23,36 +23,251 @@
  */
 
 #include "writer.h"
+#include "hdf5configuration.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#ifdef __GNUC__
+    #include <fcntl.h>
+#endif
 #include <iostream>
+#include <limits>
+#include <omp.h>
+#include <stdexcept>
+#include <type_traits>
+#include <zlib.h>
+
+namespace {
+    /**
+     * Copy a chunk of the image, apply the byte shuffle filter and compress it with deflate in the same way
+     * as the HDF5 filter pipeline would do. Chunks at the image border are padded with zeros.
+     * @param image Image containing the chunk
+     * @param row First row of the chunk
+     * @param col First column of the chunk
+     * @param chunk_dims Dimensions of the chunk
+     * @param shuffle Apply the byte shuffle filter
+     * @param level Deflate compression level. Negative values disable deflate.
+     * @return Filtered chunk
+     */
+    std::vector<unsigned char> compressChunk(const cv::Mat& image, unsigned long long row, unsigned long long col,
+                                             const hsize_t chunk_dims[2], bool shuffle, int level) {
+        const size_t elementSize = image.elemSize();
+        const unsigned long long rows = std::min<unsigned long long>(chunk_dims[0], image.rows - row);
+        const unsigned long long cols = std::min<unsigned long long>(chunk_dims[1], image.cols - col);
+        const unsigned long long numberOfElements = chunk_dims[0] * chunk_dims[1];
+
+        std::vector<unsigned char> chunk(numberOfElements * elementSize, 0);
+        for(unsigned long long i = 0; i < rows; ++i) {
+            std::memcpy(chunk.data() + i * chunk_dims[1] * elementSize,
+                        image.ptr<unsigned char>(int(row + i)) + col * elementSize, cols * elementSize);
+        }
+
+        if(shuffle && elementSize > 1) {
+            std::vector<unsigned char> shuffled(chunk.size());
+            for(unsigned long long idx = 0; idx < numberOfElements; ++idx) {
+                for(size_t byte = 0; byte < elementSize; ++byte) {
+                    shuffled[byte * numberOfElements + idx] = chunk[idx * elementSize + byte];
+                }
+            }
+            chunk.swap(shuffled);
+        }
+
+        if(level >= 0) {
+            uLongf compressedSize = compressBound(chunk.size());
+            std::vector<unsigned char> compressed(compressedSize);
+            if(compress2(compressed.data(), &compressedSize, chunk.data(), chunk.size(), level) != Z_OK) {
+                throw std::runtime_error("Could not compress chunk with deflate");
+            }
+            compressed.resize(compressedSize);
+            chunk.swap(compressed);
+        }
+        return chunk;
+    }
+
+    /**
+     * Reduce the image size by a factor of two. Each pixel is the mean of the non NaN pixels in a 2x2 block.
+     * Integer images are rounded to the nearest value.
+     * @param image Floating point or fixed point image
+     * @return Downsampled image with half the number of rows and columns rounded up
+     */
+    template<typename T>
+    cv::Mat downsampleMean(const cv::Mat& image) {
+        cv::Mat result((image.rows + 1) / 2, (image.cols + 1) / 2, image.type());
+        #pragma omp parallel for default(shared) schedule(static)
+        for(int row = 0; row < result.rows; ++row) {
+            T* resultPtr = result.ptr<T>(row);
+            for(int col = 0; col < result.cols; ++col) {
+                double sum = 0;
+                unsigned count = 0;
+                for(int y = 2 * row; y < std::min(2 * row + 2, image.rows); ++y) {
+                    const T* imagePtr = image.ptr<T>(y);
+                    for(int x = 2 * col; x < std::min(2 * col + 2, image.cols); ++x) {
+                        if(!std::isnan(imagePtr[x])) {
+                            sum += imagePtr[x];
+                            ++count;
+                        }
+                    }
+                }
+                if(std::is_integral<T>::value) {
+                    resultPtr[col] = T(std::lround(sum / count));
+                } else {
+                    resultPtr[col] = count > 0 ? T(sum / count) : std::numeric_limits<T>::quiet_NaN();
+                }
+            }
+        }
+        return result;
+    }
+
+    /**
+     * Reduce the image size by a factor of two. Each pixel is the most frequent value in a 2x2 block.
+     * Ties are resolved by the larger value so that foreground labels are kept.
+     * @param image Mask or label image
+     * @return Downsampled image with half the number of rows and columns rounded up
+     */
+    template<typename T>
+    cv::Mat downsampleMode(const cv::Mat& image) {
+        cv::Mat result((image.rows + 1) / 2, (image.cols + 1) / 2, image.type());
+        #pragma omp parallel for default(shared) schedule(static)
+        for(int row = 0; row < result.rows; ++row) {
+            T* resultPtr = result.ptr<T>(row);
+            for(int col = 0; col < result.cols; ++col) {
+                T values[4];
+                unsigned numberOfValues = 0;
+                for(int y = 2 * row; y < std::min(2 * row + 2, image.rows); ++y) {
+                    const T* imagePtr = image.ptr<T>(y);
+                    for(int x = 2 * col; x < std::min(2 * col + 2, image.cols); ++x) {
+                        values[numberOfValues++] = imagePtr[x];
+                    }
+                }
+                T mode = values[0];
+                unsigned modeCount = 0;
+                for(unsigned i = 0; i < numberOfValues; ++i) {
+                    unsigned count = (unsigned) std::count(values, values + numberOfValues, values[i]);
+                    if(count > modeCount || (count == modeCount && values[i] > mode)) {
+                        mode = values[i];
+                        modeCount = count;
+                    }
+                }
+                resultPtr[col] = mode;
+            }
+        }
+        return result;
+    }
+
+    /**
+     * @return Name of the user running the program, which is written to the created_by attribute
+     */
+    std::string currentUser() {
+        std::string username;
+        #ifdef __GNUC__
+            uid_t uid = geteuid();
+            struct passwd *pw = getpwuid(uid);
+            if (pw) {
+                username = pw->pw_name;
+            }
+        #else
+            char username_arr[UNLEN + 1];
+            DWORD username_len = UNLEN + 1;
+            GetUserName(username_arr, &username_len);
+            username = std::string(username_arr);
+        #endif
+        return username;
+    }
+}
 
 PLImg::HDF5Writer::HDF5Writer() {
     m_filename = "";
+    m_durable = false;
+    m_pyramidTileSize = 0;
+    m_queueSize = 0;
+    m_queuedImages = 0;
+    m_busy = false;
+    m_stop = false;
+}
+
+PLImg::HDF5Writer::~HDF5Writer() {
+    set_asynchronous(0);
 }
 
 std::string PLImg::HDF5Writer::path() {
+    drain();
     return this->m_filename;
 }
 
 void PLImg::HDF5Writer::set_path(const std::string& filename) {
+    if(enqueue([this, filename]() { set_path(filename); })) {
+        return;
+    }
+    auto lock = Reader::lockHDF5();
     if(this->m_filename != filename) {
+        if(!this->m_filename.empty()) {
+            this->close();
+        }
         this->m_filename = filename;
-        this->open();
+        try {
+            this->open();
+        } catch(const std::exception&) {
+            // Setting the same path again retries opening the file
+            this->m_filename.clear();
+            throw;
+        }
     }
 }
 
 void PLImg::HDF5Writer::write_attribute(const std::string& dataset, const std::string& parameter_name, float value) {
+    if(enqueue([this, dataset, parameter_name, value]() { write_attribute(dataset, parameter_name, value); })) {
+        return;
+    }
+    if(m_zarr) {
+        m_zarr->write_attribute(dataset, parameter_name, double(value));
+        return;
+    }
     this->write_type_attribute(dataset, parameter_name, H5::PredType::NATIVE_FLOAT, &value);
 }
 
 void PLImg::HDF5Writer::write_attribute(const std::string& dataset, const std::string& parameter_name, double value) {
+    if(enqueue([this, dataset, parameter_name, value]() { write_attribute(dataset, parameter_name, value); })) {
+        return;
+    }
+    if(m_zarr) {
+        m_zarr->write_attribute(dataset, parameter_name, double(value));
+        return;
+    }
     this->write_type_attribute(dataset, parameter_name, H5::PredType::NATIVE_DOUBLE, &value);
 }
 
 void PLImg::HDF5Writer::write_attribute(const std::string& dataset, const std::string& parameter_name, int value) {
+    if(enqueue([this, dataset, parameter_name, value]() { write_attribute(dataset, parameter_name, value); })) {
+        return;
+    }
+    if(m_zarr) {
+        m_zarr->write_attribute(dataset, parameter_name, double(value));
+        return;
+    }
     this->write_type_attribute(dataset, parameter_name, H5::PredType::NATIVE_INT, &value);
 }
 
+void PLImg::HDF5Writer::write_attribute(const std::string& dataset, const std::string& parameter_name, unsigned short value) {
+    if(enqueue([this, dataset, parameter_name, value]() { write_attribute(dataset, parameter_name, value); })) {
+        return;
+    }
+    if(m_zarr) {
+        m_zarr->write_attribute(dataset, parameter_name, double(value));
+        return;
+    }
+    this->write_type_attribute(dataset, parameter_name, H5::PredType::NATIVE_USHORT, &value);
+}
+
 void PLImg::HDF5Writer::write_attribute(const std::string& dataset, const std::string& parameter_name, std::string value) {
+    if(enqueue([this, dataset, parameter_name, value]() { write_attribute(dataset, parameter_name, value); })) {
+        return;
+    }
+    if(m_zarr) {
+        m_zarr->write_attribute(dataset, parameter_name, value);
+        return;
+    }
+    auto lock = Reader::lockHDF5();
     H5::StrType str_type(H5::PredType::C_S1, value.size() + 1);
     // Convert to void pointer for the attribute writing method.
     auto str = reinterpret_cast<void*>(value.data());
@@ -60,6 +275,7 @@ void PLImg::HDF5Writer::write_attribute(const std::string& dataset, const std::s
 }
 
 void PLImg::HDF5Writer::write_type_attribute(const std::string& dataset, const std::string& parameter_name, const H5::AtomType& type, void* value) {
+    auto lock = Reader::lockHDF5();
     H5::Attribute attr;
     try {
         H5::Group grp = m_hdf5file.openGroup(dataset);
@@ -84,10 +300,69 @@ void PLImg::HDF5Writer::write_type_attribute(const std::string& dataset, const s
     }
     attr.write(type, value);
     attr.close();
-    m_hdf5file.flush(H5F_SCOPE_GLOBAL);
+}
+
+void PLImg::HDF5Writer::write_dataset(const std::string& dataset, const std::shared_ptr<cv::Mat>& image, bool create_softlink) {
+    // Keep a reference to the image until it is written
+    if(enqueue([this, dataset, image, create_softlink]() { write_dataset(dataset, *image, create_softlink); }, true)) {
+        return;
+    }
+    write_dataset(dataset, *image, create_softlink);
 }
 
 void PLImg::HDF5Writer::write_dataset(const std::string& dataset, const cv::Mat& image, bool create_softlink) {
+    // The copied header shares the reference counted data of the image
+    if(enqueue([this, dataset, image, create_softlink]() { write_dataset(dataset, image, create_softlink); }, true)) {
+        return;
+    }
+    // Downsample the pyramid levels while the full resolution image is written
+    std::future<std::vector<cv::Mat>> pyramid;
+    if(create_softlink && m_pyramidTileSize > 0) {
+        pyramid = std::async(std::launch::async, &HDF5Writer::pyramidLevels, image, m_pyramidTileSize);
+    }
+
+    // The pyramid is stored next to the dataset. Products in different groups of one file have their own pyramid.
+    std::string pyramidGroup = dataset.substr(0, dataset.find_last_of('/') + 1) + "pyramid";
+    if(pyramidGroup.front() != '/') {
+        pyramidGroup = "/" + pyramidGroup;
+    }
+    if(m_zarr) {
+        // Zarr has no links. The dataset itself is the full resolution level of the pyramid.
+        m_zarr->write_dataset(dataset, image);
+        if(pyramid.valid()) {
+            std::vector<cv::Mat> levels = pyramid.get();
+            for(unsigned level = 0; level < levels.size(); ++level) {
+                char levelName[8];
+                std::snprintf(levelName, sizeof(levelName), "/%02u", level + 1);
+                m_zarr->write_dataset(pyramidGroup + levelName, levels.at(level));
+            }
+        }
+        return;
+    }
+
+    auto lock = Reader::lockHDF5();
+    bool created = write_image(dataset, image, m_compression.enabled() ? hdf5_writer_chunk_dimensions : nullptr, lock);
+    if(create_softlink && created) {
+        try {
+            m_hdf5file.createGroup(pyramidGroup);
+        } catch (...) {}
+        m_hdf5file.link(H5G_LINK_SOFT, dataset, pyramidGroup + "/00");
+    }
+
+    if(pyramid.valid()) {
+        std::vector<cv::Mat> levels = pyramid.get();
+        // Chunks of the pyramid match the tiles requested by the viewer
+        const hsize_t tile_dims[2] = {m_pyramidTileSize, m_pyramidTileSize};
+        for(unsigned level = 0; level < levels.size(); ++level) {
+            char levelName[8];
+            std::snprintf(levelName, sizeof(levelName), "/%02u", level + 1);
+            write_image(pyramidGroup + levelName, levels.at(level), tile_dims, lock);
+        }
+    }
+}
+
+bool PLImg::HDF5Writer::write_image(const std::string& dataset, const cv::Mat& image, const hsize_t* chunk_dimensions,
+                                    std::unique_lock<std::recursive_mutex>& lock) {
     H5::DataSet dset;
     H5::DataSpace dataSpace;
     hsize_t dims[2];
@@ -113,49 +388,367 @@ void PLImg::HDF5Writer::write_dataset(const std::string& dataset, const cv::Mat&
         }
         dataSpace.close();
         dset.close();
+        return false;
+    }
+
+    dset = create_image(dataset, image.rows, image.cols, image.type(), chunk_dimensions);
+    if(chunk_dimensions) {
+        // Shuffle and deflate can be applied by PLImg directly. All other filters are applied by HDF5.
+        #if H5_VERSION_GE(1, 10, 2)
+        if(m_compression.scaleOffset < 0 && (m_compression.filter == "deflate" || m_compression.filter == "none")) {
+            hsize_t chunk_dims[2] = {std::min(chunk_dimensions[0], hsize_t(image.rows)),
+                                     std::min(chunk_dimensions[1], hsize_t(image.cols))};
+            write_chunks(dset, image, chunk_dims, lock);
+        } else {
+            dset.write(image.data, hdf5Type(image.type()));
+        }
+        #else
+        dset.write(image.data, hdf5Type(image.type()));
+        #endif
     } else {
-        // Create dataset normally
-        // Check for the datatype from the OpenCV mat to determine the HDF5 datatype
-        H5::PredType dtype = H5::PredType::NATIVE_FLOAT;
-        switch(image.type()) {
+        dset.write(image.data, hdf5Type(image.type()));
+    }
+    dset.close();
+    return true;
+}
+
+H5::DataSet PLImg::HDF5Writer::create_image(const std::string& dataset, int rows, int cols, int type,
+                                            const hsize_t* chunk_dimensions) {
+    // Check for the datatype from the OpenCV mat to determine the HDF5 datatype
+    H5::DataType dtype = hdf5Type(type);
+    hsize_t dims[2] = {static_cast<hsize_t>(rows), static_cast<hsize_t>(cols)};
+    H5::DataSpace dataSpace(2, dims);
+    // Allocation and fill time of the global configuration. The property list is copied by DSetCreatPropList.
+    hid_t dcpl = HDF5Configuration::global().datasetCreationPropertyList();
+    H5::DSetCreatPropList ds_creatplist(dcpl);
+    H5Pclose(dcpl);
+    if(!chunk_dimensions) {
+        return m_hdf5file.createDataSet(dataset, dtype, dataSpace, ds_creatplist);
+    }
+
+    hsize_t chunk_dims[2] = {std::min(chunk_dimensions[0], dims[0]),
+                             std::min(chunk_dimensions[1], dims[1])};
+    ds_creatplist.setChunk(2, chunk_dims);
+    // Filters are applied in the order in which they are added to the property list
+    if(m_compression.scaleOffset >= 0) {
+        if(CV_MAT_DEPTH(type) == CV_16F) {
+            // The scale-offset filter only supports 32-bit and 64-bit floating point values
+        } else if(CV_MAT_DEPTH(type) == CV_32F || CV_MAT_DEPTH(type) == CV_64F) {
+            H5Pset_scaleoffset(ds_creatplist.getId(), H5Z_SO_FLOAT_DSCALE, m_compression.scaleOffset);
+        } else {
+            H5Pset_scaleoffset(ds_creatplist.getId(), H5Z_SO_INT, H5Z_SO_INT_MINBITS_DEFAULT);
+        }
+    }
+    if(m_compression.shuffle) {
+        ds_creatplist.setShuffle();
+    }
+    if(m_compression.filter == "deflate") {
+        ds_creatplist.setDeflate(m_compression.level);
+    } else if(m_compression.filter == "lz4" || m_compression.filter == "zstd") {
+        H5Z_filter_t filter = m_compression.filter == "lz4" ? hdf5_writer_lz4_filter : hdf5_writer_zstd_filter;
+        if(H5Zfilter_avail(filter) <= 0) {
+            throw std::runtime_error("HDF5 filter plugin for " + m_compression.filter + " is not available. Please check HDF5_PLUGIN_PATH.");
+        }
+        unsigned int cd_values[1] = {m_compression.filter == "lz4" ? 0u : (unsigned int) m_compression.level};
+        H5Pset_filter(ds_creatplist.getId(), filter, H5Z_FLAG_OPTIONAL, 1, cd_values);
+    } else if(m_compression.filter != "none") {
+        throw std::runtime_error("Unknown compression filter " + m_compression.filter);
+    }
+    return m_hdf5file.createDataSet(dataset, dtype, dataSpace, ds_creatplist);
+}
+
+void PLImg::HDF5Writer::create_dataset(const std::string& dataset, int rows, int cols, int type) {
+    if(enqueue([this, dataset, rows, cols, type]() { create_dataset(dataset, rows, cols, type); })) {
+        return;
+    }
+    if(m_zarr) {
+        m_zarr->create_dataset(dataset, rows, cols, type);
+        return;
+    }
+    std::lock_guard<std::mutex> tileLock(m_tileMutex);
+    auto lock = Reader::lockHDF5();
+    H5::Exception::dontPrint();
+    H5::DataSet dset;
+    try {
+        dset = m_hdf5file.openDataSet(dataset);
+    } catch (...) {
+        dset = create_image(dataset, rows, cols, type, hdf5_writer_chunk_dimensions);
+        dset.close();
+        return;
+    }
+    // Existing datasets can be reused if their shape and datatype match
+    hsize_t dims[2];
+    H5::DataSpace dataSpace = dset.getSpace();
+    if(dataSpace.getSimpleExtentNdims() != 2) {
+        throw std::runtime_error("Selected path is not empty and colums or rows do not match. Please check your path!");
+    }
+    dataSpace.getSimpleExtentDims(dims);
+    if(dims[0] != hsize_t(rows) || dims[1] != hsize_t(cols) || !(dset.getDataType() == hdf5Type(type))) {
+        throw std::runtime_error("Selected path is not empty and colums or rows do not match. Please check your path!");
+    }
+}
+
+void PLImg::HDF5Writer::write_tile(const std::string& dataset, const cv::Rect& tile, const cv::Mat& image) {
+    // The copied header shares the reference counted data of the tile
+    if(enqueue([this, dataset, tile, image]() { write_tile(dataset, tile, image); }, true)) {
+        return;
+    }
+    if(image.rows != tile.height || image.cols != tile.width) {
+        throw std::invalid_argument("Tile and image dimensions do not match");
+    }
+    if(m_zarr) {
+        // Chunks of Zarr stores are written by multiple producers at the same time
+        m_zarr->write_tile(dataset, tile, image);
+        return;
+    }
+
+    // Producers are serialized while they access the file. Chunks are compressed without holding the lock.
+    std::unique_lock<std::mutex> tileLock(m_tileMutex);
+    auto lock = Reader::lockHDF5();
+    H5::Exception::dontPrint();
+    H5::DataSet dset;
+    try {
+        dset = m_hdf5file.openDataSet(dataset);
+    } catch (...) {
+        throw std::runtime_error("Dataset " + dataset + " does not exist. Please call create_dataset first.");
+    }
+    hsize_t dims[2];
+    H5::DataSpace fileSpace = dset.getSpace();
+    fileSpace.getSimpleExtentDims(dims);
+    if(tile.x < 0 || tile.y < 0 || hsize_t(tile.x + tile.width) > dims[1] || hsize_t(tile.y + tile.height) > dims[0]) {
+        throw std::out_of_range("Tile exceeds the dimensions of " + dataset);
+    }
+    H5::DataType dtype = hdf5Type(image.type());
+    if(!(dset.getDataType() == dtype)) {
+        throw std::runtime_error("Tile and dataset " + dataset + " have different datatypes");
+    }
+
+    // Tiles aligned to the chunks of a dataset with at most shuffle and deflate are filtered by PLImg
+    // and written directly. All other tiles are written as hyperslabs through the HDF5 filter pipeline.
+    bool directWrite = false;
+    bool shuffle = false;
+    int level = -1;
+    hsize_t chunk_dims[2] = {0, 0};
+    #if H5_VERSION_GE(1, 10, 2)
+    H5::DSetCreatPropList plist = dset.getCreatePlist();
+    if(plist.getLayout() == H5D_CHUNKED) {
+        plist.getChunk(2, chunk_dims);
+        directWrite = tile.x % chunk_dims[1] == 0 && tile.y % chunk_dims[0] == 0 &&
+                      (tile.width % chunk_dims[1] == 0 || hsize_t(tile.x + tile.width) == dims[1]) &&
+                      (tile.height % chunk_dims[0] == 0 || hsize_t(tile.y + tile.height) == dims[0]);
+        for(int i = 0; i < plist.getNfilters() && directWrite; ++i) {
+            unsigned int flags;
+            size_t numberOfValues = 1;
+            unsigned int values[1] = {0};
+            H5Z_filter_t filter = H5Pget_filter2(plist.getId(), i, &flags, &numberOfValues, values, 0, nullptr, nullptr);
+            if(filter == H5Z_FILTER_SHUFFLE) {
+                shuffle = true;
+            } else if(filter == H5Z_FILTER_DEFLATE && numberOfValues > 0) {
+                level = int(values[0]);
+            } else {
+                directWrite = false;
+            }
+        }
+    }
+    #endif
+
+    if(!directWrite) {
+        hsize_t offset[2] = {hsize_t(tile.y), hsize_t(tile.x)};
+        hsize_t count[2] = {hsize_t(tile.height), hsize_t(tile.width)};
+        fileSpace.selectHyperslab(H5S_SELECT_SET, count, offset);
+        H5::DataSpace memSpace(2, count);
+        cv::Mat continuous = image.isContinuous() ? image : image.clone();
+        dset.write(continuous.data, dtype, memSpace, fileSpace);
+        return;
+    }
+
+    const unsigned long long chunksPerRow = (tile.width + chunk_dims[1] - 1) / chunk_dims[1];
+    const unsigned long long numberOfChunks = (tile.height + chunk_dims[0] - 1) / chunk_dims[0] * chunksPerRow;
+    std::vector<std::vector<unsigned char>> compressedChunks(numberOfChunks);
+    bool locked = lock.owns_lock();
+    if(locked) {
+        lock.unlock();
+    }
+    tileLock.unlock();
+    bool compressionFailed = false;
+    #pragma omp parallel for default(shared) schedule(dynamic)
+    for(unsigned long long chunk = 0; chunk < numberOfChunks; ++chunk) {
+        try {
+            compressedChunks.at(chunk) = compressChunk(image, chunk / chunksPerRow * chunk_dims[0],
+                                                       chunk % chunksPerRow * chunk_dims[1], chunk_dims, shuffle, level);
+        } catch (...) {
+            #pragma omp atomic write
+            compressionFailed = true;
+        }
+    }
+    if(compressionFailed) {
+        throw std::runtime_error("Could not compress chunks of " + dataset);
+    }
+    tileLock.lock();
+    if(locked) {
+        lock.lock();
+    }
+
+    #if H5_VERSION_GE(1, 10, 2)
+    for(unsigned long long chunk = 0; chunk < numberOfChunks; ++chunk) {
+        hsize_t offset[2] = {tile.y + chunk / chunksPerRow * chunk_dims[0], tile.x + chunk % chunksPerRow * chunk_dims[1]};
+        const std::vector<unsigned char>& data = compressedChunks.at(chunk);
+        if(H5Dwrite_chunk(dset.getId(), H5P_DEFAULT, 0, offset, data.size(), data.data()) < 0) {
+            throw std::runtime_error("Could not write chunk to " + m_filename);
+        }
+    }
+    #endif
+}
+
+void PLImg::HDF5Writer::set_pyramid(unsigned tileSize) {
+    if(enqueue([this, tileSize]() { set_pyramid(tileSize); })) {
+        return;
+    }
+    this->m_pyramidTileSize = tileSize;
+}
+
+std::vector<cv::Mat> PLImg::HDF5Writer::pyramidLevels(const cv::Mat& image, unsigned tileSize) {
+    std::vector<cv::Mat> levels;
+    if(tileSize == 0) {
+        return levels;
+    }
+    cv::Mat level = image;
+    while((unsigned) std::max(level.rows, level.cols) > tileSize) {
+        switch(level.type()) {
             case CV_32FC1:
-                dtype = H5::PredType::NATIVE_FLOAT;
+                level = downsampleMean<float>(level);
+                break;
+            case CV_16FC1: {
+                cv::Mat floatLevel;
+                level.convertTo(floatLevel, CV_32F);
+                downsampleMean<float>(floatLevel).convertTo(level, CV_16F);
+                break;
+            }
+            case CV_16UC1:
+                level = downsampleMean<unsigned short>(level);
                 break;
             case CV_32SC1:
-                dtype = H5::PredType::NATIVE_INT;
+                level = downsampleMode<int>(level);
                 break;
             case CV_8UC1:
-                dtype = H5::PredType::NATIVE_UINT8;
+                level = downsampleMode<unsigned char>(level);
                 break;
+            default:
+                throw std::runtime_error("Pyramid levels can only be generated for 8-bit, 16-bit unsigned, 32-bit integer and floating point images");
+        }
+        levels.push_back(level);
+    }
+    return levels;
+}
+
+H5::DataType PLImg::HDF5Writer::hdf5Type(int type) {
+    switch(type) {
+        case CV_32SC1:
+            return H5::DataType(H5::PredType::NATIVE_INT);
+        case CV_8UC1:
+            return H5::DataType(H5::PredType::NATIVE_UINT8);
+        case CV_16UC1:
+            return H5::DataType(H5::PredType::NATIVE_UINT16);
+        case CV_16FC1: {
+            // HDF5 has no predefined half precision type. Derive IEEE 754 binary16 from binary32.
+            H5::FloatType float16(H5::PredType::IEEE_F32LE);
+            float16.setFields(15, 10, 5, 0, 10);
+            float16.setSize(2);
+            float16.setEbias(15);
+            return float16;
+        }
+        case CV_32FC1:
+        default:
+            return H5::DataType(H5::PredType::NATIVE_FLOAT);
+    }
+}
+
+void PLImg::HDF5Compression::validate() const {
+    if(filter != "none" && filter != "deflate" && filter != "lz4" && filter != "zstd") {
+        throw std::invalid_argument("Unknown compression filter " + filter);
+    }
+    if(filter == "deflate" && (level < 1 || level > 9)) {
+        throw std::invalid_argument("The compression level of deflate has to be between 1 and 9, got " + std::to_string(level));
+    }
+    if(filter == "zstd" && (level < 1 || level > 22)) {
+        throw std::invalid_argument("The compression level of zstd has to be between 1 and 22, got " + std::to_string(level));
+    }
+}
+
+void PLImg::HDF5Writer::set_compression(const HDF5Compression& compression) {
+    compression.validate();
+    if(enqueue([this, compression]() { set_compression(compression); })) {
+        return;
+    }
+    this->m_compression = compression;
+    if(m_zarr) {
+        applyZarrCompression();
+    }
+}
+
+void PLImg::HDF5Writer::applyZarrCompression() {
+    if(m_compression.scaleOffset >= 0 || (m_compression.filter != "none" && m_compression.filter != "deflate")) {
+        throw std::runtime_error("Zarr stores can only be written with the deflate compression and the shuffle filter");
+    }
+    m_zarr->set_compression(m_compression.filter == "deflate" ? m_compression.level : -1, m_compression.shuffle);
+}
+
+void PLImg::HDF5Writer::write_chunks(const H5::DataSet& dset, const cv::Mat& image, const hsize_t chunk_dims[2],
+                                     std::unique_lock<std::recursive_mutex>& lock) {
+    const unsigned long long chunksPerRow = (image.cols + chunk_dims[1] - 1) / chunk_dims[1];
+    const unsigned long long numberOfChunks = (image.rows + chunk_dims[0] - 1) / chunk_dims[0] * chunksPerRow;
+    // Limit the number of compressed chunks in memory
+    const unsigned long long batchSize = 2 * omp_get_max_threads();
+    std::vector<std::vector<unsigned char>> compressedChunks(batchSize);
+    const bool locked = lock.owns_lock();
+
+    for(unsigned long long batchStart = 0; batchStart < numberOfChunks; batchStart += batchSize) {
+        const unsigned long long batchEnd = std::min(batchStart + batchSize, numberOfChunks);
+
+        // Other threads may use HDF5 while the chunks are compressed
+        if(locked) {
+            lock.unlock();
         }
-        // Write dataset
-        dims[0] = static_cast<hsize_t>(image.rows);
-        dims[1] = static_cast<hsize_t>(image.cols);
-        dataSpace = H5::DataSpace(2, dims);
-
-        //if(image.cols > hdf5_writer_chunk_dimensions[1] && image.rows > hdf5_writer_chunk_dimensions[0]) {
-        //    H5::DSetCreatPropList ds_creatplist;  // create dataset creation prop list
-        //    ds_creatplist.setChunk( 2, hdf5_writer_chunk_dimensions );  // then modify it for compression
-        //    dset = m_hdf5file.createDataSet(dataset, dtype, dataSpace, ds_creatplist);
-        //} else {
-        dset = m_hdf5file.createDataSet(dataset, dtype, dataSpace);
-        //}
-        dset.write(image.data, dtype);
-
-        if(create_softlink) {
+        bool compressionFailed = false;
+        #pragma omp parallel for default(shared) schedule(dynamic)
+        for(unsigned long long chunk = batchStart; chunk < batchEnd; ++chunk) {
             try {
-                m_hdf5file.createGroup("/pyramid");
-            } catch (...) {}
-            m_hdf5file.link(H5G_LINK_SOFT, dataset, "/pyramid/00");
+                compressedChunks.at(chunk - batchStart) = compressChunk(image, chunk / chunksPerRow * chunk_dims[0],
+                                                                         chunk % chunksPerRow * chunk_dims[1], chunk_dims,
+                                                                         m_compression.shuffle,
+                                                                         m_compression.filter == "deflate" ? m_compression.level : -1);
+            } catch (...) {
+                #pragma omp atomic write
+                compressionFailed = true;
+            }
+        }
+        if(locked) {
+            lock.lock();
+        }
+        if(compressionFailed) {
+            throw std::runtime_error("Could not compress chunks of " + m_filename);
+        }
+
+        for(unsigned long long chunk = batchStart; chunk < batchEnd; ++chunk) {
+            hsize_t offset[2] = {chunk / chunksPerRow * chunk_dims[0], chunk % chunksPerRow * chunk_dims[1]};
+            const std::vector<unsigned char>& data = compressedChunks.at(chunk - batchStart);
+            // A filter mask of 0 marks all filters of the dataset as applied
+            if(H5Dwrite_chunk(dset.getId(), H5P_DEFAULT, 0, offset, data.size(), data.data()) < 0) {
+                throw std::runtime_error("Could not write chunk to " + m_filename);
+            }
         }
-        dset.close();
-        dataSpace.close();
-        dtype.close();
     }
-    m_hdf5file.flush(H5F_SCOPE_GLOBAL);
 }
 
 void PLImg::HDF5Writer::create_group(const std::string& group) {
+    if(enqueue([this, group]() { create_group(group); })) {
+        return;
+    }
+    if(m_zarr) {
+        m_zarr->create_group(group);
+        return;
+    }
+    auto lock = Reader::lockHDF5();
     std::stringstream ss(group);
     std::string token;
     std::string groupString;
@@ -174,29 +767,267 @@ void PLImg::HDF5Writer::create_group(const std::string& group) {
     }
 }
 
-void PLImg::HDF5Writer::close() {
-    m_hdf5file.close();
+void PLImg::HDF5Writer::set_durable(bool durable) {
+    if(enqueue([this, durable]() { set_durable(durable); })) {
+        return;
+    }
+    if(durable && m_zarr) {
+        throw std::runtime_error("Durable writing is not supported for Zarr stores");
+    }
+    this->m_durable = durable;
+}
+
+std::shared_future<void> PLImg::HDF5Writer::close() {
+    auto promise = std::make_shared<std::promise<void>>();
+    std::shared_future<void> future = promise->get_future().share();
+    // Report the first error of all operations on this file when it is closed
+    bool queued = enqueue([this, promise]() {
+        try {
+            close();
+        } catch(...) {
+            if(!m_fileError) {
+                m_fileError = std::current_exception();
+            }
+        }
+        if(m_fileError) {
+            promise->set_exception(m_fileError);
+            std::lock_guard<std::mutex> taskLock(m_taskMutex);
+            if(!m_error) {
+                m_error = m_fileError;
+            }
+            m_fileError = nullptr;
+        } else {
+            promise->set_value();
+        }
+    });
+    if(queued) {
+        return future;
+    }
+
+    auto lock = Reader::lockHDF5();
+    // Reference files are shared by the products of this file only
+    m_referenceDataSets.clear();
+    m_referenceFiles.clear();
+    if(m_zarr) {
+        // Chunks and attributes of Zarr stores are written immediately
+        m_zarr.reset();
+    } else {
+        // All pending attributes and datasets are flushed once when the file is closed
+        m_hdf5file.close();
+        if(m_durable && !m_filename.empty()) {
+            syncFile(m_filename);
+        }
+    }
+    m_filename = "";
+    promise->set_value();
+    return future;
+}
+
+void PLImg::HDF5Writer::set_asynchronous(unsigned queueSize) {
+    if(queueSize > 0 && !m_thread.joinable()) {
+        m_stop = false;
+        m_thread = std::thread(&HDF5Writer::run, this);
+    } else if(queueSize == 0 && m_thread.joinable()) {
+        drain();
+        {
+            std::lock_guard<std::mutex> lock(m_taskMutex);
+            m_stop = true;
+        }
+        m_taskCondition.notify_all();
+        m_thread.join();
+    }
+    std::lock_guard<std::mutex> lock(m_taskMutex);
+    m_queueSize = queueSize;
+    m_taskCondition.notify_all();
+}
+
+void PLImg::HDF5Writer::wait() {
+    drain();
+    std::lock_guard<std::mutex> lock(m_taskMutex);
+    if(m_error) {
+        std::exception_ptr error = m_error;
+        m_error = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+bool PLImg::HDF5Writer::enqueue(std::function<void()> task, bool image) {
+    if(!m_thread.joinable() || std::this_thread::get_id() == m_thread.get_id()) {
+        return false;
+    }
+    std::unique_lock<std::mutex> lock(m_taskMutex);
+    m_taskCondition.wait(lock, [this, image]() { return !image || m_queuedImages < m_queueSize; });
+    m_tasks.emplace_back(std::move(task), image);
+    if(image) {
+        ++m_queuedImages;
+    }
+    m_taskCondition.notify_all();
+    return true;
+}
+
+void PLImg::HDF5Writer::run() {
+    std::unique_lock<std::mutex> lock(m_taskMutex);
+    while(true) {
+        m_taskCondition.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+        if(m_tasks.empty()) {
+            return;
+        }
+        auto task = std::move(m_tasks.front());
+        m_tasks.pop_front();
+        m_busy = true;
+        lock.unlock();
+
+        try {
+            task.first();
+        } catch(...) {
+            // Errors are reported when the file is closed
+            if(!m_fileError) {
+                m_fileError = std::current_exception();
+            }
+        }
+        // Release the image before the next one may be queued
+        task.first = nullptr;
+
+        lock.lock();
+        if(task.second) {
+            --m_queuedImages;
+        }
+        m_busy = false;
+        m_taskCondition.notify_all();
+    }
+}
+
+void PLImg::HDF5Writer::drain() {
+    std::unique_lock<std::mutex> lock(m_taskMutex);
+    m_taskCondition.wait(lock, [this]() { return m_tasks.empty() && !m_busy; });
+}
+
+void PLImg::HDF5Writer::syncFile(const std::string& filename) {
+    #ifdef __GNUC__
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if(fd < 0 || fsync(fd) != 0) {
+            if(fd >= 0) {
+                ::close(fd);
+            }
+            throw std::runtime_error("Could not synchronize " + filename + " with the storage device");
+        }
+        ::close(fd);
+    #else
+        HANDLE handle = CreateFileA(filename.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                                    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if(handle == INVALID_HANDLE_VALUE || !FlushFileBuffers(handle)) {
+            if(handle != INVALID_HANDLE_VALUE) {
+                CloseHandle(handle);
+            }
+            throw std::runtime_error("Could not synchronize " + filename + " with the storage device");
+        }
+        CloseHandle(handle);
+    #endif
 }
 
 void PLImg::HDF5Writer::open() {
     createDirectoriesIfMissing(m_filename);
+    // Zarr stores are written without the HDF5 library. Like HDF5 files, existing stores lose their completion marker.
+    if(Reader::isZarr(m_filename)) {
+        if(m_durable) {
+            throw std::runtime_error("Durable writing is not supported for Zarr stores");
+        }
+        auto store = std::make_unique<ZarrWriter>();
+        store->set_path(m_filename);
+        store->remove_attribute("/", hdf5_writer_complete_attribute);
+        m_zarr = std::move(store);
+        applyZarrCompression();
+        return;
+    }
     // If the file doesn't exist open it with Read-Write.
     // Otherwise open it with appending so that existing content will not be deleted.
+    HDF5Configuration configuration = HDF5Configuration::global();
+    hid_t file;
     if(PLImg::Reader::fileExists(m_filename)) {
-        try {
-            m_hdf5file = H5::H5File(m_filename, H5F_ACC_RDWR);
-        }  catch (...) {
-            H5::Exception::printErrorStack();
-            exit(EXIT_FAILURE);
+        file = configuration.open(m_filename, H5F_ACC_RDWR);
+        if(file < 0) {
+            throw std::runtime_error("Could not open " + m_filename + " for writing");
+        }
+        // The file is incomplete until mark_complete() is called again. Remove the marker before anything else
+        // is written, so that an interrupted run cannot leave a stale marker behind.
+        if(H5Aexists(file, hdf5_writer_complete_attribute) > 0) {
+            H5Adelete(file, hdf5_writer_complete_attribute);
+            H5Fflush(file, H5F_SCOPE_LOCAL);
         }
     } else {
-        m_hdf5file = H5::H5File(m_filename, H5F_ACC_TRUNC);
+        file = configuration.create(m_filename);
+        if(file < 0) {
+            throw std::runtime_error("Could not create " + m_filename);
+        }
     }
-    #ifdef __GNUC__
-        sleep(1);
-    #else
-        Sleep(1000);
-    #endif
+    // H5File keeps its own reference to the file
+    m_hdf5file = H5::H5File(file);
+    H5Fclose(file);
+}
+
+void PLImg::HDF5Writer::mark_complete(const std::string& input_identity, const std::string& software_parameters) {
+    if(enqueue([this, input_identity, software_parameters]() { mark_complete(input_identity, software_parameters); })) {
+        return;
+    }
+    write_attribute("/", "software_revision", Version::versionHash());
+    write_attribute("/", "software_parameters", software_parameters);
+    write_attribute("/", "input_identity", input_identity);
+    write_attribute("/", hdf5_writer_complete_attribute, 1);
+}
+
+bool PLImg::HDF5Writer::isComplete(const std::string& filename, const std::string& input_identity,
+                                   const std::string& software_parameters) {
+    if(!Reader::fileExists(filename)) {
+        return false;
+    }
+    if(Reader::isZarr(filename)) {
+        try {
+            std::map<std::string, std::string> attributes = ZarrWriter::read_attributes(filename, "/");
+            return attributes.count(hdf5_writer_complete_attribute) > 0 &&
+                   attributes["software_revision"] == Version::versionHash() &&
+                   attributes["software_parameters"] == software_parameters &&
+                   attributes["input_identity"] == input_identity;
+        } catch(const std::exception&) {
+            // Attributes of interrupted runs may not be readable at all
+            return false;
+        }
+    }
+    auto lock = Reader::lockHDF5();
+    H5::Exception::dontPrint();
+    try {
+        H5::H5File file(filename, H5F_ACC_RDONLY);
+        H5::Group root = file.openGroup("/");
+        if(!root.attrExists(hdf5_writer_complete_attribute)) {
+            return false;
+        }
+        auto readString = [&root](const std::string& name) {
+            std::string value;
+            if(root.attrExists(name)) {
+                H5::Attribute attr = root.openAttribute(name);
+                attr.read(attr.getStrType(), value);
+            }
+            return value;
+        };
+        return readString("software_revision") == Version::versionHash() &&
+               readString("software_parameters") == software_parameters &&
+               readString("input_identity") == input_identity;
+    } catch(H5::Exception& exception) {
+        // Files of interrupted runs may not be readable at all
+        return false;
+    }
+}
+
+std::string PLImg::HDF5Writer::inputIdentity(const std::vector<std::string>& files) {
+    std::string identity;
+    for(const std::string& file : files) {
+        std::filesystem::path path(file);
+        identity += std::filesystem::absolute(path).string() + " ";
+        if(!std::filesystem::is_directory(path)) {
+            identity += std::to_string(std::filesystem::file_size(path)) + " ";
+        }
+        identity += std::to_string(std::filesystem::last_write_time(path).time_since_epoch().count()) + ";";
+    }
+    return identity;
 }
 
 void PLImg::HDF5Writer::createDirectoriesIfMissing(const std::string &filename) {
@@ -215,6 +1046,38 @@ void PLImg::HDF5Writer::createDirectoriesIfMissing(const std::string &filename)
 void PLImg::HDF5Writer::writePLIMAttributes(const std::vector<std::string>& reference_maps,
                                             const std::string& output_dataset, const std::string& input_dataset,
                                             const std::string& modality, const int argc, char** argv) {
+    std::vector<std::pair<std::string, std::string>> references;
+    for(auto& reference : reference_maps) {
+        references.emplace_back(reference, input_dataset);
+    }
+    writePLIMAttributes(references, output_dataset, modality, argc, argv);
+}
+
+void PLImg::HDF5Writer::writePLIMAttributes(const std::vector<std::pair<std::string, std::string>>& references,
+                                            const std::string& output_dataset, const std::string& modality,
+                                            const int argc, char** argv) {
+    if(enqueue([this, references, output_dataset, modality, argc, argv]() {
+        writePLIMAttributes(references, output_dataset, modality, argc, argv);
+    })) {
+        return;
+    }
+    std::string software_parameters;
+    for(int i = 1; i < argc; ++i) {
+        software_parameters += std::string(argv[i]) + " ";
+    }
+    if(m_zarr) {
+        // The PLIM attribute handler only works on HDF5 objects. Zarr stores get the description of the product,
+        // but no attributes copied from the reference files.
+        m_zarr->write_attribute(output_dataset, "image_modality", modality);
+        m_zarr->write_attribute(output_dataset, "created_by", currentUser());
+        m_zarr->write_attribute(output_dataset, "creation_time", Version::timeStamp());
+        m_zarr->write_attribute(output_dataset, "software", std::string(argv[0]));
+        m_zarr->write_attribute(output_dataset, "software_revision", Version::versionHash());
+        m_zarr->write_attribute(output_dataset, "software_parameters", software_parameters);
+        return;
+    }
+
+    auto lock = Reader::lockHDF5();
     H5::Exception::dontPrint();
     hid_t id;
     H5::Group grp;
@@ -233,23 +1096,10 @@ void PLImg::HDF5Writer::writePLIMAttributes(const std::vector<std::string>& refe
     }
     outputHandler.setStringAttribute("image_modality", modality);
 
-    std::string username;
-    #ifdef __GNUC__
-        uid_t uid = geteuid();
-        struct passwd *pw = getpwuid(uid);
-        if (pw) {
-            username = pw->pw_name;
-        }
-    #else
-        char username_arr[UNLEN + 1];
-        DWORD username_len = UNLEN + 1;
-        GetUserName(username_arr, &username_len);
-        username = std::string(username_arr);
-    #endif
     if(outputHandler.doesAttributeExist("created_by")) {
         outputHandler.deleteAttribute("created_by");
     }
-    outputHandler.setStringAttribute("created_by", username);
+    outputHandler.setStringAttribute("created_by", currentUser());
 
     if(outputHandler.doesAttributeExist("creation_time")) {
         outputHandler.deleteAttribute("creation_time");
@@ -266,24 +1116,17 @@ void PLImg::HDF5Writer::writePLIMAttributes(const std::vector<std::string>& refe
     }
     outputHandler.setStringAttribute("software_revision", Version::versionHash());
 
-    std::string software_parameters;
-    for(int i = 1; i < argc; ++i) {
-        software_parameters += std::string(argv[i]) + " ";
-    }
     if(outputHandler.doesAttributeExist("software_parameters")) {
         outputHandler.deleteAttribute("software_parameters");
     }
     outputHandler.setStringAttribute("software_parameters", software_parameters);
 
-    std::vector<H5::H5File> reference_files;
     std::vector<H5::DataSet> reference_datasets;
     std::vector<plim::AttributeHandler> reference_modalities;
-    for(auto& reference : reference_maps) {
-        if(reference.find(".h5") != std::string::npos) {
+    for(auto& reference : references) {
+        if(reference.first.find(".h5") != std::string::npos) {
             try {
-                reference_files.emplace_back();
-                reference_files.back().openFile(reference, H5F_ACC_RDONLY);
-                reference_datasets.push_back(reference_files.back().openDataSet(input_dataset));
+                reference_datasets.push_back(openReference(reference.first, reference.second));
                 plim::AttributeHandler handler(reference_datasets.back().getId());
                 reference_modalities.push_back(handler);
 
@@ -319,17 +1162,26 @@ void PLImg::HDF5Writer::writePLIMAttributes(const std::vector<std::string>& refe
         std::cerr << e.what() << std::endl;
     }
 
-    for(auto& reference : reference_datasets) {
-        reference.close();
-    }
-    for(auto& reference : reference_files) {
-        reference.close();
-    }
-
     grp.close();
     dset.close();
 }
 
+H5::DataSet PLImg::HDF5Writer::openReference(const std::string& filename, const std::string& dataset) {
+    // Products written to the same file reference each other without opening the file again
+    if(filename == m_filename) {
+        return m_hdf5file.openDataSet(dataset);
+    }
+    auto reference = m_referenceDataSets.find({filename, dataset});
+    if(reference != m_referenceDataSets.end()) {
+        return reference->second;
+    }
+    auto file = m_referenceFiles.find(filename);
+    if(file == m_referenceFiles.end()) {
+        file = m_referenceFiles.emplace(filename, H5::H5File(filename, H5F_ACC_RDONLY)).first;
+    }
+    return m_referenceDataSets.emplace(std::make_pair(filename, dataset), file->second.openDataSet(dataset)).first->second;
+}
+
 void PLImg::HDF5Writer::writePLIMReference(plim::AttributeHandler &handler,
                                            std::initializer_list<plim::AttributeHandler> reference_handler) {
     try{
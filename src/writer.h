@@ -25,10 +25,20 @@
 #ifndef PLIMG_WRITER_H
 #define PLIMG_WRITER_H
 
+#include <condition_variable>
+#include <deque>
+#include <exception>
 #include <filesystem>
+#include <functional>
+#include <future>
 #include <H5Cpp.h>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <opencv2/core.hpp>
 #include <string>
+#include <thread>
+#include <utility>
 #ifdef __GNUC__
     #include <unistd.h>
     #include <pwd.h>
@@ -42,19 +52,58 @@
 #include "plim/PlimExceptions.h"
 #include "reader.h"
 #include "version.h"
+#include "zarr.h"
 
 constexpr hsize_t hdf5_writer_chunk_dimensions[2] = {2048, 2048};
+/// Filter ID of the registered HDF5 LZ4 plugin
+constexpr H5Z_filter_t hdf5_writer_lz4_filter = 32004;
+/// Filter ID of the registered HDF5 Zstandard plugin
+constexpr H5Z_filter_t hdf5_writer_zstd_filter = 32015;
+/// Attribute of the root group which is written last by HDF5Writer::mark_complete
+constexpr auto hdf5_writer_complete_attribute = "complete";
 
 /**
  * @file
  * @brief PLImg::HDF5Writer class
  */
 namespace PLImg {
+    /**
+     * Filters which will be applied to new datasets written by the HDF5Writer. If any filter is selected,
+     * datasets will be stored in chunks of hdf5_writer_chunk_dimensions.
+     * @brief Compression settings of the HDF5Writer
+     */
+    struct HDF5Compression {
+        /// Compression filter: none, deflate, lz4 or zstd. LZ4 and Zstandard require the HDF5 filter plugins.
+        std::string filter = "none";
+        /// Compression level of deflate (1-9) and zstd (1-22)
+        int level = 4;
+        /// Apply the byte shuffle filter before compression
+        bool shuffle = false;
+        /// Number of decimal digits kept by the scale-offset filter for 32-bit and 64-bit floating point images. Integer images are stored with the minimal number of bits. Negative values disable the filter.
+        int scaleOffset = -1;
+
+        /**
+         * @brief Check if any filter is selected
+         * @return True if datasets will be written chunked with filters
+         */
+        bool enabled() const {
+            return filter != "none" || shuffle || scaleOffset >= 0;
+        }
+        /**
+         * @brief Check the filter and the level of the filter
+         * @throws std::invalid_argument if the filter is unknown or the level is outside of the range of deflate or zstd
+         */
+        void validate() const;
+    };
+
     /**
      * The HDF5Writer class is the main class to write results from PLImig to files while preserving all information
      * like generated parameters or modality information. PLIM is used to extract the information from the original
      * transmittance and retardation. This class offers functionality to write numerical datasets and attributes
      * (float, double, int + String for attributes).
+     * Paths ending with .zarr are written as Zarr stores through a ZarrWriter instead. Numerical attributes are
+     * stored as double values in the .zattrs files, the compression is limited to deflate and shuffle and
+     * durable writing is not supported.
      * @brief The HDF5Writer class
      */
     class HDF5Writer {
@@ -64,6 +113,10 @@ namespace PLImg {
          * Default constructor for the HDF5Writer. This class will be used to write HDF5 files.
          */
         HDF5Writer();
+        /**
+         * @brief Waits until all queued operations are written and stops the background writer thread.
+         */
+        ~HDF5Writer();
         /**
          * @brief path Get currently set path
          * @return Currently set path via the set_path(const std::string& filename) method
@@ -71,9 +124,11 @@ namespace PLImg {
         std::string path();
         /**
          * Set the desired path of the HDF5 file which will be written. The file will be created if it doesn't exist.
-         * If the file already exists, open it in append mode.
+         * If the file already exists, open it in append mode. Paths ending with .zarr are written as Zarr stores.
          * @brief set_path Set HDF5 path. If path exists, open the file
          * @param filename Path of the file which will be written
+         * @throws std::runtime_error if the file can't be created or opened for writing or the compression or
+         * durable writing is not supported by a Zarr store
          */
         void set_path(const std::string& filename);
         /**
@@ -100,6 +155,14 @@ namespace PLImg {
          * @param value Value that will be written to the dataset
          */
         void write_attribute(const std::string& dataset, const std::string& parameter_name, int value);
+        /**
+         * HDF5 files support attributes in addition to storing raw data. This methods allows to set attributes for
+         * a given dataset. Here, an unsigned short attribute will be written to the parameter_name in the dataset.
+         * @param dataset Existing dataset which the attribute will be written to
+         * @param parameter_name Parameter name for the attribute in the dataset
+         * @param value Value that will be written to the dataset
+         */
+        void write_attribute(const std::string& dataset, const std::string& parameter_name, unsigned short value);
         /**
          * HDF5 files support attributes in addition to storing raw data. This methods allows to set attributes for
          * a given dataset. Here, a string attribute will be written to the parameter_name in the dataset.
@@ -114,11 +177,79 @@ namespace PLImg {
          * However, if there's already a dataset with the same name this method will check if the datatype and image
          * dimensions match. If that's the case, the data in the HDF5 file will be overwritten. Otherwise, an exception
          * is thrown.
+         * If create_softlink is set, pyramid/00 in the group of the dataset will link to the dataset. If pyramid
+         * levels are enabled with set_pyramid(unsigned), the levels pyramid/01 to pyramid/N are written as well.
+         * Products written to different groups of one file therefore have separate pyramids.
+         * Zarr stores have no links, so pyramid/00 is not written to them.
          * @brief Write OpenCV image to a dataset in the HDF5 file
          * @param dataset Destination within the HDF5 file.
          * @param image OpenCV image which will be written.
+         * @param create_softlink Link the dataset as full resolution level of the image pyramid
          */
         void write_dataset(const std::string& dataset, const cv::Mat& image, bool create_softlink=false);
+        /**
+         * Write a reference counted OpenCV image to a dataset in the HDF5 file. In asynchronous mode the writer
+         * keeps a reference to the image until it is written.
+         * @brief Write OpenCV image to a dataset in the HDF5 file
+         * @param dataset Destination within the HDF5 file.
+         * @param image OpenCV image which will be written.
+         */
+        void write_dataset(const std::string& dataset, const std::shared_ptr<cv::Mat>& image, bool create_softlink=false);
+        /**
+         * Create a chunked dataset which will be filled with write_tile(const std::string&, const cv::Rect&,
+         * const cv::Mat&). The chunks have the size of hdf5_writer_chunk_dimensions. An existing dataset
+         * is reused if its dimensions and datatype match.
+         * @brief Create an empty dataset of known shape
+         * @param dataset Destination within the HDF5 file
+         * @param rows Number of rows of the dataset
+         * @param cols Number of columns of the dataset
+         * @param type OpenCV type of the dataset (CV_8UC1, CV_16UC1, CV_16FC1, CV_32SC1 or CV_32FC1)
+         */
+        void create_dataset(const std::string& dataset, int rows, int cols, int type);
+        /**
+         * Write a tile into a dataset created by create_dataset(const std::string&, int, int, int). Tiles can be
+         * written in any order and from multiple threads. Tiles aligned to hdf5_writer_chunk_dimensions are
+         * compressed outside of the HDF5 lock and written as whole chunks. Other tiles are written as hyperslabs.
+         * @brief Write a part of a dataset
+         * @param dataset Existing dataset within the HDF5 file
+         * @param tile Position and size of the tile within the dataset
+         * @param image Image with the size of the tile
+         */
+        void write_tile(const std::string& dataset, const cv::Rect& tile, const cv::Mat& image);
+        /**
+         * Set the filters for all datasets which will be created afterwards. Shuffle and deflate are applied to
+         * all chunks on multiple threads before they are written directly to the file. Other filters are applied
+         * by the HDF5 library itself.
+         * @brief Set the compression of new datasets
+         * @param compression Filters which will be applied to new datasets
+         * @throws std::invalid_argument if the compression is invalid, see HDF5Compression::validate()
+         */
+        void set_compression(const HDF5Compression& compression);
+        /**
+         * Datasets written with create_softlink will be downsampled by a factor of two until the image fits
+         * into a single tile. The levels are written to pyramid/01, pyramid/02, ... next to the dataset in chunks
+         * of the tile size.
+         * The downsampling runs while the full resolution image is written.
+         * @brief Enable the generation of pyramid levels
+         * @param tileSize Tile size of the viewer in pixels. 0 disables the pyramid levels.
+         */
+        void set_pyramid(unsigned tileSize);
+        /**
+         * Downsample the image by a factor of two until its rows and columns are smaller or equal to the tile size.
+         * Floating point images are downsampled by the mean value, masks and integer images by the most frequent
+         * value of each 2x2 block.
+         * @brief Calculate the levels of an image pyramid
+         * @param image Full resolution image
+         * @param tileSize Tile size in pixels
+         * @return Pyramid levels starting with half the resolution of the image
+         */
+        static std::vector<cv::Mat> pyramidLevels(const cv::Mat& image, unsigned tileSize);
+        /**
+         * @brief Get the HDF5 datatype of an OpenCV image type
+         * @param type OpenCV image type
+         * @return HDF5 datatype. Unsupported types will be written as 32-bit floating point values.
+         */
+        static H5::DataType hdf5Type(int type);
         /**
          * This method allows the recursive creation of groups within a HDF5 file.
          * @brief Create group within HDF5 file
@@ -126,9 +257,36 @@ namespace PLImg {
          */
         void create_group(const std::string& group);
         /**
+         * Attributes and datasets are only flushed to the file when it is closed. If durable writing is enabled,
+         * close() will additionally wait until the operating system has written the file to the storage device.
+         * @brief Enable synchronization of closed files with the storage device
+         * @param durable True if close() shall synchronize the file with the storage device
+         * @throws std::runtime_error if durable writing is enabled for a Zarr store
+         */
+        void set_durable(bool durable);
+        /**
+         * All operations of the writer are executed in order on a background thread if the asynchronous mode
+         * is enabled. The methods of the writer will return immediately unless queueSize images are waiting
+         * to be written. Images are not copied. Images passed as cv::Mat share their data with the caller and
+         * must not be modified until they are written.
+         * Errors are reported by the future returned by close() and by wait().
+         * @brief Enable writing on a background thread
+         * @param queueSize Maximum number of images waiting to be written. 0 writes all images synchronously.
+         */
+        void set_asynchronous(unsigned queueSize);
+        /**
+         * Closes the currently opened file. All pending attributes and datasets are written to the file.
+         * In asynchronous mode, the file will be closed after all queued operations are written.
          * @brief close Closes currently opened file.
+         * @return Future which is ready when the file is closed. It holds the first error of the operations
+         * on this file.
+         */
+        std::shared_future<void> close();
+        /**
+         * @brief Wait until all queued operations are written
+         * @throws The first error of a queued operation since the last call of wait()
          */
-        void close();
+        void wait();
         /**
          *
          * @param transmittance_path Original transmittance path used for the call of the program
@@ -142,6 +300,51 @@ namespace PLImg {
         void writePLIMAttributes(const std::vector<std::string>& reference_maps,
                                  const std::string& output_dataset, const std::string& input_dataset,
                                  const std::string& modality, int argc, char** argv);
+        /**
+         * Write the PLIM attributes with references to datasets in different files. References to the currently
+         * opened file are resolved within the file. Other reference files are opened once and kept open until
+         * close() is called, so that all products written to one file share the opened references.
+         * Zarr stores only get the modality, creator, creation time and software attributes because the
+         * attributes of the reference files can only be copied between HDF5 objects.
+         * @brief Write the PLIM attributes of a dataset
+         * @param references Pairs of reference file and dataset within the reference file
+         * @param output_dataset Dataset which will be written to
+         * @param modality Name of the modality which will be written (NTransmittance, Retardation, ...)
+         * @param argc Number of arguments when calling the program
+         * @param argv Arguments when calling the program
+         */
+        void writePLIMAttributes(const std::vector<std::pair<std::string, std::string>>& references,
+                                 const std::string& output_dataset, const std::string& modality,
+                                 int argc, char** argv);
+        /**
+         * Write the revision of PLImg, the parameters and the identity of the input files to the root group of the
+         * currently opened file. The completion marker hdf5_writer_complete_attribute is written afterwards, so
+         * it is only present if all previous operations on the file succeeded. Opening an existing file for writing
+         * removes its completion marker.
+         * @brief Mark the currently opened file as complete
+         * @param input_identity Identity of the input files returned by inputIdentity(const std::vector<std::string>&)
+         * @param software_parameters Parameters of the run which influence the written results
+         */
+        void mark_complete(const std::string& input_identity, const std::string& software_parameters);
+        /**
+         * Check if a file was completely written by the same revision of PLImg with the same parameters and inputs.
+         * Missing, unreadable and partially written files are not complete.
+         * @brief Check the completion marker of a file
+         * @param filename HDF5 file or Zarr store which was written with mark_complete
+         * @param input_identity Identity of the current input files
+         * @param software_parameters Parameters of the current run
+         * @return True if the file doesn't have to be written again
+         */
+        static bool isComplete(const std::string& filename, const std::string& input_identity,
+                               const std::string& software_parameters);
+        /**
+         * The identity consists of the path, size and modification time of each file. Directories like Zarr stores
+         * use their modification time only.
+         * @brief Identify the input files of a result without reading them
+         * @param files Input files
+         * @return String which changes if an input file is replaced or modified
+         */
+        static std::string inputIdentity(const std::vector<std::string>& files);
     private:
         /**
          * @brief Opens current HDF5 path
@@ -149,15 +352,116 @@ namespace PLImg {
         void open();
 
         static void createDirectoriesIfMissing(const std::string& filename);
+        /**
+         * @brief Wait until the operating system has written the file to the storage device
+         * @param filename Closed file which will be synchronized
+         */
+        static void syncFile(const std::string& filename);
+
+        /**
+         * @brief Apply the compression of the writer to the current Zarr store
+         * @throws std::runtime_error if the compression uses filters other than deflate and shuffle
+         */
+        void applyZarrCompression();
 
         void write_type_attribute(const std::string& dataset, const std::string& parameter_name, const H5::AtomType& datatype, void* value);
 
+        /**
+         * Write the image to a dataset. Existing datasets are overwritten if the dimensions match.
+         * @param dataset Destination within the HDF5 file
+         * @param image Image which will be written
+         * @param chunk_dimensions Chunk dimensions of a new dataset. nullptr for a contiguous dataset.
+         * @param lock HDF5 lock held by the caller
+         * @return True if the dataset was created
+         */
+        bool write_image(const std::string& dataset, const cv::Mat& image, const hsize_t* chunk_dimensions,
+                         std::unique_lock<std::recursive_mutex>& lock);
+        /**
+         * Create a new dataset with the filters of the writer.
+         * @param dataset Destination within the HDF5 file
+         * @param rows Number of rows of the dataset
+         * @param cols Number of columns of the dataset
+         * @param type OpenCV type of the dataset
+         * @param chunk_dimensions Chunk dimensions of the dataset. nullptr for a contiguous dataset.
+         * @return Created dataset
+         */
+        H5::DataSet create_image(const std::string& dataset, int rows, int cols, int type, const hsize_t* chunk_dimensions);
+        /**
+         * Compress all chunks of the image on multiple threads and write them with H5Dwrite_chunk.
+         * The HDF5 lock is released while chunks are compressed.
+         * @param dset Chunked dataset with at most the shuffle and deflate filters
+         * @param image Image which will be written
+         * @param chunk_dims Chunk dimensions of the dataset
+         * @param lock HDF5 lock held by the caller
+         */
+        void write_chunks(const H5::DataSet& dset, const cv::Mat& image, const hsize_t chunk_dims[2],
+                          std::unique_lock<std::recursive_mutex>& lock);
+
+        /**
+         * Add an operation to the queue of the background writer thread. The call blocks if too many
+         * images are waiting to be written.
+         * @param task Operation which will be executed on the background writer thread
+         * @param image True if the operation holds an image
+         * @return False if the operation has to be executed directly because the writer is synchronous or
+         * the method is called from the background writer thread
+         */
+        bool enqueue(std::function<void()> task, bool image = false);
+        /**
+         * @brief Execute queued operations until the writer is stopped
+         */
+        void run();
+        /**
+         * @brief Block until the queue of the background writer thread is empty
+         */
+        void drain();
+
         static void writePLIMReference(plim::AttributeHandler& handler, std::initializer_list<plim::AttributeHandler> reference_handler);
+        /**
+         * @brief Open a reference dataset or reuse it if it was already opened for the current file
+         * @param filename Reference file. The currently opened file is not opened again.
+         * @param dataset Dataset within the reference file
+         * @return Opened reference dataset
+         */
+        H5::DataSet openReference(const std::string& filename, const std::string& dataset);
 
         ///
         std::string m_filename;
         ///
         H5::H5File m_hdf5file;
+        /// Writer of the current path if it is a Zarr store. nullptr for HDF5 files.
+        std::unique_ptr<ZarrWriter> m_zarr;
+        ///
+        HDF5Compression m_compression;
+        ///
+        bool m_durable;
+        /// Reference files of writePLIMAttributes which stay open until the current file is closed
+        std::map<std::string, H5::H5File> m_referenceFiles;
+        /// Opened reference datasets by file and dataset name
+        std::map<std::pair<std::string, std::string>, H5::DataSet> m_referenceDataSets;
+        /// Tile size of the pyramid levels. 0 if no levels are written.
+        unsigned m_pyramidTileSize;
+        /// Serializes producers of write_tile
+        std::mutex m_tileMutex;
+        /// Background writer thread
+        std::thread m_thread;
+        /// Queued operations and whether they hold an image
+        std::deque<std::pair<std::function<void()>, bool>> m_tasks;
+        ///
+        std::mutex m_taskMutex;
+        ///
+        std::condition_variable m_taskCondition;
+        /// Maximum number of queued images. 0 if the writer is synchronous.
+        unsigned m_queueSize;
+        ///
+        unsigned m_queuedImages;
+        /// True while the background writer thread executes an operation
+        bool m_busy;
+        ///
+        bool m_stop;
+        /// First error since the last call of wait()
+        std::exception_ptr m_error;
+        /// First error since the current file was opened
+        std::exception_ptr m_fileError;
     };
 }
 #endif //PLIMG_WRITER_H
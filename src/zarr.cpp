@@ -0,0 +1,783 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Forschungszentrum Jülich / Jan André Reuter.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#include "zarr.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <omp.h>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <zlib.h>
+#ifdef __GNUC__
+    #include <unistd.h>
+#else
+    #include <process.h>
+#endif
+
+namespace {
+    /**
+     * Minimal JSON value which is sufficient for the .zarray, .zgroup and .zattrs files.
+     */
+    struct JsonValue {
+        enum Type { Null, Boolean, Number, String, Array, Object };
+        Type type = Null;
+        bool boolean = false;
+        double number = 0;
+        std::string string;
+        std::vector<JsonValue> array;
+        std::map<std::string, JsonValue> object;
+
+        const JsonValue& at(const std::string& key) const {
+            static const JsonValue null;
+            auto it = object.find(key);
+            return it != object.end() ? it->second : null;
+        }
+    };
+
+    class JsonParser {
+    public:
+        explicit JsonParser(const std::string& text) : m_text(text), m_position(0) {}
+
+        JsonValue parse() {
+            JsonValue value = parseValue();
+            skipWhitespace();
+            if(m_position != m_text.size()) {
+                throw std::runtime_error("Unexpected characters after JSON value");
+            }
+            return value;
+        }
+
+    private:
+        void skipWhitespace() {
+            while(m_position < m_text.size() && std::isspace((unsigned char) m_text[m_position])) {
+                ++m_position;
+            }
+        }
+
+        char peek() {
+            skipWhitespace();
+            if(m_position >= m_text.size()) {
+                throw std::runtime_error("Unexpected end of JSON value");
+            }
+            return m_text[m_position];
+        }
+
+        void expect(char character) {
+            if(peek() != character) {
+                throw std::runtime_error(std::string("Expected '") + character + "' in JSON value");
+            }
+            ++m_position;
+        }
+
+        bool consume(const std::string& literal) {
+            if(m_text.compare(m_position, literal.size(), literal) == 0) {
+                m_position += literal.size();
+                return true;
+            }
+            return false;
+        }
+
+        JsonValue parseValue() {
+            JsonValue value;
+            char character = peek();
+            if(character == '{') {
+                value.type = JsonValue::Object;
+                ++m_position;
+                if(peek() == '}') {
+                    ++m_position;
+                    return value;
+                }
+                do {
+                    std::string key = parseString();
+                    expect(':');
+                    value.object[key] = parseValue();
+                } while(peek() == ',' && ++m_position);
+                expect('}');
+            } else if(character == '[') {
+                value.type = JsonValue::Array;
+                ++m_position;
+                if(peek() == ']') {
+                    ++m_position;
+                    return value;
+                }
+                do {
+                    value.array.push_back(parseValue());
+                } while(peek() == ',' && ++m_position);
+                expect(']');
+            } else if(character == '"') {
+                value.type = JsonValue::String;
+                value.string = parseString();
+            } else if(consume("null")) {
+                value.type = JsonValue::Null;
+            } else if(consume("true")) {
+                value.type = JsonValue::Boolean;
+                value.boolean = true;
+            } else if(consume("false")) {
+                value.type = JsonValue::Boolean;
+            } else if(consume("NaN")) {
+                value.type = JsonValue::Number;
+                value.number = std::numeric_limits<double>::quiet_NaN();
+            } else {
+                value.type = JsonValue::Number;
+                size_t length = 0;
+                value.number = std::stod(m_text.substr(m_position), &length);
+                m_position += length;
+            }
+            return value;
+        }
+
+        std::string parseString() {
+            expect('"');
+            std::string result;
+            while(m_position < m_text.size() && m_text[m_position] != '"') {
+                char character = m_text[m_position++];
+                if(character == '\\' && m_position < m_text.size()) {
+                    char escaped = m_text[m_position++];
+                    switch(escaped) {
+                        case 'n': result += '\n'; break;
+                        case 't': result += '\t'; break;
+                        case 'r': result += '\r'; break;
+                        case 'b': result += '\b'; break;
+                        case 'f': result += '\f'; break;
+                        case 'u':
+                            // Non ASCII characters are not used by PLImg and will be replaced
+                            m_position += 4;
+                            result += '?';
+                            break;
+                        default: result += escaped;
+                    }
+                } else {
+                    result += character;
+                }
+            }
+            expect('"');
+            return result;
+        }
+
+        const std::string& m_text;
+        size_t m_position;
+    };
+
+    std::string toJson(const JsonValue& value, bool topLevel = true) {
+        std::ostringstream stream;
+        switch(value.type) {
+            case JsonValue::Null:
+                stream << "null";
+                break;
+            case JsonValue::Boolean:
+                stream << (value.boolean ? "true" : "false");
+                break;
+            case JsonValue::Number:
+                // JSON has no literals for non finite numbers. Zarr encodes them as strings.
+                if(std::isnan(value.number)) {
+                    stream << "\"NaN\"";
+                } else if(std::isinf(value.number)) {
+                    stream << (value.number > 0 ? "\"Infinity\"" : "\"-Infinity\"");
+                } else {
+                    stream.precision(std::numeric_limits<double>::max_digits10);
+                    stream << value.number;
+                }
+                break;
+            case JsonValue::String:
+                stream << '"';
+                for(char character : value.string) {
+                    if(character == '"' || character == '\\') {
+                        stream << '\\' << character;
+                    } else if(character == '\n') {
+                        stream << "\\n";
+                    } else if((unsigned char) character < 0x20) {
+                        stream << ' ';
+                    } else {
+                        stream << character;
+                    }
+                }
+                stream << '"';
+                break;
+            case JsonValue::Array:
+                stream << '[';
+                for(size_t i = 0; i < value.array.size(); ++i) {
+                    stream << (i > 0 ? ", " : "") << toJson(value.array[i], false);
+                }
+                stream << ']';
+                break;
+            case JsonValue::Object: {
+                // Only the outermost object is written with one entry per line
+                stream << (topLevel ? "{\n" : "{");
+                size_t i = 0;
+                for(const auto& entry : value.object) {
+                    JsonValue key;
+                    key.type = JsonValue::String;
+                    key.string = entry.first;
+                    stream << (topLevel ? "    " : "") << toJson(key, false) << ": " << toJson(entry.second, false);
+                    if(++i < value.object.size()) {
+                        stream << (topLevel ? ",\n" : ", ");
+                    }
+                }
+                stream << (topLevel ? "\n}" : "}");
+                break;
+            }
+        }
+        return stream.str();
+    }
+
+    JsonValue number(double value) {
+        JsonValue result;
+        result.type = JsonValue::Number;
+        result.number = value;
+        return result;
+    }
+
+    JsonValue string(const std::string& value) {
+        JsonValue result;
+        result.type = JsonValue::String;
+        result.string = value;
+        return result;
+    }
+
+    std::string readFile(const std::string& filename) {
+        std::ifstream file(filename, std::ios::binary);
+        if(!file) {
+            throw std::runtime_error("Could not open " + filename);
+        }
+        std::ostringstream content;
+        content << file.rdbuf();
+        return content.str();
+    }
+
+    /**
+     * Write a file under a temporary name and rename it afterwards. Readers and concurrent writers of the same file
+     * will only see complete files.
+     */
+    void writeFileAtomically(const std::string& filename, const void* data, size_t size) {
+        static std::atomic<unsigned long long> counter(0);
+        #ifdef __GNUC__
+            const long long processId = getpid();
+        #else
+            const long long processId = _getpid();
+        #endif
+        std::string temporary = filename + ".tmp." + std::to_string(processId) + "." + std::to_string(counter++);
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            if(!file) {
+                throw std::runtime_error("Could not create " + temporary);
+            }
+            file.write(reinterpret_cast<const char*>(data), std::streamsize(size));
+            if(!file) {
+                throw std::runtime_error("Could not write " + temporary);
+            }
+        }
+        std::error_code error;
+        std::filesystem::rename(temporary, filename, error);
+        if(error) {
+            std::filesystem::remove(temporary, error);
+            throw std::runtime_error("Could not write " + filename);
+        }
+    }
+
+    void writeJson(const std::string& filename, const JsonValue& value) {
+        std::string text = toJson(value) + "\n";
+        writeFileAtomically(filename, text.data(), text.size());
+    }
+
+    size_t elementSize(const std::string& dtype) {
+        if(dtype == "|u1") {
+            return 1;
+        }
+        return dtype == "<u2" || dtype == "<f2" ? 2 : 4;
+    }
+}
+
+PLImg::ZarrArray PLImg::ZarrArray::read(const std::string& path) {
+    JsonValue metadata = JsonParser(readFile(path + "/.zarray")).parse();
+    if(metadata.at("zarr_format").number != 2) {
+        throw std::runtime_error("Only Zarr v2 arrays are supported: " + path);
+    }
+    ZarrArray array;
+    for(const JsonValue& value : metadata.at("shape").array) {
+        array.shape.push_back((unsigned long long) value.number);
+    }
+    for(const JsonValue& value : metadata.at("chunks").array) {
+        array.chunks.push_back((unsigned long long) value.number);
+    }
+    if(array.shape.size() != 2 || array.chunks.size() != 2) {
+        throw std::runtime_error("Only two dimensional Zarr arrays are supported: " + path);
+    }
+    array.dtype = metadata.at("dtype").string;
+    if(array.type() < 0) {
+        throw std::runtime_error("Unsupported Zarr datatype " + array.dtype + ": " + path);
+    }
+    if(metadata.at("order").string != "C") {
+        throw std::runtime_error("Only Zarr arrays in C order are supported: " + path);
+    }
+    const JsonValue& compressor = metadata.at("compressor");
+    if(compressor.type == JsonValue::Object) {
+        if(compressor.at("id").string != "zlib") {
+            throw std::runtime_error("Unsupported Zarr compressor " + compressor.at("id").string + ": " + path);
+        }
+        array.level = int(compressor.at("level").number);
+    }
+    for(const JsonValue& filter : metadata.at("filters").array) {
+        if(filter.at("id").string != "shuffle") {
+            throw std::runtime_error("Unsupported Zarr filter " + filter.at("id").string + ": " + path);
+        }
+        array.shuffle = true;
+    }
+    const JsonValue& fillValue = metadata.at("fill_value");
+    if(fillValue.type == JsonValue::Number) {
+        array.fillValue = fillValue.number;
+    } else if(fillValue.type == JsonValue::String) {
+        // Non finite fill values of floating point arrays are stored as strings
+        if(fillValue.string == "NaN") {
+            array.fillValue = std::numeric_limits<double>::quiet_NaN();
+        } else if(fillValue.string == "Infinity") {
+            array.fillValue = std::numeric_limits<double>::infinity();
+        } else if(fillValue.string == "-Infinity") {
+            array.fillValue = -std::numeric_limits<double>::infinity();
+        } else {
+            throw std::runtime_error("Unsupported Zarr fill value " + fillValue.string + ": " + path);
+        }
+    }
+    if(metadata.at("dimension_separator").type == JsonValue::String) {
+        array.separator = metadata.at("dimension_separator").string;
+    }
+    return array;
+}
+
+void PLImg::ZarrArray::write(const std::string& path) const {
+    JsonValue metadata;
+    metadata.type = JsonValue::Object;
+    metadata.object["zarr_format"] = number(2);
+    metadata.object["shape"].type = JsonValue::Array;
+    metadata.object["chunks"].type = JsonValue::Array;
+    for(unsigned i = 0; i < 2; ++i) {
+        metadata.object["shape"].array.push_back(number(double(shape.at(i))));
+        metadata.object["chunks"].array.push_back(number(double(chunks.at(i))));
+    }
+    metadata.object["dtype"] = string(dtype);
+    metadata.object["order"] = string("C");
+    metadata.object["fill_value"] = number(fillValue);
+    metadata.object["dimension_separator"] = string(separator);
+    if(level >= 0) {
+        JsonValue& compressor = metadata.object["compressor"];
+        compressor.type = JsonValue::Object;
+        compressor.object["id"] = string("zlib");
+        compressor.object["level"] = number(level);
+    } else {
+        metadata.object["compressor"] = JsonValue();
+    }
+    if(shuffle) {
+        JsonValue filter;
+        filter.type = JsonValue::Object;
+        filter.object["id"] = string("shuffle");
+        filter.object["elementsize"] = number(double(elementSize(dtype)));
+        metadata.object["filters"].type = JsonValue::Array;
+        metadata.object["filters"].array.push_back(filter);
+    } else {
+        metadata.object["filters"] = JsonValue();
+    }
+    writeJson(path + "/.zarray", metadata);
+}
+
+std::string PLImg::ZarrArray::arrayPath(const std::string& store, const std::string& dataset) {
+    std::string path = store;
+    while(path.size() > 1 && path.back() == '/') {
+        path.pop_back();
+    }
+    std::stringstream ss(dataset);
+    std::string token;
+    while(std::getline(ss, token, '/')) {
+        if(!token.empty()) {
+            path.append("/").append(token);
+        }
+    }
+    return path;
+}
+
+std::string PLImg::ZarrArray::dtypeOf(int type) {
+    switch(type) {
+        case CV_8UC1:
+            return "|u1";
+        case CV_16UC1:
+            return "<u2";
+        case CV_16FC1:
+            return "<f2";
+        case CV_32SC1:
+            return "<i4";
+        case CV_32FC1:
+            return "<f4";
+        default:
+            throw std::invalid_argument("Zarr arrays can only be written for 8-bit, 16-bit unsigned, 32-bit integer and floating point images");
+    }
+}
+
+int PLImg::ZarrArray::type() const {
+    if(dtype == "|u1" || dtype == "<u1") {
+        return CV_8UC1;
+    } else if(dtype == "<u2") {
+        return CV_16UC1;
+    } else if(dtype == "<f2") {
+        return CV_16FC1;
+    } else if(dtype == "<i4") {
+        return CV_32SC1;
+    } else if(dtype == "<f4") {
+        return CV_32FC1;
+    }
+    return -1;
+}
+
+std::string PLImg::ZarrArray::chunkPath(const std::string& path, unsigned long long row, unsigned long long col) const {
+    return path + "/" + std::to_string(row) + separator + std::to_string(col);
+}
+
+cv::Mat PLImg::ZarrArray::readChunk(const std::string& path, unsigned long long row, unsigned long long col) const {
+    cv::Mat chunk(int(chunks.at(0)), int(chunks.at(1)), type(), cv::Scalar(fillValue));
+    std::string filename = chunkPath(path, row, col);
+    if(!std::filesystem::exists(filename)) {
+        return chunk;
+    }
+
+    const size_t size = chunk.total() * chunk.elemSize();
+    std::string data = readFile(filename);
+    std::vector<unsigned char> decompressed;
+    const unsigned char* raw = reinterpret_cast<const unsigned char*>(data.data());
+    if(level >= 0) {
+        decompressed.resize(size);
+        uLongf decompressedSize = size;
+        if(uncompress(decompressed.data(), &decompressedSize, raw, data.size()) != Z_OK || decompressedSize != size) {
+            throw std::runtime_error("Could not decompress " + filename);
+        }
+        raw = decompressed.data();
+    } else if(data.size() != size) {
+        throw std::runtime_error("Chunk " + filename + " has an unexpected size");
+    }
+
+    const size_t numberOfElements = chunk.total();
+    const size_t elementSize = chunk.elemSize();
+    if(shuffle && elementSize > 1) {
+        for(size_t idx = 0; idx < numberOfElements; ++idx) {
+            for(size_t byte = 0; byte < elementSize; ++byte) {
+                chunk.data[idx * elementSize + byte] = raw[byte * numberOfElements + idx];
+            }
+        }
+    } else {
+        std::memcpy(chunk.data, raw, size);
+    }
+    return chunk;
+}
+
+cv::Mat PLImg::ZarrArray::readImage(const std::string& path, const cv::Rect& region) const {
+    cv::Rect area = region.empty() ? cv::Rect(0, 0, int(shape.at(1)), int(shape.at(0))) : region;
+    if(area.x < 0 || area.y < 0 || (unsigned long long) (area.y + area.height) > shape.at(0) ||
+       (unsigned long long) (area.x + area.width) > shape.at(1)) {
+        throw std::runtime_error("Region exceeds the shape of " + path);
+    }
+    cv::Mat image(area.height, area.width, type());
+    // Only the chunks overlapping the region will be read
+    const unsigned long long firstRow = area.y / chunks.at(0);
+    const unsigned long long firstCol = area.x / chunks.at(1);
+    const unsigned long long chunksPerRow = (area.x + area.width - 1) / chunks.at(1) - firstCol + 1;
+    const unsigned long long numberOfChunks = ((area.y + area.height - 1) / chunks.at(0) - firstRow + 1) * chunksPerRow;
+    const size_t elementSize = image.elemSize();
+
+    bool readFailed = false;
+    #pragma omp parallel for default(shared) schedule(dynamic)
+    for(unsigned long long chunkIndex = 0; chunkIndex < numberOfChunks; ++chunkIndex) {
+        const unsigned long long row = firstRow + chunkIndex / chunksPerRow;
+        const unsigned long long col = firstCol + chunkIndex % chunksPerRow;
+        cv::Mat chunk;
+        try {
+            chunk = readChunk(path, row, col);
+        } catch (...) {
+            #pragma omp atomic write
+            readFailed = true;
+            continue;
+        }
+        // Intersection of the chunk and the region in image coordinates
+        const cv::Rect overlap = cv::Rect(int(col * chunks.at(1)), int(row * chunks.at(0)),
+                                          int(chunks.at(1)), int(chunks.at(0))) & area;
+        for(int i = 0; i < overlap.height; ++i) {
+            std::memcpy(image.ptr<unsigned char>(overlap.y - area.y + i) + size_t(overlap.x - area.x) * elementSize,
+                        chunk.ptr<unsigned char>(int(overlap.y - row * chunks.at(0)) + i) +
+                        (overlap.x - col * chunks.at(1)) * elementSize,
+                        size_t(overlap.width) * elementSize);
+        }
+    }
+    if(readFailed) {
+        throw std::runtime_error("Could not read all chunks of " + path);
+    }
+    return image;
+}
+
+void PLImg::ZarrArray::writeChunk(const std::string& path, const cv::Mat& image, unsigned long long row,
+                                  unsigned long long col, unsigned long long imageRow, unsigned long long imageCol) const {
+    const size_t elementSize = image.elemSize();
+    const size_t numberOfElements = chunks.at(0) * chunks.at(1);
+    const unsigned long long rows = std::min<unsigned long long>(chunks.at(0), image.rows - imageRow);
+    const unsigned long long cols = std::min<unsigned long long>(chunks.at(1), image.cols - imageCol);
+
+    // Chunks at the border of the array are padded with the fill value
+    cv::Mat chunk(int(chunks.at(0)), int(chunks.at(1)), image.type(), cv::Scalar(fillValue));
+    for(unsigned long long i = 0; i < rows; ++i) {
+        std::memcpy(chunk.ptr<unsigned char>(int(i)), image.ptr<unsigned char>(int(imageRow + i)) + imageCol * elementSize,
+                    cols * elementSize);
+    }
+
+    std::vector<unsigned char> data(chunk.data, chunk.data + numberOfElements * elementSize);
+    if(shuffle && elementSize > 1) {
+        for(size_t idx = 0; idx < numberOfElements; ++idx) {
+            for(size_t byte = 0; byte < elementSize; ++byte) {
+                data[byte * numberOfElements + idx] = chunk.data[idx * elementSize + byte];
+            }
+        }
+    }
+    if(level >= 0) {
+        uLongf compressedSize = compressBound(data.size());
+        std::vector<unsigned char> compressed(compressedSize);
+        if(compress2(compressed.data(), &compressedSize, data.data(), data.size(), level) != Z_OK) {
+            throw std::runtime_error("Could not compress chunk of " + path);
+        }
+        compressed.resize(compressedSize);
+        data.swap(compressed);
+    }
+    writeFileAtomically(chunkPath(path, row, col), data.data(), data.size());
+}
+
+PLImg::ZarrWriter::ZarrWriter() {
+    m_store = "";
+    m_level = -1;
+    m_shuffle = false;
+}
+
+std::string PLImg::ZarrWriter::path() {
+    return m_store;
+}
+
+void PLImg::ZarrWriter::set_path(const std::string& store) {
+    m_store = store;
+    while(m_store.size() > 1 && m_store.back() == '/') {
+        m_store.pop_back();
+    }
+    create_group("/");
+}
+
+void PLImg::ZarrWriter::set_compression(int level, bool shuffle) {
+    m_level = std::min(level, 9);
+    m_shuffle = shuffle;
+}
+
+std::string PLImg::ZarrWriter::datasetPath(const std::string& dataset) const {
+    if(m_store.empty()) {
+        throw std::runtime_error("No Zarr store was set. Please call set_path first.");
+    }
+    return ZarrArray::arrayPath(m_store, dataset);
+}
+
+void PLImg::ZarrWriter::create_group(const std::string& group) {
+    std::string path = datasetPath("");
+    std::vector<std::string> groups = {""};
+    std::stringstream ss(group);
+    std::string token;
+    while(std::getline(ss, token, '/')) {
+        if(!token.empty()) {
+            groups.push_back(token);
+        }
+    }
+    // Create groups recursively if the group doesn't exist.
+    for(const std::string& name : groups) {
+        if(!name.empty()) {
+            path.append("/").append(name);
+        }
+        std::error_code error;
+        std::filesystem::create_directories(path, error);
+        if(error) {
+            throw std::runtime_error("Zarr group " + path + " could not be created! Please check your path and permissions");
+        }
+        if(!std::filesystem::exists(path + "/.zgroup")) {
+            JsonValue metadata;
+            metadata.type = JsonValue::Object;
+            metadata.object["zarr_format"] = number(2);
+            writeJson(path + "/.zgroup", metadata);
+        }
+    }
+}
+
+void PLImg::ZarrWriter::create_dataset(const std::string& dataset, int rows, int cols, int type) {
+    std::string path = datasetPath(dataset);
+    ZarrArray array;
+    array.shape = {(unsigned long long) rows, (unsigned long long) cols};
+    array.chunks = {std::min(zarr_chunk_dimensions[0], array.shape[0]), std::min(zarr_chunk_dimensions[1], array.shape[1])};
+    array.dtype = ZarrArray::dtypeOf(type);
+    array.level = m_level;
+    array.shuffle = m_shuffle;
+
+    if(std::filesystem::exists(path + "/.zarray")) {
+        // Existing datasets can be reused if their shape and datatype match
+        ZarrArray existing = ZarrArray::read(path);
+        if(existing.shape != array.shape || existing.type() != type) {
+            throw std::runtime_error("Selected path is not empty and colums or rows do not match. Please check your path!");
+        }
+        return;
+    }
+    auto pos = dataset.find_last_of('/');
+    if(pos != std::string::npos && pos > 0) {
+        create_group(dataset.substr(0, pos));
+    }
+    std::error_code error;
+    std::filesystem::create_directories(path, error);
+    if(error) {
+        throw std::runtime_error("Zarr array " + path + " could not be created! Please check your path and permissions");
+    }
+    array.write(path);
+}
+
+void PLImg::ZarrWriter::write_tile(const std::string& dataset, const cv::Rect& tile, const cv::Mat& image) {
+    if(image.rows != tile.height || image.cols != tile.width) {
+        throw std::invalid_argument("Tile and image dimensions do not match");
+    }
+    std::string path = datasetPath(dataset);
+    if(!std::filesystem::exists(path + "/.zarray")) {
+        throw std::runtime_error("Dataset " + dataset + " does not exist. Please call create_dataset first.");
+    }
+    ZarrArray array = ZarrArray::read(path);
+    if(tile.x < 0 || tile.y < 0 || (unsigned long long) (tile.x + tile.width) > array.shape[1] ||
+       (unsigned long long) (tile.y + tile.height) > array.shape[0]) {
+        throw std::out_of_range("Tile exceeds the dimensions of " + dataset);
+    }
+    if(array.type() != image.type()) {
+        throw std::runtime_error("Tile and dataset " + dataset + " have different datatypes");
+    }
+
+    const unsigned long long firstRow = tile.y / array.chunks[0];
+    const unsigned long long lastRow = (tile.y + tile.height - 1) / array.chunks[0];
+    const unsigned long long firstCol = tile.x / array.chunks[1];
+    const unsigned long long lastCol = (tile.x + tile.width - 1) / array.chunks[1];
+    const unsigned long long chunksPerRow = lastCol - firstCol + 1;
+    const unsigned long long numberOfChunks = (lastRow - firstRow + 1) * chunksPerRow;
+    const size_t elementSize = image.elemSize();
+
+    bool writeFailed = false;
+    #pragma omp parallel for default(shared) schedule(dynamic)
+    for(unsigned long long chunkIndex = 0; chunkIndex < numberOfChunks; ++chunkIndex) {
+        const unsigned long long row = firstRow + chunkIndex / chunksPerRow;
+        const unsigned long long col = firstCol + chunkIndex % chunksPerRow;
+        // Region of the chunk within the array which is covered by the tile
+        const unsigned long long chunkY = row * array.chunks[0];
+        const unsigned long long chunkX = col * array.chunks[1];
+        const unsigned long long y0 = std::max<unsigned long long>(chunkY, tile.y);
+        const unsigned long long x0 = std::max<unsigned long long>(chunkX, tile.x);
+        const unsigned long long y1 = std::min<unsigned long long>({chunkY + array.chunks[0], (unsigned long long) (tile.y + tile.height), array.shape[0]});
+        const unsigned long long x1 = std::min<unsigned long long>({chunkX + array.chunks[1], (unsigned long long) (tile.x + tile.width), array.shape[1]});
+        const bool covered = y0 == chunkY && x0 == chunkX &&
+                             y1 == std::min(chunkY + array.chunks[0], array.shape[0]) &&
+                             x1 == std::min(chunkX + array.chunks[1], array.shape[1]);
+        try {
+            if(covered) {
+                array.writeChunk(path, image, row, col, chunkY - tile.y, chunkX - tile.x);
+            } else {
+                // Update the existing content of partially covered chunks. Writers in other processes
+                // must not write to the same chunk.
+                std::lock_guard<std::mutex> lock(m_chunkMutex);
+                cv::Mat chunk = array.readChunk(path, row, col);
+                for(unsigned long long y = y0; y < y1; ++y) {
+                    std::memcpy(chunk.ptr<unsigned char>(int(y - chunkY)) + (x0 - chunkX) * elementSize,
+                                image.ptr<unsigned char>(int(y - tile.y)) + (x0 - tile.x) * elementSize,
+                                (x1 - x0) * elementSize);
+                }
+                array.writeChunk(path, chunk, row, col, 0, 0);
+            }
+        } catch (...) {
+            #pragma omp atomic write
+            writeFailed = true;
+        }
+    }
+    if(writeFailed) {
+        throw std::runtime_error("Could not write all chunks of " + path);
+    }
+}
+
+void PLImg::ZarrWriter::write_dataset(const std::string& dataset, const cv::Mat& image) {
+    create_dataset(dataset, image.rows, image.cols, image.type());
+    write_tile(dataset, cv::Rect(0, 0, image.cols, image.rows), image);
+}
+
+void PLImg::ZarrWriter::write_attribute(const std::string& dataset, const std::string& parameter_name, double value) {
+    std::lock_guard<std::mutex> lock(m_attributeMutex);
+    std::string filename = datasetPath(dataset) + "/.zattrs";
+    JsonValue attributes;
+    attributes.type = JsonValue::Object;
+    if(std::filesystem::exists(filename)) {
+        attributes = JsonParser(readFile(filename)).parse();
+    }
+    attributes.object[parameter_name] = number(value);
+    writeJson(filename, attributes);
+}
+
+void PLImg::ZarrWriter::write_attribute(const std::string& dataset, const std::string& parameter_name, const std::string& value) {
+    std::lock_guard<std::mutex> lock(m_attributeMutex);
+    std::string filename = datasetPath(dataset) + "/.zattrs";
+    JsonValue attributes;
+    attributes.type = JsonValue::Object;
+    if(std::filesystem::exists(filename)) {
+        attributes = JsonParser(readFile(filename)).parse();
+    }
+    attributes.object[parameter_name] = string(value);
+    writeJson(filename, attributes);
+}
+
+void PLImg::ZarrWriter::remove_attribute(const std::string& dataset, const std::string& parameter_name) {
+    std::lock_guard<std::mutex> lock(m_attributeMutex);
+    std::string filename = datasetPath(dataset) + "/.zattrs";
+    if(!std::filesystem::exists(filename)) {
+        return;
+    }
+    JsonValue attributes = JsonParser(readFile(filename)).parse();
+    if(attributes.object.erase(parameter_name) > 0) {
+        writeJson(filename, attributes);
+    }
+}
+
+std::map<std::string, std::string> PLImg::ZarrWriter::read_attributes(const std::string& store, const std::string& dataset) {
+    std::map<std::string, std::string> result;
+    std::string filename = ZarrArray::arrayPath(store, dataset) + "/.zattrs";
+    if(!std::filesystem::exists(filename)) {
+        return result;
+    }
+    JsonValue attributes = JsonParser(readFile(filename)).parse();
+    for(const auto& entry : attributes.object) {
+        result[entry.first] = entry.second.type == JsonValue::String ? entry.second.string : toJson(entry.second, false);
+    }
+    return result;
+}
+
+void PLImg::ZarrWriter::close() {
+    m_store = "";
+}
@@ -0,0 +1,252 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Forschungszentrum Jülich / Jan André Reuter.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+ */
+
+#ifndef PLIMG_ZARR_H
+#define PLIMG_ZARR_H
+
+#include <map>
+#include <mutex>
+#include <opencv2/core.hpp>
+#include <string>
+#include <vector>
+
+/// Chunk dimensions of new Zarr arrays
+constexpr unsigned long long zarr_chunk_dimensions[2] = {2048, 2048};
+
+/**
+ * @file
+ * @brief PLImg::ZarrArray and PLImg::ZarrWriter classes
+ */
+namespace PLImg {
+    /**
+     * Zarr stores an image as a directory with a JSON description (.zarray) and one file per chunk. Chunks can
+     * therefore be written by any number of threads or processes without a shared library lock.
+     * Only the subset of the Zarr v2 specification written by ZarrWriter is supported: two dimensional little
+     * endian arrays in C order with an optional shuffle filter and zlib compression.
+     * @brief Metadata of a two dimensional Zarr v2 array
+     */
+    struct ZarrArray {
+        /// Number of rows and columns of the array
+        std::vector<unsigned long long> shape;
+        /// Number of rows and columns of a chunk
+        std::vector<unsigned long long> chunks;
+        /// Zarr datatype (|u1, <u2, <f2, <i4 or <f4)
+        std::string dtype;
+        /// zlib compression level. Negative values store uncompressed chunks.
+        int level = -1;
+        /// Byte shuffle filter applied before compression
+        bool shuffle = false;
+        /// Value of pixels in missing chunks. NaN and infinite values are stored as strings.
+        double fillValue = 0;
+        /// Separator of the chunk indices in the chunk file names
+        std::string separator = ".";
+
+        /**
+         * @brief Read the metadata of an array
+         * @param path Directory of the array
+         * @return Metadata read from the .zarray file
+         */
+        static ZarrArray read(const std::string& path);
+        /**
+         * The metadata is written to a temporary file which is renamed afterwards. Concurrent writers of the same
+         * metadata therefore never leave an incomplete file behind.
+         * @brief Write the metadata of an array
+         * @param path Directory of the array
+         */
+        void write(const std::string& path) const;
+        /**
+         * @brief Get the directory of a dataset or group within a store
+         * @param store Directory of the Zarr store
+         * @param dataset Dataset or group within the store, e.g. /Image
+         * @return Directory of the dataset
+         */
+        static std::string arrayPath(const std::string& store, const std::string& dataset);
+        /**
+         * @brief Get the Zarr datatype of an OpenCV type
+         * @param type OpenCV type (CV_8UC1, CV_16UC1, CV_16FC1, CV_32SC1 or CV_32FC1)
+         * @return Zarr datatype
+         */
+        static std::string dtypeOf(int type);
+        /**
+         * @brief Get the OpenCV type of the array
+         * @return OpenCV type or -1 if the datatype is not supported
+         */
+        int type() const;
+        /**
+         * @brief Get the file name of a chunk
+         * @param path Directory of the array
+         * @param row Row index of the chunk
+         * @param col Column index of the chunk
+         * @return Path of the chunk file
+         */
+        std::string chunkPath(const std::string& path, unsigned long long row, unsigned long long col) const;
+        /**
+         * @brief Read and decompress a single chunk
+         * @param path Directory of the array
+         * @param row Row index of the chunk
+         * @param col Column index of the chunk
+         * @return Chunk with the full chunk size. Missing chunks are filled with the fill value.
+         */
+        cv::Mat readChunk(const std::string& path, unsigned long long row, unsigned long long col) const;
+        /**
+         * Read all chunks of the array overlapping the region in parallel. Missing chunks are filled with the fill value.
+         * @brief Read the array
+         * @param path Directory of the array
+         * @param region Region which shall be read. An empty region reads the full array.
+         * @return OpenCV image of the region
+         * @throws std::runtime_error if the region exceeds the array
+         */
+        cv::Mat readImage(const std::string& path, const cv::Rect& region = cv::Rect()) const;
+        /**
+         * Filter and compress a chunk of the image and write it to its own file. The chunk file is written to a
+         * temporary file which is renamed afterwards.
+         * @brief Write a chunk of an image
+         * @param path Directory of the array
+         * @param image Image containing the chunk
+         * @param row Row index of the chunk
+         * @param col Column index of the chunk
+         * @param imageRow Row of the image at which the chunk begins
+         * @param imageCol Column of the image at which the chunk begins
+         */
+        void writeChunk(const std::string& path, const cv::Mat& image, unsigned long long row, unsigned long long col,
+                        unsigned long long imageRow, unsigned long long imageCol) const;
+    };
+
+    /**
+     * The ZarrWriter writes images into a Zarr v2 directory store. In contrast to the HDF5Writer, no lock is needed
+     * to write chunks. Multiple threads may call write_tile(const std::string&, const cv::Rect&, const cv::Mat&)
+     * at the same time and multiple processes may write different tiles of the same dataset.
+     * Images written by the ZarrWriter can be read with PLImg::Reader::imread if the store ends with .zarr.
+     * @brief Write images to a Zarr directory store
+     */
+    class ZarrWriter {
+    public:
+        /**
+         * @brief ZarrWriter Default constructor for the ZarrWriter
+         */
+        ZarrWriter();
+        /**
+         * @brief path Get currently set path
+         * @return Directory of the current store
+         */
+        std::string path();
+        /**
+         * Set the directory of the Zarr store. The directory and its root group will be created if they don't exist.
+         * @brief set_path Set the Zarr store directory
+         * @param store Directory of the store. Should end with .zarr.
+         */
+        void set_path(const std::string& store);
+        /**
+         * @brief Set the compression of new datasets
+         * @param level zlib compression level (1-9). Negative values store uncompressed chunks.
+         * @param shuffle Apply the byte shuffle filter before compression
+         */
+        void set_compression(int level, bool shuffle);
+        /**
+         * An existing dataset is reused if its dimensions and datatype match. Otherwise, an exception is thrown.
+         * @brief Create an empty dataset of known shape
+         * @param dataset Destination within the store
+         * @param rows Number of rows of the dataset
+         * @param cols Number of columns of the dataset
+         * @param type OpenCV type of the dataset (CV_8UC1, CV_16UC1, CV_16FC1, CV_32SC1 or CV_32FC1)
+         */
+        void create_dataset(const std::string& dataset, int rows, int cols, int type);
+        /**
+         * Write a tile into an existing dataset. Chunks which are completely covered by the tile are written
+         * without reading anything. Partially covered chunks are read, updated and written again. This is
+         * serialized between the threads of a writer, but tiles of different processes must be aligned to
+         * zarr_chunk_dimensions.
+         * @brief Write a part of a dataset
+         * @param dataset Existing dataset within the store
+         * @param tile Position and size of the tile within the dataset
+         * @param image Image with the size of the tile
+         */
+        void write_tile(const std::string& dataset, const cv::Rect& tile, const cv::Mat& image);
+        /**
+         * Create the dataset and write all chunks of the image on multiple threads.
+         * @brief Write OpenCV image to a dataset in the store
+         * @param dataset Destination within the store
+         * @param image OpenCV image which will be written
+         */
+        void write_dataset(const std::string& dataset, const cv::Mat& image);
+        /**
+         * @brief Write a numerical attribute to the .zattrs file of a dataset or group
+         * @param dataset Existing dataset or group
+         * @param parameter_name Name of the attribute
+         * @param value Value of the attribute
+         */
+        void write_attribute(const std::string& dataset, const std::string& parameter_name, double value);
+        /**
+         * @brief Write a string attribute to the .zattrs file of a dataset or group
+         * @param dataset Existing dataset or group
+         * @param parameter_name Name of the attribute
+         * @param value Value of the attribute
+         */
+        void write_attribute(const std::string& dataset, const std::string& parameter_name, const std::string& value);
+        /**
+         * @brief Remove an attribute from the .zattrs file of a dataset or group if it exists
+         * @param dataset Existing dataset or group
+         * @param parameter_name Name of the attribute
+         */
+        void remove_attribute(const std::string& dataset, const std::string& parameter_name);
+        /**
+         * Numerical attributes are returned in their JSON representation.
+         * @brief Read the attributes of a dataset or group
+         * @param store Directory of the Zarr store
+         * @param dataset Dataset or group within the store
+         * @return Names and values of the attributes. Empty if the dataset has no .zattrs file.
+         */
+        static std::map<std::string, std::string> read_attributes(const std::string& store, const std::string& dataset);
+        /**
+         * @brief Create a group and all of its parents within the store
+         * @param group Group which shall be created
+         */
+        void create_group(const std::string& group);
+        /**
+         * Chunks are written immediately. Closing the store only resets the path.
+         * @brief close Closes the current store
+         */
+        void close();
+    private:
+        /**
+         * @brief Get the directory of a dataset or group within the store
+         * @param dataset Dataset or group
+         * @return Directory of the dataset
+         */
+        std::string datasetPath(const std::string& dataset) const;
+
+        ///
+        std::string m_store;
+        ///
+        int m_level;
+        ///
+        bool m_shuffle;
+        /// Serializes updates of the .zattrs files
+        std::mutex m_attributeMutex;
+        /// Serializes updates of partially written chunks
+        std::mutex m_chunkMutex;
+    };
+}
+
+#endif //PLIMG_ZARR_H
@@ -0,0 +1,93 @@
+//
+// Created by jreuter on 27.11.20.
+//
+
+#include "gtest/gtest.h"
+#include "distributor.h"
+#include <thread>
+#ifdef PLIMG_USE_MPI
+    #include <mpi.h>
+#endif
+
+
+TEST(DistributorTest, TestSingleProcess) {
+    // A single process retrieves all sections in order
+    PLImg::SectionDistributor distributor(3);
+    if(distributor.size() > 1) {
+        GTEST_SKIP() << "Only for a single process";
+    }
+    ASSERT_FALSE(distributor.master());
+    ASSERT_EQ(distributor.localSize(), 1);
+    ASSERT_EQ(distributor.next(), 0);
+    ASSERT_EQ(distributor.next(), 1);
+    ASSERT_EQ(distributor.next(), 2);
+    ASSERT_EQ(distributor.next(), -1);
+    ASSERT_EQ(distributor.next(), -1);
+
+    distributor.report(2, 1.5);
+    distributor.report(0, 2.0, "Could not read file");
+    distributor.report(1, 0.5);
+    std::vector<PLImg::SectionReport> reports = distributor.gather();
+    ASSERT_EQ(reports.size(), 3);
+    for(long long section = 0; section < 3; ++section) {
+        ASSERT_EQ(reports.at(section).section, section);
+        ASSERT_EQ(reports.at(section).rank, 0);
+    }
+    ASSERT_EQ(reports.at(0).error, "Could not read file");
+    ASSERT_TRUE(reports.at(1).error.empty());
+
+    std::string summary = PLImg::SectionDistributor::summary(reports, {"a.h5", "b.h5", "c.h5"});
+    ASSERT_NE(summary.find("Rank 0: 3 sections in 4.0 s, 1 failed"), std::string::npos);
+    ASSERT_NE(summary.find("2 of 3 sections were processed successfully"), std::string::npos);
+    ASSERT_NE(summary.find("Section 0 (a.h5) failed on rank 0: Could not read file"), std::string::npos);
+    ASSERT_EQ(summary.find("Section 1"), std::string::npos);
+}
+
+TEST(DistributorTest, TestDynamicDistribution) {
+    // Run with several ranks, e.g. mpirun -np 3. Rank 0 only distributes the sections. The other ranks claim them
+    // from concurrently processed sections.
+    PLImg::SectionDistributor distributor(20);
+    ASSERT_EQ(distributor.localSize(true), distributor.localSize() - (distributor.size() > 1 ? 1 : 0));
+    if(distributor.master()) {
+        distributor.serve();
+    } else {
+        std::vector<std::thread> workers;
+        for(int worker = 0; worker < 2; ++worker) {
+            workers.emplace_back([&distributor]() {
+                long long section;
+                while((section = distributor.next()) >= 0) {
+                    distributor.report(section, 0.1);
+                }
+            });
+        }
+        for(std::thread& worker : workers) {
+            worker.join();
+        }
+        ASSERT_EQ(distributor.next(), -1);
+    }
+
+    // Every section was processed exactly once and never by the master
+    std::vector<PLImg::SectionReport> reports = distributor.gather();
+    if(distributor.rank() == 0) {
+        ASSERT_EQ(reports.size(), 20);
+        for(long long section = 0; section < 20; ++section) {
+            ASSERT_EQ(reports.at(section).section, section);
+            if(distributor.size() > 1) {
+                ASSERT_NE(reports.at(section).rank, 0);
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    #ifdef PLIMG_USE_MPI
+        int threadSupport;
+        MPI_Init_thread(&argc, &argv, MPI_THREAD_SERIALIZED, &threadSupport);
+    #endif
+    ::testing::InitGoogleTest(&argc, argv);
+    int result = RUN_ALL_TESTS();
+    #ifdef PLIMG_USE_MPI
+        MPI_Finalize();
+    #endif
+    return result;
+}
@@ -0,0 +1,72 @@
+//
+// Created by jreuter on 27.11.20.
+//
+
+#include "gtest/gtest.h"
+#include "inclination.h"
+#include <cmath>
+#include <limits>
+
+TEST(InclinationTest, TestFormats) {
+    // Gray matter pixels with 0°, about 54.7°, just below 90° and NaN. The last pixel is background with 90°.
+    auto transmittance = std::make_shared<cv::Mat>(1, 5, CV_32FC1, cv::Scalar(0.5f));
+    auto retardation = std::make_shared<cv::Mat>(1, 5, CV_32FC1);
+    retardation->at<float>(0, 0) = 1.0f;
+    retardation->at<float>(0, 1) = 0.5f;
+    retardation->at<float>(0, 2) = 2e-7f;
+    retardation->at<float>(0, 3) = std::numeric_limits<float>::quiet_NaN();
+    retardation->at<float>(0, 4) = 0.0f;
+    auto blurredMask = std::make_shared<cv::Mat>(1, 5, CV_32FC1, cv::Scalar(0.0f));
+    auto mask = std::make_shared<cv::Mat>(1, 5, CV_8UC1, cv::Scalar(255));
+    mask->at<uchar>(0, 4) = 0;
+
+    PLImg::Inclination inclination(transmittance, retardation, blurredMask, mask);
+    inclination.set_Tc(0.2f);
+    inclination.set_TM(0.8f);
+    inclination.set_RrefHM(1.0f);
+    inclination.set_RrefLM(1.0f);
+    cv::Mat reference = inclination.inclination()->clone();
+    ASSERT_EQ(reference.type(), CV_32FC1);
+    ASSERT_FLOAT_EQ(reference.at<float>(0, 0), 0.0f);
+    ASSERT_GT(reference.at<float>(0, 2), 89.96875f);
+    ASSERT_LT(reference.at<float>(0, 2), 90.0f);
+    ASSERT_TRUE(std::isnan(reference.at<float>(0, 3)));
+    ASSERT_FLOAT_EQ(reference.at<float>(0, 4), 90.0f);
+    cv::Mat saturation = inclination.saturation()->clone();
+    ASSERT_NE(saturation.at<uchar>(0, 0), 0);
+    ASSERT_EQ(saturation.at<uchar>(0, 1), 0);
+    ASSERT_EQ(saturation.at<uchar>(0, 2), 0);
+    ASSERT_EQ(saturation.at<uchar>(0, 3), 0);
+    ASSERT_NE(saturation.at<uchar>(0, 4), 0);
+
+    // Inclinations below 90° are not rounded up to 90° and keep the saturation of the 32-bit inclination
+    inclination.set_format(PLImg::InclinationFormat::Float16);
+    cv::Mat half = *inclination.inclination();
+    ASSERT_EQ(half.type(), CV_16FC1);
+    ASSERT_NEAR(float(half.at<cv::float16_t>(0, 1)), reference.at<float>(0, 1), 0.03f);
+    ASSERT_FLOAT_EQ(float(half.at<cv::float16_t>(0, 2)), 89.9375f);
+    ASSERT_TRUE(std::isnan(float(half.at<cv::float16_t>(0, 3))));
+    ASSERT_FLOAT_EQ(float(half.at<cv::float16_t>(0, 4)), 90.0f);
+    for(int i = 0; i < saturation.cols; ++i) {
+        ASSERT_EQ(inclination.saturation()->at<uchar>(0, i), saturation.at<uchar>(0, i));
+    }
+
+    // NaN is stored as the reserved fill value
+    inclination.set_format(PLImg::InclinationFormat::UInt16);
+    cv::Mat fixed = *inclination.inclination();
+    ASSERT_EQ(fixed.type(), CV_16UC1);
+    ASSERT_EQ(fixed.at<unsigned short>(0, 0), 0);
+    ASSERT_NEAR(fixed.at<unsigned short>(0, 1) * inclination.scaleFactor(), reference.at<float>(0, 1), INCLINATION_UINT16_SCALE);
+    ASSERT_LT(fixed.at<unsigned short>(0, 2), INCLINATION_UINT16_FILL_VALUE - 1);
+    ASSERT_EQ(fixed.at<unsigned short>(0, 3), INCLINATION_UINT16_FILL_VALUE);
+    ASSERT_EQ(fixed.at<unsigned short>(0, 4), INCLINATION_UINT16_FILL_VALUE - 1);
+    ASSERT_FLOAT_EQ(fixed.at<unsigned short>(0, 4) * inclination.scaleFactor(), 90.0f);
+    for(int i = 0; i < saturation.cols; ++i) {
+        ASSERT_EQ(inclination.saturation()->at<uchar>(0, i), saturation.at<uchar>(0, i));
+    }
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -15,7 +15,8 @@ void f(std::vector<float>& x) {
     }
 }
 
-TEST(TestMaskgeneration, TestTRet) {
+// Retardation whose histogram has a plateau at 0.0625
+cv::Mat makeRetardationHistogramImage() {
     auto x = std::vector<float>(256 * 256);
     for(ulong i = 0; i < x.size(); ++i) {
         x.at(i) = float(i) / 256.0f;
@@ -44,11 +45,91 @@ TEST(TestMaskgeneration, TestTRet) {
         }
     }
     cv::normalize(image, image, 0, 1, cv::NORM_MINMAX);
+    return image;
+}
+
+// Transmittance whose histogram rises towards the background at 0.9494018
+cv::Mat makeTransmittanceHistogramImage() {
+    auto x = std::vector<float>(256*256);
+    for(ulong i = 0; i < x.size(); ++i) {
+        x.at(i) = float(i)/256.0f;
+    }
+
+    auto y = std::vector<float>(x.size());
+    std::copy(x.begin(), x.end(), y.begin());
+    f(y);
+    std::reverse(y.begin(), y.end());
+
+    float sum = 0;
+    for(float i : y) {
+        sum += i;
+    }
+    cv::Mat image(sum, 1, CV_32FC1);
+
+    // Fill image with data
+    unsigned current_index = 0;
+    unsigned current_sum = 0;
+    for(int i = 0; i < image.rows; ++i) {
+        image.at<float>(i) = x.at(current_index);
+
+        ++current_sum;
+        if(current_sum > unsigned(y.at(current_index))) {
+            ++current_index;
+            current_sum = 0;
+        }
+    }
+    cv::normalize(image, image, 0, 1, cv::NORM_MINMAX);
+    return image;
+}
+
+TEST(TestMaskgeneration, TestTRet) {
+    cv::Mat image = makeRetardationHistogramImage();
     auto shared_ret = std::make_shared<cv::Mat>(image);
     auto mask = PLImg::MaskGeneration(shared_ret, nullptr);
     ASSERT_FLOAT_EQ(mask.R_thres(), 0.0625f);
 }
 
+TEST(TestMaskgeneration, TestTRetWithPrior) {
+    cv::Mat image = makeRetardationHistogramImage();
+    auto shared_ret = std::make_shared<cv::Mat>(image);
+    auto mask = PLImg::MaskGeneration(shared_ret, nullptr);
+    float r_thres = mask.R_thres();
+
+    // A prior at or near the result finds the same curvature peak
+    mask.resetParameters();
+    mask.set_prior(-1.0f, r_thres);
+    ASSERT_FLOAT_EQ(mask.R_thres(), r_thres);
+    mask.resetParameters();
+    mask.set_prior(-1.0f, r_thres + 2.0f / MAX_NUMBER_OF_BINS);
+    ASSERT_FLOAT_EQ(mask.R_thres(), r_thres);
+
+    // Priors outside of the histogram fall back to the full search
+    mask.resetParameters();
+    mask.set_prior(-1.0f, 2.0f);
+    ASSERT_FLOAT_EQ(mask.R_thres(), r_thres);
+}
+
+TEST(TestMaskgeneration, TestTMaxWithPrior) {
+    cv::Mat image = makeTransmittanceHistogramImage();
+
+    auto shared_tra = std::make_shared<cv::Mat>(image);
+    auto mask = PLImg::MaskGeneration(nullptr, shared_tra);
+    float t_back = mask.T_back();
+
+    // A prior at or near the result finds the same curvature peak
+    mask.resetParameters();
+    mask.set_prior(t_back, -1.0f);
+    ASSERT_FLOAT_EQ(mask.T_back(), t_back);
+    mask.resetParameters();
+    mask.set_prior(t_back - 2.0f / MAX_NUMBER_OF_BINS, -1.0f);
+    ASSERT_FLOAT_EQ(mask.T_back(), t_back);
+
+    // Priors outside of the histogram fall back to the full search
+    mask.resetParameters();
+    mask.set_prior(2.0f, -1.0f);
+    ASSERT_FLOAT_EQ(mask.T_back(), t_back);
+}
+
 TEST(TestMaskgeneration, TestTTra) {
     cv::Mat test_retardation(100, 100, CV_32FC1);
     cv::Mat test_transmittance(100, 100, CV_32FC1);
@@ -97,39 +178,138 @@ TEST(TestMaskgeneration, TestTMin) {
 }
 
 TEST(TestMaskgeneration, TestTMax) {
-    auto x = std::vector<float>(256*256);
-    for(ulong i = 0; i < x.size(); ++i) {
-        x.at(i) = float(i)/256.0f;
-    }
+    cv::Mat image = makeTransmittanceHistogramImage();
 
-    auto y = std::vector<float>(x.size());
-    std::copy(x.begin(), x.end(), y.begin());
-    f(y);
-    std::reverse(y.begin(), y.end());
+    auto shared_tra = std::make_shared<cv::Mat>(image);
+    auto mask = PLImg::MaskGeneration(nullptr, shared_tra);
+    ASSERT_FLOAT_EQ(mask.T_back(), 0.9494018f);
+}
 
-    float sum = 0;
-    for(float i : y) {
-        sum += i;
-    }
-    cv::Mat image(sum, 1, CV_32FC1);
+TEST(TestMaskgeneration, TestTMaxWithStatistics) {
+    cv::Mat image = makeTransmittanceHistogramImage();
 
-    // Fill image with data
-    unsigned current_index = 0;
-    unsigned current_sum = 0;
-    for(int i = 0; i < image.rows; ++i) {
-        image.at<float>(i) = x.at(current_index);
+    PLImg::ImageStatistics statistics;
+    auto shared_tra = std::make_shared<cv::Mat>(PLImg::Reader::convert(image, statistics));
+    auto shared_ret = std::make_shared<cv::Mat>(cv::Mat::zeros(image.rows, image.cols, CV_32FC1));
+    PLImg::ImageStatistics retardationStatistics;
+    *shared_ret = PLImg::Reader::convert(*shared_ret, retardationStatistics);
 
-        ++current_sum;
-        if(current_sum > unsigned(y.at(current_index))) {
-            ++current_index;
-            current_sum = 0;
-        }
-    }
-    cv::normalize(image, image, 0, 1, cv::NORM_MINMAX);
+    PLImg::MaskGeneration mask;
+    mask.setModalities(shared_ret, shared_tra, retardationStatistics, statistics);
+    ASSERT_FLOAT_EQ(mask.T_back(), 0.9494018f);
 
-    auto shared_tra = std::make_shared<cv::Mat>(image);
-    auto mask = PLImg::MaskGeneration(nullptr, shared_tra);
+    // Missing statistics are calculated from the images
+    mask.setModalities(shared_ret, shared_tra, PLImg::ImageStatistics(), PLImg::ImageStatistics());
     ASSERT_FLOAT_EQ(mask.T_back(), 0.9494018f);
+    ASSERT_THROW(mask.setModalities(nullptr, shared_tra, PLImg::ImageStatistics(), statistics), std::invalid_argument);
+}
+
+TEST(TestMaskgeneration, TestEstimateParameters) {
+    cv::Mat retardation(30, 30, CV_32FC1, 0.1f);
+    cv::Mat transmittance(30, 30, CV_32FC1, 0.5f);
+    auto retPtr = std::make_shared<cv::Mat>(retardation);
+    auto traPtr = std::make_shared<cv::Mat>(transmittance);
+
+    PLImg::MaskGeneration generation(retPtr, traPtr);
+    generation.set_tthres(0.01f);
+    generation.set_rthres(0.02f);
+    generation.set_tref(0.03f);
+    generation.set_tback(0.04f);
+    // Manually set parameters are kept
+    generation.estimateParameters(std::make_shared<cv::Mat>(PLImg::Reader::subsample(retardation, 2)),
+                                  std::make_shared<cv::Mat>(PLImg::Reader::subsample(transmittance, 2)));
+    ASSERT_FLOAT_EQ(generation.T_thres(), 0.01f);
+    ASSERT_FLOAT_EQ(generation.R_thres(), 0.02f);
+    ASSERT_FLOAT_EQ(generation.T_ref(), 0.03f);
+    ASSERT_FLOAT_EQ(generation.T_back(), 0.04f);
+    // The full resolution images are not changed by the estimation
+    ASSERT_EQ(cv::countNonZero(*retPtr != 0.1f), 0);
+    ASSERT_EQ(cv::countNonZero(*traPtr != 0.5f), 0);
+}
+
+TEST(TestMaskgeneration, TestEstimateParametersOfSections) {
+    // Two sections of different width with tissue on a bright background
+    auto section = [](int cols, float tissueTransmittance, int tissueCols) {
+        cv::Mat transmittance(20, cols, CV_32FC1, 0.9f);
+        cv::Mat retardation(20, cols, CV_32FC1, 0.0f);
+        transmittance(cv::Rect(2, 2, tissueCols, 10)).setTo(tissueTransmittance);
+        retardation(cv::Rect(2, 2, tissueCols, 10)).setTo(0.2f);
+        return std::make_pair(std::make_shared<cv::Mat>(retardation), std::make_shared<cv::Mat>(transmittance));
+    };
+    auto first = section(30, 0.3f, 10);
+    auto second = section(50, 0.4f, 20);
+
+    // The histogram parameters are those of a single image with exactly the pixels of both sections
+    cv::Mat combinedRetardation(40, 40, CV_32FC1), combinedTransmittance(40, 40, CV_32FC1);
+    std::copy(first.first->begin<float>(), first.first->end<float>(), combinedRetardation.begin<float>());
+    std::copy(second.first->begin<float>(), second.first->end<float>(), combinedRetardation.begin<float>() + 600);
+    std::copy(first.second->begin<float>(), first.second->end<float>(), combinedTransmittance.begin<float>());
+    std::copy(second.second->begin<float>(), second.second->end<float>(), combinedTransmittance.begin<float>() + 600);
+    PLImg::MaskGeneration single;
+    single.estimateParameters(std::make_shared<cv::Mat>(combinedRetardation), std::make_shared<cv::Mat>(combinedTransmittance));
+
+    PLImg::MaskGeneration block;
+    block.estimateParameters({first.first, second.first}, {first.second, second.second});
+    ASSERT_FLOAT_EQ(block.T_back(), single.T_back());
+    ASSERT_FLOAT_EQ(block.R_thres(), single.R_thres());
+    // The tissue of both sections is averaged instead of only using the largest component
+    ASSERT_NEAR(block.T_ref(), (100 * 0.3f + 200 * 0.4f) / 300, 1e-5);
+    ASSERT_GE(block.R_plus(), block.R_thres());
+    ASSERT_LE(block.R_minus(), block.R_thres());
+    // The subsamples are not changed
+    ASSERT_EQ(first.second->cols, 30);
+    ASSERT_FLOAT_EQ(first.second->at<float>(0, 0), 0.9f);
+
+    // Manually set parameters are kept
+    PLImg::MaskGeneration manual;
+    manual.set_tref(0.25f);
+    manual.set_tback(0.8f);
+    manual.estimateParameters({first.first, second.first}, {first.second, second.second});
+    ASSERT_FLOAT_EQ(manual.T_ref(), 0.25f);
+    ASSERT_FLOAT_EQ(manual.T_back(), 0.8f);
+
+    std::vector<std::shared_ptr<cv::Mat>> retardations = {first.first}, transmittances = {first.second, second.second};
+    ASSERT_THROW(block.estimateParameters(retardations, transmittances), std::invalid_argument);
+    transmittances = {second.second};
+    ASSERT_THROW(block.estimateParameters(retardations, transmittances), std::invalid_argument);
+    std::vector<std::shared_ptr<cv::Mat>> none;
+    ASSERT_THROW(block.estimateParameters(none, none), std::invalid_argument);
+}
+
+TEST(TestMaskgeneration, TestSetBackground) {
+    cv::Mat retardation(30, 30, CV_32FC1, 0.1f);
+    cv::Mat transmittance(30, 30, CV_32FC1, 0.5f);
+    transmittance(cv::Rect(0, 0, 30, 10)).setTo(0.9f);
+    auto retPtr = std::make_shared<cv::Mat>(retardation);
+    auto traPtr = std::make_shared<cv::Mat>(transmittance);
+
+    // Tiles of a larger section are filled with the values of the whole section
+    PLImg::MaskGeneration generation(retPtr, traPtr);
+    generation.set_tback(0.8f);
+    generation.set_background(0.95f, 0.05f);
+    generation.removeBackground();
+    ASSERT_FLOAT_EQ(traPtr->at<float>(0, 0), 0.95f);
+    ASSERT_FLOAT_EQ(retPtr->at<float>(0, 0), 0.05f);
+    ASSERT_FLOAT_EQ(traPtr->at<float>(20, 0), 0.5f);
+    ASSERT_FLOAT_EQ(retPtr->at<float>(20, 0), 0.1f);
+}
+
+TEST(TestMaskgeneration, TestReleaseModalities) {
+    auto retPtr = std::make_shared<cv::Mat>(30, 30, CV_32FC1, 0.1f);
+    auto traPtr = std::make_shared<cv::Mat>(30, 30, CV_32FC1, 0.5f);
+
+    PLImg::MaskGeneration generation(retPtr, traPtr);
+    generation.set_tthres(0.4f);
+    generation.set_rthres(0.2f);
+    generation.set_tref(0.3f);
+    generation.set_tback(0.8f);
+    auto fullMask = generation.fullMask();
+    generation.releaseModalities();
+    // Only the caller references the modalities afterwards
+    ASSERT_EQ(retPtr.use_count(), 1);
+    ASSERT_EQ(traPtr.use_count(), 1);
+    ASSERT_EQ(generation.fullMask(), fullMask);
+    ASSERT_FLOAT_EQ(generation.T_thres(), 0.4f);
 }
 
 TEST(TestMaskgeneration, TestSetGet) {
@@ -142,6 +322,11 @@ TEST(TestMaskgeneration, TestSetGet) {
     ASSERT_FLOAT_EQ(mask.R_thres(), 0.03);
     mask.set_tthres(0.04);
     ASSERT_FLOAT_EQ(mask.T_thres(), 0.04);
+    mask.set_probability_parameters(0.05, 0.06, 0.07, 0.08);
+    ASSERT_FLOAT_EQ(mask.R_plus(), 0.05);
+    ASSERT_FLOAT_EQ(mask.R_minus(), 0.06);
+    ASSERT_FLOAT_EQ(mask.T_plus(), 0.07);
+    ASSERT_FLOAT_EQ(mask.T_minus(), 0.08);
 }
 
 TEST(TestMaskgeneration, TestWhiteMask) {
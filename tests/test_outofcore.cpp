@@ -0,0 +1,103 @@
+//
+// Created by jreuter on 27.11.20.
+//
+
+#include "gtest/gtest.h"
+#include "outofcore.h"
+#include "maskgeneration.h"
+#include "inclination.h"
+#include "reader.h"
+#include "toolbox.h"
+#include "writer.h"
+#include <cmath>
+#include <filesystem>
+
+TEST(OutOfCoreTest, TestMatchesInCore) {
+    // Only HDF5 and Zarr files can be read tile by tile
+    cv::Mat transmittance = PLImg::Reader::imread("../../tests/files/full_execution/NTransmittance.tiff");
+    cv::Mat retardation = PLImg::Reader::imread("../../tests/files/full_execution/Retardation.tiff");
+    std::filesystem::create_directories("output");
+    PLImg::HDF5Writer writer;
+    writer.set_path("output/outofcore_transmittance.h5");
+    writer.write_dataset("/Image", transmittance);
+    writer.close();
+    writer.set_path("output/outofcore_retardation.h5");
+    writer.write_dataset("/Image", retardation);
+    writer.close();
+
+    // Several tiles, but the subsample contains every pixel
+    PLImg::OutOfCoreSection section("output/outofcore_transmittance.h5", "output/outofcore_retardation.h5", "/Image",
+                                    false, 1ull << 34, 1, 64);
+    ASSERT_GT(section.grid().size(), 1);
+    ASSERT_EQ(section.stride(), 1);
+    ASSERT_EQ(section.rows(), transmittance.rows);
+    ASSERT_EQ(section.cols(), transmittance.cols);
+    ASSERT_THROW(section.estimate(PLImg::OutOfCoreParameters()), std::runtime_error);
+
+    writer.set_path("output/outofcore_result.h5");
+    writer.create_dataset("/Median", section.rows(), section.cols(), CV_32FC1);
+    section.sample(&writer, "/Median");
+    PLImg::OutOfCoreParameters manual;
+    manual.tback = 0.6f;
+    PLImg::OutOfCoreParameters parameters = section.estimate(manual);
+    ASSERT_FLOAT_EQ(parameters.tback, 0.6f);
+    section.process(parameters, writer, "/Mask", "/Probability", writer, "/Inclination", PLImg::InclinationFormat::Float32);
+    writer.close();
+    cv::Mat outOfCoreMedian = PLImg::Reader::imread("output/outofcore_result.h5", "/Median");
+    cv::Mat outOfCoreMask = PLImg::Reader::imread("output/outofcore_result.h5", "/Mask");
+    cv::Mat outOfCoreInclination = PLImg::Reader::imread("output/outofcore_result.h5", "/Inclination");
+
+    // In core with the parameters of the out-of-core run
+    PLImg::ImageStatistics transmittanceStatistics, retardationStatistics;
+    auto original = std::make_shared<cv::Mat>(PLImg::Reader::convert(transmittance, transmittanceStatistics));
+    auto medTransmittance = PLImg::cuda::filters::medianFilter(original);
+    auto inCoreRetardation = std::make_shared<cv::Mat>(PLImg::Reader::convert(retardation, retardationStatistics));
+    double maxTransmittance, minRetardation, unused;
+    cv::minMaxIdx(*medTransmittance, &unused, &maxTransmittance);
+    cv::minMaxIdx(*inCoreRetardation, &minRetardation, &unused);
+    for(int i = 0; i < medTransmittance->rows; ++i) {
+        for(int j = 0; j < medTransmittance->cols; ++j) {
+            ASSERT_FLOAT_EQ(outOfCoreMedian.at<float>(i, j), medTransmittance->at<float>(i, j));
+        }
+    }
+
+    PLImg::MaskGeneration generation(inCoreRetardation, medTransmittance);
+    generation.set_tthres(parameters.tthres);
+    generation.set_rthres(parameters.rthres);
+    generation.set_tref(parameters.tref);
+    generation.set_tback(parameters.tback);
+    generation.set_probability_parameters(parameters.rplus, parameters.rminus, parameters.tplus, parameters.tminus);
+    generation.set_background(float(maxTransmittance), float(minRetardation));
+    generation.removeBackground();
+    auto mask = generation.fullMask();
+    for(int i = 0; i < mask->rows; ++i) {
+        for(int j = 0; j < mask->cols; ++j) {
+            ASSERT_EQ(outOfCoreMask.at<uchar>(i, j), mask->at<uchar>(i, j));
+        }
+    }
+
+    // The inclination parameters of an in-core run are estimated from the masked median transmittance
+    auto maskedMedian = PLImg::cuda::filters::medianFilterMasked(original, generation.fullMask());
+    PLImg::Inclination inclination(maskedMedian, inCoreRetardation, generation.probabilityMask(), generation.fullMask());
+    auto inCoreInclination = inclination.inclination();
+    double sumOfDifferences = 0;
+    unsigned long long numberOfPixels = 0, numberOfLargeDifferences = 0;
+    for(int i = 0; i < mask->rows; ++i) {
+        for(int j = 0; j < mask->cols; ++j) {
+            if(mask->at<uchar>(i, j) > 0) {
+                float difference = std::abs(outOfCoreInclination.at<float>(i, j) - inCoreInclination->at<float>(i, j));
+                sumOfDifferences += difference;
+                numberOfLargeDifferences += difference > 5.0f;
+                ++numberOfPixels;
+            }
+        }
+    }
+    ASSERT_GT(numberOfPixels, 0);
+    ASSERT_LT(sumOfDifferences / double(numberOfPixels), 1.0);
+    ASSERT_LT(numberOfLargeDifferences, numberOfPixels / 100);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,79 @@
+//
+// Created by jreuter on 27.11.20.
+//
+
+#include "gtest/gtest.h"
+#include "parametercache.h"
+#include "inclination.h"
+#include <filesystem>
+
+TEST(ParameterCacheTest, TestStages) {
+    std::filesystem::remove("output/parametercache_test_1.h5");
+    PLImg::ParameterCache cache("output/parametercache_test_1.h5");
+    std::map<std::string, float> parameters;
+    std::string key = PLImg::ParameterCache::key("input;", {{"i_lower", 0.25f}});
+    ASSERT_NE(key, PLImg::ParameterCache::key("input;", {{"i_lower", 0.25000003f}}));
+    ASSERT_FALSE(cache.load("MaskGeneration", key, parameters));
+
+    cache.store("MaskGeneration", key, {{"r_thres", 0.1f}, {"i_upper", 0.9f}});
+    cache.store("Inclination", "other", {{"im", 0.3f}});
+    ASSERT_TRUE(cache.load("MaskGeneration", key, parameters));
+    ASSERT_EQ(parameters.size(), 2);
+    ASSERT_FLOAT_EQ(parameters.at("r_thres"), 0.1f);
+    ASSERT_FLOAT_EQ(parameters.at("i_upper"), 0.9f);
+
+    // Other keys don't load anything
+    ASSERT_FALSE(cache.load("MaskGeneration", "other", parameters));
+    ASSERT_FALSE(cache.load("Probability", key, parameters));
+
+    // Storing a stage again replaces all of its values and keeps the other stages
+    cache.store("MaskGeneration", key, {{"r_thres", 0.2f}});
+    ASSERT_TRUE(cache.load("MaskGeneration", key, parameters));
+    ASSERT_EQ(parameters.size(), 1);
+    ASSERT_FLOAT_EQ(parameters.at("r_thres"), 0.2f);
+    ASSERT_TRUE(cache.load("Inclination", "other", parameters));
+    ASSERT_FLOAT_EQ(parameters.at("im"), 0.3f);
+}
+
+TEST(ParameterCacheTest, TestInclination) {
+    std::filesystem::create_directories("output");
+    std::filesystem::remove("output/parametercache_test_2.h5");
+    PLImg::ParameterCache cache("output/parametercache_test_2.h5");
+    std::string key = PLImg::ParameterCache::key("input;");
+
+    // Manually set parameters are applied and not stored
+    PLImg::Inclination inclination;
+    std::map<std::string, float> manual = {{"im", 0.4f}, {"ic", -1.0f}};
+    std::map<std::string, float> loaded = cache.loadInclination(key, inclination, manual);
+    ASSERT_TRUE(loaded.empty());
+    ASSERT_FLOAT_EQ(inclination.T_c(), 0.4f);
+    inclination.set_TM(0.5f);
+    inclination.set_RrefHM(0.6f);
+    inclination.set_RrefLM(0.7f);
+    cache.storeInclination(key, inclination, manual, loaded);
+    std::map<std::string, float> parameters;
+    ASSERT_TRUE(cache.load("Inclination", key, parameters));
+    ASSERT_EQ(parameters.size(), 3);
+    ASSERT_EQ(parameters.count("im"), 0);
+    ASSERT_FLOAT_EQ(parameters.at("ic"), 0.5f);
+
+    // A later run loads the cached parameters unless they are set manually
+    PLImg::Inclination other;
+    loaded = cache.loadInclination(key, other, {{"rmax_gray", 0.2f}});
+    ASSERT_EQ(loaded.size(), 3);
+    ASSERT_FLOAT_EQ(other.T_M(), 0.5f);
+    ASSERT_FLOAT_EQ(other.R_refHM(), 0.6f);
+    ASSERT_FLOAT_EQ(other.R_refLM(), 0.2f);
+    ASSERT_TRUE(cache.loadInclination(key, other, {}, false).empty());
+    ASSERT_TRUE(cache.loadInclination("other", other, {}).empty());
+
+    // Unchanged parameters don't rewrite the stage
+    auto modified = std::filesystem::last_write_time("output/parametercache_test_2.h5");
+    cache.storeInclination(key, other, {{"im", 0.4f}, {"rmax_gray", 0.2f}}, loaded);
+    ASSERT_EQ(std::filesystem::last_write_time("output/parametercache_test_2.h5"), modified);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
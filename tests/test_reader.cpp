@@ -6,6 +6,8 @@
 #include "H5Cpp.h"
 #include <opencv2/core.hpp>
 #include "reader.h"
+#include "prefetcher.h"
+#include <tiffio.h>
 
 TEST(ReaderTest, TestFileExists) {
     ASSERT_TRUE(PLImg::Reader::fileExists("../../tests/files/demo.h5"));
@@ -34,6 +36,192 @@ TEST(ReaderTest, TestImageReadNIFTI) {
     ASSERT_EQ(image.type(), CV_32FC1);
 }
 
+TEST(ReaderTest, TestProbe) {
+    auto info = PLImg::Reader::probe("../../tests/files/demo.h5", "/pyramid/06");
+    ASSERT_EQ(info.dims.size(), 2);
+    ASSERT_EQ(info.dims.at(0), 195);
+    ASSERT_EQ(info.dims.at(1), 150);
+    ASSERT_EQ(info.type, CV_32FC1);
+    ASSERT_EQ(info.dtype, "float32");
+    ASSERT_EQ(info.numberOfPixels(), 195 * 150);
+
+    auto image = PLImg::Reader::imread("../../tests/files/demo.tiff");
+    info = PLImg::Reader::probe("../../tests/files/demo.tiff");
+    ASSERT_EQ(info.dims.at(0), image.rows);
+    ASSERT_EQ(info.dims.at(1), image.cols);
+    ASSERT_EQ(info.type, image.type());
+
+    image = PLImg::Reader::imread("../../tests/files/demo.nii");
+    info = PLImg::Reader::probe("../../tests/files/demo.nii");
+    ASSERT_EQ(info.dims.at(0), image.rows);
+    ASSERT_EQ(info.dims.at(1), image.cols);
+    ASSERT_EQ(info.type, image.type());
+}
+
+TEST(ReaderTest, TestProbeTiffDatatypes) {
+    auto writeTiff = [](const std::string& filename, uint16_t sampleFormat, uint16_t bitsPerSample) {
+        TIFF* tif = TIFFOpen(filename.c_str(), "w");
+        TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, 8);
+        TIFFSetField(tif, TIFFTAG_IMAGELENGTH, 6);
+        TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+        TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, bitsPerSample);
+        TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, sampleFormat);
+        TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, 2);
+        std::vector<unsigned char> row(8 * bitsPerSample / 8, 1);
+        for(uint32_t i = 0; i < 6; ++i) {
+            TIFFWriteScanline(tif, row.data(), i, 0);
+        }
+        TIFFClose(tif);
+    };
+
+    // The OpenCV type matches the size of the samples which are copied into the image
+    writeTiff("output/reader_test_float16.tiff", SAMPLEFORMAT_IEEEFP, 16);
+    auto info = PLImg::Reader::probe("output/reader_test_float16.tiff");
+    ASSERT_EQ(info.dtype, "float16");
+    ASSERT_EQ(info.type, CV_16FC1);
+    ASSERT_EQ(info.elementSize, CV_ELEM_SIZE(info.type));
+    auto strided = PLImg::Reader::imread("output/reader_test_float16.tiff", "/Image", 2);
+    ASSERT_EQ(strided.type(), CV_16FC1);
+    ASSERT_EQ(strided.rows, 3);
+    ASSERT_EQ(strided.cols, 4);
+
+    writeTiff("output/reader_test_int32.tiff", SAMPLEFORMAT_INT, 32);
+    info = PLImg::Reader::probe("output/reader_test_int32.tiff");
+    ASSERT_EQ(info.type, CV_32SC1);
+    ASSERT_EQ(info.elementSize, CV_ELEM_SIZE(info.type));
+
+    // Unsigned 32-bit integers have no OpenCV type
+    writeTiff("output/reader_test_uint32.tiff", SAMPLEFORMAT_UINT, 32);
+    ASSERT_THROW(PLImg::Reader::probe("output/reader_test_uint32.tiff"), std::runtime_error);
+    ASSERT_THROW(PLImg::Reader::imread("output/reader_test_uint32.tiff", "/Image", 2), std::runtime_error);
+}
+
+TEST(ReaderTest, TestImageReadStatistics) {
+    PLImg::ImageStatistics statistics;
+    auto image = PLImg::Reader::imread("../../tests/files/demo.tiff", "/Image", statistics);
+    ASSERT_EQ(image.type(), CV_32FC1);
+
+    double minVal, maxVal;
+    cv::minMaxIdx(image, &minVal, &maxVal);
+    ASSERT_FLOAT_EQ(statistics.min, minVal);
+    ASSERT_FLOAT_EQ(statistics.max, maxVal);
+    ASSERT_EQ(statistics.nonZero, cv::countNonZero(image));
+
+    ASSERT_EQ(statistics.histogram.rows, STATISTICS_NUMBER_OF_BINS);
+    ASSERT_EQ(cv::sum(statistics.histogram)[0], image.total());
+    ASSERT_EQ(statistics.bin(float(minVal)), 0);
+    ASSERT_EQ(statistics.bin(float(maxVal)), STATISTICS_NUMBER_OF_BINS - 1);
+    ASSERT_EQ(statistics.bin(float(maxVal) + 1.0f), -1);
+}
+
+TEST(ReaderTest, TestConvertStatistics) {
+    cv::Mat image(10, 10, CV_16UC1);
+    for(int i = 0; i < image.rows; ++i) {
+        for(int j = 0; j < image.cols; ++j) {
+            image.at<ushort>(i, j) = i * image.cols + j;
+        }
+    }
+
+    PLImg::ImageStatistics statistics;
+    auto converted = PLImg::Reader::convert(image, statistics);
+    ASSERT_EQ(converted.type(), CV_32FC1);
+    ASSERT_FLOAT_EQ(converted.at<float>(9, 9), 99.0f);
+    ASSERT_FLOAT_EQ(statistics.min, 0.0f);
+    ASSERT_FLOAT_EQ(statistics.max, 99.0f);
+    ASSERT_EQ(statistics.nonZero, 99);
+    ASSERT_EQ(statistics.histogram.at<int>(0), 1);
+    ASSERT_EQ(statistics.histogram.at<int>(STATISTICS_NUMBER_OF_BINS - 1), 1);
+
+    // Values of 8-bit and 16-bit images are counted while converting. The statistics match those of float images.
+    cv::Mat signedImage(image.rows, image.cols, CV_8SC1);
+    image.convertTo(signedImage, CV_8S, 1, -50);
+    cv::Mat floatImage;
+    signedImage.convertTo(floatImage, CV_32F);
+    PLImg::ImageStatistics signedStatistics, floatStatistics;
+    PLImg::Reader::convert(signedImage, signedStatistics);
+    PLImg::Reader::convert(floatImage, floatStatistics);
+    ASSERT_FLOAT_EQ(signedStatistics.min, -50.0f);
+    ASSERT_FLOAT_EQ(signedStatistics.max, 49.0f);
+    ASSERT_EQ(signedStatistics.nonZero, floatStatistics.nonZero);
+    ASSERT_EQ(cv::countNonZero(signedStatistics.histogram != floatStatistics.histogram), 0);
+}
+
+TEST(ReaderTest, TestImageReadStrided) {
+    for(unsigned stride : {1, 2, 3, 7}) {
+        for(const std::string& filename : {"../../tests/files/demo.tiff", "../../tests/files/demo.nii"}) {
+            auto image = PLImg::Reader::imread(filename);
+            auto strided = PLImg::Reader::imread(filename, "/Image", stride);
+            ASSERT_EQ(strided.rows, (image.rows + stride - 1) / stride);
+            ASSERT_EQ(strided.cols, (image.cols + stride - 1) / stride);
+            ASSERT_EQ(strided.type(), image.type());
+            for(int i = 0; i < strided.rows; ++i) {
+                for(int j = 0; j < strided.cols; ++j) {
+                    ASSERT_FLOAT_EQ(strided.at<float>(i, j), image.at<float>(i * stride, j * stride));
+                }
+            }
+        }
+
+        auto image = PLImg::Reader::imread("../../tests/files/demo.h5", "/pyramid/06");
+        auto strided = PLImg::Reader::imread("../../tests/files/demo.h5", "/pyramid/06", stride);
+        ASSERT_EQ(cv::norm(strided, PLImg::Reader::subsample(image, stride), cv::NORM_INF), 0);
+    }
+}
+
+TEST(ReaderTest, TestPrefetcher) {
+    std::vector<std::vector<PLImg::PrefetchInput>> sections = {
+            {{"../../tests/files/demo.tiff", "/Image", true}, {"../../tests/files/demo.nii"}},
+            {{"../../tests/files/demo.h5", "/pyramid/06"}, {"../../tests/files/demo.tiff"}},
+            {{"../../tests/files/demo.nii", "/Image", true}}
+    };
+
+    for(unsigned depth : {0, 1, 2}) {
+        PLImg::Prefetcher prefetcher(sections, depth);
+        for(const auto& inputs : sections) {
+            ASSERT_TRUE(prefetcher.hasNext());
+            auto section = prefetcher.next();
+            ASSERT_EQ(section.images.size(), inputs.size());
+            for(unsigned i = 0; i < inputs.size(); ++i) {
+                auto image = PLImg::Reader::imread(inputs.at(i).filename, inputs.at(i).dataset);
+                ASSERT_EQ(section.images.at(i)->rows, image.rows);
+                ASSERT_EQ(section.images.at(i)->cols, image.cols);
+                ASSERT_EQ(cv::norm(*section.images.at(i), image, cv::NORM_INF), 0);
+                ASSERT_EQ(section.statistics.at(i).empty(), !inputs.at(i).statistics);
+            }
+        }
+        ASSERT_FALSE(prefetcher.hasNext());
+        ASSERT_THROW(prefetcher.next(), std::out_of_range);
+    }
+}
+
+TEST(ReaderTest, TestPrefetcherSource) {
+    // Sections are requested from the source only when they are read ahead
+    std::vector<std::string> files = {"../../tests/files/demo.tiff", "../../tests/files/demo.nii"};
+    size_t requested = 0;
+    PLImg::Prefetcher prefetcher([&](std::vector<PLImg::PrefetchInput>& section) {
+        if(requested == files.size()) {
+            return false;
+        }
+        section = {{files.at(requested++)}};
+        return true;
+    }, 1);
+    for(const auto& file : files) {
+        ASSERT_TRUE(prefetcher.hasNext());
+        auto section = prefetcher.next();
+        ASSERT_LE(requested, files.size());
+        ASSERT_EQ(cv::norm(*section.images.at(0), PLImg::Reader::imread(file), cv::NORM_INF), 0);
+    }
+    ASSERT_FALSE(prefetcher.hasNext());
+    ASSERT_THROW(prefetcher.next(), std::out_of_range);
+}
+
+TEST(ReaderTest, TestPrefetcherMissingFile) {
+    std::vector<std::vector<PLImg::PrefetchInput>> sections(1);
+    sections.at(0).push_back({"../../tests/files/missing.h5"});
+    PLImg::Prefetcher prefetcher(sections, 1);
+    ASSERT_THROW(prefetcher.next(), std::filesystem::filesystem_error);
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -0,0 +1,105 @@
+//
+// Created by jreuter on 27.11.20.
+//
+
+#include "gtest/gtest.h"
+#include "scheduler.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+TEST(SchedulerTest, TestScheduler) {
+    // Two sections fit into the memory budget at the same time
+    PLImg::SectionScheduler scheduler(100, 4);
+    std::vector<size_t> order;
+    std::atomic<int> processed(0);
+    scheduler.run(6, [](size_t) { return 40ULL; }, [&](size_t section) {
+        unsigned threads = scheduler.rebalance();
+        ASSERT_TRUE(threads == 2 || threads == 4);
+        std::this_thread::sleep_for(std::chrono::milliseconds(section % 2 == 0 ? 50 : 10));
+        scheduler.inOrder("write", section, [&]() { order.push_back(section); });
+        ++processed;
+    });
+    ASSERT_EQ(processed, 6);
+    ASSERT_EQ(scheduler.peakSections(), 2);
+    ASSERT_EQ(scheduler.peakMemory(), 80);
+    ASSERT_EQ(scheduler.runningSections(), 0);
+    ASSERT_EQ(order, std::vector<size_t>({0, 1, 2, 3, 4, 5}));
+
+    // Sections larger than the budget are processed alone
+    scheduler.run(3, [](size_t) { return 1000ULL; }, [&](size_t) {
+        ASSERT_EQ(scheduler.runningSections(), 1);
+        ASSERT_EQ(scheduler.rebalance(), 4);
+    });
+    ASSERT_EQ(scheduler.peakSections(), 1);
+
+    // Sections skipping a stage don't block the following sections
+    order.clear();
+    scheduler.run(4, [](size_t) { return 10ULL; }, [&](size_t section) {
+        if(section != 1) {
+            scheduler.inOrder("write", section, [&]() { order.push_back(section); });
+        }
+    });
+    ASSERT_EQ(order, std::vector<size_t>({0, 2, 3}));
+
+    // No further sections are started after an error
+    std::atomic<size_t> started(0);
+    ASSERT_THROW(scheduler.run(20, [](size_t) { return 40ULL; }, [&](size_t section) {
+        ++started;
+        if(section == 2) {
+            throw std::runtime_error("Section failed");
+        }
+        scheduler.inOrder("write", section, []() {});
+    }), std::runtime_error);
+    ASSERT_LT(started, 20);
+
+    // Failed estimates abort the run after the running sections are finished
+    std::atomic<size_t> finished(0);
+    ASSERT_THROW(scheduler.run(10, [](size_t section) {
+        if(section == 3) {
+            throw std::runtime_error("Estimate failed");
+        }
+        return 10ULL;
+    }, [&](size_t) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        ++finished;
+    }), std::runtime_error);
+    ASSERT_EQ(finished, 3);
+    ASSERT_EQ(scheduler.runningSections(), 0);
+    ASSERT_EQ(scheduler.estimatedMemory(2), 10);
+
+    // Sections are only claimed while a slot is free
+    std::atomic<unsigned> running(0);
+    std::vector<size_t> claimed;
+    scheduler.run([&](size_t section) {
+        EXPECT_LT(scheduler.runningSections(), 4);
+        if(section >= 12) {
+            return false;
+        }
+        claimed.push_back(section);
+        return true;
+    }, [](size_t) { return 10ULL; }, [&](size_t) {
+        EXPECT_LE(++running, 4);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        --running;
+    });
+    ASSERT_EQ(claimed.size(), 12);
+    ASSERT_EQ(scheduler.peakSections(), 4);
+}
+
+TEST(SchedulerTest, TestMemory) {
+    // The memory of the process is measured independent of the estimates
+    PLImg::SectionScheduler scheduler(100, 4);
+    ASSERT_EQ(scheduler.memoryBudget(), 100);
+    ASSERT_TRUE(scheduler.memoryPressure());
+    ASSERT_GT(PLImg::SectionScheduler::residentMemory(), 0);
+    ASSERT_GE(PLImg::SectionScheduler::peakResidentMemory(), PLImg::SectionScheduler::residentMemory());
+
+    PLImg::SectionScheduler unlimited(~0ull, 4);
+    ASSERT_FALSE(unlimited.memoryPressure());
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,53 @@
+//
+// Created by jreuter on 27.11.20.
+//
+
+#include "gtest/gtest.h"
+#include <opencv2/core.hpp>
+#include "scratchimage.h"
+#include <filesystem>
+
+TEST(ScratchImageTest, TestSpillRestore) {
+    cv::Mat testMat(300, 200, CV_32FC1);
+    for(int i = 0; i < testMat.rows; ++i) {
+        for(int j = 0; j < testMat.cols; ++j) {
+            testMat.at<float>(i, j) = i * 0.5f + j;
+        }
+    }
+    std::filesystem::remove_all("output/scratch");
+
+    PLImg::ScratchImage scratch;
+    ASSERT_FALSE(scratch.spilled());
+    ASSERT_THROW(scratch.restore(), std::runtime_error);
+    auto image = std::make_shared<cv::Mat>(testMat.clone());
+    scratch.spill(image, "output/scratch");
+    ASSERT_EQ(image, nullptr);
+    ASSERT_TRUE(scratch.spilled());
+    ASSERT_EQ(scratch.size(), 300 * 200 * sizeof(float));
+    auto other = std::make_shared<cv::Mat>(testMat.clone());
+    ASSERT_THROW(scratch.spill(other, "output/scratch"), std::runtime_error);
+    ASSERT_NE(other, nullptr);
+
+    // The scratch file is removed as soon as the image is mapped again
+    image = scratch.restore();
+    ASSERT_FALSE(scratch.spilled());
+    ASSERT_TRUE(std::filesystem::is_empty("output/scratch"));
+    ASSERT_EQ(cv::norm(*image, testMat, cv::NORM_INF), 0);
+
+    // Regions of larger images are written row by row
+    cv::Rect region(10, 20, 50, 60);
+    image = std::make_shared<cv::Mat>(testMat(region));
+    scratch.spill(image, "output/scratch");
+    image = scratch.restore();
+    ASSERT_EQ(cv::norm(*image, testMat(region).clone(), cv::NORM_INF), 0);
+
+    scratch.spill(other, "output/scratch");
+    scratch.discard();
+    ASSERT_FALSE(scratch.spilled());
+    ASSERT_TRUE(std::filesystem::is_empty("output/scratch"));
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
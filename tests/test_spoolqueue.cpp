@@ -0,0 +1,61 @@
+//
+// Created by jreuter on 27.11.20.
+//
+
+#include "gtest/gtest.h"
+#include "spoolqueue.h"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+
+TEST(SpoolQueueTest, TestQueue) {
+    std::filesystem::remove_all("spool_test");
+    PLImg::SpoolQueue queue("spool_test");
+    for(const char* subdirectory : {"incoming", "running", "done", "failed"}) {
+        ASSERT_TRUE(std::filesystem::is_directory(std::string("spool_test/") + subdirectory));
+    }
+    PLImg::SpoolJob job;
+    ASSERT_FALSE(queue.take(job));
+
+    std::ofstream("spool_test/incoming/b.job") << "--itra\r\nb Transmittance.h5\n\n# comment\n--detailed\n";
+    std::ofstream("spool_test/incoming/a.job") << "--itra\na.h5\n";
+    // Files which are still written don't end with .job
+    std::ofstream("spool_test/incoming/c.tmp") << "--itra\n";
+    auto now = std::filesystem::file_time_type::clock::now();
+    std::filesystem::last_write_time("spool_test/incoming/a.job", now - std::chrono::seconds(10));
+    std::filesystem::last_write_time("spool_test/incoming/b.job", now - std::chrono::seconds(5));
+
+    // The oldest job is taken first
+    ASSERT_TRUE(queue.take(job));
+    ASSERT_EQ(job.name, "a.job");
+    ASSERT_EQ(job.arguments, std::vector<std::string>({"--itra", "a.h5"}));
+    ASSERT_TRUE(std::filesystem::exists(job.path));
+    ASSERT_TRUE(std::filesystem::exists(job.logPath));
+    ASSERT_FALSE(std::filesystem::exists("spool_test/incoming/a.job"));
+    std::ofstream(job.logPath, std::ios::app) << "Processed" << std::endl;
+    queue.finish(job, true);
+    ASSERT_TRUE(std::filesystem::exists("spool_test/done/a.job"));
+    ASSERT_TRUE(std::filesystem::exists("spool_test/done/a.log"));
+    ASSERT_FALSE(std::filesystem::exists("spool_test/running/a.job"));
+
+    ASSERT_TRUE(queue.take(job));
+    ASSERT_EQ(job.name, "b.job");
+    ASSERT_EQ(job.arguments, std::vector<std::string>({"--itra", "b Transmittance.h5", "--detailed"}));
+
+    // Jobs of an interrupted run are queued again
+    ASSERT_EQ(queue.recover(), 1);
+    ASSERT_TRUE(std::filesystem::exists("spool_test/incoming/b.job"));
+    ASSERT_FALSE(std::filesystem::exists("spool_test/running/b.log"));
+    ASSERT_TRUE(queue.take(job));
+    queue.finish(job, false);
+    ASSERT_TRUE(std::filesystem::exists("spool_test/failed/b.job"));
+    ASSERT_FALSE(queue.take(job));
+    ASSERT_TRUE(std::filesystem::exists("spool_test/incoming/c.tmp"));
+
+    ASSERT_THROW(PLImg::SpoolQueue::readArguments("spool_test/missing.job"), std::runtime_error);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
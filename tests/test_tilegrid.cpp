@@ -0,0 +1,40 @@
+//
+// Created by jreuter on 27.11.20.
+//
+
+#include "gtest/gtest.h"
+#include "tilegrid.h"
+#include <stdexcept>
+
+TEST(TileGridTest, TestTiles) {
+    PLImg::TileGrid grid(5000, 3000, 2048);
+    ASSERT_EQ(grid.size(), 6);
+    ASSERT_EQ(grid.tile(0), cv::Rect(0, 0, 2048, 2048));
+    ASSERT_EQ(grid.tile(1), cv::Rect(2048, 0, 952, 2048));
+    ASSERT_EQ(grid.tile(5), cv::Rect(2048, 4096, 952, 904));
+    ASSERT_THROW(grid.tile(6), std::out_of_range);
+
+    // The halo is clipped to the image
+    ASSERT_EQ(grid.padded(0, 10), cv::Rect(0, 0, 2058, 2058));
+    ASSERT_EQ(grid.inner(0, 10), cv::Rect(0, 0, 2048, 2048));
+    ASSERT_EQ(grid.padded(3, 10), cv::Rect(2038, 2038, 962, 2068));
+    ASSERT_EQ(grid.inner(3, 10), cv::Rect(10, 10, 952, 2048));
+
+    // The tiles cover every pixel exactly once
+    unsigned long long pixels = 0;
+    for(size_t i = 0; i < grid.size(); ++i) {
+        pixels += grid.tile(i).area();
+    }
+    ASSERT_EQ(pixels, 5000ull * 3000ull);
+
+    // Tiles are aligned to the chunks if they fit into the budget
+    ASSERT_EQ(PLImg::TileGrid::tileSize(40ull * 5000 * 5000, 40, 10, 2048), 4096);
+    ASSERT_EQ(PLImg::TileGrid::tileSize(40ull * 1000 * 1000, 40, 10, 2048), 768);
+    ASSERT_EQ(PLImg::TileGrid::tileSize(1024, 40, 10, 2048), 256);
+    ASSERT_THROW(PLImg::TileGrid(10, 10, 0), std::invalid_argument);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -162,6 +162,41 @@ TEST(TestToolbox, TestMedianFilterMasked) {
     ASSERT_TRUE(true);
 }
 
+TEST(TestToolbox, TestFusedMedianFilter) {
+    auto testImage = cv::imread("../../tests/files/median_filter/median_input.tiff", cv::IMREAD_ANYDEPTH);
+    auto testImagePtr = std::make_shared<cv::Mat>(testImage);
+    auto mask = std::make_shared<cv::Mat>(testImage.rows, testImage.cols, CV_8UC1);
+    for(int i = 0; i < mask->rows; ++i) {
+        for(int j = 0; j < mask->cols; ++j) {
+            mask->at<uchar>(i, j) = (i / 7 + j / 9) % 2;
+        }
+    }
+    auto expectedMedian = PLImg::cuda::filters::medianFilter(testImagePtr);
+    auto expectedMaskedMedian = PLImg::cuda::filters::medianFilterMasked(testImagePtr, mask);
+
+    // Both filters have to match the separate filters, whether the image is kept on the GPU, released in between or not kept
+    for(int run = 0; run < 3; ++run) {
+        PLImg::cuda::keepBuffers(run == 1);
+        PLImg::cuda::filters::FusedMedianFilter filter(testImagePtr);
+        auto median = filter.median();
+        if(run == 2) {
+            PLImg::cuda::releaseParkedImages();
+            ASSERT_EQ(PLImg::cuda::releaseParkedImages(), 0);
+        }
+        auto maskedMedian = filter.maskedMedian(mask);
+        ASSERT_EQ(PLImg::cuda::releaseParkedImages(), 0);
+        ASSERT_EQ(median->size(), testImage.size());
+        ASSERT_EQ(maskedMedian->size(), testImage.size());
+        for(int i = 0; i < testImage.rows; ++i) {
+            for(int j = 0; j < testImage.cols; ++j) {
+                ASSERT_FLOAT_EQ(median->at<float>(i, j), expectedMedian->at<float>(i, j));
+                ASSERT_FLOAT_EQ(maskedMedian->at<float>(i, j), expectedMaskedMedian->at<float>(i, j));
+            }
+        }
+    }
+    PLImg::cuda::keepBuffers(false);
+}
+
 TEST(TestToolbox, TestConnectedComponents) {
     uint maxNumber;
     cv::Mat exampleMask = (cv::Mat1s(7, 11) <<
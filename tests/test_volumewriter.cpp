@@ -0,0 +1,116 @@
+//
+// Created by jreuter on 27.11.20.
+//
+
+#include "gtest/gtest.h"
+#include "H5Cpp.h"
+#include <opencv2/core.hpp>
+#include "volumewriter.h"
+#include <cmath>
+#ifdef PLIMG_USE_MPI
+    #include <mpi.h>
+#endif
+
+
+TEST(VolumeWriterTest, TestAssignSlices) {
+    ASSERT_EQ(PLImg::HDF5VolumeWriter::assignSlices(5, 0, 2), std::vector<long long>({0, 2, 4}));
+    ASSERT_EQ(PLImg::HDF5VolumeWriter::assignSlices(5, 1, 2), std::vector<long long>({1, 3, -1}));
+    ASSERT_EQ(PLImg::HDF5VolumeWriter::assignSlices(2, 2, 4), std::vector<long long>({-1}));
+    // Blocks of neighbouring slices stay on one rank
+    ASSERT_EQ(PLImg::HDF5VolumeWriter::assignSlices(7, 0, 2, 2), std::vector<long long>({0, 1, 4, 5}));
+    ASSERT_EQ(PLImg::HDF5VolumeWriter::assignSlices(7, 1, 2, 2), std::vector<long long>({2, 3, 6, -1}));
+    ASSERT_EQ(PLImg::HDF5VolumeWriter::assignSlices(5, 0, 2, 1), PLImg::HDF5VolumeWriter::assignSlices(5, 0, 2));
+    ASSERT_THROW(PLImg::HDF5VolumeWriter::assignSlices(5, 0, 2, 0), std::invalid_argument);
+}
+
+TEST(VolumeWriterTest, TestVolume) {
+    std::vector<cv::Mat> sections;
+    for(int slice = 0; slice < 3; ++slice) {
+        cv::Mat section(100, slice == 2 ? 80 : 120, CV_32FC1);
+        for(int i = 0; i < section.rows; ++i) {
+            for(int j = 0; j < section.cols; ++j) {
+                section.at<float>(i, j) = slice * 1000 + i + j * 0.5f;
+            }
+        }
+        sections.push_back(section);
+    }
+
+    // Each rank writes its own slices. Without MPI, the only rank writes all of them.
+    PLImg::HDF5VolumeWriter writer;
+    ASSERT_GE(writer.rank(), 0);
+    ASSERT_LT(writer.rank(), writer.size());
+    writer.set_path("output/volumewriter_test_1.h5");
+    writer.create_volume("/Inclination", 4, 100, 120, CV_32FC1);
+    for(long long slice : PLImg::HDF5VolumeWriter::assignSlices(3, writer.rank(), writer.size())) {
+        writer.write_slice("/Inclination", slice, sections.at(slice));
+        writer.write_slice_attribute("/Inclination", "im", slice, slice * 0.5);
+        writer.write_slice_attribute("/Inclination", "source", slice, "section_" + std::to_string(slice));
+    }
+    // Rounds without a section select nothing
+    writer.write_slice("/Inclination", -1, cv::Mat());
+    writer.write_attribute("/Inclination", "modality", "Inclination");
+    ASSERT_THROW(writer.write_slice("/Inclination", 4, sections.at(0)), std::runtime_error);
+    ASSERT_THROW(writer.write_slice("/Inclination", 0, cv::Mat(200, 120, CV_32FC1)), std::runtime_error);
+    ASSERT_THROW(writer.write_slice("/Inclination", 0, cv::Mat(100, 120, CV_8UC1)), std::runtime_error);
+    ASSERT_THROW(writer.create_volume("/Inclination", 3, 100, 120, CV_32FC1), std::runtime_error);
+    // An error of a single rank is thrown on all ranks. Otherwise the others would wait in the next collective call.
+    if(writer.rank() == 0) {
+        ASSERT_THROW(writer.write_slice("/Inclination", 4, sections.at(0)), std::runtime_error);
+    } else {
+        ASSERT_THROW(writer.write_slice("/Inclination", -1, cv::Mat()), std::runtime_error);
+    }
+    ASSERT_THROW(writer.create_volume("/Inclination", writer.rank() == 0 ? 3 : 4, 100, 120, CV_32FC1), std::runtime_error);
+    ASSERT_THROW(writer.write_attribute(writer.rank() == 0 ? "/Missing" : "/Inclination", "modality", "Inclination"),
+                 std::runtime_error);
+    writer.close();
+    ASSERT_EQ(writer.path(), "");
+
+    H5::H5File file("output/volumewriter_test_1.h5", H5F_ACC_RDONLY);
+    H5::DataSet dset = file.openDataSet("/Inclination");
+    hsize_t dims[3];
+    dset.getSpace().getSimpleExtentDims(dims);
+    ASSERT_EQ(dims[0], 4);
+    ASSERT_EQ(dims[1], 100);
+    ASSERT_EQ(dims[2], 120);
+    for(int slice = 0; slice < 3; ++slice) {
+        cv::Mat image(100, 120, CV_32FC1);
+        H5::DataSpace fileSpace = dset.getSpace();
+        hsize_t offset[3] = {hsize_t(slice), 0, 0};
+        hsize_t count[3] = {1, 100, 120};
+        fileSpace.selectHyperslab(H5S_SELECT_SET, count, offset);
+        dset.read(image.data, H5::PredType::NATIVE_FLOAT, H5::DataSpace(3, count), fileSpace);
+        cv::Rect region(0, 0, sections.at(slice).cols, sections.at(slice).rows);
+        ASSERT_EQ(cv::norm(image(region), sections.at(slice), cv::NORM_INF), 0);
+    }
+
+    std::vector<double> im(4);
+    dset.openAttribute("im").read(H5::PredType::NATIVE_DOUBLE, im.data());
+    ASSERT_FLOAT_EQ(im.at(0), 0);
+    ASSERT_FLOAT_EQ(im.at(1), 0.5);
+    ASSERT_FLOAT_EQ(im.at(2), 1);
+    ASSERT_TRUE(std::isnan(im.at(3)));
+
+    H5::Attribute source = dset.openAttribute("source");
+    std::vector<char*> names(4);
+    source.read(source.getDataType(), names.data());
+    ASSERT_EQ(std::string(names.at(1)), "section_1");
+    ASSERT_EQ(std::string(names.at(3)), "");
+    H5Dvlen_reclaim(source.getDataType().getId(), source.getSpace().getId(), H5P_DEFAULT, names.data());
+
+    std::string modality;
+    H5::Attribute modalityAttribute = dset.openAttribute("modality");
+    modalityAttribute.read(modalityAttribute.getDataType(), modality);
+    ASSERT_EQ(modality, "Inclination");
+}
+
+int main(int argc, char** argv) {
+    #ifdef PLIMG_USE_MPI
+        MPI_Init(&argc, &argv);
+    #endif
+    ::testing::InitGoogleTest(&argc, argv);
+    int result = RUN_ALL_TESTS();
+    #ifdef PLIMG_USE_MPI
+        MPI_Finalize();
+    #endif
+    return result;
+}
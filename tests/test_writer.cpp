@@ -7,6 +7,12 @@
 #include <opencv2/core.hpp>
 #include <opencv2/hdf.hpp>
 #include "writer.h"
+#include "hdf5configuration.h"
+#include "zarr.h"
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
 
 
 TEST(WriterTest, TestEmpty) {
@@ -98,7 +104,562 @@ TEST(WriterTest, TestCreateGroup) {
     ASSERT_TRUE(file->hlexists("/demogroup"));
 }
 
+TEST(WriterTest, TestHDF5Configuration) {
+    ASSERT_EQ(PLImg::HDF5Configuration::parseSize("512"), 512);
+    ASSERT_EQ(PLImg::HDF5Configuration::parseSize("64K"), 64 * 1024);
+    ASSERT_EQ(PLImg::HDF5Configuration::parseSize("16M"), 16 * 1024 * 1024);
+    ASSERT_EQ(PLImg::HDF5Configuration::parseSize("1G"), 1024 * 1024 * 1024);
+    ASSERT_EQ(PLImg::HDF5Configuration::parseSize("8B"), 8);
+    ASSERT_THROW(PLImg::HDF5Configuration::parseSize("1X"), std::invalid_argument);
+    ASSERT_THROW(PLImg::HDF5Configuration::parseSize("64Kfoo"), std::invalid_argument);
+    ASSERT_THROW(PLImg::HDF5Configuration::parseSize("64KB"), std::invalid_argument);
+    ASSERT_THROW(PLImg::HDF5Configuration::parseSize("-1"), std::invalid_argument);
+    ASSERT_THROW(PLImg::HDF5Configuration::parseSize(" 1"), std::invalid_argument);
+    ASSERT_THROW(PLImg::HDF5Configuration::parseSize(""), std::invalid_argument);
+    ASSERT_THROW(PLImg::HDF5Configuration::parseSize("17179869184G"), std::invalid_argument);
+
+    #ifdef __GNUC__
+        // The name of an invalid environment variable is part of the error
+        setenv("PLIMG_HDF5_CHUNK_CACHE_SIZE", "-1", 1);
+        try {
+            PLImg::HDF5Configuration::fromEnvironment();
+            FAIL();
+        } catch(const std::invalid_argument& e) {
+            ASSERT_NE(std::string(e.what()).find("PLIMG_HDF5_CHUNK_CACHE_SIZE"), std::string::npos);
+        }
+        setenv("PLIMG_HDF5_CHUNK_CACHE_SIZE", "16M", 1);
+        ASSERT_EQ(PLImg::HDF5Configuration::fromEnvironment().chunkCacheSize, 16 * 1024 * 1024);
+        unsetenv("PLIMG_HDF5_CHUNK_CACHE_SIZE");
+    #endif
+
+    cv::Mat testMat(10, 10, CV_32FC1);
+    for(int i = 0; i < testMat.rows; ++i) {
+        for(int j = 0; j < testMat.cols; ++j) {
+            testMat.at<float>(i, j) = i * testMat.cols + j;
+        }
+    }
+    PLImg::HDF5Writer writer;
+    // File written with the default configuration
+    PLImg::HDF5Configuration::setGlobal(PLImg::HDF5Configuration());
+    writer.set_path("output/writer_test_4_default.h5");
+    writer.write_dataset("/Image", testMat);
+    writer.close();
+
+    PLImg::HDF5Configuration configuration;
+    configuration.chunkCacheSize = 64 * 1024 * 1024;
+    configuration.chunkCacheSlots = 12421;
+    configuration.metadataCacheSize = 4 * 1024 * 1024;
+    configuration.alignment = 4096;
+    configuration.pageBufferSize = 1024 * 1024;
+    configuration.driver = "core";
+    configuration.allocTime = "early";
+    configuration.fillTime = "never";
+    PLImg::HDF5Configuration::setGlobal(configuration);
+    writer.set_path("output/writer_test_4.h5");
+    writer.write_dataset("/Image", testMat);
+    writer.close();
+
+    // Files written with the default configuration have to be readable with a page buffer
+    auto image = PLImg::Reader::imread("output/writer_test_4_default.h5", "/Image");
+    ASSERT_EQ(cv::norm(image, testMat, cv::NORM_INF), 0);
+    image = PLImg::Reader::imread("output/writer_test_4.h5", "/Image");
+    ASSERT_EQ(cv::norm(image, testMat, cv::NORM_INF), 0);
+
+    {
+        H5::H5File file("output/writer_test_4.h5", H5F_ACC_RDONLY);
+        H5::DSetCreatPropList plist = file.openDataSet("/Image").getCreatePlist();
+        ASSERT_EQ(plist.getAllocTime(), H5D_ALLOC_TIME_EARLY);
+        ASSERT_EQ(plist.getFillTime(), H5D_FILL_TIME_NEVER);
+    }
+    configuration.fillTime = "sometimes";
+    ASSERT_THROW(configuration.datasetCreationPropertyList(), std::invalid_argument);
+
+    PLImg::HDF5Configuration::setGlobal(PLImg::HDF5Configuration());
+    image = PLImg::Reader::imread("output/writer_test_4.h5", "/Image");
+    ASSERT_EQ(cv::norm(image, testMat, cv::NORM_INF), 0);
+}
+
+TEST(WriterTest, TestCompression) {
+    // Image with multiple chunks and a partial chunk at the border
+    cv::Mat floatMat(3000, 2100, CV_32FC1);
+    cv::Mat maskMat(3000, 2100, CV_8UC1);
+    for(int i = 0; i < floatMat.rows; ++i) {
+        for(int j = 0; j < floatMat.cols; ++j) {
+            floatMat.at<float>(i, j) = float(i % 97) * 0.25f + float(j);
+            maskMat.at<unsigned char>(i, j) = (i / 100 + j / 100) % 2 * 255;
+        }
+    }
+
+    PLImg::HDF5Compression compression;
+    compression.filter = "deflate";
+    compression.shuffle = true;
+    PLImg::HDF5Writer writer;
+    writer.set_compression(compression);
+    writer.set_path("output/writer_test_5.h5");
+    writer.write_dataset("/Image", floatMat);
+    writer.write_dataset("/Mask", maskMat);
+    writer.close();
+
+    auto image = PLImg::Reader::imread("output/writer_test_5.h5", "/Image");
+    ASSERT_EQ(cv::norm(image, floatMat, cv::NORM_INF), 0);
+    image = PLImg::Reader::imread("output/writer_test_5.h5", "/Mask");
+    ASSERT_EQ(cv::norm(image, maskMat, cv::NORM_INF), 0);
+
+    auto info = PLImg::Reader::probe("output/writer_test_5.h5", "/Image");
+    ASSERT_EQ(info.layout, "chunked");
+    ASSERT_EQ(info.chunkDims, std::vector<unsigned long long>({2048, 2048}));
+    ASSERT_NE(std::find(info.filters.begin(), info.filters.end(), "shuffle"), info.filters.end());
+    ASSERT_NE(std::find(info.filters.begin(), info.filters.end(), "deflate"), info.filters.end());
+
+    // Filters which are applied by the HDF5 library
+    compression.filter = "none";
+    compression.shuffle = false;
+    compression.scaleOffset = 2;
+    writer.set_compression(compression);
+    writer.set_path("output/writer_test_6.h5");
+    writer.write_dataset("/Image", floatMat);
+    writer.close();
+    image = PLImg::Reader::imread("output/writer_test_6.h5", "/Image");
+    ASSERT_LE(cv::norm(image, floatMat, cv::NORM_INF), 0.01);
+
+    // The range of the level depends on the filter
+    compression.scaleOffset = -1;
+    compression.filter = "deflate";
+    compression.level = 9;
+    ASSERT_NO_THROW(writer.set_compression(compression));
+    compression.level = 10;
+    ASSERT_THROW(writer.set_compression(compression), std::invalid_argument);
+    compression.filter = "zstd";
+    compression.level = 22;
+    ASSERT_NO_THROW(compression.validate());
+    compression.level = 23;
+    ASSERT_THROW(writer.set_compression(compression), std::invalid_argument);
+    compression.filter = "gzip";
+    compression.level = 4;
+    ASSERT_THROW(writer.set_compression(compression), std::invalid_argument);
+}
+
+TEST(WriterTest, TestReopenAfterClose) {
+    cv::Mat testMat(10, 10, CV_8UC1, cv::Scalar(1));
+    PLImg::HDF5Writer writer;
+    writer.set_durable(true);
+    writer.set_path("output/writer_test_7.h5");
+    writer.write_dataset("/Image", testMat);
+    writer.close();
+    ASSERT_EQ(writer.path(), "");
+
+    // The same file has to be opened again after it was closed
+    writer.set_path("output/writer_test_7.h5");
+    writer.write_dataset("/Second", testMat);
+    writer.write_attribute("/Second", "value", 2);
+    writer.close();
+
+    auto image = PLImg::Reader::imread("output/writer_test_7.h5", "/Image");
+    ASSERT_EQ(cv::norm(image, testMat, cv::NORM_INF), 0);
+    image = PLImg::Reader::imread("output/writer_test_7.h5", "/Second");
+    ASSERT_EQ(cv::norm(image, testMat, cv::NORM_INF), 0);
+
+    // Existing files which can't be opened for writing are reported to the caller
+    std::ofstream("output/writer_test_7_invalid.h5") << "No HDF5 file";
+    ASSERT_THROW(writer.set_path("output/writer_test_7_invalid.h5"), std::runtime_error);
+    ASSERT_EQ(writer.path(), "");
+    ASSERT_THROW(writer.set_path("output/writer_test_7_invalid.h5"), std::runtime_error);
+}
+
+TEST(WriterTest, TestAsynchronous) {
+    auto testMat = std::make_shared<cv::Mat>(100, 100, CV_32FC1);
+    for(int i = 0; i < testMat->rows; ++i) {
+        for(int j = 0; j < testMat->cols; ++j) {
+            testMat->at<float>(i, j) = i * testMat->cols + j;
+        }
+    }
+
+    PLImg::HDF5Writer writer;
+    writer.set_asynchronous(1);
+    writer.set_path("output/writer_test_8.h5");
+    writer.write_dataset("/Image", testMat, true);
+    writer.write_attribute("/Image", "value", 1);
+    writer.write_dataset("/Second", *testMat);
+    auto future = writer.close();
+    ASSERT_NO_THROW(future.get());
+    ASSERT_NO_THROW(writer.wait());
+
+    auto image = PLImg::Reader::imread("output/writer_test_8.h5", "/Image");
+    ASSERT_EQ(cv::norm(image, *testMat, cv::NORM_INF), 0);
+    image = PLImg::Reader::imread("output/writer_test_8.h5", "/Second");
+    ASSERT_EQ(cv::norm(image, *testMat, cv::NORM_INF), 0);
+
+    // A copy queued for writing keeps the values of the image at the time it was queued
+    writer.set_path("output/writer_test_8.h5");
+    writer.write_dataset("/Large", cv::Mat(2000, 2000, CV_32FC1, cv::Scalar(1)));
+    auto modifiedMat = std::make_shared<cv::Mat>(testMat->clone());
+    writer.write_dataset("/Copy", std::make_shared<cv::Mat>(modifiedMat->clone()));
+    modifiedMat->setTo(-1);
+    writer.close().get();
+    image = PLImg::Reader::imread("output/writer_test_8.h5", "/Copy");
+    ASSERT_EQ(cv::norm(image, *testMat, cv::NORM_INF), 0);
+
+    // Errors of the background thread are reported when the file is closed
+    writer.set_path("output/writer_test_8.h5");
+    writer.write_dataset("/Image", cv::Mat(10, 10, CV_32FC1, cv::Scalar(1)));
+    future = writer.close();
+    ASSERT_THROW(future.get(), std::runtime_error);
+    ASSERT_THROW(writer.wait(), std::runtime_error);
+    ASSERT_NO_THROW(writer.wait());
+}
+
+TEST(WriterTest, TestPyramid) {
+    cv::Mat floatMat(1000, 700, CV_32FC1);
+    cv::Mat maskMat(1000, 700, CV_8UC1);
+    for(int i = 0; i < floatMat.rows; ++i) {
+        for(int j = 0; j < floatMat.cols; ++j) {
+            floatMat.at<float>(i, j) = i + j;
+            maskMat.at<unsigned char>(i, j) = (i / 3) % 2 * 255;
+        }
+    }
+
+    auto levels = PLImg::HDF5Writer::pyramidLevels(floatMat, 256);
+    ASSERT_EQ(levels.size(), 2);
+    ASSERT_EQ(levels.at(0).rows, 500);
+    ASSERT_EQ(levels.at(0).cols, 350);
+    ASSERT_EQ(levels.at(1).rows, 250);
+    ASSERT_EQ(levels.at(1).cols, 175);
+    // Mean of each 2x2 block
+    ASSERT_FLOAT_EQ(levels.at(0).at<float>(0, 0), 1.0f);
+    ASSERT_FLOAT_EQ(levels.at(0).at<float>(3, 4), 15.0f);
+    // Most frequent value of each 2x2 block. Ties keep the larger value.
+    levels = PLImg::HDF5Writer::pyramidLevels(maskMat, 256);
+    ASSERT_EQ(levels.at(0).at<unsigned char>(0, 0), 0);
+    ASSERT_EQ(levels.at(0).at<unsigned char>(1, 0), 255);
+    ASSERT_EQ(levels.at(0).at<unsigned char>(2, 0), 255);
+
+    PLImg::HDF5Writer writer;
+    writer.set_pyramid(256);
+    writer.set_path("output/writer_test_9.h5");
+    writer.write_dataset("/Image", floatMat, true);
+    writer.close();
+
+    auto image = PLImg::Reader::imread("output/writer_test_9.h5", "/pyramid/00");
+    ASSERT_EQ(cv::norm(image, floatMat, cv::NORM_INF), 0);
+    levels = PLImg::HDF5Writer::pyramidLevels(floatMat, 256);
+    image = PLImg::Reader::imread("output/writer_test_9.h5", "/pyramid/01");
+    ASSERT_EQ(cv::norm(image, levels.at(0), cv::NORM_INF), 0);
+    image = PLImg::Reader::imread("output/writer_test_9.h5", "/pyramid/02");
+    ASSERT_EQ(cv::norm(image, levels.at(1), cv::NORM_INF), 0);
+    auto info = PLImg::Reader::probe("output/writer_test_9.h5", "/pyramid/01");
+    ASSERT_EQ(info.layout, "chunked");
+    ASSERT_EQ(info.chunkDims, std::vector<unsigned long long>({256, 256}));
+}
+
+TEST(WriterTest, TestWriteTile) {
+    cv::Mat testMat(3000, 2500, CV_32FC1);
+    for(int i = 0; i < testMat.rows; ++i) {
+        for(int j = 0; j < testMat.cols; ++j) {
+            testMat.at<float>(i, j) = i * 0.5f + j;
+        }
+    }
+
+    PLImg::HDF5Compression compression;
+    compression.filter = "deflate";
+    compression.shuffle = true;
+    // Tiles can only be written to existing datasets. Remove the file of previous runs.
+    std::filesystem::remove("output/writer_test_10.h5");
+    PLImg::HDF5Writer writer;
+    writer.set_compression(compression);
+    writer.set_path("output/writer_test_10.h5");
+    ASSERT_THROW(writer.write_tile("/Image", cv::Rect(0, 0, 10, 10), testMat(cv::Rect(0, 0, 10, 10))), std::runtime_error);
+    writer.create_dataset("/Image", testMat.rows, testMat.cols, CV_32FC1);
+
+    // Chunk aligned tiles from multiple threads
+    std::vector<cv::Rect> tiles;
+    for(int y = 0; y < testMat.rows; y += hdf5_writer_chunk_dimensions[0]) {
+        for(int x = 0; x < testMat.cols; x += hdf5_writer_chunk_dimensions[1]) {
+            tiles.emplace_back(x, y, std::min(int(hdf5_writer_chunk_dimensions[1]), testMat.cols - x),
+                               std::min(int(hdf5_writer_chunk_dimensions[0]), testMat.rows - y));
+        }
+    }
+    #pragma omp parallel for
+    for(unsigned i = 0; i < tiles.size(); ++i) {
+        writer.write_tile("/Image", tiles.at(i), testMat(tiles.at(i)));
+    }
+    // Unaligned tile
+    cv::Rect tile(100, 150, 300, 200);
+    writer.write_tile("/Image", tile, testMat(tile));
+
+    ASSERT_THROW(writer.write_tile("/Image", cv::Rect(2400, 0, 200, 10), cv::Mat(10, 200, CV_32FC1)), std::out_of_range);
+    ASSERT_THROW(writer.write_tile("/Image", cv::Rect(0, 0, 10, 10), cv::Mat(10, 10, CV_8UC1)), std::runtime_error);
+    ASSERT_THROW(writer.create_dataset("/Image", 10, 10, CV_32FC1), std::runtime_error);
+    writer.close();
+
+    auto image = PLImg::Reader::imread("output/writer_test_10.h5", "/Image");
+    ASSERT_EQ(cv::norm(image, testMat, cv::NORM_INF), 0);
+
+    // Regions across chunk borders are read with a hyperslab
+    cv::Rect region(2000, 1990, 500, 30);
+    image = PLImg::Reader::imread("output/writer_test_10.h5", "/Image", region);
+    ASSERT_EQ(image.rows, region.height);
+    ASSERT_EQ(image.cols, region.width);
+    ASSERT_EQ(cv::norm(image, testMat(region).clone(), cv::NORM_INF), 0);
+    ASSERT_THROW(PLImg::Reader::imread("output/writer_test_10.h5", "/Image", cv::Rect(2400, 0, 200, 10)), std::runtime_error);
+}
+
+TEST(WriterTest, TestZarr) {
+    cv::Mat floatMat(3000, 2500, CV_32FC1);
+    cv::Mat maskMat(3000, 2500, CV_8UC1);
+    for(int i = 0; i < floatMat.rows; ++i) {
+        for(int j = 0; j < floatMat.cols; ++j) {
+            floatMat.at<float>(i, j) = i * 0.5f + j;
+            maskMat.at<unsigned char>(i, j) = (i + j) % 255;
+        }
+    }
+    std::filesystem::remove_all("output/writer_test_11.zarr");
+
+    PLImg::ZarrWriter writer;
+    writer.set_compression(4, true);
+    writer.set_path("output/writer_test_11.zarr");
+    writer.write_dataset("/Image", floatMat);
+    writer.write_attribute("/Image", "r_thres", 0.25);
+    writer.write_attribute("/Image", "image_modality", std::string("Mask"));
+
+    // Tiles which are not aligned to the chunks can be written from multiple threads
+    writer.create_dataset("/Masks/Mask", maskMat.rows, maskMat.cols, CV_8UC1);
+    #pragma omp parallel for
+    for(int i = 0; i < 3; ++i) {
+        cv::Rect tile(0, i * 1000, maskMat.cols, 1000);
+        writer.write_tile("/Masks/Mask", tile, maskMat(tile));
+    }
+    ASSERT_THROW(writer.write_tile("/Masks/Mask", cv::Rect(0, 0, 10, 10), cv::Mat(10, 10, CV_32FC1)), std::runtime_error);
+    ASSERT_THROW(writer.create_dataset("/Masks/Mask", 10, 10, CV_8UC1), std::runtime_error);
+    writer.close();
+
+    auto image = PLImg::Reader::imread("output/writer_test_11.zarr", "/Image");
+    ASSERT_EQ(cv::norm(image, floatMat, cv::NORM_INF), 0);
+    image = PLImg::Reader::imread("output/writer_test_11.zarr", "/Masks/Mask");
+    ASSERT_EQ(cv::norm(image, maskMat, cv::NORM_INF), 0);
+    // Only the chunks overlapping a region are read
+    cv::Rect region(2040, 1000, 460, 2000);
+    image = PLImg::Reader::imread("output/writer_test_11.zarr", "/Masks/Mask", region);
+    ASSERT_EQ(cv::norm(image, maskMat(region).clone(), cv::NORM_INF), 0);
+    ASSERT_THROW(PLImg::Reader::imread("output/writer_test_11.zarr", "/Image", cv::Rect(0, 2990, 10, 20)), std::runtime_error);
+
+    auto info = PLImg::Reader::probe("output/writer_test_11.zarr", "/Image");
+    ASSERT_EQ(info.dims, std::vector<unsigned long long>({3000, 2500}));
+    ASSERT_EQ(info.type, CV_32FC1);
+    ASSERT_EQ(info.layout, "chunked");
+    ASSERT_EQ(info.filters, std::vector<std::string>({"shuffle", "zlib"}));
+    ASSERT_TRUE(std::filesystem::exists("output/writer_test_11.zarr/Image/.zattrs"));
+    ASSERT_TRUE(std::filesystem::exists("output/writer_test_11.zarr/Image/1.1"));
+
+    // Non finite fill values are stored as strings and missing chunks are filled with them
+    PLImg::ZarrArray array = PLImg::ZarrArray::read("output/writer_test_11.zarr/Image");
+    std::filesystem::create_directories("output/writer_test_11.zarr/Empty");
+    array.fillValue = std::numeric_limits<double>::quiet_NaN();
+    array.write("output/writer_test_11.zarr/Empty");
+    std::ifstream metadata("output/writer_test_11.zarr/Empty/.zarray");
+    std::string json((std::istreambuf_iterator<char>(metadata)), std::istreambuf_iterator<char>());
+    ASSERT_NE(json.find("\"NaN\""), std::string::npos);
+    ASSERT_TRUE(std::isnan(PLImg::ZarrArray::read("output/writer_test_11.zarr/Empty").fillValue));
+    image = PLImg::Reader::imread("output/writer_test_11.zarr", "/Empty", cv::Rect(0, 0, 10, 10));
+    ASSERT_TRUE(std::isnan(image.at<float>(5, 5)));
+    array.fillValue = -std::numeric_limits<double>::infinity();
+    array.write("output/writer_test_11.zarr/Empty");
+    ASSERT_EQ(PLImg::ZarrArray::read("output/writer_test_11.zarr/Empty").fillValue, -std::numeric_limits<double>::infinity());
+}
+
+TEST(WriterTest, TestReducedPrecision) {
+    cv::Mat floatMat(300, 200, CV_32FC1);
+    cv::Mat fixedMat(300, 200, CV_16UC1);
+    for(int i = 0; i < floatMat.rows; ++i) {
+        for(int j = 0; j < floatMat.cols; ++j) {
+            floatMat.at<float>(i, j) = float(i + j) * 90.0f / 500.0f;
+            fixedMat.at<unsigned short>(i, j) = (unsigned short) (i * 200 + j);
+        }
+    }
+    cv::Mat halfMat;
+    floatMat.convertTo(halfMat, CV_16F);
+
+    PLImg::HDF5Compression compression;
+    compression.filter = "deflate";
+    compression.shuffle = true;
+    PLImg::HDF5Writer writer;
+    writer.set_compression(compression);
+    writer.set_pyramid(64);
+    writer.set_path("output/writer_test_13.h5");
+    writer.write_dataset("/Fixed", fixedMat, true);
+    writer.write_dataset("/Half", halfMat);
+    writer.close();
+
+    // Half precision values are read as 32-bit floating point values
+    auto info = PLImg::Reader::probe("output/writer_test_13.h5", "/Half");
+    ASSERT_EQ(info.dtype, "float16");
+    ASSERT_EQ(info.elementSize, 2);
+    ASSERT_EQ(info.type, CV_32FC1);
+    auto image = PLImg::Reader::imread("output/writer_test_13.h5", "/Half");
+    ASSERT_EQ(image.type(), CV_32FC1);
+    ASSERT_LE(cv::norm(image, floatMat, cv::NORM_INF), 0.05);
+
+    info = PLImg::Reader::probe("output/writer_test_13.h5", "/Fixed");
+    ASSERT_EQ(info.dtype, "uint16");
+    image = PLImg::Reader::imread("output/writer_test_13.h5", "/Fixed");
+    ASSERT_EQ(image.type(), CV_16UC1);
+    ASSERT_EQ(cv::norm(image, fixedMat, cv::NORM_INF), 0);
+
+    auto levels = PLImg::HDF5Writer::pyramidLevels(fixedMat, 64);
+    image = PLImg::Reader::imread("output/writer_test_13.h5", "/pyramid/01");
+    ASSERT_EQ(cv::norm(image, levels.at(0), cv::NORM_INF), 0);
+    // Mean of 0, 1, 200 and 201 rounded to the nearest integer
+    ASSERT_EQ(levels.at(0).at<unsigned short>(0, 0), 101);
+    levels = PLImg::HDF5Writer::pyramidLevels(halfMat, 64);
+    ASSERT_EQ(levels.at(0).type(), CV_16FC1);
+    ASSERT_EQ(levels.at(0).rows, 150);
+    ASSERT_EQ(levels.at(0).cols, 100);
+}
+
+TEST(WriterTest, TestSingleFile) {
+    cv::Mat maskMat(200, 150, CV_8UC1);
+    cv::Mat floatMat(200, 150, CV_32FC1);
+    for(int i = 0; i < floatMat.rows; ++i) {
+        for(int j = 0; j < floatMat.cols; ++j) {
+            maskMat.at<unsigned char>(i, j) = (i + j) % 2 * 255;
+            floatMat.at<float>(i, j) = i * 0.25f + j;
+        }
+    }
+
+    // The pyramid of the root group must not exist. Remove the file of previous runs.
+    std::filesystem::remove("output/writer_test_14.h5");
+    PLImg::HDF5Writer writer;
+    writer.set_path("output/writer_test_14_reference.h5");
+    writer.write_dataset("/Image", floatMat);
+    writer.close();
+
+    // All products of a section are written to groups of one file with their own pyramid
+    char program[] = "PLImigPipeline";
+    char* arguments[] = {program};
+    writer.set_pyramid(64);
+    writer.set_path("output/writer_test_14.h5");
+    writer.create_group("/Mask");
+    writer.write_dataset("/Mask/Image", maskMat, true);
+    writer.writePLIMAttributes({{"output/writer_test_14_reference.h5", "/Image"}}, "/Mask/Image", "Mask", 1, arguments);
+    writer.create_group("/Inclination");
+    writer.write_dataset("/Inclination/Image", floatMat, true);
+    writer.writePLIMAttributes({{"output/writer_test_14_reference.h5", "/Image"},
+                                {"output/writer_test_14.h5", "/Mask/Image"}}, "/Inclination/Image", "Inclination", 1, arguments);
+    writer.close();
+
+    auto image = PLImg::Reader::imread("output/writer_test_14.h5", "/Mask/pyramid/00");
+    ASSERT_EQ(cv::norm(image, maskMat, cv::NORM_INF), 0);
+    image = PLImg::Reader::imread("output/writer_test_14.h5", "/Inclination/pyramid/00");
+    ASSERT_EQ(cv::norm(image, floatMat, cv::NORM_INF), 0);
+    auto levels = PLImg::HDF5Writer::pyramidLevels(floatMat, 64);
+    image = PLImg::Reader::imread("output/writer_test_14.h5", "/Inclination/pyramid/02");
+    ASSERT_EQ(cv::norm(image, levels.at(1), cv::NORM_INF), 0);
+    ASSERT_THROW(PLImg::Reader::imread("output/writer_test_14.h5", "/pyramid/00"), std::exception);
+
+    // The reference file is closed with the written file and can be opened for writing again
+    writer.set_path("output/writer_test_14_reference.h5");
+    writer.write_dataset("/Image", floatMat);
+    writer.close();
+}
+
+TEST(WriterTest, TestCompletionMarker) {
+    cv::Mat testMat(100, 80, CV_32FC1, cv::Scalar(0.5f));
+    std::filesystem::remove("output/writer_test_15.h5");
+    ASSERT_FALSE(PLImg::HDF5Writer::isComplete("output/writer_test_15.h5", "", ""));
+
+    PLImg::HDF5Writer writer;
+    writer.set_path("output/writer_test_15_input.h5");
+    writer.write_dataset("/Image", testMat);
+    writer.close();
+    std::string identity = PLImg::HDF5Writer::inputIdentity({"output/writer_test_15_input.h5", "output"});
+
+    writer.set_asynchronous(2);
+    writer.set_path("output/writer_test_15.h5");
+    writer.write_dataset("/Image", testMat);
+    writer.mark_complete(identity, "--tthres 0.5");
+    writer.close().get();
+    ASSERT_TRUE(PLImg::HDF5Writer::isComplete("output/writer_test_15.h5", identity, "--tthres 0.5"));
+    ASSERT_FALSE(PLImg::HDF5Writer::isComplete("output/writer_test_15.h5", identity, "--tthres 0.6"));
+    ASSERT_FALSE(PLImg::HDF5Writer::isComplete("output/writer_test_15.h5", identity + "x", "--tthres 0.5"));
+    ASSERT_EQ(PLImg::Reader::attribute("output/writer_test_15.h5", "/", hdf5_writer_complete_attribute), 1);
+    ASSERT_THROW(PLImg::Reader::attribute("output/writer_test_15.h5", "/Image", "missing"), std::runtime_error);
+
+    // Opening the file for writing removes the marker until the file is marked again
+    writer.set_path("output/writer_test_15.h5");
+    writer.write_dataset("/Image", testMat);
+    writer.close().get();
+    ASSERT_FALSE(PLImg::HDF5Writer::isComplete("output/writer_test_15.h5", identity, "--tthres 0.5"));
+
+    // Modified inputs change the identity
+    writer.set_path("output/writer_test_15_input.h5");
+    writer.write_dataset("/Larger", testMat);
+    writer.close().get();
+    ASSERT_NE(PLImg::HDF5Writer::inputIdentity({"output/writer_test_15_input.h5", "output"}), identity);
+}
+
+TEST(WriterTest, TestZarrOutput) {
+    cv::Mat testMat(600, 500, CV_16UC1);
+    for(int i = 0; i < testMat.rows; ++i) {
+        for(int j = 0; j < testMat.cols; ++j) {
+            testMat.at<unsigned short>(i, j) = (unsigned short) (i * 7 + j);
+        }
+    }
+    std::filesystem::remove_all("output/writer_test_16.zarr");
+
+    // Paths ending with .zarr are written as Zarr stores
+    PLImg::HDF5Writer writer;
+    PLImg::HDF5Compression compression;
+    compression.filter = "deflate";
+    compression.shuffle = true;
+    writer.set_compression(compression);
+    writer.set_pyramid(256);
+    writer.set_asynchronous(2);
+    writer.set_path("output/writer_test_16.zarr");
+    writer.create_group("/Inclination");
+    writer.write_dataset("/Inclination/Image", testMat, true);
+    writer.write_attribute("/Inclination/Image", "scale_factor", 0.5f);
+    writer.write_attribute("/Inclination/Image", "im", 3);
+    writer.write_attribute("/Inclination/Image", "image_modality", std::string("Inclination"));
+    writer.create_dataset("/Mask", testMat.rows, testMat.cols, CV_8UC1);
+    writer.write_tile("/Mask", cv::Rect(0, 0, 500, 300), cv::Mat(300, 500, CV_8UC1, cv::Scalar(1)));
+    writer.write_tile("/Mask", cv::Rect(0, 300, 500, 300), cv::Mat(300, 500, CV_8UC1, cv::Scalar(2)));
+    writer.mark_complete("identity", "--tthres 0.5");
+    writer.close().get();
+
+    ASSERT_TRUE(std::filesystem::exists("output/writer_test_16.zarr/.zgroup"));
+    auto image = PLImg::Reader::imread("output/writer_test_16.zarr", "/Inclination/Image");
+    ASSERT_EQ(image.type(), CV_16UC1);
+    ASSERT_EQ(cv::norm(image, testMat, cv::NORM_INF), 0);
+    image = PLImg::Reader::imread("output/writer_test_16.zarr", "/Inclination/pyramid/01");
+    ASSERT_EQ(image.rows, 300);
+    ASSERT_EQ(image.cols, 250);
+    ASSERT_EQ(PLImg::Reader::imread("output/writer_test_16.zarr", "/Inclination/pyramid/02").rows, 150);
+    image = PLImg::Reader::imread("output/writer_test_16.zarr", "/Mask");
+    ASSERT_EQ(image.at<unsigned char>(299, 0), 1);
+    ASSERT_EQ(image.at<unsigned char>(300, 0), 2);
+
+    auto attributes = PLImg::ZarrWriter::read_attributes("output/writer_test_16.zarr", "/Inclination/Image");
+    ASSERT_EQ(std::stod(attributes.at("scale_factor")), 0.5);
+    ASSERT_EQ(attributes.at("image_modality"), "Inclination");
+    ASSERT_EQ(PLImg::Reader::attribute("output/writer_test_16.zarr", "/Inclination/Image", "im"), 3);
+    ASSERT_THROW(PLImg::Reader::attribute("output/writer_test_16.zarr", "/Inclination/Image", "image_modality"), std::runtime_error);
+    ASSERT_THROW(PLImg::Reader::attribute("output/writer_test_16.zarr", "/Inclination/Image", "missing"), std::runtime_error);
+    ASSERT_TRUE(PLImg::HDF5Writer::isComplete("output/writer_test_16.zarr", "identity", "--tthres 0.5"));
+    ASSERT_FALSE(PLImg::HDF5Writer::isComplete("output/writer_test_16.zarr", "identity", "--tthres 0.6"));
+
+    // Opening the store for writing removes the marker. Filters other than deflate and shuffle are rejected.
+    compression.filter = "zstd";
+    writer.set_asynchronous(0);
+    writer.set_compression(compression);
+    ASSERT_THROW(writer.set_path("output/writer_test_16.zarr"), std::runtime_error);
+    ASSERT_FALSE(PLImg::HDF5Writer::isComplete("output/writer_test_16.zarr", "identity", "--tthres 0.5"));
+    compression.filter = "none";
+    writer.set_compression(compression);
+    writer.set_path("output/writer_test_16.zarr");
+    ASSERT_THROW(writer.set_durable(true), std::runtime_error);
+    writer.close();
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
-}
\ No newline at end of file
+}